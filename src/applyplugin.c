@@ -5,316 +5,182 @@
 
 /*****************************************************************************/
 
+#include <dirent.h>
 #include <dlfcn.h>
-#include <endian.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sched.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 /*****************************************************************************/
 
 #include "ladspa.h"
 
+#include "host.h"
 #include "utils.h"
 
 /*****************************************************************************/
 
+/* Default number of frames read, processed and written at a time. */
 #define BUFFER_SIZE 2048
 
-/*****************************************************************************/
-
-/* Macros provide hook for word-order swapping because of
-   big/little-endian issues. */
-
-#ifndef BYTE_ORDER
-#error "Could not determine byte order."
-#endif
-
-#if (BYTE_ORDER == LITTLE_ENDIAN)
-
-/* (i386 is little-endian.) */
-
-#define WORD_ORDER_SWAP_16BIT(ptr)
-#define WORD_ORDER_SWAP_32BIT(ptr)
-
-#else
-
-/* The following isn't ANSI C, but it'll work fine on GCC. To make it
-   ANSI compiliant, make cTmp global, remove the braces (etc). Then
-   check carefully to see where WORD_ORDER_SWAP_* is
-   used. Alternatively, rewrite as procedures. */
-
-#define WORD_ORDER_SWAP_16BIT(pvPtr) {					\
-  char cTmp, * pcPtr = (char *)pvPtr;					\
-  cTmp = pcPtr[0];							\
-  pcPtr[0] = pcPtr[1];							\
-  pcPtr[1] = cTmp;							\
-}
-#define WORD_ORDER_SWAP_32BIT(pvPtr) {					\
-  char cTmp, * pcPtr = (char *)pvPtr;					\
-  cTmp = pcPtr[0];							\
-  pcPtr[0] = pcPtr[3];							\
-  pcPtr[3] = cTmp;							\
-  cTmp = pcPtr[1];							\
-  pcPtr[1] = pcPtr[2];							\
-  pcPtr[2] = cTmp;							\
-}
-
-#endif
-
-/*****************************************************************************/
-
-/* Horrid hard-coded Wave Interface:
-   --------------------------------- */
-/* Please please feel free to replace this with something nice. 
-
-   Only handles 16bit PCM files in a single data block. Returns
-   channel count and sample rate by reference. Only one file can be
-   open for read at a time. */
-
-FILE * g_poInputFile;
-FILE * g_poOutputFile;
-LADSPA_Data g_fPeakWritten = 0;
-
-unsigned long g_lInputFileChannelCount;
-unsigned long g_lOutputFileChannelCount;
-
-short * g_psInputFileBuffer;
-short * g_psOutputFileBuffer;
-
-static void 
-openWaveFile(const char * pcFilename,
-	     unsigned long * plChannelCount,
-	     unsigned long * plSampleRate,
-	     unsigned long * plLength) {
-
-  char pcHeader[44];
-  size_t lReadLength;
-
-  g_poInputFile = fopen(pcFilename, "rb");
-  if (!g_poInputFile) {
-    fprintf(stderr,
-	    "Failed to open input file \"%s\": %s\n",
-	    pcFilename,
-	    strerror(errno));
-    exit(1);
-  }
-
-  lReadLength = fread(pcHeader, sizeof(char), 44, g_poInputFile);
-  if (lReadLength < 44) {
-    fprintf(stderr,
-	    "Failed to read header from input file \"%s\": %s\n",
-	    pcFilename,
-	    strerror(errno));
-    exit(1);
-  }
-  if (strncmp(pcHeader + 0, "RIFF", 4) != 0 ||
-      strncmp(pcHeader + 8, "WAVE", 4) != 0 ||
-      strncmp(pcHeader + 12, "fmt ", 4) != 0 ||
-      pcHeader[20] != 1 || pcHeader[21] != 0 || /* PCM */
-      pcHeader[34] != 16 || pcHeader[35] != 0 || /* 16 bit */
-      strncmp(pcHeader + 36, "data", 4) != 0) /* Data block elsewhere */ {
-    fprintf(stderr,
-	    "\"applyplugin\" has very limited support for sound files types. "
-	    "The file \"%s\" is not a simple 16bit PCM Wave File.\n",
-	    pcFilename);
-    exit(1);
-  }
+/* Sub-block sizes tried by --autotune start here and double up to
+   the I/O block size. */
+#define AUTOTUNE_MIN_SUB_BLOCK 16
 
-  /* Not portable casting (short assumed 16bit, unsigned int assumed
-     32bit), alignment assumed not a problem. This is all bad. */
-  WORD_ORDER_SWAP_16BIT(pcHeader + 22);
-  g_lInputFileChannelCount 
-    = *plChannelCount 
-    = *((unsigned short *)(pcHeader + 22));
-  WORD_ORDER_SWAP_32BIT(pcHeader + 24);
-  *plSampleRate
-    = *((unsigned int *)(pcHeader + 24));
-  WORD_ORDER_SWAP_32BIT(pcHeader + 40);
-  *plLength
-    = (*((unsigned int *)(pcHeader + 40))
-       / (*plChannelCount * sizeof(short)));
-
-  g_psInputFileBuffer
-    = (short *)calloc(*plChannelCount * BUFFER_SIZE, sizeof(short));
-}
-
-static void 
-createWaveFile(const char * pcFilename,
-	       unsigned long lChannelCount,
-	       unsigned long lSampleRate,
-	       unsigned long lLength) {
-
-
-  char pcHeader[44];
-  size_t lWriteLength;
-
-  static const char pcHeaderBase[44] = {
-    'R', 'I', 'F', 'F',
-    0, 0, 0, 0,
-    'W', 'A', 'V', 'E',
-    'f', 'm', 't', ' ',
-    16, 0, 0, 0,
-    1, 0,
-    1, 0,
-    0, 0, 0, 0,
-    0, 0, 0, 0,
-    0, 0,
-    16, 0,
-    'd', 'a', 't', 'a',
-    0, 0, 0, 0
-  };
-
-  g_poOutputFile = fopen(pcFilename, "wb");
-  if (!g_poOutputFile) {
-    fprintf(stderr,
-	    "Failed to open output file \"%s\": %s\n",
-	    pcFilename,
-	    strerror(errno));
-    exit(1);
-  }
-
-  /* Not portable casting (short assumed 16bit, unsigned int assumed
-     32bit), alignment assumed not a problem. This is all bad. */
-  memcpy(pcHeader, pcHeaderBase, 44);
-
-  *(unsigned int *)(pcHeader + 4) 
-    = (unsigned int)(lLength * lChannelCount * sizeof(short) + 36);
-  WORD_ORDER_SWAP_32BIT(pcHeader + 4);
-  /* (Or should it be +32?) */
-  *(unsigned short *)(pcHeader + 22) 
-    = (unsigned short)lChannelCount;
-  WORD_ORDER_SWAP_16BIT(pcHeader + 22);
-  *(unsigned int *)(pcHeader + 24) 
-    = (unsigned int)lSampleRate;
-  WORD_ORDER_SWAP_32BIT(pcHeader + 24);
-  *(unsigned int *)(pcHeader + 28) 
-    = (unsigned int)(lSampleRate * lChannelCount * sizeof(short));
-  WORD_ORDER_SWAP_32BIT(pcHeader + 28);
-  *(unsigned short *)(pcHeader + 32) 
-    = (unsigned short)(lChannelCount * sizeof(short));
-  WORD_ORDER_SWAP_16BIT(pcHeader + 32);
-  *(unsigned int *)(pcHeader + 40) 
-    = (unsigned int)(lLength * lChannelCount * sizeof(short));
-  WORD_ORDER_SWAP_32BIT(pcHeader + 40);
-
-  g_lOutputFileChannelCount = lChannelCount;
-
-  lWriteLength = fwrite(pcHeader, sizeof(char), 44, g_poOutputFile);
-  if (lWriteLength < 44) {
-    fprintf(stderr,
-	    "Failed to write header to output file \"%s\": %s\n",
-	    pcFilename,
-	    strerror(errno));
-    exit(1);
-  }
-
-  g_psOutputFileBuffer 
-    = (short *)calloc(lChannelCount * BUFFER_SIZE, sizeof(short));
-}
-
-static void
-readIntoBuffers(LADSPA_Data ** ppfBuffers, 
-		const unsigned long lFrameSize) {
-
-  short * psReadPointer;
-  size_t lReadLength;
-  unsigned long lChannelIndex;
-  unsigned long lFrameIndex;
-
-  lReadLength = fread(g_psInputFileBuffer,
-		      sizeof(short) * g_lInputFileChannelCount,
-		      lFrameSize,
-		      g_poInputFile);
-  if (lReadLength < lFrameSize) {
-    fprintf(stderr,
-	    "Failed to read audio from input file. Is the file damaged?\n");
-    exit(1);
-  }
+/* Each candidate sub-block size is timed this many times and the
+   best time kept. */
+#define AUTOTUNE_ROUNDS 3
 
-  for (lChannelIndex = 0;
-       lChannelIndex < g_lInputFileChannelCount; 
-       lChannelIndex++) {
-    psReadPointer = g_psInputFileBuffer + lChannelIndex;
-    for (lFrameIndex = 0; 
-	 lFrameIndex < lFrameSize; 
-	 lFrameIndex++, psReadPointer += g_lInputFileChannelCount) {
-      WORD_ORDER_SWAP_16BIT(psReadPointer);
-      ppfBuffers[lChannelIndex][lFrameIndex] 
-	= ((LADSPA_Data)*psReadPointer) * (1.0f / 32767.5f);
-    }
-  }
-}
+/* Seconds of input timed by --autotune when no length is given. */
+#define AUTOTUNE_SECONDS 5
 
-static void
-writeFromBuffers(LADSPA_Data ** ppfBuffers, 
-		 const unsigned long lFrameSize) {
+/* Default warm-up for each chunk of a chunked render, enough for the
+   SDK delay line. */
+#define CHUNK_WARM_UP_SECONDS 1
 
-  LADSPA_Data fValue, fAbsValue;
-  short * psWritePointer;
-  size_t lWriteLength;
-  unsigned long lChannelIndex;
-  unsigned long lFrameIndex;
+/* Default pre-roll for --start: seconds the chain runs before the
+   range, with its output dropped, so the range starts as it would in
+   a full render of most plugins. */
+#define PRE_ROLL_SECONDS 1
 
-  for (lChannelIndex = 0;
-       lChannelIndex < g_lOutputFileChannelCount; 
-       lChannelIndex++) {
-    psWritePointer = g_psOutputFileBuffer + lChannelIndex;
-    for (lFrameIndex = 0; 
-	 lFrameIndex < lFrameSize; 
-	 lFrameIndex++, psWritePointer += g_lOutputFileChannelCount) {
-      fValue = ppfBuffers[lChannelIndex][lFrameIndex] * 32767.5f;
-      fAbsValue = fabs(fValue);
-      if (fAbsValue > g_fPeakWritten)
-	g_fPeakWritten = fAbsValue;
-      /* Use hard clipping as it sounds better than wraparound. */
-      if (fValue > 32767)
-	*psWritePointer = 32767;
-      else if (fValue <= -32768)
-	*psWritePointer = -32768;
-      else
-	*psWritePointer = (short)fValue;
-      WORD_ORDER_SWAP_16BIT(psWritePointer);
-    }
-  }
+/* Seconds of input used to measure the cost of each plugin when
+   splitting a chain into pipeline stages. */
+#define PIPELINE_BALANCE_SECONDS 1
 
-  lWriteLength = fwrite(g_psOutputFileBuffer,
-			sizeof(short) * g_lOutputFileChannelCount,
-			lFrameSize,
-			g_poOutputFile);
-  if (lWriteLength < lFrameSize) {
-    fprintf(stderr,
-	    "Failed to read audio to output file. Is the disk full?\n");
-    exit(1);
-  }
+/* Defaults for -s auto: the level the output must stay below, in dB
+   relative to full scale, for how long, and the longest tail
+   rendered. */
+#define TAIL_THRESHOLD -90
+#define TAIL_WINDOW_SECONDS 0.5
+#define TAIL_MAX_SECONDS 60
 
-}
+/* --realtime streams the files through a ring of this many seconds
+   of periods, with reader and writer threads on stacks of this many
+   bytes, and keeps callback times in this many bins a period wide. */
+#define REALTIME_QUEUE_SECONDS 0.5
+#define REALTIME_IO_STACK_SIZE (256 * 1024)
+#define REALTIME_HISTOGRAM_BINS 1000
 
-static void
-closeFiles(void) {
-  fclose(g_poInputFile);
-  fclose(g_poOutputFile);
-  printf("Peak output: %g\n", g_fPeakWritten);
-}
+/* Default --automation-step: automation points closer together than
+   this many frames share a run() call, and ramps move this often. */
+#define AUTOMATION_STEP 32
 
 /*****************************************************************************/
 
-static unsigned long
-getPortCountByType(const LADSPA_Descriptor     * psDescriptor,
-		   const LADSPA_PortDescriptor   iType) {
-
-  unsigned long lCount;
-  unsigned long lIndex;
-
-  lCount = 0;
-  for (lIndex = 0; lIndex < psDescriptor->PortCount; lIndex++)
-    if ((psDescriptor->PortDescriptors[lIndex] & iType) == iType)
-      lCount++;
+/* Options controlling a render. */
+typedef struct {
 
-  return lCount;
-}
+  /* Seconds of silence processed after the end of the input. If
+     bAutoTail is set, silence is processed instead until the output
+     has stayed below fTailThreshold dB for fTailWindow seconds, for
+     at most fTailMaxSeconds. */
+  LADSPA_Data fExtraSeconds;
+  int bAutoTail;
+  LADSPA_Data fTailThreshold;
+  LADSPA_Data fTailWindow;
+  LADSPA_Data fTailMaxSeconds;
+
+  /* Render only the output from fStartSeconds up to fEndSeconds (0
+     for the end), running the chain from fPreRollSeconds before the
+     start. */
+  LADSPA_Data fStartSeconds;
+  LADSPA_Data fEndSeconds;
+  LADSPA_Data fPreRollSeconds;
+
+  /* Sample format of the output file, WAVE_SAMPLE_NONE to follow the
+     input file. */
+  int iOutputSampleFormat;
+
+  /* Blocks in flight between I/O threads, 0 for synchronous I/O. */
+  unsigned long lQueueDepth;
+
+  /* Number of threads the plugins are spread over, in consecutive
+     runs. More than one implies asynchronous I/O. */
+  unsigned long lStageCount;
+
+  /* Threads the channels are spread over when every plugin is run
+     once per channel, 0 for one per CPU. */
+  unsigned long lChannelThreadCount;
+
+  /* Number of time ranges rendered in parallel, each starting
+     fWarmUpSeconds early. If bVerifySeams is set the result is
+     compared with a serial render. */
+  unsigned long lChunkCount;
+  LADSPA_Data fWarmUpSeconds;
+  int bVerifySeams;
+
+  /* Frames read and written at a time, and frames handed to each
+     run() call. */
+  unsigned long lBlockSize;
+  unsigned long lSubBlockSize;
+
+  /* If positive, choose lSubBlockSize by timing the chain on this
+     many seconds from the start of the input. */
+  LADSPA_Data fAutotuneSeconds;
+
+  /* Control automation file, or NULL, and the shortest run() it may
+     cause. */
+  const char * pcAutomationFile;
+  unsigned long lAutomationStep;
+
+  /* File the control outputs are logged to after each run, or
+     NULL. */
+  const char * pcControlLogFile;
+
+  /* Time every stage of the render and report it, also as JSON to
+     pcProfileFile ("-" for stdout) if that is set. */
+  int bProfile;
+  const char * pcProfileFile;
+
+  /* Meter the output as it is written and report its levels and
+     loudness, also as JSON to pcMeterFile ("-" for stdout) if that is
+     set. */
+  int bMeter;
+  const char * pcMeterFile;
+
+  /* If non-zero, run the chain lRealtimePeriod frames at a time on a
+     timer as a sound card would, at SCHED_FIFO priority
+     lRealtimePriority if that is non-zero. */
+  unsigned long lRealtimePeriod;
+  unsigned long lRealtimePriority;
+
+  /* If iRawInputFormat is not WAVE_SAMPLE_NONE, the input is
+     headerless interleaved samples with this many channels at this
+     rate. If bRawOutput is set, the output is written with no
+     header. */
+  int iRawInputFormat;
+  unsigned long lRawInputChannelCount;
+  unsigned long lRawInputSampleRate;
+  int bRawOutput;
+
+  /* Rates the chain runs at and the output is written at, 0 meaning
+     the input's and the chain's. The lPluginRateCount plugins
+     numbered (from 1) in plPluginRateIndices run at their own rates
+     from plPluginRates. */
+  unsigned long lChainSampleRate;
+  unsigned long lOutputSampleRate;
+  unsigned long lPluginRateCount;
+  unsigned long * plPluginRateIndices;
+  unsigned long * plPluginRates;
+
+  /* Put the audio buffers on huge pages where the system allows. */
+  int bHugePages;
+
+  /* If set, compare the output with this file instead of writing it,
+     failing if any sample is out by more than fTolerance. */
+  const char * pcReferenceFile;
+  LADSPA_Data fTolerance;
+
+} RenderOptions;
 
 /*****************************************************************************/
 
@@ -381,412 +247,4365 @@ listControlsForPlugin(const LADSPA_Descriptor * psDescriptor) {
 
 /*****************************************************************************/
 
-/* Note that this procedure leaks memory like mad. */
-static void
-applyPlugin(const char               * pcInputFilename,
-	    const char               * pcOutputFilename,
-	    const LADSPA_Data          fExtraSeconds,
-	    const unsigned long        lPluginCount,
-	    const LADSPA_Descriptor ** ppsPluginDescriptors,
-	    LADSPA_Data             ** ppfPluginControlValues) {
+/* Blocks of audio handed between the reader, processing and writer
+   threads when file I/O runs asynchronously. */
+typedef struct {
 
-  LADSPA_PortDescriptor iPortDescriptor;
-  LADSPA_Handle * ppsPlugins;
+  /* One buffer of a block's worth of frames for each buffer the
+     chain needs. */
   LADSPA_Data ** ppfBuffers;
-  long lFrameSize;
-  unsigned long lAudioInputCount;
-  unsigned long lAudioOutputCount;
-  unsigned long lPreviousAudioOutputCount;
+
+  /* Frames to run the chain for and write out. */
+  unsigned long lFrameCount;
+
+} AudioBlock;
+
+/* State shared by the asynchronous I/O threads. Empty blocks go from
+   the writer back to the reader through the free ring, filled blocks
+   from the reader to the first processing stage through the read
+   ring, and processed blocks from the last stage on to the writer
+   through the write ring. A NULL block marks the end of the
+   audio. An input of unknown length ends at the first short read and
+   the output lExtraFrames after that. */
+typedef struct {
+
+  WaveFile * psInputFile;
+  WaveFile * psOutputFile;
+  unsigned long lInputLength;
+  unsigned long lOutputLength;
+  unsigned long lExtraFrames;
   unsigned long lBufferCount;
-  unsigned long lBufferIndex;
-  unsigned long lControlIndex;
-  unsigned long lInputFileChannelCount;
-  unsigned long lInputFileLength;
-  unsigned long lOutputFileChannelCount;
-  unsigned long lOutputFileLength;
-  unsigned long lPluginIndex;
-  unsigned long lPortIndex;
-  unsigned long lSampleRate;
-  unsigned long lTimeAt;
-  LADSPA_Data fDummyControlOutput;
+  unsigned long lBlockSize;
 
-  /* Open input file and output file: 
-     -------------------------------- */
+  BlockRing sFreeRing;
+  BlockRing sReadRing;
+  BlockRing sWriteRing;
 
-  lOutputFileChannelCount
-    = getPortCountByType(ppsPluginDescriptors[lPluginCount - 1],
-			 LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT);
-  if (lOutputFileChannelCount == 0) {
-    fprintf(stderr,
-	    "The last plugin in the chain has no audio outputs.\n");
-    exit(1);
-  }
+} AsyncIO;
 
-  openWaveFile(pcInputFilename, 
-	       &lInputFileChannelCount, 
-	       &lSampleRate,
-	       &lInputFileLength);
-  if (lInputFileChannelCount
-      != getPortCountByType(ppsPluginDescriptors[0],
-			    LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT)) {
-    fprintf(stderr,
-	    "Mismatch between channel count in input file and audio inputs "
-	    "on first plugin in chain.\n");
-    exit(1);
-  }
+/* One processing stage of a pipelined chain: a run of consecutive
+   plugins taking blocks from one ring and passing them on to the
+   next. */
+typedef struct {
 
-  lOutputFileLength 
-    = lInputFileLength + (unsigned long)(fExtraSeconds * lSampleRate);
+  PluginChain sSegment;
+  unsigned long lSubBlockSize;
 
-  createWaveFile(pcOutputFilename,
-		 lOutputFileChannelCount,
-		 lSampleRate,
-		 lOutputFileLength);
+  BlockRing * psInputRing;
+  BlockRing * psOutputRing;
 
-  /* Count buffers and sanity-check the flow graph:
-     ---------------------------------------------- */
+  /* Time spent running plugins, for reporting balance. */
+  double dBusySeconds;
 
-  lBufferCount = 0;
-  lPreviousAudioOutputCount = 0;
-  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+} PipelineStage;
 
-    lAudioInputCount
-      = getPortCountByType(ppsPluginDescriptors[lPluginIndex],
-			   LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT);
-    lAudioOutputCount
-      = getPortCountByType(ppsPluginDescriptors[lPluginIndex],
-			   LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT);
+/*****************************************************************************/
 
-    if (lBufferCount < lAudioInputCount)
-      lBufferCount = lAudioInputCount;
+static double
+getSeconds(void) {
+  struct timespec sNow;
+  clock_gettime(CLOCK_MONOTONIC, &sNow);
+  return sNow.tv_sec + sNow.tv_nsec * 1e-9;
+}
 
-    if (lPluginIndex > 0) 
-      if (lAudioInputCount != lPreviousAudioOutputCount) {
-	fprintf(stderr,
-		"There is a mismatch between the number of output channels "
-		"on plugin \"%s\" (%ld) and the number of input channels on "
-		"plugin \"%s\" (%ld).\n",
-		ppsPluginDescriptors[lPluginIndex - 1]->Name,
-		lPreviousAudioOutputCount,
-		ppsPluginDescriptors[lPluginIndex]->Name,
-		lAudioInputCount);
-	exit(1);
-      }
+/*****************************************************************************/
 
-    lPreviousAudioOutputCount = lAudioOutputCount;
+/* Allocate lBufferCount silent buffers of lBlockSize frames, each
+   cache-line aligned and all back to back in one arena. The arena
+   itself and the array of pointers are kept at its start, so
+   freeBuffers() needs only the array. */
+static LADSPA_Data **
+allocateBuffers(const unsigned long lBufferCount,
+		const unsigned long lBlockSize,
+		const int bHugePages) {
+
+  BufferArena sArena;
+  BufferArena * psArena;
+  LADSPA_Data ** ppfBuffers;
+  unsigned long lBufferIndex;
 
-    if (lBufferCount < lAudioOutputCount)
-      lBufferCount = lAudioOutputCount;
-  }
+  createBufferArena(&sArena,
+		    (getArenaSpace(sizeof(BufferArena))
+		     + getArenaSpace(lBufferCount * sizeof(LADSPA_Data *))
+		     + (lBufferCount
+			* getArenaSpace(lBlockSize * sizeof(LADSPA_Data)))),
+		    bHugePages);
+  psArena = (BufferArena *)allocateFromArena(&sArena, sizeof(BufferArena));
+  ppfBuffers
+    = (LADSPA_Data **)allocateFromArena(&sArena,
+					lBufferCount * sizeof(LADSPA_Data *));
+  for (lBufferIndex = 0; lBufferIndex < lBufferCount; lBufferIndex++)
+    ppfBuffers[lBufferIndex]
+      = (LADSPA_Data *)allocateFromArena(&sArena,
+					 lBlockSize * sizeof(LADSPA_Data));
+  *psArena = sArena;
 
-  /* Create the buffers, create instances, wire them up:
-     --------------------------------------------------- */
+  return ppfBuffers;
+}
 
-  ppsPlugins = (LADSPA_Handle *)calloc(lPluginCount, sizeof(LADSPA_Handle));
-  ppfBuffers = (LADSPA_Data **)calloc(lBufferCount, sizeof(LADSPA_Data *));
-  for (lBufferIndex = 0; lBufferIndex < lBufferCount; lBufferIndex++)
-    ppfBuffers[lBufferIndex] 
-      = (LADSPA_Data *)calloc(BUFFER_SIZE, sizeof(LADSPA_Data));
+/* The arena holding buffers from allocateBuffers(). */
+static BufferArena *
+getBufferArena(LADSPA_Data ** ppfBuffers) {
+  return (BufferArena *)((unsigned char *)ppfBuffers
+			 - getArenaSpace(sizeof(BufferArena)));
+}
 
-  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+static void
+freeBuffers(LADSPA_Data ** ppfBuffers) {
 
-    ppsPlugins[lPluginIndex]
-      = ppsPluginDescriptors[lPluginIndex]
-      ->instantiate(ppsPluginDescriptors[lPluginIndex],
-		    lSampleRate);
-    if (!ppsPlugins[lPluginIndex]) {
-      fprintf(stderr,
-	      "Failed to instantiate plugin of type \"%s\".\n",
-	      ppsPluginDescriptors[lPluginIndex]->Name);
-      exit(1);
-    }
+  BufferArena sArena;
+
+  /* Copied out first, as the arena is about to go. */
+  sArena = *getBufferArena(ppfBuffers);
+  destroyBufferArena(&sArena);
+}
 
-    /* Controls:
-       --------- */
+/* The alignment in bytes every audio port is guaranteed when
+   connected. Buffers start on an arena boundary and chains are
+   connected at whole sub-blocks (or realtime periods) into them, but
+   automation may split a run on any frame. --autotune only tries
+   sub-blocks that keep full alignment. */
+static unsigned long
+getPortAlignment(const RenderOptions * psOptions) {
 
-    lControlIndex = 0;
-    for (lPortIndex = 0;
-	 lPortIndex < ppsPluginDescriptors[lPluginIndex]->PortCount; 
-	 lPortIndex++) {
+  unsigned long lAlignment;
 
-      iPortDescriptor 
-	= ppsPluginDescriptors[lPluginIndex]->PortDescriptors[lPortIndex];
-      
-      if (LADSPA_IS_PORT_CONTROL(iPortDescriptor)) {
-	if (LADSPA_IS_PORT_INPUT(iPortDescriptor))
-	  ppsPluginDescriptors[lPluginIndex]->connect_port
-	    (ppsPlugins[lPluginIndex],
-	     lPortIndex,
-	     ppfPluginControlValues[lPluginIndex] + (lControlIndex++));
-	if (LADSPA_IS_PORT_OUTPUT(iPortDescriptor))
-	  ppsPluginDescriptors[lPluginIndex]->connect_port
-	    (ppsPlugins[lPluginIndex],
-	     lPortIndex,
-	     &fDummyControlOutput);
-      }
-    }
+  if (psOptions->pcAutomationFile)
+    return sizeof(LADSPA_Data);
 
-    /* Input Buffers:
-       -------------- */
+  lAlignment = ARENA_ALIGNMENT;
+  if (psOptions->fAutotuneSeconds <= 0
+      && psOptions->lSubBlockSize < psOptions->lBlockSize)
+    while ((psOptions->lSubBlockSize * sizeof(LADSPA_Data)) % lAlignment)
+      lAlignment /= 2;
+  if (psOptions->lRealtimePeriod > 0)
+    while ((psOptions->lRealtimePeriod * sizeof(LADSPA_Data)) % lAlignment)
+      lAlignment /= 2;
 
-    lBufferIndex = 0;
-    for (lPortIndex = 0;
-	 lPortIndex < ppsPluginDescriptors[lPluginIndex]->PortCount; 
-	 lPortIndex++) {
-      iPortDescriptor 
-	= ppsPluginDescriptors[lPluginIndex]->PortDescriptors[lPortIndex];
-      if (LADSPA_IS_PORT_INPUT(iPortDescriptor) 
-	  && LADSPA_IS_PORT_AUDIO(iPortDescriptor))
-	ppsPluginDescriptors[lPluginIndex]->connect_port
-	  (ppsPlugins[lPluginIndex],
-	   lPortIndex,
-	   ppfBuffers[lBufferIndex++]);
-    }
-    
+  return lAlignment;
+}
 
-    /* Output Buffers:
-       --------------- */
+/* Fill ppfBuffers with the block of audio starting at lTimeAt. Past
+   the end of the input, the buffers are silent. Sets *plFrameSize to
+   the number of frames read. If lInputLength is WAVE_LENGTH_UNKNOWN
+   the input is a stream and a short count means it has ended. Returns
+   -1 with a message in psInputFile->pcError if the input cannot be
+   read, otherwise 0. */
+static int
+tryReadBlock(WaveFile * psInputFile,
+	     const unsigned long lInputLength,
+	     const unsigned long lTimeAt,
+	     LADSPA_Data ** ppfBuffers,
+	     const unsigned long lBufferCount,
+	     const unsigned long lBlockSize,
+	     unsigned long * plFrameSize) {
 
-    lBufferIndex = 0;
-    for (lPortIndex = 0;
-	 lPortIndex < ppsPluginDescriptors[lPluginIndex]->PortCount; 
-	 lPortIndex++) {
-      iPortDescriptor 
-	= ppsPluginDescriptors[lPluginIndex]->PortDescriptors[lPortIndex];
-      if (LADSPA_IS_PORT_OUTPUT(iPortDescriptor) 
-	  && LADSPA_IS_PORT_AUDIO(iPortDescriptor))
-	ppsPluginDescriptors[lPluginIndex]->connect_port
-	  (ppsPlugins[lPluginIndex],
-	   lPortIndex,
-	   ppfBuffers[lBufferIndex++]);
-    }
+  unsigned long lBufferIndex;
+  unsigned long lFrameSize;
+
+  if (lInputLength == WAVE_LENGTH_UNKNOWN) {
+    lFrameSize = readWaveFileUpTo(psInputFile, ppfBuffers, lBlockSize);
+    if (lFrameSize < lBlockSize)
+      for (lBufferIndex = 0; lBufferIndex < lBufferCount; lBufferIndex++)
+	memset(ppfBuffers[lBufferIndex] + lFrameSize,
+	       0,
+	       sizeof(LADSPA_Data) * (lBlockSize - lFrameSize));
+    *plFrameSize = lFrameSize;
+    return 0;
   }
 
-  /* Activate:
-     --------- */
+  lFrameSize = (lTimeAt < lInputLength ? lInputLength - lTimeAt : 0);
+  if (lFrameSize > lBlockSize)
+    lFrameSize = lBlockSize;
+  else {
+    /* We've reached or are reaching the end of the file. We're not
+       going to fill the buffer from file. Could just memset the end
+       part, but there's only one frame where this is worth the
+       effort. */
+    for (lBufferIndex = 0; lBufferIndex < lBufferCount; lBufferIndex++)
+      memset(ppfBuffers[lBufferIndex], 0, sizeof(LADSPA_Data) * lBlockSize);
+  }
 
-  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) 
-    if (ppsPluginDescriptors[lPluginIndex]->activate != NULL)
-      ppsPluginDescriptors[lPluginIndex]->activate(ppsPlugins[lPluginIndex]);
+  if (lFrameSize > 0) {
+    /* Read from disk. */
+    if (tryReadWaveFile(psInputFile, ppfBuffers, lFrameSize) != 0)
+      return -1;
+  }
 
-  /* Run:
-     ---- */
+  *plFrameSize = lFrameSize;
+  return 0;
+}
 
-  lTimeAt = 0;
-  while (lTimeAt < lOutputFileLength) {
+/* As tryReadBlock(), but returning the number of frames read and
+   exiting if the input cannot be read. */
+static unsigned long
+readBlock(WaveFile * psInputFile,
+	  const unsigned long lInputLength,
+	  const unsigned long lTimeAt,
+	  LADSPA_Data ** ppfBuffers,
+	  const unsigned long lBufferCount,
+	  const unsigned long lBlockSize) {
+
+  unsigned long lFrameSize;
+
+  if (tryReadBlock(psInputFile,
+		   lInputLength,
+		   lTimeAt,
+		   ppfBuffers,
+		   lBufferCount,
+		   lBlockSize,
+		   &lFrameSize) != 0) {
+    fprintf(stderr, "%s\n", psInputFile->pcError);
+    exit(1);
+  }
 
-    lFrameSize = lInputFileLength - lTimeAt;
-    if (lFrameSize > BUFFER_SIZE)
-      lFrameSize = BUFFER_SIZE;
-    else {
-      /* We've reached or are reaching the end of the file. We're not
-         going to fill the buffer from file. Could just memset the end
-         part, but there's only one frame where this is worth the
-         effort. */
-      for (lBufferIndex = 0; lBufferIndex < lBufferCount; lBufferIndex++)
-	memset(ppfBuffers[lBufferIndex], 0, sizeof(LADSPA_Data) * BUFFER_SIZE);
-    }
+  return lFrameSize;
+}
+
+/* Seconds of silence processed after the input, the most that -s
+   auto allows. */
+static LADSPA_Data
+getExtraSeconds(const RenderOptions * psOptions) {
+  return (psOptions->bAutoTail
+	  ? psOptions->fTailMaxSeconds
+	  : psOptions->fExtraSeconds);
+}
+
+static void *
+readerThread(void * pvAsyncIO) {
 
-    if (lFrameSize > 0) {
-      /* Read from disk. */
-      readIntoBuffers(ppfBuffers, lFrameSize);
+  AsyncIO * psAsyncIO;
+  AudioBlock * psBlock;
+  unsigned long lReadSize;
+  unsigned long lTimeAt;
+
+  psAsyncIO = (AsyncIO *)pvAsyncIO;
+
+  lTimeAt = 0;
+  while (lTimeAt < psAsyncIO->lOutputLength) {
+    psBlock = (AudioBlock *)popBlockRing(&psAsyncIO->sFreeRing);
+    lReadSize = readBlock(psAsyncIO->psInputFile,
+			  psAsyncIO->lInputLength,
+			  lTimeAt,
+			  psBlock->ppfBuffers,
+			  psAsyncIO->lBufferCount,
+			  psAsyncIO->lBlockSize);
+    if (psAsyncIO->lInputLength == WAVE_LENGTH_UNKNOWN
+	&& lReadSize < psAsyncIO->lBlockSize) {
+      psAsyncIO->lInputLength = lTimeAt + lReadSize;
+      psAsyncIO->lOutputLength
+	= psAsyncIO->lInputLength + psAsyncIO->lExtraFrames;
+      if (lTimeAt >= psAsyncIO->lOutputLength)
+	break;
     }
+    psBlock->lFrameCount = psAsyncIO->lOutputLength - lTimeAt;
+    if (psBlock->lFrameCount > psAsyncIO->lBlockSize)
+      psBlock->lFrameCount = psAsyncIO->lBlockSize;
+    lTimeAt += psBlock->lFrameCount;
+    pushBlockRing(&psAsyncIO->sReadRing, psBlock);
+  }
+  pushBlockRing(&psAsyncIO->sReadRing, NULL);
 
-    /* Run the plugins: */
-    lFrameSize = lOutputFileLength - lTimeAt;
-    if (lFrameSize > BUFFER_SIZE)
-      lFrameSize = BUFFER_SIZE;
+  return NULL;
+}
 
-    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) 
-      ppsPluginDescriptors[lPluginIndex]
-	->run(ppsPlugins[lPluginIndex],
-	      lFrameSize);
-    
-    /* Write the output to disk. */
-    writeFromBuffers(ppfBuffers, lFrameSize);
+static void *
+writerThread(void * pvAsyncIO) {
 
-    lTimeAt += lFrameSize;
+  AsyncIO * psAsyncIO;
+  AudioBlock * psBlock;
+
+  psAsyncIO = (AsyncIO *)pvAsyncIO;
+
+  while ((psBlock = (AudioBlock *)popBlockRing(&psAsyncIO->sWriteRing))
+	 != NULL) {
+    writeWaveFile(psAsyncIO->psOutputFile,
+		  psBlock->ppfBuffers,
+		  psBlock->lFrameCount);
+    pushBlockRing(&psAsyncIO->sFreeRing, psBlock);
   }
 
-  /* Deactivate:
-     ----------- */
+  return NULL;
+}
 
-  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) 
-    if (ppsPluginDescriptors[lPluginIndex]->deactivate != NULL)
-      ppsPluginDescriptors[lPluginIndex]->deactivate(ppsPlugins[lPluginIndex]);
+/* Plugins may be reconnected between calls to run(), so each block
+   is processed where it sits. Blocks pass through every stage in
+   order, so each plugin sees exactly what it would in a serial
+   run. */
+static void *
+stageThread(void * pvStage) {
+
+  AudioBlock * psBlock;
+  PipelineStage * psStage;
+  double dStart;
+
+  psStage = (PipelineStage *)pvStage;
+
+  while ((psBlock = (AudioBlock *)popBlockRing(psStage->psInputRing))
+	 != NULL) {
+    dStart = getSeconds();
+    processPluginChain(&psStage->sSegment,
+		       psBlock->ppfBuffers,
+		       psBlock->lFrameCount,
+		       psStage->lSubBlockSize);
+    psStage->dBusySeconds += getSeconds() - dStart;
+    pushBlockRing(psStage->psOutputRing, psBlock);
+  }
+  pushBlockRing(psStage->psOutputRing, NULL);
 
-  /* Cleanup:
-     -------- */
+  return NULL;
+}
 
-  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) 
-    ppsPluginDescriptors[lPluginIndex]->cleanup(ppsPlugins[lPluginIndex]);
+static double
+getMeanDepth(const BlockRing * psRing) {
+  return (psRing->lPopCount
+	  ? (double)psRing->lDepthTotal / psRing->lPopCount
+	  : 0.0);
+}
 
-  /* Close the input and output files:
-     --------------------------------- */
+/* Run the chain with a reader thread and a writer thread keeping up
+   to lQueueDepth blocks in flight, so disk I/O and sample conversion
+   overlap with plugin processing. The chain is split into
+   lStageCount runs of plugins starting at the indices in plFirst;
+   every stage but the last gets its own thread, so a long chain is
+   spread over several cores at the cost of a block of latency per
+   extra stage. The output is identical to a synchronous run. */
+static void
+runChainAsync(PluginChain * psChain,
+	      WaveFile * psInputFile,
+	      WaveFile * psOutputFile,
+	      const unsigned long lOutputLength,
+	      const unsigned long lStageCount,
+	      const unsigned long * plFirst,
+	      const RenderOptions * psOptions) {
+
+  AsyncIO sAsyncIO;
+  AudioBlock * psBlocks;
+  BlockRing * psStageRings;
+  PipelineStage * psStages;
+  pthread_t * psThreads;
+  pthread_t sReader;
+  pthread_t sWriter;
+  unsigned long lBlockIndex;
+  unsigned long lQueueDepth;
+  unsigned long lStageIndex;
+
+  sAsyncIO.psInputFile = psInputFile;
+  sAsyncIO.psOutputFile = psOutputFile;
+  sAsyncIO.lInputLength = psInputFile->lLength;
+  sAsyncIO.lOutputLength = lOutputLength;
+  sAsyncIO.lExtraFrames
+    = (unsigned long)(getExtraSeconds(psOptions) * psInputFile->lSampleRate);
+  sAsyncIO.lBufferCount = psChain->lBufferCount;
+  sAsyncIO.lBlockSize = psOptions->lBlockSize;
+  lQueueDepth = psOptions->lQueueDepth;
+
+  createBlockRing(&sAsyncIO.sFreeRing, lQueueDepth);
+  createBlockRing(&sAsyncIO.sReadRing, lQueueDepth + 1);
+  createBlockRing(&sAsyncIO.sWriteRing, lQueueDepth + 1);
+
+  /* Wire up the stages: the read ring feeds the first, a ring
+     between each pair and the last feeds the write ring. */
+  psStages = (PipelineStage *)calloc(lStageCount, sizeof(PipelineStage));
+  psStageRings = (BlockRing *)calloc(lStageCount, sizeof(BlockRing));
+  psThreads = (pthread_t *)calloc(lStageCount, sizeof(pthread_t));
+  for (lStageIndex = 0; lStageIndex < lStageCount; lStageIndex++) {
+    getPluginChainSegment(psChain,
+			  plFirst[lStageIndex],
+			  (lStageIndex + 1 < lStageCount
+			   ? plFirst[lStageIndex + 1]
+			   : psChain->lPluginCount) - plFirst[lStageIndex],
+			  &psStages[lStageIndex].sSegment);
+    psStages[lStageIndex].lSubBlockSize = psOptions->lSubBlockSize;
+    psStages[lStageIndex].psInputRing
+      = (lStageIndex == 0
+	 ? &sAsyncIO.sReadRing
+	 : psStageRings + lStageIndex - 1);
+    if (lStageIndex + 1 < lStageCount) {
+      createBlockRing(psStageRings + lStageIndex, lQueueDepth + 1);
+      psStages[lStageIndex].psOutputRing = psStageRings + lStageIndex;
+    }
+    else
+      psStages[lStageIndex].psOutputRing = &sAsyncIO.sWriteRing;
+  }
+
+  psBlocks = (AudioBlock *)calloc(lQueueDepth, sizeof(AudioBlock));
+  for (lBlockIndex = 0; lBlockIndex < lQueueDepth; lBlockIndex++) {
+    psBlocks[lBlockIndex].ppfBuffers
+      = allocateBuffers(psChain->lBufferCount,
+			psOptions->lBlockSize,
+			psOptions->bHugePages);
+    pushBlockRing(&sAsyncIO.sFreeRing, psBlocks + lBlockIndex);
+  }
 
-  closeFiles();
+  if (pthread_create(&sReader, NULL, readerThread, &sAsyncIO) != 0
+      || pthread_create(&sWriter, NULL, writerThread, &sAsyncIO) != 0) {
+    fprintf(stderr, "Failed to start I/O threads.\n");
+    exit(1);
+  }
+  for (lStageIndex = 0; lStageIndex + 1 < lStageCount; lStageIndex++)
+    if (pthread_create(psThreads + lStageIndex,
+		       NULL,
+		       stageThread,
+		       psStages + lStageIndex) != 0) {
+      fprintf(stderr, "Failed to start processing threads.\n");
+      exit(1);
+    }
 
+  /* The last stage runs here. */
+  stageThread(psStages + lStageCount - 1);
+
+  for (lStageIndex = 0; lStageIndex + 1 < lStageCount; lStageIndex++)
+    pthread_join(psThreads[lStageIndex], NULL);
+  pthread_join(sReader, NULL);
+  pthread_join(sWriter, NULL);
+
+  printf("Read queue: mean depth %.1f of %lu blocks, "
+	 "reader waited %lu times, processing waited %lu times.\n",
+	 getMeanDepth(&sAsyncIO.sReadRing),
+	 lQueueDepth,
+	 sAsyncIO.sFreeRing.lPopWaits,
+	 sAsyncIO.sReadRing.lPopWaits);
+  if (lStageCount > 1)
+    for (lStageIndex = 0; lStageIndex < lStageCount; lStageIndex++)
+      printf("Stage %lu (plugins %lu to %lu): busy %.3f seconds, "
+	     "waited %lu times for input, %lu times for output.\n",
+	     lStageIndex + 1,
+	     plFirst[lStageIndex] + 1,
+	     plFirst[lStageIndex] + psStages[lStageIndex].sSegment.lPluginCount,
+	     psStages[lStageIndex].dBusySeconds,
+	     psStages[lStageIndex].psInputRing->lPopWaits,
+	     psStages[lStageIndex].psOutputRing->lPushWaits);
+  printf("Write queue: mean depth %.1f of %lu blocks, "
+	 "writer waited %lu times.\n",
+	 getMeanDepth(&sAsyncIO.sWriteRing),
+	 lQueueDepth,
+	 sAsyncIO.sWriteRing.lPopWaits);
+
+  for (lBlockIndex = 0; lBlockIndex < lQueueDepth; lBlockIndex++)
+    freeBuffers(psBlocks[lBlockIndex].ppfBuffers);
+  free(psBlocks);
+  for (lStageIndex = 0; lStageIndex + 1 < lStageCount; lStageIndex++)
+    destroyBlockRing(psStageRings + lStageIndex);
+  free(psStageRings);
+  free(psStages);
+  free(psThreads);
+  destroyBlockRing(&sAsyncIO.sFreeRing);
+  destroyBlockRing(&sAsyncIO.sReadRing);
+  destroyBlockRing(&sAsyncIO.sWriteRing);
 }
 
 /*****************************************************************************/
 
-/* Note that this function leaks memory and that dynamic libraries
-   that are dlopen()ed are never dlclose()d. */
-int 
-main(const int iArgc, char * const ppcArgv[]) {
+/* The start of the input, decoded ahead of time so that processing
+   can be timed on its own. */
+typedef struct {
 
-  char * pcEndPointer;
-  const char * pcControlValue;
-  const char * pcInputFilename;
-  const char * pcOutputFilename;
-  const LADSPA_Descriptor ** ppsPluginDescriptors;
-  LADSPA_Data ** ppfPluginControlValues;
-  LADSPA_Data fExtraSeconds;
-  int bBadParameters;
-  int bBadControls;
-  LADSPA_Properties iProperties;
-  unsigned long lArgumentIndex;
-  unsigned long lControlValueCount;
-  unsigned long lControlValueIndex;
-  unsigned long lPluginCount;
-  unsigned long lPluginCountUpperLimit;
-  unsigned long lPluginIndex;
-  void ** ppvPluginLibraries;
+  unsigned long lLength;
+  unsigned long lBlockCount;
+  unsigned long lBlockSize;
+  unsigned long lBufferCount;
+  LADSPA_Data *** pppfBlocks;
 
-  bBadParameters = 0;
-  fExtraSeconds = 0;
+} TuningAudio;
 
-  /* Check for a -s flag, but only at the start. Cannot get use
-     getopt() as it gets thoroughly confused when faced with negative
-     numbers on the command line. */
-  lArgumentIndex = 1;
-  if (iArgc >= 3) {
-    if (strcmp(ppcArgv[1], "-s") == 0) {
-      fExtraSeconds = (LADSPA_Data)strtod(ppcArgv[2], &pcEndPointer);
-      bBadControls = (ppcArgv[2] + strlen(ppcArgv[2]) 
-		      != pcEndPointer);
-      lArgumentIndex = 3;
-    }
-    else if (strncmp(ppcArgv[1], "-s", 2) == 0) {
-      fExtraSeconds = (LADSPA_Data)strtod(ppcArgv[1] + 2, &pcEndPointer);
-      bBadControls = (ppcArgv[1] + strlen(ppcArgv[1]) 
-		      != pcEndPointer);
-      lArgumentIndex = 2;
-    }
+/* Decode up to fSeconds from the start of the input and rewind it.
+   Returns the number of frames loaded, which is none when the input
+   is a pipe and cannot be rewound. */
+static unsigned long
+loadTuningAudio(TuningAudio * psAudio,
+		WaveFile * psInputFile,
+		const LADSPA_Data fSeconds,
+		const unsigned long lBufferCount,
+		const unsigned long lBlockSize) {
+
+  unsigned long lBlockIndex;
+
+  psAudio->lLength = (unsigned long)(fSeconds * psInputFile->lSampleRate);
+  if (psAudio->lLength > psInputFile->lLength)
+    psAudio->lLength = psInputFile->lLength;
+  if (!canRewindWaveFile(psInputFile)) {
+    fprintf(stderr,
+	    "Input \"%s\" cannot be rewound, so it is not timed before "
+	    "rendering.\n",
+	    psInputFile->pcFilename);
+    psAudio->lLength = 0;
   }
-  
-  /* We need to analyse the rest of the parameters. The first two
-     should be input and output files involved. */
-  if (lArgumentIndex + 4 > (unsigned long)iArgc) {
-    /* There aren't enough parameters to include an input file, an
-       output file and one plugin. */
-    bBadParameters = 1;
+  psAudio->lBlockSize = lBlockSize;
+  psAudio->lBufferCount = lBufferCount;
+  psAudio->lBlockCount = (psAudio->lLength + lBlockSize - 1) / lBlockSize;
+
+  psAudio->pppfBlocks
+    = (LADSPA_Data ***)calloc(psAudio->lBlockCount + 1,
+			      sizeof(LADSPA_Data **));
+  for (lBlockIndex = 0; lBlockIndex < psAudio->lBlockCount; lBlockIndex++) {
+    psAudio->pppfBlocks[lBlockIndex]
+      = allocateBuffers(lBufferCount, lBlockSize, 0);
+    readBlock(psInputFile,
+	      psAudio->lLength,
+	      lBlockIndex * lBlockSize,
+	      psAudio->pppfBlocks[lBlockIndex],
+	      lBufferCount,
+	      lBlockSize);
   }
-  else {
+  seekWaveFile(psInputFile, 0);
 
-    pcInputFilename = ppcArgv[lArgumentIndex];
-    pcOutputFilename = ppcArgv[lArgumentIndex + 1];
+  return psAudio->lLength;
+}
 
-    /* Now we need to look through any plugins and plugin parameters
-       present. At this stage we're loading plugins and parameters,
-       but not attempting to wire them up.
+/* Copy a block of tuning audio into working buffers, returning its
+   length in frames. */
+static unsigned long
+restoreTuningBlock(const TuningAudio * psAudio,
+		   const unsigned long lBlockIndex,
+		   LADSPA_Data ** ppfBuffers) {
 
-       First we construct some arrays to contain the data we're
-       hopefully about to extract. Note that these arrays are usually
-       larger than is needed, however they will be large enough.
+  unsigned long lBufferIndex;
+  unsigned long lFrameCount;
 
-       WARNING: Note that there is no attempt to tidy up the memory at
-       the end of this function and libraries are not unloaded under
-       error conditions. This is only a toy program. */
+  for (lBufferIndex = 0; lBufferIndex < psAudio->lBufferCount; lBufferIndex++)
+    memcpy(ppfBuffers[lBufferIndex],
+	   psAudio->pppfBlocks[lBlockIndex][lBufferIndex],
+	   sizeof(LADSPA_Data) * psAudio->lBlockSize);
 
-    lPluginCountUpperLimit = (iArgc - lArgumentIndex - 1) / 2;
+  lFrameCount = psAudio->lLength - lBlockIndex * psAudio->lBlockSize;
+  if (lFrameCount > psAudio->lBlockSize)
+    lFrameCount = psAudio->lBlockSize;
+  return lFrameCount;
+}
 
-    ppvPluginLibraries = ((void **)
-			  calloc(lPluginCountUpperLimit,
-				 sizeof(void *)));
-    ppsPluginDescriptors = ((const LADSPA_Descriptor **)
-			    calloc(lPluginCountUpperLimit,
-				   sizeof(LADSPA_Descriptor *)));
-    ppfPluginControlValues = ((LADSPA_Data **)
-			      calloc(lPluginCountUpperLimit,
-				     sizeof(LADSPA_Data *)));
-    lPluginIndex = 0;
-    lArgumentIndex += 2;
-    bBadControls = 0;
-    while (lArgumentIndex < (unsigned long)iArgc && !bBadControls) {
+static void
+freeTuningAudio(TuningAudio * psAudio) {
 
-      if (lArgumentIndex + 1 == (unsigned long)iArgc) {
-	bBadParameters = 1;
-	break;
-      }
+  unsigned long lBlockIndex;
 
-      /* Parameter should be a plugin file name followed by a
-         label. Load the plugin. This call will exit() if the load
-         fails. */
-      ppvPluginLibraries[lPluginIndex]
-	= loadLADSPAPluginLibrary(ppcArgv[lArgumentIndex]);
-      ppsPluginDescriptors[lPluginIndex] 
-	= findLADSPAPluginDescriptor(ppvPluginLibraries[lPluginIndex],
-				     ppcArgv[lArgumentIndex],
-				     ppcArgv[lArgumentIndex + 1]);
-
-      /* Check the plugin is in-place compatible. */
-      iProperties = ppsPluginDescriptors[lPluginIndex]->Properties;
-      if (LADSPA_IS_INPLACE_BROKEN(iProperties)) {
-	fprintf(stderr,
-		"Plugin \"%s\" is not capable of in-place processing and "
-		"therefore cannot be used by this program.\n",
-		ppsPluginDescriptors[lPluginIndex]->Name);
-	/* This is somewhat lazy - this isn't a difficult problem to
-           get around. */
-	return(1);
-      }
+  for (lBlockIndex = 0; lBlockIndex < psAudio->lBlockCount; lBlockIndex++)
+    freeBuffers(psAudio->pppfBlocks[lBlockIndex]);
+  free(psAudio->pppfBlocks);
+}
 
-      lControlValueCount
-	= getPortCountByType(ppsPluginDescriptors[lPluginIndex],
-			     LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL);
-      
-      bBadControls = (lControlValueCount + lArgumentIndex + 2 
-		      > (unsigned long)iArgc);
-      if (lControlValueCount > 0 && !bBadControls) {
-	ppfPluginControlValues[lPluginIndex]
-	  = (LADSPA_Data *)calloc(lControlValueCount, sizeof(LADSPA_Data));
-	for (lControlValueIndex = 0; 
-	     lControlValueIndex < lControlValueCount && !bBadControls;
-	     lControlValueIndex++) {
-	  pcControlValue = ppcArgv[lArgumentIndex + 2 + lControlValueIndex];
-
-	  ppfPluginControlValues[lPluginIndex][lControlValueIndex]
-	    = (LADSPA_Data)strtod(pcControlValue, &pcEndPointer);
-
-	  bBadControls = (pcControlValue + strlen(pcControlValue) 
-			  != pcEndPointer);
-	}
+/* Find the fastest sub-block size for this chain on this machine by
+   rendering the first fSeconds of the input with each candidate. A
+   separate set of instances is used so the real render starts from
+   a clean state. The input file is left at its start. */
+static unsigned long
+autotuneSubBlockSize(const unsigned long        lPluginCount,
+		     const LADSPA_Descriptor ** ppsPluginDescriptors,
+		     LADSPA_Data             ** ppfPluginControlValues,
+		     WaveFile                 * psInputFile,
+		     const RenderOptions      * psOptions) {
+
+  LADSPA_Data ** ppfWork;
+  PluginChain sChain;
+  TuningAudio sAudio;
+  double dBestTime;
+  double dStart;
+  double dTime;
+  unsigned long lBestSize;
+  unsigned long lBlockIndex;
+  unsigned long lFrameCount;
+  unsigned long lRound;
+  unsigned long lSize;
+
+  createPluginChain(&sChain,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues,
+		    psInputFile->lChannelCount,
+		    psInputFile->lSampleRate);
+
+  if (loadTuningAudio(&sAudio,
+		      psInputFile,
+		      psOptions->fAutotuneSeconds,
+		      sChain.lBufferCount,
+		      psOptions->lBlockSize) == 0) {
+    freeTuningAudio(&sAudio);
+    destroyPluginChain(&sChain);
+    return psOptions->lSubBlockSize;
+  }
+  ppfWork = allocateBuffers(sChain.lBufferCount,
+			    psOptions->lBlockSize,
+			    psOptions->bHugePages);
+
+  lBestSize = psOptions->lBlockSize;
+  dBestTime = -1;
+  printf("Autotune over %g seconds:\n",
+	 (double)sAudio.lLength / psInputFile->lSampleRate);
+
+  lSize = AUTOTUNE_MIN_SUB_BLOCK;
+  while (1) {
+    if (lSize > psOptions->lBlockSize)
+      lSize = psOptions->lBlockSize;
+
+    dTime = -1;
+    for (lRound = 0; lRound < AUTOTUNE_ROUNDS; lRound++) {
+      activatePluginChain(&sChain);
+      dStart = 0;
+      for (lBlockIndex = 0; lBlockIndex < sAudio.lBlockCount; lBlockIndex++) {
+	lFrameCount = restoreTuningBlock(&sAudio, lBlockIndex, ppfWork);
+	dStart -= getSeconds();
+	processPluginChain(&sChain, ppfWork, lFrameCount, lSize);
+	dStart += getSeconds();
       }
+      deactivatePluginChain(&sChain);
+      if (dTime < 0 || dStart < dTime)
+	dTime = dStart;
+    }
 
-      if (bBadControls)
-	listControlsForPlugin(ppsPluginDescriptors[lPluginIndex]);
-
-      lArgumentIndex += (2 + lControlValueCount);
-      lPluginIndex++;
+    printf("\tsub-block %5lu: %.2f ns/frame\n",
+	   lSize,
+	   dTime * 1e9 / sAudio.lLength);
+    if (dBestTime < 0 || dTime < dBestTime) {
+      dBestTime = dTime;
+      lBestSize = lSize;
     }
 
-    lPluginCount = lPluginIndex;
+    if (lSize == psOptions->lBlockSize)
+      break;
+    lSize *= 2;
+  }
 
-    if (!bBadControls) {
+  printf("Using sub-block size %lu.\n", lBestSize);
 
-      /* We have all the data we need. Go go go. If this function
-	 fails it will exit(). */
-      applyPlugin(pcInputFilename,
-		  pcOutputFilename,
-		  fExtraSeconds,
-		  lPluginCount,
-		  ppsPluginDescriptors,
-		  ppfPluginControlValues);
+  destroyPluginChain(&sChain);
+  freeTuningAudio(&sAudio);
+  freeBuffers(ppfWork);
 
-      for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
-	unloadLADSPAPluginLibrary(ppvPluginLibraries[lPluginIndex]);
-    }
+  return lBestSize;
+}
+
+/* Split the chain into lStageCount runs of consecutive plugins of
+   roughly equal cost, writing the index of the first plugin of each
+   stage to plFirst. The cost of each plugin is measured on the start
+   of the input with a separate set of instances; if there is no
+   input to measure on, every plugin is assumed to cost the same. */
+static void
+balancePipeline(const unsigned long        lPluginCount,
+		const LADSPA_Descriptor ** ppsPluginDescriptors,
+		LADSPA_Data             ** ppfPluginControlValues,
+		WaveFile                 * psInputFile,
+		const RenderOptions      * psOptions,
+		const unsigned long        lStageCount,
+		unsigned long            * plFirst) {
+
+  LADSPA_Data ** ppfWork;
+  PluginChain sChain;
+  PluginChain sSegment;
+  TuningAudio sAudio;
+  double * pdBest;
+  double * pdCosts;
+  double dCost;
+  double dStart;
+  unsigned long * plSplit;
+  unsigned long lBlockIndex;
+  unsigned long lEnd;
+  unsigned long lFrameCount;
+  unsigned long lPluginIndex;
+  unsigned long lStageIndex;
+  unsigned long lStart;
+
+  pdCosts = (double *)calloc(lPluginCount + 1, sizeof(double));
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+    pdCosts[lPluginIndex] = 1;
+
+  createPluginChain(&sChain,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues,
+		    psInputFile->lChannelCount,
+		    psInputFile->lSampleRate);
+  if (loadTuningAudio(&sAudio,
+		      psInputFile,
+		      PIPELINE_BALANCE_SECONDS,
+		      sChain.lBufferCount,
+		      psOptions->lBlockSize) > 0) {
+    ppfWork = allocateBuffers(sChain.lBufferCount,
+			      psOptions->lBlockSize,
+			      psOptions->bHugePages);
+    memset(pdCosts, 0, sizeof(double) * lPluginCount);
+    activatePluginChain(&sChain);
+    for (lBlockIndex = 0; lBlockIndex < sAudio.lBlockCount; lBlockIndex++) {
+      lFrameCount = restoreTuningBlock(&sAudio, lBlockIndex, ppfWork);
+      for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+	getPluginChainSegment(&sChain, lPluginIndex, 1, &sSegment);
+	dStart = getSeconds();
+	processPluginChain(&sSegment,
+			   ppfWork,
+			   lFrameCount,
+			   psOptions->lSubBlockSize);
+	pdCosts[lPluginIndex] += getSeconds() - dStart;
+      }
+    }
+    deactivatePluginChain(&sChain);
+    freeBuffers(ppfWork);
+  }
+  freeTuningAudio(&sAudio);
+  destroyPluginChain(&sChain);
+
+  /* Linear partition: pdBest[s * (n + 1) + i] is the smallest
+     possible cost of the slowest stage when the first i plugins are
+     split into s + 1 stages, and plSplit holds where the last of
+     those stages starts. */
+  pdBest = (double *)calloc(lStageCount * (lPluginCount + 1), sizeof(double));
+  plSplit = (unsigned long *)calloc(lStageCount * (lPluginCount + 1),
+				    sizeof(unsigned long));
+  for (lEnd = 1; lEnd <= lPluginCount; lEnd++)
+    pdBest[lEnd] = pdBest[lEnd - 1] + pdCosts[lEnd - 1];
+  for (lStageIndex = 1; lStageIndex < lStageCount; lStageIndex++)
+    for (lEnd = lStageIndex + 1; lEnd <= lPluginCount; lEnd++) {
+      pdBest[lStageIndex * (lPluginCount + 1) + lEnd] = -1;
+      dCost = 0;
+      for (lStart = lEnd - 1; lStart >= lStageIndex; lStart--) {
+	dCost += pdCosts[lStart];
+	dStart = pdBest[(lStageIndex - 1) * (lPluginCount + 1) + lStart];
+	if (dStart < dCost)
+	  dStart = dCost;
+	if (pdBest[lStageIndex * (lPluginCount + 1) + lEnd] < 0
+	    || dStart < pdBest[lStageIndex * (lPluginCount + 1) + lEnd]) {
+	  pdBest[lStageIndex * (lPluginCount + 1) + lEnd] = dStart;
+	  plSplit[lStageIndex * (lPluginCount + 1) + lEnd] = lStart;
+	}
+      }
+    }
+
+  lEnd = lPluginCount;
+  for (lStageIndex = lStageCount - 1; lStageIndex > 0; lStageIndex--) {
+    plFirst[lStageIndex] = plSplit[lStageIndex * (lPluginCount + 1) + lEnd];
+    lEnd = plFirst[lStageIndex];
+  }
+  plFirst[0] = 0;
+
+  free(pdBest);
+  free(plSplit);
+  free(pdCosts);
+}
+
+/*****************************************************************************/
+
+/* Sample rate the chain runs at, and that the output is written at,
+   for an input at lInputRate. */
+static unsigned long
+getChainSampleRate(const RenderOptions * psOptions,
+		   const unsigned long lInputRate) {
+  return (psOptions->lChainSampleRate
+	  ? psOptions->lChainSampleRate
+	  : lInputRate);
+}
+
+static unsigned long
+getOutputSampleRate(const RenderOptions * psOptions,
+		    const unsigned long lInputRate) {
+  return (psOptions->lOutputSampleRate
+	  ? psOptions->lOutputSampleRate
+	  : getChainSampleRate(psOptions, lInputRate));
+}
+
+/* Frames of output for lInputLength frames of input followed by the
+   extra silence, at the output rate. With -s auto this is an upper
+   bound. */
+static unsigned long
+getOutputLength(const RenderOptions * psOptions,
+		const WaveFile * psInputFile,
+		const unsigned long lInputLength) {
+
+  unsigned long lFrameCount;
+  unsigned long lOutputRate;
+
+  lFrameCount = (lInputLength
+		 + (unsigned long)(getExtraSeconds(psOptions)
+				   * psInputFile->lSampleRate));
+  lOutputRate = getOutputSampleRate(psOptions, psInputFile->lSampleRate);
+  if (lOutputRate == psInputFile->lSampleRate)
+    return lFrameCount;
+  return (unsigned long)(((unsigned long long)lFrameCount * lOutputRate
+			  + psInputFile->lSampleRate - 1)
+			 / psInputFile->lSampleRate);
+}
+
+/* The first frame written of an output at lSampleRate, from
+   --start. */
+static unsigned long
+getRangeStart(const RenderOptions * psOptions,
+	      const unsigned long lSampleRate) {
+  return (unsigned long)(psOptions->fStartSeconds * lSampleRate);
+}
+
+/* The frame the output stops before: lOutputLength, or --end if that
+   is sooner. */
+static unsigned long
+getRangeEnd(const RenderOptions * psOptions,
+	    const unsigned long lSampleRate,
+	    const unsigned long lOutputLength) {
+
+  unsigned long lEnd;
+
+  if (psOptions->fEndSeconds > 0) {
+    lEnd = (unsigned long)(psOptions->fEndSeconds * lSampleRate);
+    if (lEnd < lOutputLength)
+      return lEnd;
+  }
+  return lOutputLength;
+}
+
+/* Open the input file and create the output file for a chain,
+   checking channel counts. Sets *plOutputFileLength to the length of
+   the output in frames, WAVE_LENGTH_UNKNOWN if the input is a stream
+   of unknown length. Either file may be "-" for standard input or
+   output. If pcOutputFilename is NULL no output file is created. With
+   --start or --end the output file holds only that range, but the
+   length given is still that of the whole render. Returns -1 with a
+   message in pcError, and both files closed, on failure, otherwise
+   0. */
+static int
+tryOpenRenderFiles(const char               * pcInputFilename,
+		   const char               * pcOutputFilename,
+		   const RenderOptions      * psOptions,
+		   const unsigned long        lPluginCount,
+		   const LADSPA_Descriptor ** ppsPluginDescriptors,
+		   WaveFile                 * psInputFile,
+		   WaveFile                 * psOutputFile,
+		   unsigned long            * plOutputFileLength,
+		   char                     * pcError,
+		   const size_t               lErrorSize) {
+
+  int iError;
+  int iOutputSampleFormat;
+  unsigned long lCreateLength;
+  unsigned long lOutputFileChannelCount;
+  unsigned long lOutputFileLength;
+
+  if (psOptions->iRawInputFormat != WAVE_SAMPLE_NONE)
+    iError = tryOpenRawFile(psInputFile,
+			    pcInputFilename,
+			    psOptions->iRawInputFormat,
+			    psOptions->lRawInputChannelCount,
+			    psOptions->lRawInputSampleRate,
+			    psOptions->lBlockSize);
+  else
+    iError = tryOpenWaveFile(psInputFile,
+			     pcInputFilename,
+			     psOptions->lBlockSize);
+  if (iError != 0) {
+    snprintf(pcError, lErrorSize, "%s", psInputFile->pcError);
+    return -1;
+  }
+
+  /* Mono plugins are run once per channel of a wider input. */
+  if (tryGetPluginChainOutputCount(lPluginCount,
+				   ppsPluginDescriptors,
+				   psInputFile->lChannelCount,
+				   &lOutputFileChannelCount,
+				   pcError,
+				   lErrorSize) != 0) {
+    closeWaveFile(psInputFile);
+    return -1;
+  }
+  if (lOutputFileChannelCount == 0) {
+    snprintf(pcError,
+	     lErrorSize,
+	     "The last plugin in the chain has no audio outputs.");
+    closeWaveFile(psInputFile);
+    return -1;
+  }
+
+  if (psInputFile->lLength == WAVE_LENGTH_UNKNOWN)
+    lOutputFileLength = WAVE_LENGTH_UNKNOWN;
+  else
+    lOutputFileLength
+      = getOutputLength(psOptions, psInputFile, psInputFile->lLength);
+  *plOutputFileLength = lOutputFileLength;
+
+  /* With -s auto the output usually stops short of this length and
+     closeWaveFile() corrects the header. Standard output cannot be
+     rewound to do that, so is given a header of unknown length. */
+  if (lOutputFileLength != WAVE_LENGTH_UNKNOWN
+      && (getRangeStart(psOptions, psInputFile->lSampleRate)
+	  >= lOutputFileLength)) {
+    snprintf(pcError,
+	     lErrorSize,
+	     "The render of \"%s\" is only %.3f seconds long.",
+	     pcInputFilename,
+	     (double)lOutputFileLength / psInputFile->lSampleRate);
+    closeWaveFile(psInputFile);
+    return -1;
+  }
+
+  if (pcOutputFilename == NULL)
+    return 0;
+  lCreateLength = lOutputFileLength;
+  if (lCreateLength != WAVE_LENGTH_UNKNOWN)
+    lCreateLength
+      = (getRangeEnd(psOptions, psInputFile->lSampleRate, lCreateLength)
+	 - getRangeStart(psOptions, psInputFile->lSampleRate));
+  if (psOptions->bAutoTail && strcmp(pcOutputFilename, "-") == 0)
+    lCreateLength = WAVE_LENGTH_UNKNOWN;
+
+  /* Unless asked otherwise, write samples the way they came in. */
+  iOutputSampleFormat = (psOptions->iOutputSampleFormat != WAVE_SAMPLE_NONE
+			 ? psOptions->iOutputSampleFormat
+			 : psInputFile->iSampleFormat);
+  if (psOptions->bRawOutput)
+    iError = tryCreateRawFile(psOutputFile,
+			      pcOutputFilename,
+			      lOutputFileChannelCount,
+			      getOutputSampleRate(psOptions,
+						  psInputFile->lSampleRate),
+			      lCreateLength,
+			      iOutputSampleFormat,
+			      psOptions->lBlockSize);
+  else
+    iError = tryCreateWaveFile(psOutputFile,
+			       pcOutputFilename,
+			       lOutputFileChannelCount,
+			       getOutputSampleRate(psOptions,
+						   psInputFile->lSampleRate),
+			       lCreateLength,
+			       iOutputSampleFormat,
+			       psOptions->lBlockSize);
+  if (iError != 0) {
+    snprintf(pcError, lErrorSize, "%s", psOutputFile->pcError);
+    closeWaveFile(psInputFile);
+    return -1;
+  }
+
+  /* With the audio on standard output, reports go to stderr. */
+  if (strcmp(pcOutputFilename, "-") == 0) {
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+  }
+
+  return 0;
+}
+
+/* As tryOpenRenderFiles(), but returning the length of the output
+   and exiting on failure. */
+static unsigned long
+openRenderFiles(const char               * pcInputFilename,
+		const char               * pcOutputFilename,
+		const RenderOptions      * psOptions,
+		const unsigned long        lPluginCount,
+		const LADSPA_Descriptor ** ppsPluginDescriptors,
+		WaveFile                 * psInputFile,
+		WaveFile                 * psOutputFile) {
+
+  char pcError[WAVE_ERROR_SIZE];
+  unsigned long lOutputFileLength;
+
+  if (tryOpenRenderFiles(pcInputFilename,
+			 pcOutputFilename,
+			 psOptions,
+			 lPluginCount,
+			 ppsPluginDescriptors,
+			 psInputFile,
+			 psOutputFile,
+			 &lOutputFileLength,
+			 pcError,
+			 sizeof(pcError)) != 0) {
+    fprintf(stderr, "%s\n", pcError);
+    exit(1);
+  }
+
+  return lOutputFileLength;
+}
+
+/* For -s auto, look at lFrameCount frames of output starting at
+   lTimeAt and return how many to keep. If the output has now been
+   below the tail threshold for the whole tail window since the input
+   ended at lInputLength, *pbEnded is set and the frames after that
+   are dropped. *plQuietFrames carries the count of quiet frames from
+   block to block. */
+static unsigned long
+findTailEnd(const RenderOptions * psOptions,
+	    LADSPA_Data ** ppfOutputs,
+	    const unsigned long lChannelCount,
+	    const unsigned long lSampleRate,
+	    const unsigned long lInputLength,
+	    const unsigned long lTimeAt,
+	    const unsigned long lFrameCount,
+	    unsigned long * plQuietFrames,
+	    int * pbEnded) {
+
+  LADSPA_Data fThreshold;
+  int bLoud;
+  unsigned long lChannelIndex;
+  unsigned long lFrame;
+  unsigned long lWindow;
+
+  if (lTimeAt + lFrameCount <= lInputLength)
+    return lFrameCount;
+
+  fThreshold = powf(10, psOptions->fTailThreshold / 20);
+  lWindow = (unsigned long)(psOptions->fTailWindow * lSampleRate);
+  if (lWindow == 0)
+    lWindow = 1;
+
+  for (lFrame = (lTimeAt < lInputLength ? lInputLength - lTimeAt : 0);
+       lFrame < lFrameCount;
+       lFrame++) {
+    bLoud = 0;
+    for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++)
+      if (fabsf(ppfOutputs[lChannelIndex][lFrame]) > fThreshold)
+	bLoud = 1;
+    if (bLoud)
+      *plQuietFrames = 0;
+    else if (++*plQuietFrames >= lWindow) {
+      *pbEnded = 1;
+      return lFrame + 1;
+    }
+  }
+
+  return lFrameCount;
+}
+
+/* Run an activated chain over a whole file on this thread, using
+   ppfBuffers as working space. A stream of unknown length is read a
+   block at a time until it ends, so memory use does not depend on
+   its length. With -s auto the render ends once the tail has died
+   away. If psComparison is not NULL the output is compared with its
+   reference instead of being written to psOutputFile. With --start
+   the input is sought to the pre-roll before the range, which is
+   run but not written, and with --end the render stops early.
+   Returns -1 with a message in pcError if a file cannot be read or
+   written, otherwise 0. */
+static int
+tryRenderFile(PluginChain * psChain,
+	      WaveFile * psInputFile,
+	      WaveFile * psOutputFile,
+	      unsigned long lOutputFileLength,
+	      LADSPA_Data ** ppfBuffers,
+	      const RenderOptions * psOptions,
+	      ReferenceComparison * psComparison,
+	      char * pcError,
+	      const size_t lErrorSize) {
+
+  LADSPA_Data ** ppfWrite;
+  int bTailEnded;
+  unsigned long lChannelIndex;
+  unsigned long lFrameSize;
+  unsigned long lInputLength;
+  unsigned long lPreRoll;
+  unsigned long lQuietFrames;
+  unsigned long lRangeStart;
+  unsigned long lReadSize;
+  unsigned long lSkip;
+  unsigned long lTimeAt;
+  unsigned long lWriteSize;
+
+  lInputLength = psInputFile->lLength;
+  bTailEnded = 0;
+  lQuietFrames = 0;
+
+  lRangeStart = getRangeStart(psOptions, psInputFile->lSampleRate);
+  lOutputFileLength = getRangeEnd(psOptions,
+				  psInputFile->lSampleRate,
+				  lOutputFileLength);
+  lPreRoll = (unsigned long)(psOptions->fPreRollSeconds
+			     * psInputFile->lSampleRate);
+  lTimeAt = (lRangeStart > lPreRoll ? lRangeStart - lPreRoll : 0);
+  if (lTimeAt > 0
+      && lTimeAt < lInputLength
+      && trySeekWaveFile(psInputFile, lTimeAt) != 0) {
+    snprintf(pcError, lErrorSize, "%s", psInputFile->pcError);
+    return -1;
+  }
+  /* Automation and the control log follow the input, and the log
+     leaves out the pre-roll as the output does. */
+  psChain->lFramePosition = lTimeAt;
+  if (psChain->psControlLog)
+    psChain->psControlLog->lFirstFrame = lRangeStart;
+  if (lRangeStart > 0 || psOptions->fEndSeconds > 0)
+    printf("Rendering frames %lu to %lu after a pre-roll of %lu "
+	   "frames.\n",
+	   lRangeStart,
+	   lOutputFileLength,
+	   lRangeStart - lTimeAt);
+  ppfWrite = (LADSPA_Data **)calloc(psChain->lOutputCount,
+				    sizeof(LADSPA_Data *));
+
+  while (lTimeAt < lOutputFileLength && !bTailEnded) {
+
+    if (tryReadBlock(psInputFile,
+		     lInputLength,
+		     lTimeAt,
+		     ppfBuffers,
+		     psChain->lBufferCount,
+		     psOptions->lBlockSize,
+		     &lReadSize) != 0) {
+      snprintf(pcError, lErrorSize, "%s", psInputFile->pcError);
+      free(ppfWrite);
+      return -1;
+    }
+    if (lInputLength == WAVE_LENGTH_UNKNOWN
+	&& lReadSize < psOptions->lBlockSize) {
+      lInputLength = lTimeAt + lReadSize;
+      lOutputFileLength
+	= getRangeEnd(psOptions,
+		      psInputFile->lSampleRate,
+		      getOutputLength(psOptions, psInputFile, lInputLength));
+    }
+
+    /* Run the plugins: */
+    lFrameSize = lOutputFileLength - lTimeAt;
+    if (lFrameSize > psOptions->lBlockSize)
+      lFrameSize = psOptions->lBlockSize;
+    processPluginChain(psChain,
+		       ppfBuffers,
+		       lFrameSize,
+		       psOptions->lSubBlockSize);
+
+    lWriteSize = lFrameSize;
+    if (psOptions->bAutoTail) {
+      lWriteSize = findTailEnd(psOptions,
+			       ppfBuffers,
+			       psChain->lOutputCount,
+			       psInputFile->lSampleRate,
+			       lInputLength,
+			       lTimeAt,
+			       lFrameSize,
+			       &lQuietFrames,
+			       &bTailEnded);
+    }
+
+    /* Write the output to disk, less any pre-roll. */
+    lSkip = (lRangeStart > lTimeAt ? lRangeStart - lTimeAt : 0);
+    if (lWriteSize > lSkip) {
+      for (lChannelIndex = 0;
+	   lChannelIndex < psChain->lOutputCount;
+	   lChannelIndex++)
+	ppfWrite[lChannelIndex] = ppfBuffers[lChannelIndex] + lSkip;
+      if (psComparison)
+	compareWithReference(psComparison, ppfWrite, lWriteSize - lSkip);
+      else if (tryWriteWaveFile(psOutputFile,
+				ppfWrite,
+				lWriteSize - lSkip) != 0) {
+	snprintf(pcError, lErrorSize, "%s", psOutputFile->pcError);
+	free(ppfWrite);
+	return -1;
+      }
+    }
+
+    lTimeAt += lWriteSize;
+  }
+  free(ppfWrite);
+
+  if (psOptions->bAutoTail)
+    printf("Rendered a tail of %.3f seconds%s.\n",
+	   (double)(lTimeAt - lInputLength) / psInputFile->lSampleRate,
+	   bTailEnded ? "" : ", the most allowed");
+
+  return 0;
+}
+
+/* As tryRenderFile(), but exiting on failure. */
+static void
+renderFile(PluginChain * psChain,
+	   WaveFile * psInputFile,
+	   WaveFile * psOutputFile,
+	   unsigned long lOutputFileLength,
+	   LADSPA_Data ** ppfBuffers,
+	   const RenderOptions * psOptions,
+	   ReferenceComparison * psComparison) {
+
+  char pcError[WAVE_ERROR_SIZE];
+
+  if (tryRenderFile(psChain,
+		    psInputFile,
+		    psOutputFile,
+		    lOutputFileLength,
+		    ppfBuffers,
+		    psOptions,
+		    psComparison,
+		    pcError,
+		    sizeof(pcError)) != 0) {
+    fprintf(stderr, "%s\n", pcError);
+    exit(1);
+  }
+}
+
+/* Note that this procedure leaks memory like mad. Returns 1 if the
+   output was compared with a reference and failed, 0 otherwise. */
+static int
+applyPlugin(const char               * pcInputFilename,
+	    const char               * pcOutputFilename,
+	    const RenderOptions      * psOptions,
+	    const unsigned long        lPluginCount,
+	    const LADSPA_Descriptor ** ppsPluginDescriptors,
+	    LADSPA_Data             ** ppfPluginControlValues) {
+
+  FILE * poMeterFile;
+  FILE * poProfileFile;
+  LADSPA_Data ** ppfBuffers;
+  OutputMeter * psMeter;
+  PluginChain sChain;
+  ProfileStage * psProfile;
+  ReferenceComparison sComparison;
+  RenderOptions sOptions;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  char ** ppcProfileNames;
+  double dStart;
+  double dWallSeconds;
+  unsigned long * plStageFirst;
+  unsigned long lExtraRuns;
+  unsigned long lOutputFileLength;
+  unsigned long lPluginIndex;
+  unsigned long lPointCount;
+  unsigned long lStageIndex;
+  unsigned long lThreadCount;
+
+  sOptions = *psOptions;
+
+  /* Open input file and output file: 
+     -------------------------------- */
+
+  lOutputFileLength = openRenderFiles(pcInputFilename,
+				      (sOptions.pcReferenceFile
+				       ? NULL
+				       : pcOutputFilename),
+				      &sOptions,
+				      lPluginCount,
+				      ppsPluginDescriptors,
+				      &sInputFile,
+				      &sOutputFile);
+
+  /* The writer measures each block on its way out. */
+  psMeter = NULL;
+  if (sOptions.bMeter) {
+    psMeter = createOutputMeter(sOutputFile.lChannelCount,
+				sOutputFile.lSampleRate,
+				sOptions.lBlockSize);
+    sOutputFile.pvMeter = psMeter;
+  }
+
+  if (sOptions.fAutotuneSeconds > 0)
+    sOptions.lSubBlockSize = autotuneSubBlockSize(lPluginCount,
+						  ppsPluginDescriptors,
+						  ppfPluginControlValues,
+						  &sInputFile,
+						  &sOptions);
+
+  /* Each pipeline stage needs at least one plugin, and each stage
+     holds a block while the reader and writer hold another each. */
+  if (sOptions.lStageCount > lPluginCount)
+    sOptions.lStageCount = lPluginCount;
+  if (sOptions.lStageCount > 1) {
+    if (sOptions.lQueueDepth < 2 * (sOptions.lStageCount + 2))
+      sOptions.lQueueDepth = 2 * (sOptions.lStageCount + 2);
+  }
+  else
+    sOptions.lStageCount = 1;
+
+  plStageFirst
+    = (unsigned long *)calloc(sOptions.lStageCount, sizeof(unsigned long));
+  if (sOptions.lStageCount > 1) {
+    balancePipeline(lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues,
+		    &sInputFile,
+		    &sOptions,
+		    sOptions.lStageCount,
+		    plStageFirst);
+    printf("Pipeline of %lu stages starting at plugins",
+	   sOptions.lStageCount);
+    for (lStageIndex = 0; lStageIndex < sOptions.lStageCount; lStageIndex++)
+      printf(" %lu", plStageFirst[lStageIndex] + 1);
+    printf(", adding a latency of %lu blocks (%lu frames, %.1f ms).\n",
+	   sOptions.lStageCount - 1,
+	   (sOptions.lStageCount - 1) * sOptions.lBlockSize,
+	   (sOptions.lStageCount - 1) * sOptions.lBlockSize * 1000.0
+	   / sInputFile.lSampleRate);
+  }
+
+  /* Create instances and activate them:
+     ----------------------------------- */
+
+  createPluginChain(&sChain,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues,
+		    sInputFile.lChannelCount,
+		    sInputFile.lSampleRate);
+  if (sOptions.pcAutomationFile)
+    sChain.psAutomation = loadAutomation(sOptions.pcAutomationFile,
+					 lPluginCount,
+					 ppsPluginDescriptors,
+					 ppfPluginControlValues,
+					 sInputFile.lSampleRate,
+					 sOptions.lAutomationStep);
+  if (sOptions.pcControlLogFile)
+    sChain.psControlLog = createControlLog(sOptions.pcControlLogFile,
+					   lPluginCount,
+					   ppsPluginDescriptors,
+					   sChain.plInstanceCounts,
+					   sChain.ppfControlOutputs,
+					   sInputFile.lSampleRate);
+
+  /* Mono plugins run per channel on a wide input can have groups of
+     channels run on threads of their own. */
+  if (sOptions.lQueueDepth == 0 && !sOptions.bProfile) {
+    lThreadCount = sOptions.lChannelThreadCount;
+    if (lThreadCount == 0)
+      lThreadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    lThreadCount = startPluginChainThreads(&sChain,
+					   lThreadCount,
+					   sOptions.lBlockSize,
+					   sOptions.bHugePages);
+    if (lThreadCount > 1)
+      printf("Running %lu channels on %lu threads.\n",
+	     sChain.lInputCount,
+	     lThreadCount);
+  }
+  activatePluginChain(&sChain);
+  printf("Buffer plan: %lu buffers of %lu frames (%lu bytes).\n",
+	 sChain.lBufferCount,
+	 sOptions.lBlockSize,
+	 sChain.lBufferCount * sOptions.lBlockSize
+	 * (unsigned long)sizeof(LADSPA_Data));
+
+  /* Time the reading, conversion and plugins of the render itself,
+     after any tuning has touched the input. */
+  psProfile = NULL;
+  ppcProfileNames = NULL;
+  if (sOptions.bProfile) {
+    psProfile = (ProfileStage *)calloc(lPluginCount + 4,
+				       sizeof(ProfileStage));
+    ppcProfileNames = (char **)calloc(lPluginCount, sizeof(char *));
+    psProfile[0].pcName = "read";
+    psProfile[1].pcName = "decode";
+    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+      ppcProfileNames[lPluginIndex]
+	= (char *)malloc(strlen(ppsPluginDescriptors[lPluginIndex]->Label)
+			 + 24);
+      sprintf(ppcProfileNames[lPluginIndex],
+	      "%lu: %s",
+	      lPluginIndex + 1,
+	      ppsPluginDescriptors[lPluginIndex]->Label);
+      psProfile[lPluginIndex + 2].pcName = ppcProfileNames[lPluginIndex];
+    }
+    psProfile[lPluginCount + 2].pcName = "encode";
+    psProfile[lPluginCount + 3].pcName = "write";
+    sInputFile.psAccessProfile = psProfile;
+    sInputFile.psConvertProfile = psProfile + 1;
+    sChain.psProfile = psProfile + 2;
+    sOutputFile.psConvertProfile = psProfile + lPluginCount + 2;
+    sOutputFile.psAccessProfile = psProfile + lPluginCount + 3;
+  }
+  dStart = getSeconds();
+
+  /* Run:
+     ---- */
+
+  if (sOptions.lQueueDepth > 0)
+    runChainAsync(&sChain,
+		  &sInputFile,
+		  &sOutputFile,
+		  lOutputFileLength,
+		  sOptions.lStageCount,
+		  plStageFirst,
+		  &sOptions);
+  else {
+    ppfBuffers = allocateBuffers(sChain.lBufferCount,
+				 sOptions.lBlockSize,
+				 sOptions.bHugePages);
+    if (sOptions.bHugePages)
+      printf("Audio buffers are on %s.\n",
+	     getArenaBackingName(getBufferArena(ppfBuffers)->iBacking));
+    if (sOptions.pcReferenceFile)
+      openReferenceComparison(&sComparison,
+			      sOptions.pcReferenceFile,
+			      sChain.lOutputCount,
+			      sInputFile.lSampleRate,
+			      sOptions.lBlockSize,
+			      sOptions.fTolerance);
+    renderFile(&sChain,
+	       &sInputFile,
+	       &sOutputFile,
+	       lOutputFileLength,
+	       ppfBuffers,
+	       &sOptions,
+	       sOptions.pcReferenceFile ? &sComparison : NULL);
+    freeBuffers(ppfBuffers);
+  }
+
+  if (psProfile) {
+    dWallSeconds = getSeconds() - dStart;
+    printProfile(stdout,
+		 psProfile,
+		 lPluginCount + 4,
+		 sOutputFile.lFramePosition,
+		 sInputFile.lSampleRate,
+		 dWallSeconds);
+    if (sOptions.pcProfileFile) {
+      if (strcmp(sOptions.pcProfileFile, "-") == 0)
+	poProfileFile = stdout;
+      else
+	poProfileFile = fopen(sOptions.pcProfileFile, "w");
+      if (!poProfileFile) {
+	fprintf(stderr,
+		"Failed to create profile file \"%s\".\n",
+		sOptions.pcProfileFile);
+	exit(1);
+      }
+      writeProfileJSON(poProfileFile,
+		       psProfile,
+		       lPluginCount + 4,
+		       sOutputFile.lFramePosition,
+		       sInputFile.lSampleRate,
+		       dWallSeconds);
+      if (poProfileFile != stdout)
+	fclose(poProfileFile);
+    }
+    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+      free(ppcProfileNames[lPluginIndex]);
+    free(ppcProfileNames);
+  }
+
+  /* Deactivate and clean up:
+     ------------------------ */
+
+  if (sChain.psAutomation) {
+    lPointCount = 0;
+    lExtraRuns = 0;
+    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+      lPointCount += sChain.psAutomation[lPluginIndex].lPointCount;
+      lExtraRuns += sChain.psAutomation[lPluginIndex].lExtraRuns;
+    }
+    printf("Automation: %lu points, %lu extra run() calls.\n",
+	   lPointCount,
+	   lExtraRuns);
+    freeAutomation(sChain.psAutomation, lPluginCount);
+  }
+
+  if (sChain.psControlLog)
+    printf("Control log: %lu rows written to \"%s\".\n",
+	   closeControlLog(sChain.psControlLog),
+	   sOptions.pcControlLogFile);
+
+  deactivatePluginChain(&sChain);
+  destroyPluginChain(&sChain);
+  free(plStageFirst);
+  if (psProfile)
+    freeProfileStages(psProfile, lPluginCount + 4);
+
+  /* Close the input and output files:
+     --------------------------------- */
+
+  closeWaveFile(&sInputFile);
+  if (sOptions.pcReferenceFile)
+    return closeReferenceComparison(&sComparison);
+  closeWaveFile(&sOutputFile);
+  /* Reported in 16bit sample units as it always has been. */
+  printf("Peak output: %g\n", sOutputFile.fPeak * 32767.5f);
+
+  if (psMeter) {
+    finishOutputMeter(psMeter);
+    printOutputMeter(stdout, psMeter);
+    if (sOptions.pcMeterFile) {
+      if (strcmp(sOptions.pcMeterFile, "-") == 0)
+	poMeterFile = stdout;
+      else
+	poMeterFile = fopen(sOptions.pcMeterFile, "w");
+      if (!poMeterFile) {
+	fprintf(stderr,
+		"Failed to create meter file \"%s\".\n",
+		sOptions.pcMeterFile);
+	exit(1);
+      }
+      writeOutputMeterJSON(poMeterFile, psMeter);
+      if (poMeterFile != stdout)
+	fclose(poMeterFile);
+    }
+    destroyOutputMeter(psMeter);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************/
+
+static long long
+getNanoseconds(const struct timespec * psTime) {
+  return psTime->tv_sec * 1000000000LL + psTime->tv_nsec;
+}
+
+/* Render as a sound card driver would: wake on a timer once per
+   period, move a period of audio in and out of the chain and check
+   that the chain finished before the card would have needed the
+   output. Reader and writer threads stream the files through a ring
+   of REALTIME_QUEUE_SECONDS of period blocks, the card's side of the
+   bargain, so the memory locked for the timed loop does not grow
+   with the length of the file. The loop waiting on the reader counts
+   against its deadline, as it would on a card. Periods are never
+   skipped, so the output matches an offline render however many
+   deadlines are missed. Returns the number of missed deadlines
+   (xruns). */
+static unsigned long
+applyPluginRealtime(const char               * pcInputFilename,
+		    const char               * pcOutputFilename,
+		    const RenderOptions      * psOptions,
+		    const unsigned long        lPluginCount,
+		    const LADSPA_Descriptor ** ppsPluginDescriptors,
+		    LADSPA_Data             ** ppfPluginControlValues) {
+
+  AsyncIO sAsyncIO;
+  AudioBlock * psBlock;
+  AudioBlock * psBlocks;
+  PluginChain sChain;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  double dCallbackSeconds;
+  double dCallbackTotal;
+  double dCallbackWorst;
+  double dCallbackP99;
+  double dJitterTotal;
+  double dJitterWorst;
+  double dPeriodSeconds;
+  long long llDeadline;
+  long long llDone;
+  long long llLate;
+  long long llNext;
+  long long llPeriod;
+  long long llWake;
+  pthread_attr_t sAttributes;
+  pthread_t sReader;
+  pthread_t sWriter;
+  struct sched_param sParameters;
+  struct timespec sTime;
+  unsigned long plHistogram[REALTIME_HISTOGRAM_BINS + 1];
+  unsigned long lBin;
+  unsigned long lBlockIndex;
+  unsigned long lCount;
+  unsigned long lOutputFileLength;
+  unsigned long lPeriod;
+  unsigned long lPeriodCount;
+  unsigned long lQueueDepth;
+  unsigned long lSubBlockSize;
+  unsigned long lXrunCount;
+
+  lPeriod = psOptions->lRealtimePeriod;
+  lSubBlockSize = (psOptions->lSubBlockSize < lPeriod
+		   ? psOptions->lSubBlockSize
+		   : lPeriod);
+
+  lOutputFileLength = openRenderFiles(pcInputFilename,
+				      pcOutputFilename,
+				      psOptions,
+				      lPluginCount,
+				      ppsPluginDescriptors,
+				      &sInputFile,
+				      &sOutputFile);
+
+  createPluginChain(&sChain,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues,
+		    sInputFile.lChannelCount,
+		    sInputFile.lSampleRate);
+  if (psOptions->pcAutomationFile)
+    sChain.psAutomation = loadAutomation(psOptions->pcAutomationFile,
+					 lPluginCount,
+					 ppsPluginDescriptors,
+					 ppfPluginControlValues,
+					 sInputFile.lSampleRate,
+					 psOptions->lAutomationStep);
+
+  /* Start streaming the files, the card's side of the bargain:
+     ---------------------------------------------------------- */
+
+  /* Mapped files would be locked whole by mlockall(). */
+  unmapWaveFile(&sInputFile);
+  unmapWaveFile(&sOutputFile);
+
+  lQueueDepth = (unsigned long)(REALTIME_QUEUE_SECONDS
+				* sInputFile.lSampleRate
+				/ lPeriod) + 1;
+  if (lQueueDepth < 4)
+    lQueueDepth = 4;
+  sAsyncIO.psInputFile = &sInputFile;
+  sAsyncIO.psOutputFile = &sOutputFile;
+  sAsyncIO.lInputLength = sInputFile.lLength;
+  sAsyncIO.lOutputLength = lOutputFileLength;
+  sAsyncIO.lExtraFrames
+    = (unsigned long)(getExtraSeconds(psOptions) * sInputFile.lSampleRate);
+  sAsyncIO.lBufferCount = sChain.lBufferCount;
+  sAsyncIO.lBlockSize = lPeriod;
+  createBlockRing(&sAsyncIO.sFreeRing, lQueueDepth);
+  createBlockRing(&sAsyncIO.sReadRing, lQueueDepth + 1);
+  createBlockRing(&sAsyncIO.sWriteRing, lQueueDepth + 1);
+  psBlocks = (AudioBlock *)calloc(lQueueDepth, sizeof(AudioBlock));
+  for (lBlockIndex = 0; lBlockIndex < lQueueDepth; lBlockIndex++) {
+    psBlocks[lBlockIndex].ppfBuffers
+      = allocateBuffers(sChain.lBufferCount,
+			lPeriod,
+			psOptions->bHugePages);
+    pushBlockRing(&sAsyncIO.sFreeRing, psBlocks + lBlockIndex);
+  }
+
+  /* The I/O threads are started before this one changes priority, so
+     they stay at normal priority, and have small stacks, as those are
+     locked too. */
+  pthread_attr_init(&sAttributes);
+  pthread_attr_setstacksize(&sAttributes, REALTIME_IO_STACK_SIZE);
+  if (pthread_create(&sReader, &sAttributes, readerThread, &sAsyncIO) != 0
+      || pthread_create(&sWriter,
+			&sAttributes,
+			writerThread,
+			&sAsyncIO) != 0) {
+    fprintf(stderr, "Failed to start I/O threads.\n");
+    exit(1);
+  }
+  pthread_attr_destroy(&sAttributes);
+
+  /* Get ready to run without faults:
+     -------------------------------- */
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    fprintf(stderr,
+	    "Warning: could not lock memory; page faults may cause "
+	    "xruns.\n");
+  if (psOptions->lRealtimePriority > 0) {
+    memset(&sParameters, 0, sizeof(sParameters));
+    sParameters.sched_priority = (int)psOptions->lRealtimePriority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sParameters) != 0)
+      fprintf(stderr,
+	      "Warning: could not switch to SCHED_FIFO priority %lu; "
+	      "running at normal priority.\n",
+	      psOptions->lRealtimePriority);
+  }
+
+  activatePluginChain(&sChain);
+
+  /* Run a period per timer tick:
+     ---------------------------- */
+
+  dPeriodSeconds = (double)lPeriod / sInputFile.lSampleRate;
+  llPeriod = (long long)(dPeriodSeconds * 1e9);
+  dCallbackTotal = 0;
+  dCallbackWorst = 0;
+  dJitterTotal = 0;
+  dJitterWorst = 0;
+  lXrunCount = 0;
+  memset(plHistogram, 0, sizeof(plHistogram));
+
+  clock_gettime(CLOCK_MONOTONIC, &sTime);
+  llNext = getNanoseconds(&sTime) + llPeriod;
+  for (lPeriodCount = 0; ; lPeriodCount++) {
+
+    sTime.tv_sec = llNext / 1000000000LL;
+    sTime.tv_nsec = llNext % 1000000000LL;
+    /* clock_nanosleep() returns the error rather than setting errno. */
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sTime, NULL)
+	   == EINTR)
+      ;
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    llWake = getNanoseconds(&sTime);
+
+    psBlock = (AudioBlock *)popBlockRing(&sAsyncIO.sReadRing);
+    if (!psBlock)
+      break;
+    processPluginChain(&sChain,
+		       psBlock->ppfBuffers,
+		       psBlock->lFrameCount,
+		       lSubBlockSize);
+    pushBlockRing(&sAsyncIO.sWriteRing, psBlock);
+
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    llDone = getNanoseconds(&sTime);
+
+    llLate = llWake - llNext;
+    dJitterTotal += llLate * 1e-9;
+    if (dJitterWorst < llLate * 1e-9)
+      dJitterWorst = llLate * 1e-9;
+    dCallbackSeconds = (llDone - llWake) * 1e-9;
+    dCallbackTotal += dCallbackSeconds;
+    if (dCallbackWorst < dCallbackSeconds)
+      dCallbackWorst = dCallbackSeconds;
+    lBin = (unsigned long)(dCallbackSeconds / dPeriodSeconds
+			   * REALTIME_HISTOGRAM_BINS);
+    plHistogram[lBin < REALTIME_HISTOGRAM_BINS
+		? lBin
+		: REALTIME_HISTOGRAM_BINS]++;
+
+    /* The card wants this period's output when the next one is due.
+       After a miss it starts again from now, as a driver restarting
+       the stream would. */
+    llDeadline = llNext + llPeriod;
+    if (llDone > llDeadline) {
+      lXrunCount++;
+      llNext = llDone;
+    }
+    else
+      llNext = llDeadline;
+  }
+  pushBlockRing(&sAsyncIO.sWriteRing, NULL);
+
+  deactivatePluginChain(&sChain);
+  munlockall();
+  pthread_join(sReader, NULL);
+  pthread_join(sWriter, NULL);
+
+  printf("Realtime: %lu periods of %lu frames (%.2f ms), %lu xruns.\n",
+	 lPeriodCount,
+	 lPeriod,
+	 dPeriodSeconds * 1e3,
+	 lXrunCount);
+  if (lPeriodCount > 0) {
+    /* The 99th percentile to the resolution of the histogram, or the
+       worst if it is beyond a whole period. The top of a bin can lie
+       above the worst callback, which bounds it. */
+    lCount = 0;
+    for (lBin = 0; lBin < REALTIME_HISTOGRAM_BINS; lBin++) {
+      lCount += plHistogram[lBin];
+      if (lCount * 100 >= lPeriodCount * 99)
+	break;
+    }
+    dCallbackP99 = dCallbackWorst;
+    if (lBin < REALTIME_HISTOGRAM_BINS
+	&& (lBin + 1) * dPeriodSeconds / REALTIME_HISTOGRAM_BINS
+	< dCallbackWorst)
+      dCallbackP99 = (lBin + 1) * dPeriodSeconds / REALTIME_HISTOGRAM_BINS;
+    printf("Callback: mean %.1f us, p99 %.1f us, worst %.1f us "
+	   "(%.0f%% of the period).\n",
+	   dCallbackTotal * 1e6 / lPeriodCount,
+	   dCallbackP99 * 1e6,
+	   dCallbackWorst * 1e6,
+	   100 * dCallbackWorst / dPeriodSeconds);
+    printf("Wake-up jitter: mean %.1f us, worst %.1f us.\n",
+	   dJitterTotal * 1e6 / lPeriodCount,
+	   dJitterWorst * 1e6);
+  }
+  printf("Input queue: %lu blocks, the loop waited for the reader "
+	 "%lu times.\n",
+	 lQueueDepth,
+	 sAsyncIO.sReadRing.lPopWaits);
+
+  for (lBlockIndex = 0; lBlockIndex < lQueueDepth; lBlockIndex++)
+    freeBuffers(psBlocks[lBlockIndex].ppfBuffers);
+  free(psBlocks);
+  destroyBlockRing(&sAsyncIO.sFreeRing);
+  destroyBlockRing(&sAsyncIO.sReadRing);
+  destroyBlockRing(&sAsyncIO.sWriteRing);
+  if (sChain.psAutomation)
+    freeAutomation(sChain.psAutomation, lPluginCount);
+  destroyPluginChain(&sChain);
+
+  closeWaveFile(&sInputFile);
+  closeWaveFile(&sOutputFile);
+  printf("Peak output: %g\n", sOutputFile.fPeak * 32767.5f);
+
+  return lXrunCount;
+}
+
+/*****************************************************************************/
+
+/* A run of consecutive plugins sharing a sample rate, with the
+   resampler feeding it, if any, and buffers large enough for
+   whatever that resampler produces. */
+typedef struct {
+
+  unsigned long lFirstPlugin;
+  unsigned long lPluginCount;
+  unsigned long lSampleRate;
+
+  PluginChain sChain;
+  Resampler * psResampler;
+  LADSPA_Data ** ppfBuffers;
+  unsigned long lBufferFrames;
+
+} RateSection;
+
+/* Render with resampling in front of the chain, behind it and around
+   plugins that run at their own rates, all in the one streaming pass.
+   Each run of plugins at one rate is its own chain. The resamplers add
+   no delay, so the output lines up with the input. */
+static void
+applyPluginResampled(const char               * pcInputFilename,
+		     const char               * pcOutputFilename,
+		     const RenderOptions      * psOptions,
+		     const unsigned long        lPluginCount,
+		     const LADSPA_Descriptor ** ppsPluginDescriptors,
+		     LADSPA_Data             ** ppfPluginControlValues) {
+
+  LADSPA_Data ** ppfData;
+  LADSPA_Data ** ppfInput;
+  LADSPA_Data ** ppfOutput;
+  LADSPA_Data ** ppfPiece;
+  RateSection * psSection;
+  RateSection * psSections;
+  Resampler * psOutputResampler;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  unsigned long * plPluginRates;
+  unsigned long lBufferFrames;
+  unsigned long lChainRate;
+  unsigned long lChannelCount;
+  unsigned long lChannelIndex;
+  unsigned long lFrameCount;
+  unsigned long lInputLength;
+  unsigned long lOffset;
+  unsigned long lOutputFileLength;
+  unsigned long lPieceSize;
+  unsigned long lPluginIndex;
+  unsigned long lRateIndex;
+  unsigned long lReadSize;
+  unsigned long lSectionCount;
+  unsigned long lSectionIndex;
+  unsigned long lTimeAt;
+  unsigned long lWritten;
+
+  lOutputFileLength = openRenderFiles(pcInputFilename,
+				      pcOutputFilename,
+				      psOptions,
+				      lPluginCount,
+				      ppsPluginDescriptors,
+				      &sInputFile,
+				      &sOutputFile);
+
+  /* Work out the rate of every plugin and split the chain where it
+     changes:
+     ----------------------------------------------------------- */
+
+  lChainRate = getChainSampleRate(psOptions, sInputFile.lSampleRate);
+  plPluginRates = (unsigned long *)calloc(lPluginCount, sizeof(unsigned long));
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+    plPluginRates[lPluginIndex] = lChainRate;
+  for (lRateIndex = 0; lRateIndex < psOptions->lPluginRateCount; lRateIndex++) {
+    lPluginIndex = psOptions->plPluginRateIndices[lRateIndex];
+    if (lPluginIndex < 1 || lPluginIndex > lPluginCount) {
+      fprintf(stderr,
+	      "There is no plugin %lu to set the sample rate of.\n",
+	      lPluginIndex);
+      exit(1);
+    }
+    plPluginRates[lPluginIndex - 1] = psOptions->plPluginRates[lRateIndex];
+  }
+
+  psSections = (RateSection *)calloc(lPluginCount, sizeof(RateSection));
+  lSectionCount = 0;
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+    if (lPluginIndex == 0
+	|| plPluginRates[lPluginIndex] != plPluginRates[lPluginIndex - 1]) {
+      psSection = psSections + lSectionCount++;
+      psSection->lFirstPlugin = lPluginIndex;
+      psSection->lSampleRate = plPluginRates[lPluginIndex];
+    }
+    psSections[lSectionCount - 1].lPluginCount++;
+  }
+
+  /* Create the chains and the resamplers between them, sizing each
+     section's buffers for the most its resampler can produce from
+     the section before:
+     ------------------------------------------------------------- */
+
+  lBufferFrames = psOptions->lBlockSize;
+  lChannelCount = sInputFile.lChannelCount;
+  for (lSectionIndex = 0; lSectionIndex < lSectionCount; lSectionIndex++) {
+    psSection = psSections + lSectionIndex;
+
+    lPluginIndex = psSection->lFirstPlugin;
+    createPluginChain(&psSection->sChain,
+		      psSection->lPluginCount,
+		      ppsPluginDescriptors + lPluginIndex,
+		      ppfPluginControlValues + lPluginIndex,
+		      lChannelCount,
+		      psSection->lSampleRate);
+    activatePluginChain(&psSection->sChain);
+
+    if (psSection->lSampleRate
+	!= (lSectionIndex == 0
+	    ? sInputFile.lSampleRate
+	    : psSections[lSectionIndex - 1].lSampleRate)) {
+      psSection->psResampler
+	= createResampler(lChannelCount,
+			  (lSectionIndex == 0
+			   ? sInputFile.lSampleRate
+			   : psSections[lSectionIndex - 1].lSampleRate),
+			  psSection->lSampleRate,
+			  lBufferFrames);
+      lBufferFrames = getResamplerMaxOutput(psSection->psResampler,
+					    lBufferFrames);
+      printf("Resampling from %lu Hz to %lu Hz before plugin %lu "
+	     "(%lu phases of %lu taps).\n",
+	     psSection->psResampler->lInputRate,
+	     psSection->psResampler->lOutputRate,
+	     lPluginIndex + 1,
+	     psSection->psResampler->lUp,
+	     psSection->psResampler->lTapCount);
+    }
+
+    psSection->lBufferFrames = lBufferFrames;
+    psSection->ppfBuffers = allocateBuffers(psSection->sChain.lBufferCount,
+					    lBufferFrames,
+					    psOptions->bHugePages);
+    lChannelCount = psSection->sChain.lOutputCount;
+  }
+
+  psOutputResampler = NULL;
+  ppfOutput = NULL;
+  if (sOutputFile.lSampleRate != psSections[lSectionCount - 1].lSampleRate) {
+    psOutputResampler
+      = createResampler(lChannelCount,
+			psSections[lSectionCount - 1].lSampleRate,
+			sOutputFile.lSampleRate,
+			lBufferFrames);
+    lBufferFrames = getResamplerMaxOutput(psOutputResampler, lBufferFrames);
+    ppfOutput = allocateBuffers(lChannelCount,
+				lBufferFrames,
+				psOptions->bHugePages);
+    printf("Resampling from %lu Hz to %lu Hz for the output "
+	   "(%lu phases of %lu taps).\n",
+	   psOutputResampler->lInputRate,
+	   psOutputResampler->lOutputRate,
+	   psOutputResampler->lUp,
+	   psOutputResampler->lTapCount);
+  }
+
+  /* Input is read straight into the first chain unless it is
+     resampled first. */
+  if (psSections[0].psResampler)
+    ppfInput = allocateBuffers(sInputFile.lChannelCount,
+			       psOptions->lBlockSize,
+			       psOptions->bHugePages);
+  else
+    ppfInput = psSections[0].ppfBuffers;
+  ppfPiece = (LADSPA_Data **)calloc(lChannelCount, sizeof(LADSPA_Data *));
+
+  /* Run:
+     ---- */
+
+  /* After the input ends, silence is fed through until the output is
+     complete. That also flushes the resamplers. */
+  lInputLength = sInputFile.lLength;
+  lTimeAt = 0;
+  lWritten = 0;
+  while (lWritten < lOutputFileLength) {
+
+    lReadSize = readBlock(&sInputFile,
+			  lInputLength,
+			  lTimeAt,
+			  ppfInput,
+			  (psSections[0].psResampler
+			   ? sInputFile.lChannelCount
+			   : psSections[0].sChain.lBufferCount),
+			  psOptions->lBlockSize);
+    if (lInputLength == WAVE_LENGTH_UNKNOWN
+	&& lReadSize < psOptions->lBlockSize) {
+      lInputLength = lTimeAt + lReadSize;
+      lOutputFileLength = getOutputLength(psOptions,
+					  &sInputFile,
+					  lInputLength);
+    }
+    lTimeAt += psOptions->lBlockSize;
+
+    ppfData = ppfInput;
+    lFrameCount = psOptions->lBlockSize;
+    for (lSectionIndex = 0; lSectionIndex < lSectionCount; lSectionIndex++) {
+      psSection = psSections + lSectionIndex;
+      if (psSection->psResampler)
+	lFrameCount = runResampler(psSection->psResampler,
+				   ppfData,
+				   lFrameCount,
+				   psSection->ppfBuffers);
+      processPluginChain(&psSection->sChain,
+			 psSection->ppfBuffers,
+			 lFrameCount,
+			 psOptions->lSubBlockSize);
+      ppfData = psSection->ppfBuffers;
+    }
+    if (psOutputResampler) {
+      lFrameCount = runResampler(psOutputResampler,
+				 ppfData,
+				 lFrameCount,
+				 ppfOutput);
+      ppfData = ppfOutput;
+    }
+
+    /* Write out what is due, no more than a block at a time. */
+    if (lFrameCount > lOutputFileLength - lWritten)
+      lFrameCount = lOutputFileLength - lWritten;
+    for (lOffset = 0; lOffset < lFrameCount; lOffset += lPieceSize) {
+      lPieceSize = lFrameCount - lOffset;
+      if (lPieceSize > psOptions->lBlockSize)
+	lPieceSize = psOptions->lBlockSize;
+      for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++)
+	ppfPiece[lChannelIndex] = ppfData[lChannelIndex] + lOffset;
+      writeWaveFile(&sOutputFile, ppfPiece, lPieceSize);
+    }
+    lWritten += lFrameCount;
+  }
+
+  /* Clean up:
+     --------- */
+
+  if (psSections[0].psResampler)
+    freeBuffers(ppfInput);
+  for (lSectionIndex = 0; lSectionIndex < lSectionCount; lSectionIndex++) {
+    psSection = psSections + lSectionIndex;
+    freeBuffers(psSection->ppfBuffers);
+    if (psSection->psResampler)
+      destroyResampler(psSection->psResampler);
+    deactivatePluginChain(&psSection->sChain);
+    destroyPluginChain(&psSection->sChain);
+  }
+  if (psOutputResampler) {
+    freeBuffers(ppfOutput);
+    destroyResampler(psOutputResampler);
+  }
+  free(ppfPiece);
+  free(psSections);
+  free(plPluginRates);
+
+  closeWaveFile(&sInputFile);
+  closeWaveFile(&sOutputFile);
+  printf("Peak output: %g\n", sOutputFile.fPeak * 32767.5f);
+}
+
+/*****************************************************************************/
+
+/* State shared by the threads of a chunked render. */
+typedef struct {
+
+  const char * pcInputFilename;
+  WaveFile * psOutputFile;
+  unsigned long lWarmUpLength;
+
+  const RenderOptions * psOptions;
+  unsigned long lPluginCount;
+  const LADSPA_Descriptor ** ppsPluginDescriptors;
+  LADSPA_Data ** ppfPluginControlValues;
+
+} ChunkedRender;
+
+/* One time range of the output, rendered by its own thread with its
+   own chain. */
+typedef struct {
+
+  ChunkedRender * psRender;
+  unsigned long lStart;
+  unsigned long lEnd;
+  LADSPA_Data fPeak;
+  pthread_t sThread;
+
+} RenderChunk;
+
+/* Render one chunk. The chain starts lWarmUpLength frames early so
+   that filter and delay state has settled by the start of the chunk;
+   output from the warm-up is thrown away. */
+static void *
+chunkWorker(void * pvChunk) {
+
+  ChunkedRender * psRender;
+  LADSPA_Data ** ppfBuffers;
+  LADSPA_Data ** ppfWrite;
+  PluginChain sChain;
+  RenderChunk * psChunk;
+  WaveFile sInputFile;
+  unsigned long lBlockSize;
+  unsigned long lBufferIndex;
+  unsigned long lFrameSize;
+  unsigned long lSkip;
+  unsigned long lTimeAt;
+
+  psChunk = (RenderChunk *)pvChunk;
+  psRender = psChunk->psRender;
+  lBlockSize = psRender->psOptions->lBlockSize;
+
+  /* Each chunk reads the input through its own handle. */
+  openWaveFile(&sInputFile, psRender->pcInputFilename, lBlockSize);
+  createPluginChain(&sChain,
+		    psRender->lPluginCount,
+		    psRender->ppsPluginDescriptors,
+		    psRender->ppfPluginControlValues,
+		    sInputFile.lChannelCount,
+		    sInputFile.lSampleRate);
+  ppfBuffers = allocateBuffers(sChain.lBufferCount,
+			       lBlockSize,
+			       psRender->psOptions->bHugePages);
+  ppfWrite = (LADSPA_Data **)calloc(sChain.lBufferCount,
+				    sizeof(LADSPA_Data *));
+
+  lTimeAt = (psChunk->lStart > psRender->lWarmUpLength
+	     ? psChunk->lStart - psRender->lWarmUpLength
+	     : 0);
+  if (lTimeAt < sInputFile.lLength)
+    seekWaveFile(&sInputFile, lTimeAt);
+
+  activatePluginChain(&sChain);
+  while (lTimeAt < psChunk->lEnd) {
+
+    readBlock(&sInputFile,
+	      sInputFile.lLength,
+	      lTimeAt,
+	      ppfBuffers,
+	      sChain.lBufferCount,
+	      lBlockSize);
+
+    lFrameSize = psChunk->lEnd - lTimeAt;
+    if (lFrameSize > lBlockSize)
+      lFrameSize = lBlockSize;
+    processPluginChain(&sChain,
+		       ppfBuffers,
+		       lFrameSize,
+		       psRender->psOptions->lSubBlockSize);
+
+    if (lTimeAt + lFrameSize > psChunk->lStart) {
+      lSkip = (psChunk->lStart > lTimeAt ? psChunk->lStart - lTimeAt : 0);
+      for (lBufferIndex = 0; lBufferIndex < sChain.lBufferCount; lBufferIndex++)
+	ppfWrite[lBufferIndex] = ppfBuffers[lBufferIndex] + lSkip;
+      writeWaveFileAt(psRender->psOutputFile,
+		      ppfWrite,
+		      lFrameSize - lSkip,
+		      lTimeAt + lSkip,
+		      &psChunk->fPeak);
+    }
+
+    lTimeAt += lFrameSize;
+  }
+  deactivatePluginChain(&sChain);
+
+  destroyPluginChain(&sChain);
+  freeBuffers(ppfBuffers);
+  free(ppfWrite);
+  closeWaveFile(&sInputFile);
+
+  return NULL;
+}
+
+/* Render the output again serially and compare it with what the
+   chunked render wrote, reporting the worst error after each seam.
+   The serial render is passed through the output sample format so
+   that only differences the file can hold are counted. */
+static void
+verifySeams(const char               * pcInputFilename,
+	    const char               * pcOutputFilename,
+	    const RenderChunk        * psChunks,
+	    const unsigned long        lChunkCount,
+	    const RenderOptions      * psOptions,
+	    const unsigned long        lPluginCount,
+	    const LADSPA_Descriptor ** ppsPluginDescriptors,
+	    LADSPA_Data             ** ppfPluginControlValues) {
+
+  LADSPA_Data ** ppfBuffers;
+  LADSPA_Data ** ppfWritten;
+  LADSPA_Data * pfChunkError;
+  LADSPA_Data fError;
+  LADSPA_Data fWorst;
+  PluginChain sChain;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  unsigned long * plFirstError;
+  unsigned long lChannelIndex;
+  unsigned long lChunkIndex;
+  unsigned long lFrameIndex;
+  unsigned long lFrameSize;
+  unsigned long lTimeAt;
+
+  openWaveFile(&sInputFile, pcInputFilename, psOptions->lBlockSize);
+  openWaveFile(&sOutputFile, pcOutputFilename, psOptions->lBlockSize);
+  createPluginChain(&sChain,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues,
+		    sInputFile.lChannelCount,
+		    sInputFile.lSampleRate);
+  ppfBuffers = allocateBuffers(sChain.lBufferCount,
+			       psOptions->lBlockSize,
+			       psOptions->bHugePages);
+  ppfWritten = allocateBuffers(sOutputFile.lChannelCount,
+			       psOptions->lBlockSize,
+			       psOptions->bHugePages);
+  pfChunkError = (LADSPA_Data *)calloc(lChunkCount, sizeof(LADSPA_Data));
+  plFirstError = (unsigned long *)calloc(lChunkCount, sizeof(unsigned long));
+
+  activatePluginChain(&sChain);
+  lChunkIndex = 0;
+  lTimeAt = 0;
+  while (lTimeAt < sOutputFile.lLength) {
+
+    readBlock(&sInputFile,
+	      sInputFile.lLength,
+	      lTimeAt,
+	      ppfBuffers,
+	      sChain.lBufferCount,
+	      psOptions->lBlockSize);
+    lFrameSize = sOutputFile.lLength - lTimeAt;
+    if (lFrameSize > psOptions->lBlockSize)
+      lFrameSize = psOptions->lBlockSize;
+    processPluginChain(&sChain,
+		       ppfBuffers,
+		       lFrameSize,
+		       psOptions->lSubBlockSize);
+    quantizeWaveSamples(sOutputFile.iSampleFormat,
+			ppfBuffers,
+			sOutputFile.lChannelCount,
+			lFrameSize);
+    readWaveFile(&sOutputFile, ppfWritten, lFrameSize);
+
+    for (lFrameIndex = 0; lFrameIndex < lFrameSize; lFrameIndex++) {
+      while (lTimeAt + lFrameIndex >= psChunks[lChunkIndex].lEnd)
+	lChunkIndex++;
+      for (lChannelIndex = 0;
+	   lChannelIndex < sOutputFile.lChannelCount;
+	   lChannelIndex++) {
+	fError = fabsf(ppfBuffers[lChannelIndex][lFrameIndex]
+		       - ppfWritten[lChannelIndex][lFrameIndex]);
+	if (fError > pfChunkError[lChunkIndex]) {
+	  if (pfChunkError[lChunkIndex] == 0)
+	    plFirstError[lChunkIndex] = lTimeAt + lFrameIndex;
+	  pfChunkError[lChunkIndex] = fError;
+	}
+      }
+    }
+
+    lTimeAt += lFrameSize;
+  }
+  deactivatePluginChain(&sChain);
+
+  fWorst = 0;
+  for (lChunkIndex = 1; lChunkIndex < lChunkCount; lChunkIndex++) {
+    if (pfChunkError[lChunkIndex] > 0)
+      printf("Seam %lu at frame %lu: max error %g (%.1f dBFS), "
+	     "first error at frame %lu.\n",
+	     lChunkIndex,
+	     psChunks[lChunkIndex].lStart,
+	     pfChunkError[lChunkIndex],
+	     20 * log10(pfChunkError[lChunkIndex]),
+	     plFirstError[lChunkIndex]);
+    else
+      printf("Seam %lu at frame %lu: exact.\n",
+	     lChunkIndex,
+	     psChunks[lChunkIndex].lStart);
+    if (pfChunkError[lChunkIndex] > fWorst)
+      fWorst = pfChunkError[lChunkIndex];
+  }
+  if (fWorst > 0)
+    printf("Chunked render differs from serial render by up to %g "
+	   "(%.1f dBFS).\n",
+	   fWorst,
+	   20 * log10(fWorst));
+  else
+    printf("Chunked render matches serial render exactly.\n");
+
+  destroyPluginChain(&sChain);
+  freeBuffers(ppfBuffers);
+  freeBuffers(ppfWritten);
+  free(pfChunkError);
+  free(plFirstError);
+  closeWaveFile(&sInputFile);
+  closeWaveFile(&sOutputFile);
+}
+
+/* Split the output into lChunkCount time ranges and render each on
+   its own thread with its own chain, writing straight into the
+   memory-mapped output file. */
+static void
+applyPluginChunked(const char               * pcInputFilename,
+		   const char               * pcOutputFilename,
+		   const RenderOptions      * psOptions,
+		   const unsigned long        lPluginCount,
+		   const LADSPA_Descriptor ** ppsPluginDescriptors,
+		   LADSPA_Data             ** ppfPluginControlValues) {
+
+  ChunkedRender sRender;
+  LADSPA_Data ** ppfBuffers;
+  LADSPA_Data fPeak;
+  PluginChain sChain;
+  RenderChunk * psChunks;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  unsigned long lChunkCount;
+  unsigned long lChunkIndex;
+  unsigned long lOutputFileLength;
+
+  lOutputFileLength = openRenderFiles(pcInputFilename,
+				      pcOutputFilename,
+				      psOptions,
+				      lPluginCount,
+				      ppsPluginDescriptors,
+				      &sInputFile,
+				      &sOutputFile);
+
+  /* Every chunk gets at least a block. */
+  lChunkCount = ((lOutputFileLength + psOptions->lBlockSize - 1)
+		 / psOptions->lBlockSize);
+  if (lChunkCount > psOptions->lChunkCount)
+    lChunkCount = psOptions->lChunkCount;
+
+  if (lChunkCount < 2 || !sOutputFile.pucMap) {
+    if (!sOutputFile.pucMap)
+      printf("Output file cannot be memory-mapped, rendering serially.\n");
+    createPluginChain(&sChain,
+		      lPluginCount,
+		      ppsPluginDescriptors,
+		      ppfPluginControlValues,
+		      sInputFile.lChannelCount,
+		      sInputFile.lSampleRate);
+    ppfBuffers = allocateBuffers(sChain.lBufferCount,
+				 psOptions->lBlockSize,
+				 psOptions->bHugePages);
+    activatePluginChain(&sChain);
+    renderFile(&sChain,
+	       &sInputFile,
+	       &sOutputFile,
+	       lOutputFileLength,
+	       ppfBuffers,
+	       psOptions,
+	       NULL);
+    deactivatePluginChain(&sChain);
+    destroyPluginChain(&sChain);
+    freeBuffers(ppfBuffers);
+    closeWaveFile(&sInputFile);
+    closeWaveFile(&sOutputFile);
+    printf("Peak output: %g\n", sOutputFile.fPeak * 32767.5f);
+    return;
+  }
+
+  sRender.pcInputFilename = pcInputFilename;
+  sRender.psOutputFile = &sOutputFile;
+  sRender.lWarmUpLength = (unsigned long)(psOptions->fWarmUpSeconds
+					  * sInputFile.lSampleRate);
+  sRender.psOptions = psOptions;
+  sRender.lPluginCount = lPluginCount;
+  sRender.ppsPluginDescriptors = ppsPluginDescriptors;
+  sRender.ppfPluginControlValues = ppfPluginControlValues;
+
+  /* The chunks open the input themselves. */
+  closeWaveFile(&sInputFile);
+
+  psChunks = (RenderChunk *)calloc(lChunkCount, sizeof(RenderChunk));
+  for (lChunkIndex = 0; lChunkIndex < lChunkCount; lChunkIndex++) {
+    psChunks[lChunkIndex].psRender = &sRender;
+    psChunks[lChunkIndex].lStart
+      = lOutputFileLength / lChunkCount * lChunkIndex;
+    psChunks[lChunkIndex].lEnd
+      = (lChunkIndex + 1 < lChunkCount
+	 ? lOutputFileLength / lChunkCount * (lChunkIndex + 1)
+	 : lOutputFileLength);
+    if (pthread_create(&psChunks[lChunkIndex].sThread,
+		       NULL,
+		       chunkWorker,
+		       psChunks + lChunkIndex) != 0) {
+      fprintf(stderr, "Failed to start chunk threads.\n");
+      exit(1);
+    }
+  }
+
+  fPeak = 0;
+  for (lChunkIndex = 0; lChunkIndex < lChunkCount; lChunkIndex++) {
+    pthread_join(psChunks[lChunkIndex].sThread, NULL);
+    if (psChunks[lChunkIndex].fPeak > fPeak)
+      fPeak = psChunks[lChunkIndex].fPeak;
+  }
+
+  printf("Rendered %lu chunks of about %lu frames, each with %lu frames "
+	 "of warm-up.\n",
+	 lChunkCount,
+	 lOutputFileLength / lChunkCount,
+	 sRender.lWarmUpLength);
+
+  seekWaveFile(&sOutputFile, lOutputFileLength);
+  closeWaveFile(&sOutputFile);
+
+  if (psOptions->bVerifySeams)
+    verifySeams(pcInputFilename,
+		pcOutputFilename,
+		psChunks,
+		lChunkCount,
+		psOptions,
+		lPluginCount,
+		ppsPluginDescriptors,
+		ppfPluginControlValues);
+
+  free(psChunks);
+
+  /* Reported in 16bit sample units as it always has been. */
+  printf("Peak output: %g\n", fPeak * 32767.5f);
+}
+
+/*****************************************************************************/
+
+/* One file to render in batch mode. */
+typedef struct {
+  char * pcInputFilename;
+  char * pcOutputFilename;
+} BatchJob;
+
+/* State shared by batch workers. Jobs are handed out in order
+   through lNextJob. */
+typedef struct {
+
+  BatchJob * psJobs;
+  unsigned long lJobCount;
+  unsigned long lNextJob;
+
+  const RenderOptions * psOptions;
+  unsigned long lPluginCount;
+  const LADSPA_Descriptor ** ppsPluginDescriptors;
+  LADSPA_Data ** ppfPluginControlValues;
+
+  /* Totals for the summary, updated atomically. */
+  unsigned long lFramesRendered;
+  unsigned long lInstantiations;
+  unsigned long lFailedJobs;
+
+} Batch;
+
+static char *
+joinPath(const char * pcDirectory, const char * pcName) {
+
+  char * pcPath;
+
+  pcPath = (char *)malloc(strlen(pcDirectory) + strlen(pcName) + 2);
+  strcpy(pcPath, pcDirectory);
+  if (pcPath[0] != '\0' && pcPath[strlen(pcPath) - 1] != '/')
+    strcat(pcPath, "/");
+  strcat(pcPath, pcName);
+
+  return pcPath;
+}
+
+static void
+addBatchJob(BatchJob ** ppsJobs,
+	    unsigned long * plJobCount,
+	    char * pcInputFilename,
+	    char * pcOutputFilename) {
+
+  /* Grow by doubling. */
+  if ((*plJobCount & (*plJobCount - 1)) == 0)
+    *ppsJobs = (BatchJob *)realloc(*ppsJobs,
+				   (*plJobCount ? *plJobCount * 2 : 1)
+				   * sizeof(BatchJob));
+  (*ppsJobs)[*plJobCount].pcInputFilename = pcInputFilename;
+  (*ppsJobs)[*plJobCount].pcOutputFilename = pcOutputFilename;
+  (*plJobCount)++;
+}
+
+static int
+compareBatchJobs(const void * pvA, const void * pvB) {
+  return strcmp(((const BatchJob *)pvA)->pcInputFilename,
+		((const BatchJob *)pvB)->pcInputFilename);
+}
+
+/* Build the list of files to render. pcBatch is either a directory,
+   in which case every .wav file in it is rendered to the same name in
+   pcOutputDirectory, or a text file with one job per line: an input
+   file and an output file separated by a tab (or, if there is no tab,
+   by the first space). Lines giving only an input file write to the
+   same name in pcOutputDirectory. Blank lines and lines starting with
+   '#' are ignored. A job that would write over its own input is
+   refused. Errors are handled by writing a message to stderr and
+   calling exit(1). */
+static BatchJob *
+readBatchJobs(const char * pcBatch,
+	      const char * pcOutputDirectory,
+	      unsigned long * plJobCount) {
+
+  BatchJob * psJobs;
+  DIR * psDirectory;
+  FILE * poList;
+  char * pcInputPath;
+  char * pcLine;
+  char * pcOutputPath;
+  char * pcSeparator;
+  const char * pcName;
+  unsigned long lJobIndex;
+  size_t lLineSize;
+  ssize_t lLineLength;
+  struct dirent * psEntry;
+  struct stat sStat;
+
+  psJobs = NULL;
+  *plJobCount = 0;
+
+  if (stat(pcBatch, &sStat) == 0 && S_ISDIR(sStat.st_mode)) {
+
+    if (!pcOutputDirectory) {
+      fprintf(stderr,
+	      "An output directory is needed to render directory \"%s\".\n",
+	      pcBatch);
+      exit(1);
+    }
+    pcInputPath = realpath(pcBatch, NULL);
+    pcOutputPath = realpath(pcOutputDirectory, NULL);
+    if (pcInputPath && pcOutputPath && strcmp(pcInputPath, pcOutputPath) == 0) {
+      fprintf(stderr,
+	      "The output directory \"%s\" is the input directory.\n",
+	      pcOutputDirectory);
+      exit(1);
+    }
+    free(pcInputPath);
+    free(pcOutputPath);
+    psDirectory = opendir(pcBatch);
+    if (!psDirectory) {
+      fprintf(stderr, "Failed to read directory \"%s\".\n", pcBatch);
+      exit(1);
+    }
+    while ((psEntry = readdir(psDirectory)) != NULL) {
+      pcName = psEntry->d_name;
+      if (strlen(pcName) > 4
+	  && strcasecmp(pcName + strlen(pcName) - 4, ".wav") == 0)
+	addBatchJob(&psJobs,
+		    plJobCount,
+		    joinPath(pcBatch, pcName),
+		    joinPath(pcOutputDirectory, pcName));
+    }
+    closedir(psDirectory);
+
+    /* Directory order is arbitrary. */
+    qsort(psJobs, *plJobCount, sizeof(BatchJob), compareBatchJobs);
+  }
+  else {
+
+    poList = fopen(pcBatch, "r");
+    if (!poList) {
+      fprintf(stderr, "Failed to open batch list \"%s\".\n", pcBatch);
+      exit(1);
+    }
+    pcLine = NULL;
+    lLineSize = 0;
+    while ((lLineLength = getline(&pcLine, &lLineSize, poList)) >= 0) {
+
+      while (lLineLength > 0
+	     && (pcLine[lLineLength - 1] == '\n'
+		 || pcLine[lLineLength - 1] == '\r'))
+	pcLine[--lLineLength] = '\0';
+      if (lLineLength == 0 || pcLine[0] == '#')
+	continue;
+
+      pcSeparator = strchr(pcLine, '\t');
+      if (!pcSeparator)
+	pcSeparator = strchr(pcLine, ' ');
+      if (pcSeparator) {
+	*pcSeparator = '\0';
+	addBatchJob(&psJobs,
+		    plJobCount,
+		    strdup(pcLine),
+		    strdup(pcSeparator + 1));
+      }
+      else if (pcOutputDirectory) {
+	pcName = strrchr(pcLine, '/');
+	addBatchJob(&psJobs,
+		    plJobCount,
+		    strdup(pcLine),
+		    joinPath(pcOutputDirectory, pcName ? pcName + 1 : pcLine));
+      }
+      else {
+	fprintf(stderr,
+		"No output file given for \"%s\" in batch list \"%s\".\n",
+		pcLine,
+		pcBatch);
+	exit(1);
+      }
+    }
+    free(pcLine);
+    fclose(poList);
+  }
+
+  if (*plJobCount == 0) {
+    fprintf(stderr, "No files to render in \"%s\".\n", pcBatch);
+    exit(1);
+  }
+
+  /* An output that does not exist yet cannot be its input. */
+  for (lJobIndex = 0; lJobIndex < *plJobCount; lJobIndex++) {
+    pcInputPath = realpath(psJobs[lJobIndex].pcInputFilename, NULL);
+    pcOutputPath = realpath(psJobs[lJobIndex].pcOutputFilename, NULL);
+    if (pcInputPath && pcOutputPath && strcmp(pcInputPath, pcOutputPath) == 0) {
+      fprintf(stderr,
+	      "Batch job \"%s\" would write over its own input.\n",
+	      psJobs[lJobIndex].pcInputFilename);
+      exit(1);
+    }
+    free(pcInputPath);
+    free(pcOutputPath);
+  }
+
+  return psJobs;
+}
+
+/* Report a batch job that failed and count it, removing its partial
+   output if one was created. The rest of the batch carries on. */
+static void
+failBatchJob(Batch * psBatch,
+	     const BatchJob * psJob,
+	     const char * pcError,
+	     const int bRemoveOutput) {
+  fprintf(stderr, "%s: %s\n", psJob->pcInputFilename, pcError);
+  if (bRemoveOutput && strcmp(psJob->pcOutputFilename, "-") != 0)
+    unlink(psJob->pcOutputFilename);
+  __atomic_fetch_add(&psBatch->lFailedJobs, 1, __ATOMIC_RELAXED);
+}
+
+/* Batch worker. Each worker owns a chain of instances which is only
+   activated and deactivated between files, and is instantiated again
+   only when the sample rate changes. */
+static void *
+batchWorker(void * pvBatch) {
+
+  Batch * psBatch;
+  BatchJob * psJob;
+  LADSPA_Data ** ppfBuffers;
+  PluginChain sChain;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  char pcError[WAVE_ERROR_SIZE];
+  int bHaveChain;
+  int iError;
+  unsigned long lJobIndex;
+  unsigned long lOutputFileLength;
+
+  psBatch = (Batch *)pvBatch;
+  bHaveChain = 0;
+  ppfBuffers = NULL;
+
+  while ((lJobIndex = __atomic_fetch_add(&psBatch->lNextJob,
+					 1,
+					 __ATOMIC_RELAXED))
+	 < psBatch->lJobCount) {
+
+    psJob = psBatch->psJobs + lJobIndex;
+    if (tryOpenRenderFiles(psJob->pcInputFilename,
+			   psJob->pcOutputFilename,
+			   psBatch->psOptions,
+			   psBatch->lPluginCount,
+			   psBatch->ppsPluginDescriptors,
+			   &sInputFile,
+			   &sOutputFile,
+			   &lOutputFileLength,
+			   pcError,
+			   sizeof(pcError)) != 0) {
+      failBatchJob(psBatch, psJob, pcError, 0);
+      continue;
+    }
+
+    if (bHaveChain
+	&& (sChain.lSampleRate != sInputFile.lSampleRate
+	    || sChain.lInputCount != sInputFile.lChannelCount)) {
+      destroyPluginChain(&sChain);
+      freeBuffers(ppfBuffers);
+      bHaveChain = 0;
+    }
+    if (!bHaveChain) {
+      if (tryCreatePluginChain(&sChain,
+			       psBatch->lPluginCount,
+			       psBatch->ppsPluginDescriptors,
+			       psBatch->ppfPluginControlValues,
+			       sInputFile.lChannelCount,
+			       sInputFile.lSampleRate,
+			       pcError,
+			       sizeof(pcError)) != 0) {
+	tryCloseWaveFile(&sInputFile);
+	tryCloseWaveFile(&sOutputFile);
+	failBatchJob(psBatch, psJob, pcError, 1);
+	continue;
+      }
+      ppfBuffers = allocateBuffers(sChain.lBufferCount,
+				   psBatch->psOptions->lBlockSize,
+				   psBatch->psOptions->bHugePages);
+      bHaveChain = 1;
+      __atomic_fetch_add(&psBatch->lInstantiations, 1, __ATOMIC_RELAXED);
+    }
+
+    activatePluginChain(&sChain);
+    iError = tryRenderFile(&sChain,
+			   &sInputFile,
+			   &sOutputFile,
+			   lOutputFileLength,
+			   ppfBuffers,
+			   psBatch->psOptions,
+			   NULL,
+			   pcError,
+			   sizeof(pcError));
+    deactivatePluginChain(&sChain);
+
+    tryCloseWaveFile(&sInputFile);
+    if (tryCloseWaveFile(&sOutputFile) != 0 && iError == 0) {
+      snprintf(pcError, sizeof(pcError), "%s", sOutputFile.pcError);
+      iError = -1;
+    }
+    if (iError != 0) {
+      failBatchJob(psBatch, psJob, pcError, 1);
+      continue;
+    }
+    __atomic_fetch_add(&psBatch->lFramesRendered,
+		       sOutputFile.lFramePosition,
+		       __ATOMIC_RELAXED);
+
+    /* Reported in 16bit sample units as it always has been. */
+    printf("%s: peak output %g\n",
+	   psJob->pcOutputFilename,
+	   sOutputFile.fPeak * 32767.5f);
+  }
+
+  if (bHaveChain) {
+    destroyPluginChain(&sChain);
+    freeBuffers(ppfBuffers);
+  }
+
+  return NULL;
+}
+
+/* Render every file listed by pcBatch (see readBatchJobs()) through
+   the same chain, with lWorkerCount threads each owning a set of
+   instances. Plugin libraries are loaded once by the caller. Returns
+   1 if any file failed to render, otherwise 0. */
+static int
+applyPluginBatch(const char               * pcBatch,
+		 const char               * pcOutputDirectory,
+		 unsigned long              lWorkerCount,
+		 const RenderOptions      * psOptions,
+		 const unsigned long        lPluginCount,
+		 const LADSPA_Descriptor ** ppsPluginDescriptors,
+		 LADSPA_Data             ** ppfPluginControlValues) {
+
+  Batch sBatch;
+  double dSeconds;
+  pthread_t * psWorkers;
+  unsigned long lJobIndex;
+  unsigned long lWorkerIndex;
+
+  memset(&sBatch, 0, sizeof(sBatch));
+  sBatch.psJobs = readBatchJobs(pcBatch, pcOutputDirectory, &sBatch.lJobCount);
+  sBatch.psOptions = psOptions;
+  sBatch.lPluginCount = lPluginCount;
+  sBatch.ppsPluginDescriptors = ppsPluginDescriptors;
+  sBatch.ppfPluginControlValues = ppfPluginControlValues;
+
+  if (lWorkerCount > sBatch.lJobCount)
+    lWorkerCount = sBatch.lJobCount;
+
+  dSeconds = -getSeconds();
+  psWorkers = (pthread_t *)calloc(lWorkerCount, sizeof(pthread_t));
+  for (lWorkerIndex = 0; lWorkerIndex < lWorkerCount; lWorkerIndex++)
+    if (pthread_create(psWorkers + lWorkerIndex,
+		       NULL,
+		       batchWorker,
+		       &sBatch) != 0) {
+      fprintf(stderr, "Failed to start batch workers.\n");
+      exit(1);
+    }
+  for (lWorkerIndex = 0; lWorkerIndex < lWorkerCount; lWorkerIndex++)
+    pthread_join(psWorkers[lWorkerIndex], NULL);
+  dSeconds += getSeconds();
+
+  printf("Rendered %lu files (%lu frames) in %.2f seconds with %lu "
+	 "workers and %lu sets of instances.\n",
+	 sBatch.lJobCount - sBatch.lFailedJobs,
+	 sBatch.lFramesRendered,
+	 dSeconds,
+	 lWorkerCount,
+	 sBatch.lInstantiations);
+  if (sBatch.lFailedJobs > 0)
+    fprintf(stderr,
+	    "%lu of %lu files failed to render.\n",
+	    sBatch.lFailedJobs,
+	    sBatch.lJobCount);
+
+  for (lJobIndex = 0; lJobIndex < sBatch.lJobCount; lJobIndex++) {
+    free(sBatch.psJobs[lJobIndex].pcInputFilename);
+    free(sBatch.psJobs[lJobIndex].pcOutputFilename);
+  }
+  free(sBatch.psJobs);
+  free(psWorkers);
+
+  return (sBatch.lFailedJobs > 0);
+}
+
+/*****************************************************************************/
+
+/* One point of a parameter sweep: a chain of its own with its own
+   output file and control log. */
+typedef struct {
+  PluginChain sChain;
+  LADSPA_Data ** ppfBuffers;
+  WaveFile sOutputFile;
+  char * pcOutputFilename;
+  char * pcControlLogFilename;
+} SweepChain;
+
+/* State shared by sweep workers. The reader decodes each block once
+   into one of two input buffers while the workers run the chains on
+   the other, and all meet at sBarrier between blocks. */
+typedef struct {
+
+  SweepChain * psChains;
+  unsigned long lChainCount;
+  unsigned long lWorkerCount;
+
+  LADSPA_Data ** pppfInput[2];
+  unsigned long lInputChannelCount;
+  unsigned long lOutputFileLength;
+
+  const RenderOptions * psOptions;
+  pthread_barrier_t sBarrier;
+
+} SweepRender;
+
+typedef struct {
+  SweepRender * psRender;
+  unsigned long lWorkerIndex;
+} SweepWorker;
+
+/* The name of a sweep output: pcTemplate with the point number,
+   counting from 1 and padded to the width of lPointCount, inserted
+   before its extension. */
+static char *
+getSweepFilename(const char * pcTemplate,
+		 const unsigned long lPoint,
+		 const unsigned long lPointCount) {
+
+  char * pcFilename;
+  const char * pcExtension;
+  const char * pcSlash;
+  int iWidth;
+
+  iWidth = snprintf(NULL, 0, "%lu", lPointCount);
+  pcExtension = strrchr(pcTemplate, '.');
+  pcSlash = strrchr(pcTemplate, '/');
+  if (!pcExtension || (pcSlash && pcExtension < pcSlash))
+    pcExtension = pcTemplate + strlen(pcTemplate);
+
+  pcFilename = (char *)malloc(strlen(pcTemplate) + iWidth + 24);
+  sprintf(pcFilename,
+	  "%.*s.%0*lu%s",
+	  (int)(pcExtension - pcTemplate),
+	  pcTemplate,
+	  iWidth,
+	  lPoint + 1,
+	  pcExtension);
+
+  return pcFilename;
+}
+
+/* Sweep worker. Chains are dealt out to workers in turn, so each
+   chain stays on one thread for the whole render. */
+static void *
+sweepWorker(void * pvWorker) {
+
+  LADSPA_Data ** ppfInput;
+  SweepChain * psChain;
+  SweepRender * psRender;
+  SweepWorker * psWorker;
+  unsigned long lBlockIndex;
+  unsigned long lBlockSize;
+  unsigned long lChainIndex;
+  unsigned long lChannelIndex;
+  unsigned long lFrameSize;
+  unsigned long lTimeAt;
+
+  psWorker = (SweepWorker *)pvWorker;
+  psRender = psWorker->psRender;
+  lBlockSize = psRender->psOptions->lBlockSize;
+
+  for (lBlockIndex = 0, lTimeAt = 0;; lBlockIndex++, lTimeAt += lFrameSize) {
+
+    /* Wait for the block to be decoded. */
+    pthread_barrier_wait(&psRender->sBarrier);
+    if (lTimeAt >= psRender->lOutputFileLength)
+      break;
+
+    lFrameSize = psRender->lOutputFileLength - lTimeAt;
+    if (lFrameSize > lBlockSize)
+      lFrameSize = lBlockSize;
+    ppfInput = psRender->pppfInput[lBlockIndex % 2];
+
+    for (lChainIndex = psWorker->lWorkerIndex;
+	 lChainIndex < psRender->lChainCount;
+	 lChainIndex += psRender->lWorkerCount) {
+      psChain = psRender->psChains + lChainIndex;
+      for (lChannelIndex = 0;
+	   lChannelIndex < psRender->lInputChannelCount;
+	   lChannelIndex++)
+	memcpy(psChain->ppfBuffers[lChannelIndex],
+	       ppfInput[lChannelIndex],
+	       lFrameSize * sizeof(LADSPA_Data));
+      processPluginChain(&psChain->sChain,
+			 psChain->ppfBuffers,
+			 lFrameSize,
+			 psRender->psOptions->lSubBlockSize);
+      writeWaveFile(&psChain->sOutputFile, psChain->ppfBuffers, lFrameSize);
+    }
+  }
+
+  return NULL;
+}
+
+/* Render every point of the sweep in pcSweepFilename, decoding the
+   input only once. Each point gets its own chain, output file and
+   control log, named after pcOutputFilename and the control log file
+   with the point number added, and the chains are run on
+   lWorkerCount threads. */
+static void
+applyPluginSweep(const char               * pcSweepFilename,
+		 const char               * pcInputFilename,
+		 const char               * pcOutputFilename,
+		 unsigned long              lWorkerCount,
+		 const RenderOptions      * psOptions,
+		 const unsigned long        lPluginCount,
+		 const LADSPA_Descriptor ** ppsPluginDescriptors,
+		 LADSPA_Data             ** ppfPluginControlValues) {
+
+  ParameterSweep sSweep;
+  SweepChain * psChain;
+  SweepRender sRender;
+  SweepWorker * psWorkers;
+  WaveFile sInputFile;
+  double dSeconds;
+  int iOutputSampleFormat;
+  pthread_t * psThreads;
+  unsigned long lBlockIndex;
+  unsigned long lChainIndex;
+  unsigned long lOutputFileChannelCount;
+  unsigned long lTimeAt;
+  unsigned long lWorkerIndex;
+
+  loadParameterSweep(&sSweep,
+		     pcSweepFilename,
+		     lPluginCount,
+		     ppsPluginDescriptors,
+		     ppfPluginControlValues);
+
+  openWaveFile(&sInputFile, pcInputFilename, psOptions->lBlockSize);
+  lOutputFileChannelCount
+    = getPluginChainOutputCount(lPluginCount,
+				ppsPluginDescriptors,
+				sInputFile.lChannelCount);
+  if (lOutputFileChannelCount == 0) {
+    fprintf(stderr,
+	    "The last plugin in the chain has no audio outputs.\n");
+    exit(1);
+  }
+  iOutputSampleFormat = (psOptions->iOutputSampleFormat != WAVE_SAMPLE_NONE
+			 ? psOptions->iOutputSampleFormat
+			 : sInputFile.iSampleFormat);
+  /* Every point's file is created at its full length up front. */
+  if (sInputFile.lLength == WAVE_LENGTH_UNKNOWN) {
+    fprintf(stderr,
+	    "Input \"%s\" is a stream of unknown length, which cannot be "
+	    "swept.\n",
+	    pcInputFilename);
+    exit(1);
+  }
+
+  memset(&sRender, 0, sizeof(sRender));
+  sRender.lChainCount = sSweep.lPointCount;
+  sRender.lWorkerCount = (lWorkerCount < sSweep.lPointCount
+			  ? lWorkerCount
+			  : sSweep.lPointCount);
+  sRender.lInputChannelCount = sInputFile.lChannelCount;
+  sRender.lOutputFileLength
+    = getOutputLength(psOptions, &sInputFile, sInputFile.lLength);
+  sRender.psOptions = psOptions;
+
+  /* Create a chain and files for each point:
+     ---------------------------------------- */
+
+  sRender.psChains
+    = (SweepChain *)calloc(sRender.lChainCount, sizeof(SweepChain));
+  for (lChainIndex = 0; lChainIndex < sRender.lChainCount; lChainIndex++) {
+    psChain = sRender.psChains + lChainIndex;
+    createPluginChain(&psChain->sChain,
+		      lPluginCount,
+		      ppsPluginDescriptors,
+		      sSweep.pppfControlValues[lChainIndex],
+		      sInputFile.lChannelCount,
+		      sInputFile.lSampleRate);
+    psChain->pcOutputFilename = getSweepFilename(pcOutputFilename,
+						 lChainIndex,
+						 sRender.lChainCount);
+    createWaveFile(&psChain->sOutputFile,
+		   psChain->pcOutputFilename,
+		   lOutputFileChannelCount,
+		   sInputFile.lSampleRate,
+		   sRender.lOutputFileLength,
+		   iOutputSampleFormat,
+		   psOptions->lBlockSize);
+    if (psOptions->pcControlLogFile) {
+      psChain->pcControlLogFilename
+	= getSweepFilename(psOptions->pcControlLogFile,
+			   lChainIndex,
+			   sRender.lChainCount);
+      psChain->sChain.psControlLog
+	= createControlLog(psChain->pcControlLogFilename,
+			   lPluginCount,
+			   ppsPluginDescriptors,
+			   psChain->sChain.plInstanceCounts,
+			   psChain->sChain.ppfControlOutputs,
+			   sInputFile.lSampleRate);
+    }
+    psChain->ppfBuffers = allocateBuffers(psChain->sChain.lBufferCount,
+					  psOptions->lBlockSize,
+					  psOptions->bHugePages);
+    activatePluginChain(&psChain->sChain);
+    printf("Point %lu: %s -> \"%s\"\n",
+	   lChainIndex + 1,
+	   sSweep.ppcDescriptions[lChainIndex],
+	   psChain->pcOutputFilename);
+  }
+  for (lBlockIndex = 0; lBlockIndex < 2; lBlockIndex++)
+    sRender.pppfInput[lBlockIndex]
+      = allocateBuffers(sInputFile.lChannelCount,
+			psOptions->lBlockSize,
+			psOptions->bHugePages);
+
+  /* Run:
+     ---- */
+
+  dSeconds = -getSeconds();
+  pthread_barrier_init(&sRender.sBarrier, NULL, sRender.lWorkerCount + 1);
+  psThreads = (pthread_t *)calloc(sRender.lWorkerCount, sizeof(pthread_t));
+  psWorkers = (SweepWorker *)calloc(sRender.lWorkerCount,
+				    sizeof(SweepWorker));
+  for (lWorkerIndex = 0; lWorkerIndex < sRender.lWorkerCount; lWorkerIndex++) {
+    psWorkers[lWorkerIndex].psRender = &sRender;
+    psWorkers[lWorkerIndex].lWorkerIndex = lWorkerIndex;
+    if (pthread_create(psThreads + lWorkerIndex,
+		       NULL,
+		       sweepWorker,
+		       psWorkers + lWorkerIndex) != 0) {
+      fprintf(stderr, "Failed to start sweep workers.\n");
+      exit(1);
+    }
+  }
+
+  /* Decode each block while the workers run the one before. */
+  readBlock(&sInputFile,
+	    sInputFile.lLength,
+	    0,
+	    sRender.pppfInput[0],
+	    sInputFile.lChannelCount,
+	    psOptions->lBlockSize);
+  for (lBlockIndex = 0, lTimeAt = 0;
+       lTimeAt < sRender.lOutputFileLength;
+       lBlockIndex++, lTimeAt += psOptions->lBlockSize) {
+    pthread_barrier_wait(&sRender.sBarrier);
+    if (lTimeAt + psOptions->lBlockSize < sRender.lOutputFileLength)
+      readBlock(&sInputFile,
+		sInputFile.lLength,
+		lTimeAt + psOptions->lBlockSize,
+		sRender.pppfInput[(lBlockIndex + 1) % 2],
+		sInputFile.lChannelCount,
+		psOptions->lBlockSize);
+  }
+  pthread_barrier_wait(&sRender.sBarrier);
+
+  for (lWorkerIndex = 0; lWorkerIndex < sRender.lWorkerCount; lWorkerIndex++)
+    pthread_join(psThreads[lWorkerIndex], NULL);
+  pthread_barrier_destroy(&sRender.sBarrier);
+  dSeconds += getSeconds();
+
+  printf("Swept %lu points over %lu frames in %.2f seconds with %lu "
+	 "workers, decoding the input once.\n",
+	 sRender.lChainCount,
+	 sRender.lOutputFileLength,
+	 dSeconds,
+	 sRender.lWorkerCount);
+
+  /* Clean up:
+     --------- */
+
+  for (lChainIndex = 0; lChainIndex < sRender.lChainCount; lChainIndex++) {
+    psChain = sRender.psChains + lChainIndex;
+    if (psChain->sChain.psControlLog) {
+      closeControlLog(psChain->sChain.psControlLog);
+      free(psChain->pcControlLogFilename);
+    }
+    deactivatePluginChain(&psChain->sChain);
+    destroyPluginChain(&psChain->sChain);
+    freeBuffers(psChain->ppfBuffers);
+    closeWaveFile(&psChain->sOutputFile);
+
+    /* Reported in 16bit sample units as it always has been. */
+    printf("%s: peak output %g\n",
+	   psChain->pcOutputFilename,
+	   psChain->sOutputFile.fPeak * 32767.5f);
+    free(psChain->pcOutputFilename);
+  }
+  for (lBlockIndex = 0; lBlockIndex < 2; lBlockIndex++)
+    freeBuffers(sRender.pppfInput[lBlockIndex]);
+  free(sRender.psChains);
+  free(psThreads);
+  free(psWorkers);
+  closeWaveFile(&sInputFile);
+  freeParameterSweep(&sSweep, lPluginCount);
+}
+
+/*****************************************************************************/
+
+/* Render through a processing graph read from pcGraphFilename (see
+   host.h for the format) instead of a chain, with lThreadCount
+   threads running independent branches. */
+static void
+applyPluginGraph(const char          * pcGraphFilename,
+		 const char          * pcInputFilename,
+		 const char          * pcOutputFilename,
+		 const unsigned long   lThreadCount,
+		 const RenderOptions * psOptions) {
+
+  ProcessGraph sGraph;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  double dSeconds;
+  int bTailEnded;
+  unsigned long lFrameSize;
+  unsigned long lInputLength;
+  unsigned long lOutputFileLength;
+  unsigned long lQuietFrames;
+  unsigned long lReadSize;
+  unsigned long lTimeAt;
+
+  loadProcessGraph(&sGraph, pcGraphFilename);
+
+  openWaveFile(&sInputFile, pcInputFilename, psOptions->lBlockSize);
+  if (sInputFile.lChannelCount != sGraph.lInputCount) {
+    fprintf(stderr,
+	    "Mismatch between channel count in input file (%lu) and graph "
+	    "inputs (%lu).\n",
+	    sInputFile.lChannelCount,
+	    sGraph.lInputCount);
+    exit(1);
+  }
+
+  /* A stream of unknown length is read until it runs short. */
+  lInputLength = sInputFile.lLength;
+  lOutputFileLength
+    = (lInputLength == WAVE_LENGTH_UNKNOWN
+       ? WAVE_LENGTH_UNKNOWN
+       : (lInputLength
+	  + (unsigned long)(getExtraSeconds(psOptions)
+			    * sInputFile.lSampleRate)));
+  createWaveFile(&sOutputFile,
+		 pcOutputFilename,
+		 sGraph.lOutputCount,
+		 sInputFile.lSampleRate,
+		 (psOptions->bAutoTail && strcmp(pcOutputFilename, "-") == 0
+		  ? WAVE_LENGTH_UNKNOWN
+		  : lOutputFileLength),
+		 (psOptions->iOutputSampleFormat != WAVE_SAMPLE_NONE
+		  ? psOptions->iOutputSampleFormat
+		  : sInputFile.iSampleFormat),
+		 psOptions->lBlockSize);
+
+  instantiateProcessGraph(&sGraph,
+			  sInputFile.lSampleRate,
+			  psOptions->lBlockSize,
+			  lThreadCount,
+			  psOptions->bHugePages);
+  printf("Graph: %lu nodes, %lu edges, %lu branches on %lu threads.\n",
+	 sGraph.lNodeCount,
+	 sGraph.lEdgeCount,
+	 sGraph.lTaskCount,
+	 sGraph.lThreadCount);
+
+  activateProcessGraph(&sGraph);
+  dSeconds = -getSeconds();
+  bTailEnded = 0;
+  lQuietFrames = 0;
+  lTimeAt = 0;
+  while (lTimeAt < lOutputFileLength && !bTailEnded) {
+    lReadSize = readBlock(&sInputFile,
+			  lInputLength,
+			  lTimeAt,
+			  sGraph.ppfInputBuffers,
+			  sGraph.lInputCount,
+			  psOptions->lBlockSize);
+    if (lInputLength == WAVE_LENGTH_UNKNOWN
+	&& lReadSize < psOptions->lBlockSize) {
+      lInputLength = lTimeAt + lReadSize;
+      lOutputFileLength
+	= (lInputLength
+	   + (unsigned long)(getExtraSeconds(psOptions)
+			     * sInputFile.lSampleRate));
+      if (lTimeAt >= lOutputFileLength)
+	break;
+    }
+    lFrameSize = lOutputFileLength - lTimeAt;
+    if (lFrameSize > psOptions->lBlockSize)
+      lFrameSize = psOptions->lBlockSize;
+    runProcessGraph(&sGraph, lFrameSize, psOptions->lSubBlockSize);
+    if (psOptions->bAutoTail)
+      lFrameSize = findTailEnd(psOptions,
+			       sGraph.ppfOutputBuffers,
+			       sGraph.lOutputCount,
+			       sInputFile.lSampleRate,
+			       lInputLength,
+			       lTimeAt,
+			       lFrameSize,
+			       &lQuietFrames,
+			       &bTailEnded);
+    writeWaveFile(&sOutputFile, sGraph.ppfOutputBuffers, lFrameSize);
+    lTimeAt += lFrameSize;
+  }
+  dSeconds += getSeconds();
+  deactivateProcessGraph(&sGraph);
+
+  printf("Ran %lu blocks in %.3f seconds, %lu branches stolen between "
+	 "threads.\n",
+	 sGraph.lBlocksRun,
+	 dSeconds,
+	 sGraph.lSteals);
+  if (psOptions->bAutoTail)
+    printf("Rendered a tail of %.3f seconds%s.\n",
+	   (double)(lTimeAt - lInputLength) / sInputFile.lSampleRate,
+	   bTailEnded ? "" : ", the most allowed");
+
+  destroyProcessGraph(&sGraph);
+  closeWaveFile(&sInputFile);
+  closeWaveFile(&sOutputFile);
+
+  /* Reported in 16bit sample units as it always has been. */
+  printf("Peak output: %g\n", sOutputFile.fPeak * 32767.5f);
+}
+
+/*****************************************************************************/
+
+/* Plugin libraries loaded so far, so a daemon loads each only once
+   however many jobs name it. A name with a '/' in it is kept and
+   loaded as the file it resolves to, as each job runs in its client's
+   directory and dlopen() would otherwise match the name to a library
+   loaded for another; other names are found on the LADSPA_PATH and
+   kept as given. */
+typedef struct {
+  unsigned long lCount;
+  char ** ppcNames;
+  void ** ppvLibraries;
+} LibraryCache;
+
+static void *
+loadCachedLibrary(LibraryCache * psCache, const char * pcPluginFilename) {
+
+  char * pcName;
+  unsigned long lIndex;
+
+  if (psCache == NULL)
+    return loadLADSPAPluginLibrary(pcPluginFilename);
+
+  pcName = NULL;
+  if (strchr(pcPluginFilename, '/') != NULL)
+    pcName = realpath(pcPluginFilename, NULL);
+  if (pcName == NULL)
+    pcName = strdup(pcPluginFilename);
+
+  for (lIndex = 0; lIndex < psCache->lCount; lIndex++)
+    if (strcmp(psCache->ppcNames[lIndex], pcName) == 0) {
+      free(pcName);
+      return psCache->ppvLibraries[lIndex];
+    }
+
+  psCache->ppcNames
+    = (char **)realloc(psCache->ppcNames,
+		       (psCache->lCount + 1) * sizeof(char *));
+  psCache->ppvLibraries
+    = (void **)realloc(psCache->ppvLibraries,
+		       (psCache->lCount + 1) * sizeof(void *));
+  psCache->ppcNames[psCache->lCount] = pcName;
+  psCache->ppvLibraries[psCache->lCount]
+    = loadLADSPAPluginLibrary(pcName);
+
+  return psCache->ppvLibraries[psCache->lCount++];
+}
+
+/* Load the plugins named by lWordCount words, each a plugin file
+   name, a label and its control values, into arrays with room for
+   (lWordCount + 1) / 2 plugins. Libraries come from psCache if it is
+   not NULL. Returns the number of plugins. If a plugin is given too
+   few controls or one that is not a number, its controls are listed
+   and *pbBadControls is set; if a file name has no label after it,
+   *pbBadParameters is set. Errors loading plugins are handled by
+   writing a message to stderr and calling exit(1). */
+static unsigned long
+loadChainArguments(char * const * ppcWords,
+		   const unsigned long lWordCount,
+		   LibraryCache * psCache,
+		   void ** ppvPluginLibraries,
+		   const LADSPA_Descriptor ** ppsPluginDescriptors,
+		   LADSPA_Data ** ppfPluginControlValues,
+		   int * pbBadParameters,
+		   int * pbBadControls) {
+
+  char * pcEndPointer;
+  const char * pcControlValue;
+  unsigned long lControlValueCount;
+  unsigned long lControlValueIndex;
+  unsigned long lPluginIndex;
+  unsigned long lWordIndex;
+
+  lPluginIndex = 0;
+  lWordIndex = 0;
+  *pbBadControls = 0;
+  while (lWordIndex < lWordCount && !*pbBadControls) {
+
+    if (lWordIndex + 1 == lWordCount) {
+      *pbBadParameters = 1;
+      break;
+    }
+
+    /* Parameter should be a plugin file name followed by a
+       label. Load the plugin. This call will exit() if the load
+       fails. */
+    ppvPluginLibraries[lPluginIndex]
+      = loadCachedLibrary(psCache, ppcWords[lWordIndex]);
+    ppsPluginDescriptors[lPluginIndex] 
+      = findLADSPAPluginDescriptor(ppvPluginLibraries[lPluginIndex],
+				   ppcWords[lWordIndex],
+				   ppcWords[lWordIndex + 1]);
+
+    lControlValueCount
+      = getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			   LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL);
+      
+    *pbBadControls = (lControlValueCount + lWordIndex + 2 > lWordCount);
+    if (lControlValueCount > 0 && !*pbBadControls) {
+      ppfPluginControlValues[lPluginIndex]
+	= (LADSPA_Data *)calloc(lControlValueCount, sizeof(LADSPA_Data));
+      for (lControlValueIndex = 0; 
+	   lControlValueIndex < lControlValueCount && !*pbBadControls;
+	   lControlValueIndex++) {
+	pcControlValue = ppcWords[lWordIndex + 2 + lControlValueIndex];
+
+	ppfPluginControlValues[lPluginIndex][lControlValueIndex]
+	  = (LADSPA_Data)strtod(pcControlValue, &pcEndPointer);
+
+	*pbBadControls = (pcControlValue + strlen(pcControlValue) 
+			  != pcEndPointer);
+      }
+    }
+
+    if (*pbBadControls)
+      listControlsForPlugin(ppsPluginDescriptors[lPluginIndex]);
+
+    lWordIndex += (2 + lControlValueCount);
+    lPluginIndex++;
+  }
+
+  return lPluginIndex;
+}
+
+/*****************************************************************************/
+
+/* Chains a daemon worker keeps instantiated between jobs. */
+#define DAEMON_WARM_CHAINS 32
+
+/* An instantiated chain kept by a daemon worker, with the control
+   values it is connected to and buffers to run it with. A job with
+   the same plugins, channel count and sample rate copies its controls
+   in and runs it rather than instantiating anything. */
+typedef struct {
+
+  unsigned long lPluginCount;
+  const LADSPA_Descriptor ** ppsDescriptors;
+  LADSPA_Data ** ppfControlValues;
+  unsigned long lChannelCount;
+  unsigned long lSampleRate;
+
+  PluginChain sChain;
+  LADSPA_Data ** ppfBuffers;
+
+  /* The job that last ran it, for choosing one to replace. */
+  unsigned long lLastUsed;
+
+} WarmChain;
+
+/* What a daemon worker keeps from job to job. Each worker process has
+   its own copy. */
+typedef struct {
+
+  const RenderOptions * psOptions;
+  LibraryCache sLibraries;
+
+  unsigned long lWarmChainCount;
+  WarmChain psWarmChains[DAEMON_WARM_CHAINS];
+
+  unsigned long lJobCount;
+
+} DaemonState;
+
+static int
+isWarmChainFor(const WarmChain * psWarm,
+	       const unsigned long lPluginCount,
+	       const LADSPA_Descriptor ** ppsPluginDescriptors,
+	       const unsigned long lChannelCount,
+	       const unsigned long lSampleRate) {
+
+  unsigned long lPluginIndex;
+
+  if (psWarm->lPluginCount != lPluginCount
+      || psWarm->lChannelCount != lChannelCount
+      || psWarm->lSampleRate != lSampleRate)
+    return 0;
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+    if (psWarm->ppsDescriptors[lPluginIndex]
+	!= ppsPluginDescriptors[lPluginIndex])
+      return 0;
+
+  return 1;
+}
+
+static void
+freeWarmChain(WarmChain * psWarm) {
+
+  unsigned long lPluginIndex;
+
+  destroyPluginChain(&psWarm->sChain);
+  freeBuffers(psWarm->ppfBuffers);
+  for (lPluginIndex = 0; lPluginIndex < psWarm->lPluginCount; lPluginIndex++)
+    free(psWarm->ppfControlValues[lPluginIndex]);
+  free(psWarm->ppfControlValues);
+  free(psWarm->ppsDescriptors);
+}
+
+/* Find a warm chain for the plugins at this channel count and rate,
+   setting *pbWarm, or instantiate one, replacing the least recently
+   used if there are already DAEMON_WARM_CHAINS. Either way the chain
+   is left connected to a copy of ppfPluginControlValues. */
+static WarmChain *
+getWarmChain(DaemonState * psState,
+	     const unsigned long lPluginCount,
+	     const LADSPA_Descriptor ** ppsPluginDescriptors,
+	     LADSPA_Data ** ppfPluginControlValues,
+	     const unsigned long lChannelCount,
+	     const unsigned long lSampleRate,
+	     int * pbWarm) {
+
+  WarmChain * psWarm;
+  unsigned long lControlValueCount;
+  unsigned long lIndex;
+  unsigned long lPluginIndex;
+
+  psWarm = NULL;
+  for (lIndex = 0; lIndex < psState->lWarmChainCount; lIndex++)
+    if (isWarmChainFor(psState->psWarmChains + lIndex,
+		       lPluginCount,
+		       ppsPluginDescriptors,
+		       lChannelCount,
+		       lSampleRate)) {
+      psWarm = psState->psWarmChains + lIndex;
+      break;
+    }
+
+  if (psWarm) {
+    *pbWarm = 1;
+    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+      lControlValueCount
+	= getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			     LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL);
+      if (lControlValueCount > 0)
+	memcpy(psWarm->ppfControlValues[lPluginIndex],
+	       ppfPluginControlValues[lPluginIndex],
+	       lControlValueCount * sizeof(LADSPA_Data));
+    }
+  }
+  else {
+
+    if (psState->lWarmChainCount < DAEMON_WARM_CHAINS)
+      psWarm = psState->psWarmChains + psState->lWarmChainCount++;
+    else {
+      psWarm = psState->psWarmChains;
+      for (lIndex = 1; lIndex < DAEMON_WARM_CHAINS; lIndex++)
+	if (psState->psWarmChains[lIndex].lLastUsed < psWarm->lLastUsed)
+	  psWarm = psState->psWarmChains + lIndex;
+      freeWarmChain(psWarm);
+    }
+
+    psWarm->lPluginCount = lPluginCount;
+    psWarm->ppsDescriptors
+      = (const LADSPA_Descriptor **)calloc(lPluginCount,
+					   sizeof(LADSPA_Descriptor *));
+    psWarm->ppfControlValues
+      = (LADSPA_Data **)calloc(lPluginCount, sizeof(LADSPA_Data *));
+    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+      psWarm->ppsDescriptors[lPluginIndex]
+	= ppsPluginDescriptors[lPluginIndex];
+      lControlValueCount
+	= getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			     LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL);
+      psWarm->ppfControlValues[lPluginIndex]
+	= (LADSPA_Data *)calloc(lControlValueCount + 1,
+				sizeof(LADSPA_Data));
+      if (lControlValueCount > 0)
+	memcpy(psWarm->ppfControlValues[lPluginIndex],
+	       ppfPluginControlValues[lPluginIndex],
+	       lControlValueCount * sizeof(LADSPA_Data));
+    }
+    psWarm->lChannelCount = lChannelCount;
+    psWarm->lSampleRate = lSampleRate;
+
+    createPluginChain(&psWarm->sChain,
+		      lPluginCount,
+		      psWarm->ppsDescriptors,
+		      psWarm->ppfControlValues,
+		      lChannelCount,
+		      lSampleRate);
+    psWarm->ppfBuffers = allocateBuffers(psWarm->sChain.lBufferCount,
+					 psState->psOptions->lBlockSize,
+					 psState->psOptions->bHugePages);
+  }
+
+  psWarm->lLastUsed = psState->lJobCount;
+  return psWarm;
+}
+
+/* Run one daemon job: the words of an applyplugin command line after
+   the flags, which are the daemon's own. See DaemonJobFunction in
+   host.h. */
+static unsigned long
+renderDaemonJob(void * pvState,
+		char ** ppcWords,
+		const unsigned long lWordCount,
+		int * pbWarm) {
+
+  DaemonState * psState;
+  LADSPA_Data ** ppfPluginControlValues;
+  WarmChain * psWarm;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  const LADSPA_Descriptor ** ppsPluginDescriptors;
+  int bBadControls;
+  int bBadParameters;
+  unsigned long lOutputFileLength;
+  unsigned long lPluginCount;
+  unsigned long lPluginCountUpperLimit;
+  unsigned long lPluginIndex;
+  void ** ppvPluginLibraries;
+
+  psState = (DaemonState *)pvState;
+  psState->lJobCount++;
+
+  if (lWordCount < 4) {
+    fprintf(stderr,
+	    "A daemon job needs an input file, an output file and at "
+	    "least one plugin.\n");
+    exit(1);
+  }
+  if (strcmp(ppcWords[0], "-") == 0 || strcmp(ppcWords[1], "-") == 0) {
+    fprintf(stderr, "Daemon jobs cannot read or write streams.\n");
+    exit(1);
+  }
+
+  lPluginCountUpperLimit = (lWordCount - 2 + 1) / 2;
+  ppvPluginLibraries = (void **)calloc(lPluginCountUpperLimit,
+				       sizeof(void *));
+  ppsPluginDescriptors
+    = ((const LADSPA_Descriptor **)
+       calloc(lPluginCountUpperLimit, sizeof(LADSPA_Descriptor *)));
+  ppfPluginControlValues
+    = (LADSPA_Data **)calloc(lPluginCountUpperLimit, sizeof(LADSPA_Data *));
+  bBadParameters = 0;
+  lPluginCount = loadChainArguments(ppcWords + 2,
+				    lWordCount - 2,
+				    &psState->sLibraries,
+				    ppvPluginLibraries,
+				    ppsPluginDescriptors,
+				    ppfPluginControlValues,
+				    &bBadParameters,
+				    &bBadControls);
+  if (bBadParameters || bBadControls) {
+    fprintf(stderr, "Bad plugin arguments for a daemon job.\n");
+    exit(1);
+  }
+
+  lOutputFileLength = openRenderFiles(ppcWords[0],
+				      ppcWords[1],
+				      psState->psOptions,
+				      lPluginCount,
+				      ppsPluginDescriptors,
+				      &sInputFile,
+				      &sOutputFile);
+  psWarm = getWarmChain(psState,
+			lPluginCount,
+			ppsPluginDescriptors,
+			ppfPluginControlValues,
+			sInputFile.lChannelCount,
+			sInputFile.lSampleRate,
+			pbWarm);
+
+  activatePluginChain(&psWarm->sChain);
+  renderFile(&psWarm->sChain,
+	     &sInputFile,
+	     &sOutputFile,
+	     lOutputFileLength,
+	     psWarm->ppfBuffers,
+	     psState->psOptions,
+	     NULL);
+  deactivatePluginChain(&psWarm->sChain);
+
+  closeWaveFile(&sInputFile);
+  closeWaveFile(&sOutputFile);
+  /* Reported in 16bit sample units as it always has been. */
+  printf("Peak output: %g\n", sOutputFile.fPeak * 32767.5f);
+
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+    free(ppfPluginControlValues[lPluginIndex]);
+  free(ppfPluginControlValues);
+  free(ppsPluginDescriptors);
+  free(ppvPluginLibraries);
+
+  return sOutputFile.lFramePosition;
+}
+
+/* Serve render jobs on pcSocketPath with lWorkerCount worker
+   processes, each keeping its plugin libraries loaded and its chains
+   instantiated from job to job. Jobs render as the plain serial
+   renderer does, with the daemon's options. */
+static void
+applyPluginDaemon(const char          * pcSocketPath,
+		  const unsigned long   lWorkerCount,
+		  const RenderOptions * psOptions) {
+
+  DaemonState * psState;
+
+  psState = (DaemonState *)calloc(1, sizeof(DaemonState));
+  psState->psOptions = psOptions;
+  runDaemon(pcSocketPath, lWorkerCount, renderDaemonJob, psState);
+  free(psState);
+}
+
+/*****************************************************************************/
+
+/* Command line flags come before the file names. Short flags take a
+   value either attached ("-s2") or as the next argument ("-s 2").
+   Long flags take it after '=' ("--async=4") or as the next argument
+   ("--async 4"). If ppcArgv[*plArgumentIndex] is pcFlag, step past it
+   and its value, set *ppcValue to the value (NULL if missing) and
+   return 1. Flags without values pass ppcValue as NULL. Otherwise
+   return 0. */
+static int
+getFlag(const int iArgc,
+	char * const ppcArgv[],
+	unsigned long * plArgumentIndex,
+	const char * pcFlag,
+	const char ** ppcValue) {
+
+  const char * pcArgument;
+  size_t lFlagLength;
+
+  pcArgument = ppcArgv[*plArgumentIndex];
+  lFlagLength = strlen(pcFlag);
+  if (strncmp(pcArgument, pcFlag, lFlagLength) != 0)
+    return 0;
+
+  if (ppcValue == NULL) {
+    if (pcArgument[lFlagLength] != '\0')
+      return 0;
+    (*plArgumentIndex)++;
+    return 1;
+  }
+
+  if (pcFlag[1] == '-') {
+    if (pcArgument[lFlagLength] == '=') {
+      (*plArgumentIndex)++;
+      *ppcValue = pcArgument + lFlagLength + 1;
+      return 1;
+    }
+    if (pcArgument[lFlagLength] != '\0')
+      return 0;
+  }
+  else if (pcArgument[lFlagLength] != '\0') {
+    (*plArgumentIndex)++;
+    *ppcValue = pcArgument + lFlagLength;
+    return 1;
+  }
+
+  if (*plArgumentIndex + 1 >= (unsigned long)iArgc) {
+    (*plArgumentIndex)++;
+    *ppcValue = NULL;
+    return 1;
+  }
+  *plArgumentIndex += 2;
+  *ppcValue = ppcArgv[*plArgumentIndex - 1];
+  return 1;
+}
+
+/* Parse a flag value. Return 0 if it is missing or malformed. */
+
+static int
+parseNumber(const char * pcValue, LADSPA_Data * pfResult) {
+  char * pcEndPointer;
+  if (!pcValue || *pcValue == '\0')
+    return 0;
+  *pfResult = (LADSPA_Data)strtod(pcValue, &pcEndPointer);
+  return (*pcEndPointer == '\0');
+}
+
+static int
+parseCount(const char * pcValue, unsigned long * plResult) {
+  char * pcEndPointer;
+  if (!pcValue || *pcValue < '0' || *pcValue > '9')
+    return 0;
+  *plResult = strtoul(pcValue, &pcEndPointer, 10);
+  return (*pcEndPointer == '\0');
+}
+
+/* Parse "<plugin>:<rate>" for --plugin-rate, adding it to the
+   list. */
+static int
+parsePluginRate(const char * pcValue, RenderOptions * psOptions) {
+
+  char * pcEndPointer;
+  unsigned long lPluginIndex;
+  unsigned long lRate;
+
+  if (!pcValue || *pcValue < '0' || *pcValue > '9')
+    return 0;
+  lPluginIndex = strtoul(pcValue, &pcEndPointer, 10);
+  if (*pcEndPointer != ':'
+      || !parseCount(pcEndPointer + 1, &lRate)
+      || lPluginIndex == 0
+      || lRate == 0)
+    return 0;
+
+  psOptions->plPluginRateIndices
+    = (unsigned long *)realloc(psOptions->plPluginRateIndices,
+			       ((psOptions->lPluginRateCount + 1)
+				* sizeof(unsigned long)));
+  psOptions->plPluginRates
+    = (unsigned long *)realloc(psOptions->plPluginRates,
+			       ((psOptions->lPluginRateCount + 1)
+				* sizeof(unsigned long)));
+  psOptions->plPluginRateIndices[psOptions->lPluginRateCount] = lPluginIndex;
+  psOptions->plPluginRates[psOptions->lPluginRateCount] = lRate;
+  psOptions->lPluginRateCount++;
+  return 1;
+}
+
+/* Parse "<format>:<channels>:<rate>" for --raw-input. */
+static int
+parseRawFormat(const char * pcValue, RenderOptions * psOptions) {
+
+  char pcFormat[16];
+  const char * pcColon;
+  char * pcEndPointer;
+
+  if (!pcValue || (pcColon = strchr(pcValue, ':')) == NULL
+      || (size_t)(pcColon - pcValue) >= sizeof(pcFormat))
+    return 0;
+  memcpy(pcFormat, pcValue, pcColon - pcValue);
+  pcFormat[pcColon - pcValue] = '\0';
+  psOptions->iRawInputFormat = getWaveSampleFormat(pcFormat);
+
+  psOptions->lRawInputChannelCount = strtoul(pcColon + 1, &pcEndPointer, 10);
+  if (*pcEndPointer != ':')
+    return 0;
+  if (!parseCount(pcEndPointer + 1, &psOptions->lRawInputSampleRate))
+    return 0;
+
+  return (psOptions->iRawInputFormat != WAVE_SAMPLE_NONE
+	  && psOptions->lRawInputChannelCount > 0
+	  && psOptions->lRawInputSampleRate > 0);
+}
+
+/*****************************************************************************/
+
+/* Note that this function leaks memory and that dynamic libraries
+   that are dlopen()ed are never dlclose()d. */
+int 
+main(const int iArgc, char * const ppcArgv[]) {
+
+  char pcAlignment[32];
+  const char * pcFlagValue;
+  const char * pcBatch;
+  const char * pcClient;
+  const char * pcDaemon;
+  const char * pcGraph;
+  const char * pcInputFilename;
+  const char * pcOutputDirectory;
+  const char * pcOutputFilename;
+  const char * pcSweep;
+  const LADSPA_Descriptor ** ppsPluginDescriptors;
+  LADSPA_Data ** ppfPluginControlValues;
+  RenderOptions sOptions;
+  int bBadParameters;
+  int bBadControls;
+  int bExportControls;
+  int bResample;
+  int iExitStatus;
+  unsigned long lArgumentIndex;
+  unsigned long lFileArgumentCount;
+  unsigned long lFlagCount;
+  unsigned long lWorkerCount;
+  unsigned long lPluginCount;
+  unsigned long lPluginCountUpperLimit;
+  unsigned long lPluginIndex;
+  void ** ppvPluginLibraries;
+
+  bBadParameters = 0;
+  bExportControls = 0;
+  iExitStatus = 0;
+  memset(&sOptions, 0, sizeof(sOptions));
+  sOptions.iOutputSampleFormat = WAVE_SAMPLE_NONE;
+  sOptions.lBlockSize = BUFFER_SIZE;
+  sOptions.fWarmUpSeconds = CHUNK_WARM_UP_SECONDS;
+  sOptions.fPreRollSeconds = PRE_ROLL_SECONDS;
+  sOptions.lAutomationStep = AUTOMATION_STEP;
+  sOptions.fTailThreshold = TAIL_THRESHOLD;
+  sOptions.fTailWindow = TAIL_WINDOW_SECONDS;
+  sOptions.fTailMaxSeconds = TAIL_MAX_SECONDS;
+  pcBatch = NULL;
+  pcClient = NULL;
+  pcDaemon = NULL;
+  pcGraph = NULL;
+  pcOutputDirectory = NULL;
+  pcSweep = NULL;
+  lWorkerCount = 0;
+
+  /* Check for flags, but only at the start. Cannot get use getopt()
+     as it gets thoroughly confused when faced with negative numbers
+     on the command line. */
+  lArgumentIndex = 1;
+  lFlagCount = 0;
+  while (lArgumentIndex < (unsigned long)iArgc && !bBadParameters) {
+    if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "-s", &pcFlagValue)) {
+      sOptions.bAutoTail = (pcFlagValue && strcmp(pcFlagValue, "auto") == 0);
+      if (!sOptions.bAutoTail)
+	bBadParameters = !parseNumber(pcFlagValue, &sOptions.fExtraSeconds);
+    }
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--tail-threshold",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fTailThreshold)
+			|| sOptions.fTailThreshold >= 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--tail-window",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fTailWindow)
+			|| sOptions.fTailWindow <= 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--tail-max",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fTailMaxSeconds)
+			|| sOptions.fTailMaxSeconds < 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "-f", &pcFlagValue)) {
+      if (pcFlagValue)
+	sOptions.iOutputSampleFormat = getWaveSampleFormat(pcFlagValue);
+      bBadParameters = (sOptions.iOutputSampleFormat == WAVE_SAMPLE_NONE);
+    }
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--async",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lQueueDepth)
+			|| sOptions.lQueueDepth < 2);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--pipeline",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lStageCount)
+			|| sOptions.lStageCount < 2);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--chunks",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lChunkCount)
+			|| sOptions.lChunkCount < 2);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--start",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fStartSeconds)
+			|| sOptions.fStartSeconds < 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--end",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fEndSeconds)
+			|| sOptions.fEndSeconds <= 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--pre-roll",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fPreRollSeconds)
+			|| sOptions.fPreRollSeconds < 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--warm-up",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fWarmUpSeconds)
+			|| sOptions.fWarmUpSeconds < 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--verify-seams",
+		     NULL))
+      sOptions.bVerifySeams = 1;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--io-block",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lBlockSize)
+			|| sOptions.lBlockSize == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--dsp-block",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lSubBlockSize)
+			|| sOptions.lSubBlockSize == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--batch",
+		     &pcBatch))
+      bBadParameters = (pcBatch == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--graph",
+		     &pcGraph))
+      bBadParameters = (pcGraph == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--sweep",
+		     &pcSweep))
+      bBadParameters = (pcSweep == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--output-dir",
+		     &pcOutputDirectory))
+      bBadParameters = (pcOutputDirectory == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--jobs",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &lWorkerCount)
+			|| lWorkerCount == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--daemon",
+		     &pcDaemon))
+      bBadParameters = (pcDaemon == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--client",
+		     &pcClient))
+      bBadParameters = (pcClient == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--compare",
+		     &sOptions.pcReferenceFile))
+      bBadParameters = (sOptions.pcReferenceFile == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--tolerance",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fTolerance)
+			|| sOptions.fTolerance < 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--automation",
+		     &sOptions.pcAutomationFile))
+      bBadParameters = (sOptions.pcAutomationFile == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--automation-step",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lAutomationStep)
+			|| sOptions.lAutomationStep == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--controls",
+		     &sOptions.pcControlLogFile))
+      bBadParameters = (sOptions.pcControlLogFile == NULL);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--export-controls",
+		     NULL))
+      bExportControls = 1;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--profile", NULL))
+      sOptions.bProfile = 1;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--profile",
+		     &sOptions.pcProfileFile)) {
+      sOptions.bProfile = 1;
+      bBadParameters = (sOptions.pcProfileFile == NULL);
+    }
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--meter", NULL))
+      sOptions.bMeter = 1;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--meter",
+		     &sOptions.pcMeterFile)) {
+      sOptions.bMeter = 1;
+      bBadParameters = (sOptions.pcMeterFile == NULL);
+    }
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--realtime",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lRealtimePeriod)
+			|| sOptions.lRealtimePeriod == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--rt-priority",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue,
+				    &sOptions.lRealtimePriority)
+			|| sOptions.lRealtimePriority < 1
+			|| sOptions.lRealtimePriority > 99);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--chain-rate",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lChainSampleRate)
+			|| sOptions.lChainSampleRate == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--output-rate",
+		     &pcFlagValue))
+      bBadParameters = (!parseCount(pcFlagValue, &sOptions.lOutputSampleRate)
+			|| sOptions.lOutputSampleRate == 0);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--plugin-rate",
+		     &pcFlagValue))
+      bBadParameters = !parsePluginRate(pcFlagValue, &sOptions);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--raw-input",
+		     &pcFlagValue))
+      bBadParameters = !parseRawFormat(pcFlagValue, &sOptions);
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--raw-output", NULL))
+      sOptions.bRawOutput = 1;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--huge-pages", NULL))
+      sOptions.bHugePages = 1;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--autotune", NULL))
+      sOptions.fAutotuneSeconds = AUTOTUNE_SECONDS;
+    else if (getFlag(iArgc, ppcArgv, &lArgumentIndex, "--autotune",
+		     &pcFlagValue))
+      bBadParameters = (!parseNumber(pcFlagValue, &sOptions.fAutotuneSeconds)
+			|| sOptions.fAutotuneSeconds <= 0);
+    else
+      break;
+    lFlagCount++;
+  }
+
+  /* The DSP sub-block defaults to, and may not exceed, the I/O
+     block. */
+  if (sOptions.lSubBlockSize == 0
+      || sOptions.lSubBlockSize > sOptions.lBlockSize)
+    sOptions.lSubBlockSize = sOptions.lBlockSize;
+
+  /* Plugins may look this up when they are instantiated, to choose
+     aligned SIMD loads. */
+  sprintf(pcAlignment, "%lu", getPortAlignment(&sOptions));
+  setenv(ARENA_ALIGNMENT_VARIABLE, pcAlignment, 1);
+
+  /* Exporting a control log to CSV renders nothing. */
+  if (bExportControls) {
+    if (lArgumentIndex + 2 != (unsigned long)iArgc)
+      bBadParameters = 1;
+    else {
+      printf("Exported %lu rows.\n",
+	     exportControlLog(ppcArgv[lArgumentIndex],
+			      ppcArgv[lArgumentIndex + 1]));
+      return(0);
+    }
+  }
+
+  /* A client hands the rest of its command line to a daemon. The
+     daemon's flags apply to every job, so the client takes no
+     others. */
+  if (pcClient) {
+    if (bBadParameters
+	|| lFlagCount != 1
+	|| lArgumentIndex == (unsigned long)iArgc)
+      bBadParameters = 1;
+    else
+      return submitDaemonJob(pcClient,
+			     ppcArgv + lArgumentIndex,
+			     iArgc - lArgumentIndex);
+  }
+
+  /* A daemon takes its jobs from clients, each rendered as the plain
+     serial renderer would with the flags given here. */
+  if (pcDaemon) {
+    if (bBadParameters
+	|| pcBatch
+	|| pcGraph
+	|| pcSweep
+	|| pcOutputDirectory
+	|| sOptions.lQueueDepth > 0
+	|| sOptions.lStageCount > 0
+	|| sOptions.lChunkCount > 0
+	|| sOptions.bVerifySeams
+	|| sOptions.fAutotuneSeconds > 0
+	|| sOptions.pcAutomationFile
+	|| sOptions.pcControlLogFile
+	|| sOptions.bProfile
+	|| sOptions.lRealtimePeriod > 0
+	|| sOptions.iRawInputFormat != WAVE_SAMPLE_NONE
+	|| sOptions.bRawOutput
+	|| sOptions.lChainSampleRate > 0
+	|| sOptions.lOutputSampleRate > 0
+	|| sOptions.lPluginRateCount > 0
+	|| sOptions.pcReferenceFile
+	|| sOptions.bMeter
+	|| sOptions.fStartSeconds > 0
+	|| sOptions.fEndSeconds > 0
+	|| lArgumentIndex != (unsigned long)iArgc)
+      bBadParameters = 1;
+    else {
+      if (lWorkerCount == 0)
+	lWorkerCount = sysconf(_SC_NPROCESSORS_ONLN);
+      if (lWorkerCount == 0)
+	lWorkerCount = 1;
+      applyPluginDaemon(pcDaemon, lWorkerCount, &sOptions);
+      return(0);
+    }
+  }
+
+  /* A graph replaces the chain on the command line, and runs on its
+     own thread pool. */
+  if (pcGraph) {
+    if (bBadParameters
+	|| pcBatch
+	|| pcSweep
+	|| pcOutputDirectory
+	|| sOptions.lQueueDepth > 0
+	|| sOptions.lStageCount > 0
+	|| sOptions.lChunkCount > 0
+	|| sOptions.bVerifySeams
+	|| sOptions.fAutotuneSeconds > 0
+	|| sOptions.pcAutomationFile
+	|| sOptions.pcControlLogFile
+	|| sOptions.bProfile
+	|| sOptions.lRealtimePeriod > 0
+	|| sOptions.lRealtimePriority > 0
+	|| sOptions.lChainSampleRate > 0
+	|| sOptions.lOutputSampleRate > 0
+	|| sOptions.lPluginRateCount > 0
+	|| sOptions.iRawInputFormat != WAVE_SAMPLE_NONE
+	|| sOptions.bRawOutput
+	|| sOptions.pcReferenceFile
+	|| sOptions.bMeter
+	|| sOptions.fStartSeconds > 0
+	|| sOptions.fEndSeconds > 0
+	|| lArgumentIndex + 2 != (unsigned long)iArgc)
+      bBadParameters = 1;
+    else {
+      if (lWorkerCount == 0)
+	lWorkerCount = sysconf(_SC_NPROCESSORS_ONLN);
+      applyPluginGraph(pcGraph,
+		       ppcArgv[lArgumentIndex],
+		       ppcArgv[lArgumentIndex + 1],
+		       lWorkerCount,
+		       &sOptions);
+      return(0);
+    }
+  }
+
+  /* Chunked rendering is its own form of parallelism. */
+  if ((sOptions.lChunkCount > 0 || sOptions.bVerifySeams)
+      && (sOptions.lChunkCount == 0
+	  || sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.fAutotuneSeconds > 0
+	  || sOptions.pcAutomationFile
+	  || sOptions.pcControlLogFile
+	  || sOptions.bProfile
+	  || pcBatch))
+    bBadParameters = 1;
+
+  /* The realtime driver runs the whole chain in its own loop, and
+     keeps file I/O out of it. */
+  if ((sOptions.lRealtimePeriod > 0 || sOptions.lRealtimePriority > 0)
+      && (sOptions.lRealtimePeriod == 0
+	  || sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.pcControlLogFile
+	  || sOptions.bProfile
+	  || pcBatch
+	  || pcGraph))
+    bBadParameters = 1;
+
+  /* Streams are read and written once, front to back, a block at a
+     time. Tuning, pipeline balancing and chunks need to go back over
+     the input, the realtime driver and the I/O threads want its
+     length up front, and batches name their own files. */
+  if (lArgumentIndex + 2 <= (unsigned long)iArgc
+      && (strcmp(ppcArgv[lArgumentIndex], "-") == 0
+	  || strcmp(ppcArgv[lArgumentIndex + 1], "-") == 0
+	  || sOptions.iRawInputFormat != WAVE_SAMPLE_NONE
+	  || sOptions.bRawOutput)
+      && (sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.fAutotuneSeconds > 0
+	  || sOptions.lRealtimePeriod > 0
+	  || pcBatch))
+    bBadParameters = 1;
+
+  /* Tails are watched for as the output is written on this thread,
+     so the other renderers, which fix the length up front or write
+     elsewhere, cannot stop early. */
+  if (sOptions.bAutoTail
+      && (sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.lRealtimePeriod > 0
+	  || sOptions.lChainSampleRate > 0
+	  || sOptions.lOutputSampleRate > 0
+	  || sOptions.lPluginRateCount > 0))
+    bBadParameters = 1;
+
+  /* Resampling joins chains at different rates in a single serial
+     pass. Automation, control logs and profiles are kept per chain,
+     so they are not offered. */
+  bResample = (sOptions.lChainSampleRate > 0
+	       || sOptions.lOutputSampleRate > 0
+	       || sOptions.lPluginRateCount > 0);
+  if (bResample
+      && (sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.fAutotuneSeconds > 0
+	  || sOptions.lRealtimePeriod > 0
+	  || sOptions.pcAutomationFile
+	  || sOptions.pcControlLogFile
+	  || sOptions.bProfile
+	  || pcBatch))
+    bBadParameters = 1;
+
+  /* The control log is written by whichever thread runs the last
+     plugin, so it needs the chain in one piece. */
+  if (sOptions.pcControlLogFile && sOptions.lStageCount > 0)
+    bBadParameters = 1;
+
+  /* A sweep runs one input through a copy of the chain for every
+     point, in step, so it needs files it can name outputs after and
+     the plain serial renderer's options. */
+  if (pcSweep) {
+    if (sOptions.lQueueDepth > 0
+	|| sOptions.lStageCount > 0
+	|| sOptions.lChunkCount > 0
+	|| sOptions.bVerifySeams
+	|| sOptions.fAutotuneSeconds > 0
+	|| sOptions.pcAutomationFile
+	|| sOptions.bProfile
+	|| sOptions.lRealtimePeriod > 0
+	|| sOptions.bAutoTail
+	|| sOptions.iRawInputFormat != WAVE_SAMPLE_NONE
+	|| sOptions.bRawOutput
+	|| bResample
+	|| pcBatch)
+      bBadParameters = 1;
+    if (lArgumentIndex + 2 <= (unsigned long)iArgc
+	&& (strcmp(ppcArgv[lArgumentIndex], "-") == 0
+	    || strcmp(ppcArgv[lArgumentIndex + 1], "-") == 0))
+      bBadParameters = 1;
+    if (lWorkerCount == 0)
+      lWorkerCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (lWorkerCount == 0)
+      lWorkerCount = 1;
+  }
+
+  /* A comparison takes the place of the output file, and is made by
+     the plain serial renderer as it goes. */
+  if (sOptions.pcReferenceFile
+      && (sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.bVerifySeams
+	  || sOptions.lRealtimePeriod > 0
+	  || sOptions.bProfile
+	  || sOptions.bRawOutput
+	  || bResample
+	  || pcBatch
+	  || pcSweep
+	  || strcmp(sOptions.pcReferenceFile, "-") == 0))
+    bBadParameters = 1;
+
+  /* The meter sits on the one output file the plain renderer writes
+     from one thread, with or without I/O threads and pipelining. */
+  if (sOptions.bMeter
+      && (sOptions.lChunkCount > 0
+	  || sOptions.lRealtimePeriod > 0
+	  || sOptions.pcReferenceFile
+	  || bResample
+	  || pcBatch
+	  || pcSweep))
+    bBadParameters = 1;
+
+  /* A range seeks the input and skips the pre-roll on the way out,
+     which only the plain renderer does. */
+  if ((sOptions.fStartSeconds > 0 || sOptions.fEndSeconds > 0)
+      && ((sOptions.fEndSeconds > 0
+	   && sOptions.fEndSeconds <= sOptions.fStartSeconds)
+	  || sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.lRealtimePeriod > 0
+	  || bResample
+	  || pcSweep))
+    bBadParameters = 1;
+
+  /* Batch mode takes its files from a list, and gets its parallelism
+     from rendering several files at once. */
+  if (pcBatch) {
+    lFileArgumentCount = 0;
+    if (sOptions.lQueueDepth > 0
+	|| sOptions.lStageCount > 0
+	|| sOptions.fAutotuneSeconds > 0
+	|| sOptions.pcAutomationFile
+	|| sOptions.pcControlLogFile
+	|| sOptions.bProfile)
+      bBadParameters = 1;
+    if (lWorkerCount == 0)
+      lWorkerCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (lWorkerCount == 0)
+      lWorkerCount = 1;
+  }
+  else {
+    lFileArgumentCount = (sOptions.pcReferenceFile ? 1 : 2);
+    if (pcOutputDirectory)
+      bBadParameters = 1;
+
+    /* Otherwise --jobs spreads channels over threads, which only the
+       plain serial renderer does. */
+    if (!pcSweep && lWorkerCount > 0) {
+      if (sOptions.lQueueDepth > 0
+	  || sOptions.lStageCount > 0
+	  || sOptions.lChunkCount > 0
+	  || sOptions.lRealtimePeriod > 0
+	  || bResample)
+	bBadParameters = 1;
+      sOptions.lChannelThreadCount = lWorkerCount;
+    }
+  }
+  
+  /* We need to analyse the rest of the parameters. The first two
+     should be input and output files involved. */
+  if (bBadParameters
+      || lArgumentIndex + lFileArgumentCount + 2 > (unsigned long)iArgc) {
+    /* There aren't enough parameters to include an input file, an
+       output file and one plugin. */
+    bBadParameters = 1;
+  }
+  else {
+
+    pcInputFilename = ppcArgv[lArgumentIndex];
+    pcOutputFilename = (sOptions.pcReferenceFile
+			? NULL
+			: ppcArgv[lArgumentIndex + 1]);
+
+    /* Now we need to look through any plugins and plugin parameters
+       present. At this stage we're loading plugins and parameters,
+       but not attempting to wire them up.
+
+       First we construct some arrays to contain the data we're
+       hopefully about to extract. Note that these arrays are usually
+       larger than is needed, however they will be large enough.
+
+       WARNING: Note that there is no attempt to tidy up the memory at
+       the end of this function and libraries are not unloaded under
+       error conditions. This is only a toy program. */
+
+    lPluginCountUpperLimit = (iArgc - lArgumentIndex + 1) / 2;
+
+    ppvPluginLibraries = ((void **)
+			  calloc(lPluginCountUpperLimit,
+				 sizeof(void *)));
+    ppsPluginDescriptors = ((const LADSPA_Descriptor **)
+			    calloc(lPluginCountUpperLimit,
+				   sizeof(LADSPA_Descriptor *)));
+    ppfPluginControlValues = ((LADSPA_Data **)
+			      calloc(lPluginCountUpperLimit,
+				     sizeof(LADSPA_Data *)));
+    lArgumentIndex += lFileArgumentCount;
+    lPluginCount = loadChainArguments(ppcArgv + lArgumentIndex,
+				      iArgc - lArgumentIndex,
+				      NULL,
+				      ppvPluginLibraries,
+				      ppsPluginDescriptors,
+				      ppfPluginControlValues,
+				      &bBadParameters,
+				      &bBadControls);
+
+    if (!bBadControls) {
+
+      /* We have all the data we need. Go go go. If this function
+	 fails it will exit(). */
+      if (pcBatch)
+	iExitStatus = applyPluginBatch(pcBatch,
+				       pcOutputDirectory,
+				       lWorkerCount,
+				       &sOptions,
+				       lPluginCount,
+				       ppsPluginDescriptors,
+				       ppfPluginControlValues);
+      else if (pcSweep)
+	applyPluginSweep(pcSweep,
+			 pcInputFilename,
+			 pcOutputFilename,
+			 lWorkerCount,
+			 &sOptions,
+			 lPluginCount,
+			 ppsPluginDescriptors,
+			 ppfPluginControlValues);
+      else if (sOptions.lChunkCount > 0)
+	applyPluginChunked(pcInputFilename,
+			   pcOutputFilename,
+			   &sOptions,
+			   lPluginCount,
+			   ppsPluginDescriptors,
+			   ppfPluginControlValues);
+      else if (bResample)
+	applyPluginResampled(pcInputFilename,
+			     pcOutputFilename,
+			     &sOptions,
+			     lPluginCount,
+			     ppsPluginDescriptors,
+			     ppfPluginControlValues);
+      else if (sOptions.lRealtimePeriod > 0)
+	iExitStatus = (applyPluginRealtime(pcInputFilename,
+					   pcOutputFilename,
+					   &sOptions,
+					   lPluginCount,
+					   ppsPluginDescriptors,
+					   ppfPluginControlValues) > 0);
+      else
+	iExitStatus = applyPlugin(pcInputFilename,
+				  pcOutputFilename,
+				  &sOptions,
+				  lPluginCount,
+				  ppsPluginDescriptors,
+				  ppfPluginControlValues);
+
+      for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+	unloadLADSPAPluginLibrary(ppvPluginLibraries[lPluginIndex]);
+    }
   }
 
   if (bBadParameters) {
@@ -797,18 +4616,292 @@ main(const int iArgc, char * const ppcArgv[]) {
 	    "<Control1> <Control2>...\n"
 	    "\t[<LADSPA plugin file name> <plugin label> "
 	    "<Control1> <Control2>...]...\n"
+	    "\tapplyplugin [flags] --graph <graph file> [--jobs <threads>]\n"
+	    "\t<input Wave file> <output Wave file>\n"
+	    "\tapplyplugin --export-controls <control log> <CSV file>\n"
+	    "\tapplyplugin [flags] --batch <list file or directory>\n"
+	    "\t[--output-dir <directory>] [--jobs <threads>]\n"
+	    "\t<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...\n"
+	    "\t[<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...]...\n"
+	    "\tapplyplugin [flags] --sweep <sweep file> [--jobs <threads>]\n"
+	    "\t<input Wave file> <output Wave file>\n"
+	    "\t<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...\n"
+	    "\t[<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...]...\n"
+	    "\tapplyplugin [flags] --daemon <socket> [--jobs <processes>]\n"
+	    "\tapplyplugin --client <socket> <input Wave file> "
+	    "<output Wave file>\n"
+	    "\t<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...\n"
+	    "\t[<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...]...\n"
+	    "\tapplyplugin --client <socket> status|shutdown\n"
+	    "\tapplyplugin [flags] --compare <reference Wave file>\n"
+	    "\t[--tolerance <error>] <input Wave file>\n"
+	    "\t<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...\n"
+	    "\t[<LADSPA plugin file name> <plugin label> "
+	    "<Control1> <Control2>...]...\n"
 	    "Flags:"
 	    "\t-s<seconds>  Add seconds of silence after end of input file.\n"
+	    "\t-s auto      Instead, keep going after the end of the input "
+	    "until the\n"
+	    "\t             output has stayed quiet for the tail window. Not "
+	    "with\n"
+	    "\t             --async, --pipeline, --chunks, --realtime or "
+	    "resampling.\n"
+	    "\t--tail-threshold <dB>\n"
+	    "\t             Level below full scale that counts as quiet for "
+	    "-s auto\n"
+	    "\t             (default %d).\n"
+	    "\t--tail-window <seconds>\n"
+	    "\t             How long the output must stay quiet (default "
+	    "%g).\n"
+	    "\t--tail-max <seconds>\n"
+	    "\t             The longest tail rendered (default %d).\n"
+	    "\t-f<format>   Output sample format: 16, 24, 32, float or "
+	    "double.\n"
+	    "\t             Defaults to the format of the input file.\n"
+	    "\t             Output files named *.w64 are written as Wave64, "
+	    "and those\n"
+	    "\t             over 4GB as RF64. Both are also read.\n"
+	    "\t--async <blocks>\n"
+	    "\t             Read and write on separate threads, keeping up to "
+	    "<blocks>\n"
+	    "\t             blocks (at least 2) in flight.\n"
+	    "\t--pipeline <threads>\n"
+	    "\t             Spread the plugins over this many threads "
+	    "(at least 2),\n"
+	    "\t             one block of latency each. Output is unchanged.\n"
+	    "\t--io-block <frames>\n"
+	    "\t             Frames read and written at a time (default %d).\n"
+	    "\t--dsp-block <frames>\n"
+	    "\t             Frames passed to each plugin run() call. Defaults "
+	    "to the\n"
+	    "\t             I/O block size.\n"
+	    "\t--autotune[=<seconds>]\n"
+	    "\t             Choose the DSP block size by timing the chain on "
+	    "the first\n"
+	    "\t             seconds of the input (default %g).\n"
+	    "\t--huge-pages\n"
+	    "\t             Put audio buffers on huge pages, reserved ones if "
+	    "there are\n"
+	    "\t             enough and otherwise transparent ones. Buffers "
+	    "always start\n"
+	    "\t             on a 64-byte boundary and plugins are told the "
+	    "alignment of\n"
+	    "\t             their audio ports in $"
+	    ARENA_ALIGNMENT_VARIABLE ".\n"
+	    "\t--automation <file>\n"
+	    "\t             Change controls while rendering. Each line reads "
+	    "\"<seconds>\n"
+	    "\t             <plugin> <control> <value> [<ramp seconds>]\", "
+	    "counting\n"
+	    "\t             plugins and controls from 1 or naming the "
+	    "control, in\n"
+	    "\t             double quotes if the name has spaces.\n"
+	    "\t--automation-step <frames>\n"
+	    "\t             Changes closer together than this are applied "
+	    "together, and\n"
+	    "\t             ramps move this often (default %d).\n"
+	    "\t--controls <file>\n"
+	    "\t             Log every control output after each DSP block to "
+	    "a binary\n"
+	    "\t             file, which --export-controls turns into CSV. "
+	    "Cannot be\n"
+	    "\t             used with --pipeline.\n"
+	    "\t--profile[=<JSON file>]\n"
+	    "\t             Time reading, decoding, each plugin, encoding and "
+	    "writing\n"
+	    "\t             and report the realtime factor and block time "
+	    "percentiles,\n"
+	    "\t             also as JSON if a file (or - for stdout) is "
+	    "given.\n"
+	    "\t--meter[=<JSON file>]\n"
+	    "\t             Measure the output as it is written and report "
+	    "each\n"
+	    "\t             channel's peak, true peak (4x oversampled), RMS "
+	    "level and\n"
+	    "\t             clipped samples and the EBU R128 integrated "
+	    "loudness, also\n"
+	    "\t             as JSON if a file (or - for stdout) is given. Not "
+	    "with\n"
+	    "\t             --chunks, --realtime, --compare, resampling, "
+	    "--batch,\n"
+	    "\t             --sweep, --graph or --daemon.\n"
+	    "\t--realtime <frames>\n"
+	    "\t             Run the chain a period of this many frames at a "
+	    "time on a\n"
+	    "\t             timer, as a sound card would, and report missed "
+	    "deadlines\n"
+	    "\t             (xruns) and timing. Exits with status 1 after any "
+	    "xrun.\n"
+	    "\t--rt-priority <1-99>\n"
+	    "\t             Run --realtime at this SCHED_FIFO priority.\n"
+	    "\t--chain-rate <Hz>\n"
+	    "\t             Resample the input to this rate and run the "
+	    "plugins at it.\n"
+	    "\t--output-rate <Hz>\n"
+	    "\t             Resample the output to this rate. Defaults to "
+	    "the rate the\n"
+	    "\t             plugins run at.\n"
+	    "\t--plugin-rate <plugin>:<Hz>\n"
+	    "\t             Run one plugin, counting from 1, at its own rate,\n"
+	    "\t             resampling around it. May be given more than "
+	    "once.\n"
+	    "\t             Resampling is done in the same pass as the "
+	    "plugins, and\n"
+	    "\t             cannot be used with --async, --pipeline, "
+	    "--autotune,\n"
+	    "\t             --chunks, --realtime, --automation, --controls, "
+	    "--profile,\n"
+	    "\t             --batch or --graph.\n"
+	    "\t--raw-input <format>:<channels>:<rate>\n"
+	    "\t             Read headerless interleaved samples, for instance\n"
+	    "\t             float:2:48000.\n"
+	    "\t--raw-output\n"
+	    "\t             Write headerless interleaved samples.\n"
+	    "\t             An input or output file of - is standard input "
+	    "or output,\n"
+	    "\t             streamed a block at a time. Input of unknown "
+	    "length is\n"
+	    "\t             read until it ends and Wave output to a pipe "
+	    "then has\n"
+	    "\t             unknown length in its header. Streams cannot be "
+	    "used with\n"
+	    "\t             --async, --pipeline, --autotune, --chunks, "
+	    "--realtime or\n"
+	    "\t             --batch.\n"
+	    "\t--chunks <threads>\n"
+	    "\t             Split the file into this many time ranges "
+	    "(at least 2) and\n"
+	    "\t             render each on its own thread. Each starts early "
+	    "by the\n"
+	    "\t             warm-up time, which is then discarded. Output is "
+	    "close to,\n"
+	    "\t             but not exactly, a serial render.\n"
+	    "\t--warm-up <seconds>\n"
+	    "\t             Warm-up time for --chunks (default %g).\n"
+	    "\t--start <seconds>\n"
+	    "\t--end <seconds>\n"
+	    "\t             Render only this part of the output. The input is "
+	    "sought to\n"
+	    "\t             the pre-roll before the start, which is run "
+	    "through the\n"
+	    "\t             chain to settle its state and then discarded. An "
+	    "input that\n"
+	    "\t             cannot seek is read up to it instead. Not with "
+	    "--async,\n"
+	    "\t             --pipeline, --chunks, --realtime, resampling, "
+	    "--sweep,\n"
+	    "\t             --graph or --daemon.\n"
+	    "\t--pre-roll <seconds>\n"
+	    "\t             Pre-roll time for --start (default %g).\n"
+	    "\t--verify-seams\n"
+	    "\t             After a --chunks render, render serially and "
+	    "report the\n"
+	    "\t             error after each seam.\n"
+	    "\t--batch <list file or directory>\n"
+	    "\t             Render many files through one chain. A list file "
+	    "holds an\n"
+	    "\t             input and an output file per line, separated by a "
+	    "tab. A\n"
+	    "\t             directory has each .wav file in it rendered into\n"
+	    "\t             --output-dir. Cannot be used with --async, "
+	    "--pipeline or\n"
+	    "\t             --autotune. Files that fail are reported and "
+	    "skipped, and\n"
+	    "\t             the exit status is then 1.\n"
+	    "\t--graph <graph file>\n"
+	    "\t             Process through a graph of plugins and mix points "
+	    "instead\n"
+	    "\t             of a chain. Lines are \"input <edges>\", \"output "
+	    "<edges>\",\n"
+	    "\t             \"node <name> <plugin file> <label> <inputs> -> "
+	    "<outputs>\n"
+	    "\t             <controls>\" and \"mix <edge> "
+	    "<edge>[*<gain>]...\".\n"
+	    "\t--sweep <sweep file>\n"
+	    "\t             Render the input once for each set of controls "
+	    "in the file,\n"
+	    "\t             decoding it only once. Lines \"<plugin> <control> "
+	    "<values>\"\n"
+	    "\t             give a grid, where a value may be "
+	    "<first>:<last>:<count>;\n"
+	    "\t             lines \"point <plugin>:<control>=<value>...\" give "
+	    "single\n"
+	    "\t             points. Outputs and control logs are numbered, "
+	    "as in\n"
+	    "\t             out.01.wav.\n"
+	    "\t--jobs <threads>\n"
+	    "\t             Batch, sweep or graph worker threads (default one "
+	    "per CPU).\n"
+	    "\t             Otherwise, threads to spread channels over when "
+	    "a mono\n"
+	    "\t             chain is run once per channel of a wider file.\n"
+	    "\t--daemon <socket>\n"
+	    "\t             Listen on a Unix domain socket and render jobs "
+	    "sent by\n"
+	    "\t             --client, on --jobs worker processes (default "
+	    "one per CPU)\n"
+	    "\t             that keep plugins loaded and chains instantiated "
+	    "between\n"
+	    "\t             jobs. The flags given to the daemon apply to "
+	    "every job. Not\n"
+	    "\t             with --async, --pipeline, --autotune, --chunks, "
+	    "--realtime,\n"
+	    "\t             --automation, --controls, --profile, raw files, "
+	    "resampling,\n"
+	    "\t             --batch, --sweep or --graph.\n"
+	    "\t--client <socket>\n"
+	    "\t             Send a render to a daemon and print its reply, "
+	    "exiting with\n"
+	    "\t             status 1 if it failed. \"status\" reports the "
+	    "daemon's job\n"
+	    "\t             counts and timing, \"shutdown\" stops it.\n"
+	    "\t--compare <reference Wave file>\n"
+	    "\t             Instead of writing an output file, compare the "
+	    "output, as\n"
+	    "\t             it would be written in the reference's sample "
+	    "format, with\n"
+	    "\t             the reference and report the maximum and RMS "
+	    "error, SNR and\n"
+	    "\t             the first sample out by more than the tolerance. "
+	    "Exits with\n"
+	    "\t             status 1 if there is one or the lengths differ. "
+	    "Not with\n"
+	    "\t             --async, --pipeline, --chunks, --realtime, "
+	    "--profile, raw\n"
+	    "\t             output, resampling, --batch, --sweep, --graph or "
+	    "--daemon.\n"
+	    "\t--tolerance <error>\n"
+	    "\t             The largest error --compare allows in a sample, "
+	    "full scale\n"
+	    "\t             being 1 (default 0).\n"
 	    "\n"
+	    "Plugins with one audio input and one audio output are run once "
+	    "per channel\n"
+	    "when given more channels than that.\n"
 	    "To find out what control values are needed by a plugin, "
 	    "use the\n"
 	    "\"analyseplugin\" program and check for control input ports.\n"
             "Note that the LADSPA_PATH environment variable is used "
-            "to help find plugins.\n");
+            "to help find plugins.\n",
+	    TAIL_THRESHOLD,
+	    (double)TAIL_WINDOW_SECONDS,
+	    TAIL_MAX_SECONDS,
+	    BUFFER_SIZE,
+	    (double)AUTOTUNE_SECONDS,
+	    AUTOMATION_STEP,
+	    (double)CHUNK_WARM_UP_SECONDS,
+	    (double)PRE_ROLL_SECONDS);
     return(1);
   }
 
-  return(0);
+  return(iExitStatus);
 }
 
 /*****************************************************************************/
@@ -0,0 +1,183 @@
+/* arena.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Used if /proc/meminfo does not say. */
+#define ARENA_DEFAULT_HUGE_PAGE_SIZE (2UL << 20)
+
+/*****************************************************************************/
+
+/* The default huge page size, which MAP_HUGETLB mappings must be a
+   multiple of and transparent huge pages are aligned to. */
+static unsigned long
+getHugePageSize(void) {
+
+  FILE * poFile;
+  char pcLine[128];
+  unsigned long lKilobytes;
+
+  lKilobytes = 0;
+  poFile = fopen("/proc/meminfo", "r");
+  if (poFile) {
+    while (fgets(pcLine, sizeof(pcLine), poFile))
+      if (sscanf(pcLine, "Hugepagesize: %lu kB", &lKilobytes) == 1)
+	break;
+    fclose(poFile);
+  }
+
+  return lKilobytes ? lKilobytes << 10 : ARENA_DEFAULT_HUGE_PAGE_SIZE;
+}
+
+static unsigned long
+roundUp(const unsigned long lSize, const unsigned long lGranule) {
+  return (lSize + lGranule - 1) / lGranule * lGranule;
+}
+
+/*****************************************************************************/
+
+unsigned long
+getArenaSpace(const unsigned long lBytes) {
+  return roundUp(lBytes, ARENA_ALIGNMENT);
+}
+
+int
+tryCreateBufferArena(BufferArena * psArena,
+		     const unsigned long lSize,
+		     const int bHugePages) {
+
+  unsigned long lHugePageSize;
+  unsigned long lMisalignment;
+  void * pvMapping;
+
+  psArena->lSize = roundUp(lSize ? lSize : 1, ARENA_ALIGNMENT);
+  psArena->lUsed = 0;
+  psArena->pvMapping = NULL;
+
+  if (bHugePages) {
+
+    /* Reserved huge pages first. These fail unless the administrator
+       has set some aside in /proc/sys/vm/nr_hugepages. */
+    lHugePageSize = getHugePageSize();
+    psArena->lMappingSize = roundUp(psArena->lSize, lHugePageSize);
+    pvMapping = mmap(NULL,
+		     psArena->lMappingSize,
+		     PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+		     -1,
+		     0);
+    if (pvMapping != MAP_FAILED) {
+      psArena->pvMapping = pvMapping;
+      psArena->pucBase = (unsigned char *)pvMapping;
+      psArena->iBacking = ARENA_HUGETLB;
+      return 0;
+    }
+
+    /* Otherwise ordinary pages the kernel may back with transparent
+       huge pages, over-allocated so the arena can start on a huge
+       page boundary. */
+    psArena->lMappingSize = roundUp(psArena->lSize, lHugePageSize)
+      + lHugePageSize;
+    pvMapping = mmap(NULL,
+		     psArena->lMappingSize,
+		     PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS,
+		     -1,
+		     0);
+    if (pvMapping == MAP_FAILED)
+      return -1;
+    psArena->pvMapping = pvMapping;
+    psArena->pucBase = (unsigned char *)pvMapping;
+    lMisalignment = (unsigned long)psArena->pucBase % lHugePageSize;
+    if (lMisalignment)
+      psArena->pucBase += lHugePageSize - lMisalignment;
+#ifdef MADV_HUGEPAGE
+    madvise(psArena->pucBase,
+	    roundUp(psArena->lSize, lHugePageSize),
+	    MADV_HUGEPAGE);
+#endif
+    psArena->iBacking = ARENA_TRANSPARENT;
+    return 0;
+  }
+
+  psArena->lMappingSize = psArena->lSize;
+  if (posix_memalign(&pvMapping, ARENA_ALIGNMENT, psArena->lSize) != 0)
+    return -1;
+  memset(pvMapping, 0, psArena->lSize);
+  psArena->pvMapping = pvMapping;
+  psArena->pucBase = (unsigned char *)pvMapping;
+  psArena->iBacking = ARENA_HEAP;
+  return 0;
+}
+
+void
+createBufferArena(BufferArena * psArena,
+		  const unsigned long lSize,
+		  const int bHugePages) {
+  if (tryCreateBufferArena(psArena, lSize, bHugePages) != 0) {
+    fprintf(stderr,
+	    "Failed to allocate %lu bytes of audio buffers.\n",
+	    psArena->lMappingSize);
+    exit(1);
+  }
+}
+
+void *
+allocateFromArena(BufferArena * psArena, const unsigned long lBytes) {
+
+  void * pvResult;
+
+  if (getArenaSpace(lBytes) > psArena->lSize - psArena->lUsed) {
+    fprintf(stderr,
+	    "Internal error: buffer arena of %lu bytes exhausted.\n",
+	    psArena->lSize);
+    exit(1);
+  }
+  pvResult = psArena->pucBase + psArena->lUsed;
+  psArena->lUsed += getArenaSpace(lBytes);
+
+  return pvResult;
+}
+
+void
+destroyBufferArena(BufferArena * psArena) {
+
+  if (psArena->pvMapping == NULL)
+    return;
+  if (psArena->iBacking == ARENA_HEAP)
+    free(psArena->pvMapping);
+  else
+    munmap(psArena->pvMapping, psArena->lMappingSize);
+  psArena->pvMapping = NULL;
+  psArena->pucBase = NULL;
+}
+
+const char *
+getArenaBackingName(const int iBacking) {
+  switch (iBacking) {
+  case ARENA_HUGETLB:
+    return "huge pages";
+  case ARENA_TRANSPARENT:
+    return "transparent huge pages";
+  default:
+    return "heap";
+  }
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,361 @@
+/* automation.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Most words allowed on one line of an automation file. */
+#define AUTOMATION_MAX_WORDS 8
+
+/*****************************************************************************/
+
+static int
+compareAutomationPoints(const void * pvA, const void * pvB) {
+
+  const AutomationPoint * psA;
+  const AutomationPoint * psB;
+
+  psA = (const AutomationPoint *)pvA;
+  psB = (const AutomationPoint *)pvB;
+
+  /* Points at the same time keep their order in the file. */
+  if (psA->lFrame != psB->lFrame)
+    return (psA->lFrame < psB->lFrame ? -1 : 1);
+  return (psA->lSequence < psB->lSequence
+	  ? -1
+	  : psA->lSequence > psB->lSequence);
+}
+
+static void
+failAutomationLine(const char * pcFilename,
+		   const unsigned long lLine,
+		   const char * pcMessage,
+		   const char * pcDetail) {
+  fprintf(stderr,
+	  "%s:%lu: %s \"%s\".\n",
+	  pcFilename,
+	  lLine,
+	  pcMessage,
+	  pcDetail);
+  exit(1);
+}
+
+/* Split pcLine in place into at most lMaxWords words separated by
+   white space. A word in double quotes may hold spaces, as control
+   names often do, and '#' outside quotes starts a comment. Returns
+   the number of words, or ~0 if a quote is not closed. */
+static unsigned long
+splitAutomationLine(char * pcLine,
+		    char ** ppcWords,
+		    const unsigned long lMaxWords) {
+
+  char * pcRead;
+  unsigned long lWordCount;
+
+  lWordCount = 0;
+  pcRead = pcLine;
+  while (lWordCount < lMaxWords) {
+
+    while (*pcRead != '\0' && strchr(" \t\r\n", *pcRead))
+      pcRead++;
+    if (*pcRead == '\0' || *pcRead == '#')
+      break;
+
+    if (*pcRead == '"') {
+      ppcWords[lWordCount++] = ++pcRead;
+      pcRead = strchr(pcRead, '"');
+      if (!pcRead)
+	return ~0UL;
+    }
+    else {
+      ppcWords[lWordCount++] = pcRead;
+      while (*pcRead != '\0' && !strchr(" \t\r\n#", *pcRead))
+	pcRead++;
+      if (*pcRead == '#') {
+	*pcRead = '\0';
+	break;
+      }
+    }
+    if (*pcRead == '\0')
+      break;
+    *(pcRead++) = '\0';
+  }
+
+  return lWordCount;
+}
+
+unsigned long
+findControl(const LADSPA_Descriptor * psDescriptor, const char * pcName) {
+
+  LADSPA_PortDescriptor iPortDescriptor;
+  char * pcEndPointer;
+  unsigned long lControlIndex;
+  unsigned long lNumber;
+  unsigned long lPortIndex;
+
+  lNumber = strtoul(pcName, &pcEndPointer, 10);
+  if (*pcEndPointer != '\0')
+    lNumber = 0;
+
+  lControlIndex = 0;
+  for (lPortIndex = 0; lPortIndex < psDescriptor->PortCount; lPortIndex++) {
+    iPortDescriptor = psDescriptor->PortDescriptors[lPortIndex];
+    if (LADSPA_IS_PORT_CONTROL(iPortDescriptor)
+	&& LADSPA_IS_PORT_INPUT(iPortDescriptor)) {
+      if (lControlIndex + 1 == lNumber
+	  || strcmp(psDescriptor->PortNames[lPortIndex], pcName) == 0)
+	return lControlIndex;
+      lControlIndex++;
+    }
+  }
+
+  return ~0UL;
+}
+
+/*****************************************************************************/
+
+PluginAutomation *
+loadAutomation(const char               * pcFilename,
+	       const unsigned long        lPluginCount,
+	       const LADSPA_Descriptor ** ppsPluginDescriptors,
+	       LADSPA_Data             ** ppfPluginControlValues,
+	       const unsigned long        lSampleRate,
+	       const unsigned long        lStep) {
+
+  AutomationPoint sPoint;
+  AutomationPoint * psLeader;
+  FILE * poFile;
+  PluginAutomation * psAutomation;
+  PluginAutomation * psPlugin;
+  char * pcEndPointer;
+  char * pcLine;
+  char * ppcWords[AUTOMATION_MAX_WORDS + 1];
+  double dRamp;
+  double dTime;
+  size_t lLineSize;
+  unsigned long lControlCount;
+  unsigned long lLine;
+  unsigned long lPluginIndex;
+  unsigned long lPointIndex;
+  unsigned long lWordCount;
+
+  psAutomation
+    = (PluginAutomation *)calloc(lPluginCount, sizeof(PluginAutomation));
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+    psPlugin = psAutomation + lPluginIndex;
+    lControlCount
+      = getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			   LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT);
+    psPlugin->lControlCount = lControlCount;
+    psPlugin->pfControls = ppfPluginControlValues[lPluginIndex];
+    psPlugin->lStep = lStep;
+    psPlugin->pfInitial
+      = (LADSPA_Data *)calloc(lControlCount + 1, sizeof(LADSPA_Data));
+    if (lControlCount > 0)
+      memcpy(psPlugin->pfInitial,
+	     psPlugin->pfControls,
+	     lControlCount * sizeof(LADSPA_Data));
+    psPlugin->psRamps
+      = (AutomationRamp *)calloc(lControlCount + 1, sizeof(AutomationRamp));
+  }
+
+  poFile = fopen(pcFilename, "r");
+  if (!poFile) {
+    fprintf(stderr, "Failed to open automation file \"%s\".\n", pcFilename);
+    exit(1);
+  }
+
+  pcLine = NULL;
+  lLineSize = 0;
+  lLine = 0;
+  while (getline(&pcLine, &lLineSize, poFile) >= 0) {
+
+    lLine++;
+    lWordCount = splitAutomationLine(pcLine, ppcWords, AUTOMATION_MAX_WORDS);
+    if (lWordCount == ~0UL) {
+      fprintf(stderr, "%s:%lu: unclosed quote.\n", pcFilename, lLine);
+      exit(1);
+    }
+    if (lWordCount == 0)
+      continue;
+    if (lWordCount < 4 || lWordCount > 5) {
+      fprintf(stderr,
+	      "%s:%lu: expected <seconds> <plugin> <control> <value> "
+	      "[<ramp seconds>].\n",
+	      pcFilename,
+	      lLine);
+      exit(1);
+    }
+
+    memset(&sPoint, 0, sizeof(sPoint));
+
+    dTime = strtod(ppcWords[0], &pcEndPointer);
+    if (*pcEndPointer != '\0' || dTime < 0)
+      failAutomationLine(pcFilename, lLine, "Bad time", ppcWords[0]);
+    sPoint.lFrame = (unsigned long)(dTime * lSampleRate + 0.5);
+
+    lPluginIndex = strtoul(ppcWords[1], &pcEndPointer, 10);
+    if (*pcEndPointer != '\0'
+	|| lPluginIndex < 1
+	|| lPluginIndex > lPluginCount)
+      failAutomationLine(pcFilename, lLine, "No such plugin", ppcWords[1]);
+    lPluginIndex--;
+
+    sPoint.lControl = findControl(ppsPluginDescriptors[lPluginIndex],
+				  ppcWords[2]);
+    if (sPoint.lControl == ~0UL)
+      failAutomationLine(pcFilename, lLine, "No such control", ppcWords[2]);
+
+    sPoint.fValue = (LADSPA_Data)strtod(ppcWords[3], &pcEndPointer);
+    if (*pcEndPointer != '\0')
+      failAutomationLine(pcFilename, lLine, "Bad value", ppcWords[3]);
+
+    if (lWordCount == 5) {
+      dRamp = strtod(ppcWords[4], &pcEndPointer);
+      if (*pcEndPointer != '\0' || dRamp < 0)
+	failAutomationLine(pcFilename, lLine, "Bad ramp time", ppcWords[4]);
+      sPoint.lRampFrames = (unsigned long)(dRamp * lSampleRate + 0.5);
+    }
+
+    psPlugin = psAutomation + lPluginIndex;
+    sPoint.lSequence = psPlugin->lPointCount;
+    psPlugin->psPoints
+      = (AutomationPoint *)realloc(psPlugin->psPoints,
+				   (psPlugin->lPointCount + 1)
+				   * sizeof(AutomationPoint));
+    psPlugin->psPoints[psPlugin->lPointCount++] = sPoint;
+  }
+  free(pcLine);
+  fclose(poFile);
+
+  /* Points less than a step after an earlier one are moved back to
+     it so they share a run() call. This is done here rather than
+     while rendering so the result does not depend on block sizes. */
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+    psPlugin = psAutomation + lPluginIndex;
+    qsort(psPlugin->psPoints,
+	  psPlugin->lPointCount,
+	  sizeof(AutomationPoint),
+	  compareAutomationPoints);
+    psLeader = psPlugin->psPoints;
+    for (lPointIndex = 1; lPointIndex < psPlugin->lPointCount; lPointIndex++)
+      if (psPlugin->psPoints[lPointIndex].lFrame < psLeader->lFrame + lStep)
+	psPlugin->psPoints[lPointIndex].lFrame = psLeader->lFrame;
+      else
+	psLeader = psPlugin->psPoints + lPointIndex;
+  }
+
+  return psAutomation;
+}
+
+/*****************************************************************************/
+
+void
+resetAutomation(PluginAutomation * psAutomation) {
+
+  psAutomation->lNextPoint = 0;
+  psAutomation->lRampCount = 0;
+  memset(psAutomation->psRamps,
+	 0,
+	 psAutomation->lControlCount * sizeof(AutomationRamp));
+  if (psAutomation->lControlCount > 0)
+    memcpy(psAutomation->pfControls,
+	   psAutomation->pfInitial,
+	   psAutomation->lControlCount * sizeof(LADSPA_Data));
+}
+
+unsigned long
+applyAutomation(PluginAutomation * psAutomation,
+		const unsigned long lPosition) {
+
+  AutomationPoint * psPoint;
+  AutomationRamp * psRamp;
+  unsigned long lControlIndex;
+  unsigned long lNext;
+  unsigned long lStepStart;
+
+  while (psAutomation->lNextPoint < psAutomation->lPointCount
+	 && (psAutomation->psPoints[psAutomation->lNextPoint].lFrame
+	     <= lPosition)) {
+    psPoint = psAutomation->psPoints + psAutomation->lNextPoint++;
+    psRamp = psAutomation->psRamps + psPoint->lControl;
+    if (psRamp->bActive) {
+      psRamp->bActive = 0;
+      psAutomation->lRampCount--;
+    }
+    if (psPoint->lRampFrames == 0)
+      psAutomation->pfControls[psPoint->lControl] = psPoint->fValue;
+    else {
+      psRamp->bActive = 1;
+      psRamp->lStart = psPoint->lFrame;
+      psRamp->lEnd = psPoint->lFrame + psPoint->lRampFrames;
+      psRamp->fFrom = psAutomation->pfControls[psPoint->lControl];
+      psRamp->fTo = psPoint->fValue;
+      psAutomation->lRampCount++;
+    }
+  }
+
+  lNext = ~0UL;
+  if (psAutomation->lNextPoint < psAutomation->lPointCount)
+    lNext = psAutomation->psPoints[psAutomation->lNextPoint].lFrame;
+
+  /* Ramps move a step at a time, counted from the start of the ramp,
+     and hold the value from the start of the step. */
+  if (psAutomation->lRampCount > 0)
+    for (lControlIndex = 0;
+	 lControlIndex < psAutomation->lControlCount;
+	 lControlIndex++) {
+      psRamp = psAutomation->psRamps + lControlIndex;
+      if (!psRamp->bActive)
+	continue;
+      if (lPosition >= psRamp->lEnd) {
+	psAutomation->pfControls[lControlIndex] = psRamp->fTo;
+	psRamp->bActive = 0;
+	psAutomation->lRampCount--;
+	continue;
+      }
+      lStepStart = (lPosition
+		    - (lPosition - psRamp->lStart) % psAutomation->lStep);
+      psAutomation->pfControls[lControlIndex]
+	= (psRamp->fFrom
+	   + ((psRamp->fTo - psRamp->fFrom)
+	      * (LADSPA_Data)(lStepStart - psRamp->lStart)
+	      / (LADSPA_Data)(psRamp->lEnd - psRamp->lStart)));
+      if (lNext > lStepStart + psAutomation->lStep)
+	lNext = lStepStart + psAutomation->lStep;
+      if (lNext > psRamp->lEnd)
+	lNext = psRamp->lEnd;
+    }
+
+  return (lNext == ~0UL ? ~0UL : lNext - lPosition);
+}
+
+void
+freeAutomation(PluginAutomation * psAutomation,
+	       const unsigned long lPluginCount) {
+
+  unsigned long lPluginIndex;
+
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+    free(psAutomation[lPluginIndex].psPoints);
+    free(psAutomation[lPluginIndex].pfInitial);
+    free(psAutomation[lPluginIndex].psRamps);
+  }
+  free(psAutomation);
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,936 @@
+/* chain.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Room for the messages of the functions here that exit on error. */
+#define CHAIN_ERROR_SIZE 512
+
+/*****************************************************************************/
+
+unsigned long
+getPortCountByType(const LADSPA_Descriptor     * psDescriptor,
+		   const LADSPA_PortDescriptor   iType) {
+
+  unsigned long lCount;
+  unsigned long lIndex;
+
+  lCount = 0;
+  for (lIndex = 0; lIndex < psDescriptor->PortCount; lIndex++)
+    if ((psDescriptor->PortDescriptors[lIndex] & iType) == iType)
+      lCount++;
+
+  return lCount;
+}
+
+/* How many instances of a plugin to run when lChannelCount channels
+   reach it: one if they match its audio inputs, one per channel for
+   a plugin with a single audio input and output, otherwise none. */
+static unsigned long
+getInstanceCount(const LADSPA_Descriptor * psDescriptor,
+		 const unsigned long lChannelCount) {
+
+  unsigned long lInputCount;
+
+  lInputCount = getPortCountByType(psDescriptor,
+				   LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT);
+  if (lInputCount == lChannelCount)
+    return 1;
+  if (lInputCount == 1
+      && lChannelCount > 1
+      && getPortCountByType(psDescriptor,
+			    LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT) == 1)
+    return lChannelCount;
+  return 0;
+}
+
+/* Walk the channels down the chain, filling in the instance count of
+   each plugin if plInstanceCounts is not NULL, and the number of
+   channels leaving it in *plOutputCount. Returns -1, with a message
+   in pcError, if the channels do not match up and 0 otherwise. */
+static int
+checkPluginChain(const unsigned long        lPluginCount,
+		 const LADSPA_Descriptor ** ppsPluginDescriptors,
+		 const unsigned long        lChannelCount,
+		 unsigned long            * plInstanceCounts,
+		 unsigned long            * plOutputCount,
+		 char                     * pcError,
+		 const size_t               lErrorSize) {
+
+  unsigned long lChannels;
+  unsigned long lInstanceCount;
+  unsigned long lPluginIndex;
+
+  lChannels = lChannelCount;
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+
+    lInstanceCount = getInstanceCount(ppsPluginDescriptors[lPluginIndex],
+				      lChannels);
+    if (lInstanceCount == 0) {
+      if (lPluginIndex == 0)
+	snprintf(pcError,
+		 lErrorSize,
+		 "There is a mismatch between the number of channels coming "
+		 "in (%ld) and the number of input channels on plugin \"%s\" "
+		 "(%ld).",
+		 lChannels,
+		 ppsPluginDescriptors[lPluginIndex]->Name,
+		 getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+				    LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT));
+      else
+	snprintf(pcError,
+		 lErrorSize,
+		 "There is a mismatch between the number of output channels "
+		 "on plugin \"%s\" (%ld) and the number of input channels on "
+		 "plugin \"%s\" (%ld).",
+		 ppsPluginDescriptors[lPluginIndex - 1]->Name,
+		 lChannels,
+		 ppsPluginDescriptors[lPluginIndex]->Name,
+		 getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+				    LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT));
+      return -1;
+    }
+
+    if (plInstanceCounts)
+      plInstanceCounts[lPluginIndex] = lInstanceCount;
+    lChannels = lInstanceCount
+      * getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			   LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT);
+  }
+
+  *plOutputCount = lChannels;
+  return 0;
+}
+
+int
+tryGetPluginChainOutputCount(const unsigned long        lPluginCount,
+			     const LADSPA_Descriptor ** ppsPluginDescriptors,
+			     const unsigned long        lChannelCount,
+			     unsigned long            * plOutputCount,
+			     char                     * pcError,
+			     const size_t               lErrorSize) {
+  return checkPluginChain(lPluginCount,
+			  ppsPluginDescriptors,
+			  lChannelCount,
+			  NULL,
+			  plOutputCount,
+			  pcError,
+			  lErrorSize);
+}
+
+unsigned long
+getPluginChainOutputCount(const unsigned long        lPluginCount,
+			  const LADSPA_Descriptor ** ppsPluginDescriptors,
+			  const unsigned long        lChannelCount) {
+
+  char pcError[CHAIN_ERROR_SIZE];
+  unsigned long lOutputCount;
+
+  if (tryGetPluginChainOutputCount(lPluginCount,
+				   ppsPluginDescriptors,
+				   lChannelCount,
+				   &lOutputCount,
+				   pcError,
+				   sizeof(pcError)) != 0) {
+    fprintf(stderr, "%s\n", pcError);
+    exit(1);
+  }
+
+  return lOutputCount;
+}
+
+/*****************************************************************************/
+
+/* Decide which buffer each audio port uses. Walking down the chain,
+   the signals between two plugins are live and hold a buffer each.
+   A plugin that can run in place writes each output over the
+   matching input; an INPLACE_BROKEN plugin needs buffers for its
+   outputs that none of its inputs use. New buffers are always the
+   lowest free index, which for a linear chain needs no more buffers
+   than the busiest plugin. The chain inputs start in buffers 0
+   upwards. A plugin run once per channel takes the live signals in
+   order, an instance at a time. */
+static void
+planPluginChainBuffers(PluginChain * psChain) {
+
+  const LADSPA_Descriptor * psDescriptor;
+  LADSPA_PortDescriptor iPortDescriptor;
+  char * pcBusy;
+  int bInPlace;
+  unsigned long * plLive;
+  unsigned long * plNext;
+  unsigned long * plSwap;
+  unsigned long lBuffer;
+  unsigned long lIndex;
+  unsigned long lInputIndex;
+  unsigned long lInstanceIndex;
+  unsigned long lLimit;
+  unsigned long lLiveCount;
+  unsigned long lOutputIndex;
+  unsigned long lPluginIndex;
+  unsigned long lPortIndex;
+
+  /* No plugin can need more buffers than its instances have audio
+     ports. */
+  lLimit = psChain->lInputCount + 1;
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    if (lLimit < (psChain->ppsDescriptors[lPluginIndex]->PortCount
+		  * psChain->plInstanceCounts[lPluginIndex]))
+      lLimit = (psChain->ppsDescriptors[lPluginIndex]->PortCount
+		* psChain->plInstanceCounts[lPluginIndex]);
+
+  pcBusy = (char *)calloc(lLimit, 1);
+  plLive = (unsigned long *)calloc(lLimit, sizeof(unsigned long));
+  plNext = (unsigned long *)calloc(lLimit, sizeof(unsigned long));
+  psChain->pplPortBuffers
+    = (unsigned long **)calloc(psChain->lPluginCount, sizeof(unsigned long *));
+
+  lLiveCount = psChain->lInputCount;
+  for (lIndex = 0; lIndex < lLiveCount; lIndex++)
+    plLive[lIndex] = lIndex;
+  psChain->lBufferCount = lLiveCount;
+
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++) {
+
+    psDescriptor = psChain->ppsDescriptors[lPluginIndex];
+    bInPlace = !LADSPA_IS_INPLACE_BROKEN(psDescriptor->Properties);
+    psChain->pplPortBuffers[lPluginIndex]
+      = (unsigned long *)calloc(psDescriptor->PortCount
+				* psChain->plInstanceCounts[lPluginIndex],
+				sizeof(unsigned long));
+
+    memset(pcBusy, 0, lLimit);
+    for (lIndex = 0; lIndex < lLiveCount; lIndex++)
+      pcBusy[plLive[lIndex]] = 1;
+
+    lInputIndex = 0;
+    lOutputIndex = 0;
+    for (lInstanceIndex = 0;
+	 lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+	 lInstanceIndex++)
+      for (lPortIndex = 0;
+	   lPortIndex < psDescriptor->PortCount;
+	   lPortIndex++) {
+	iPortDescriptor = psDescriptor->PortDescriptors[lPortIndex];
+	if (!LADSPA_IS_PORT_AUDIO(iPortDescriptor))
+	  continue;
+	if (LADSPA_IS_PORT_INPUT(iPortDescriptor))
+	  lBuffer = plLive[lInputIndex++];
+	else {
+	  if (bInPlace && lOutputIndex < lLiveCount)
+	    lBuffer = plLive[lOutputIndex];
+	  else {
+	    for (lBuffer = 0; pcBusy[lBuffer]; lBuffer++)
+	      ;
+	    pcBusy[lBuffer] = 1;
+	  }
+	  plNext[lOutputIndex++] = lBuffer;
+	}
+	psChain->pplPortBuffers[lPluginIndex]
+	  [lInstanceIndex * psDescriptor->PortCount + lPortIndex] = lBuffer;
+	if (psChain->lBufferCount < lBuffer + 1)
+	  psChain->lBufferCount = lBuffer + 1;
+      }
+
+    plSwap = plLive;
+    plLive = plNext;
+    plNext = plSwap;
+    lLiveCount = lOutputIndex;
+  }
+
+  /* The chain outputs are moved to the front once a block has been
+     processed: outputs first, then the other buffers in order. */
+  psChain->plOutputOrder
+    = (unsigned long *)calloc(psChain->lBufferCount, sizeof(unsigned long));
+  psChain->ppfReorder
+    = (LADSPA_Data **)calloc(psChain->lBufferCount, sizeof(LADSPA_Data *));
+  memset(pcBusy, 0, lLimit);
+  for (lIndex = 0; lIndex < lLiveCount; lIndex++) {
+    psChain->plOutputOrder[lIndex] = plLive[lIndex];
+    pcBusy[plLive[lIndex]] = 1;
+  }
+  for (lBuffer = 0; lBuffer < psChain->lBufferCount; lBuffer++)
+    if (!pcBusy[lBuffer])
+      psChain->plOutputOrder[lIndex++] = lBuffer;
+  psChain->bReorderBuffers = 0;
+  for (lIndex = 0; lIndex < psChain->lBufferCount; lIndex++)
+    if (psChain->plOutputOrder[lIndex] != lIndex)
+      psChain->bReorderBuffers = 1;
+
+  free(pcBusy);
+  free(plLive);
+  free(plNext);
+}
+
+/*****************************************************************************/
+
+int
+tryCreatePluginChain(PluginChain              * psChain,
+		     const unsigned long        lPluginCount,
+		     const LADSPA_Descriptor ** ppsPluginDescriptors,
+		     LADSPA_Data             ** ppfPluginControlValues,
+		     const unsigned long        lChannelCount,
+		     const unsigned long        lSampleRate,
+		     char                     * pcError,
+		     const size_t               lErrorSize) {
+
+  LADSPA_Handle psInstance;
+  LADSPA_Data * pfControlOutputs;
+  LADSPA_PortDescriptor iPortDescriptor;
+  unsigned long lArenaSize;
+  unsigned long lControlIndex;
+  unsigned long lControlOutputCount;
+  unsigned long lControlOutputIndex;
+  unsigned long lInstanceIndex;
+  unsigned long lPluginIndex;
+  unsigned long lPortIndex;
+
+  memset(psChain, 0, sizeof(PluginChain));
+  psChain->lPluginCount = lPluginCount;
+  psChain->ppsDescriptors = ppsPluginDescriptors;
+  psChain->ppfControlValues = ppfPluginControlValues;
+  psChain->lSampleRate = lSampleRate;
+  psChain->bEndOfChain = 1;
+
+  /* Count instances and buffers and sanity-check the flow graph:
+     ------------------------------------------------------------ */
+
+  psChain->plInstanceCounts
+    = (unsigned long *)calloc(lPluginCount, sizeof(unsigned long));
+  psChain->lInputCount = lChannelCount;
+  if (checkPluginChain(lPluginCount,
+		       ppsPluginDescriptors,
+		       lChannelCount,
+		       psChain->plInstanceCounts,
+		       &psChain->lOutputCount,
+		       pcError,
+		       lErrorSize) != 0) {
+    free(psChain->plInstanceCounts);
+    psChain->plInstanceCounts = NULL;
+    return -1;
+  }
+
+  planPluginChainBuffers(psChain);
+
+  /* Create instances and wire up the controls:
+     ------------------------------------------ */
+
+  psChain->pppsInstances
+    = (LADSPA_Handle **)calloc(lPluginCount, sizeof(LADSPA_Handle *));
+  psChain->ppfControlOutputs
+    = (LADSPA_Data **)calloc(lPluginCount, sizeof(LADSPA_Data *));
+
+  /* The control outputs of every instance share one arena, those of
+     a plugin's instances one after another. */
+  lArenaSize = 0;
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+    lArenaSize += getArenaSpace((psChain->plInstanceCounts[lPluginIndex]
+				 * getPortCountByType
+				 (ppsPluginDescriptors[lPluginIndex],
+				  LADSPA_PORT_CONTROL | LADSPA_PORT_OUTPUT)
+				 + 1) * sizeof(LADSPA_Data));
+  if (tryCreateBufferArena(&psChain->sControlArena, lArenaSize, 0) != 0) {
+    snprintf(pcError, lErrorSize, "Failed to allocate control outputs.");
+    destroyPluginChain(psChain);
+    return -1;
+  }
+
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+
+    psChain->pppsInstances[lPluginIndex]
+      = (LADSPA_Handle *)calloc(psChain->plInstanceCounts[lPluginIndex],
+				sizeof(LADSPA_Handle));
+    lControlOutputCount
+      = getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			   LADSPA_PORT_CONTROL | LADSPA_PORT_OUTPUT);
+    psChain->ppfControlOutputs[lPluginIndex]
+      = (LADSPA_Data *)allocateFromArena
+      (&psChain->sControlArena,
+       (psChain->plInstanceCounts[lPluginIndex] * lControlOutputCount + 1)
+       * sizeof(LADSPA_Data));
+
+    for (lInstanceIndex = 0;
+	 lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+	 lInstanceIndex++) {
+
+      psInstance
+	= ppsPluginDescriptors[lPluginIndex]
+	->instantiate(ppsPluginDescriptors[lPluginIndex],
+		      lSampleRate);
+      if (!psInstance) {
+	snprintf(pcError,
+		 lErrorSize,
+		 "Failed to instantiate plugin of type \"%s\".",
+		 ppsPluginDescriptors[lPluginIndex]->Name);
+	destroyPluginChain(psChain);
+	return -1;
+      }
+      psChain->pppsInstances[lPluginIndex][lInstanceIndex] = psInstance;
+
+      pfControlOutputs = (psChain->ppfControlOutputs[lPluginIndex]
+			  + lInstanceIndex * lControlOutputCount);
+
+      lControlIndex = 0;
+      lControlOutputIndex = 0;
+      for (lPortIndex = 0;
+	   lPortIndex < ppsPluginDescriptors[lPluginIndex]->PortCount;
+	   lPortIndex++) {
+
+	iPortDescriptor
+	  = ppsPluginDescriptors[lPluginIndex]->PortDescriptors[lPortIndex];
+
+	if (LADSPA_IS_PORT_CONTROL(iPortDescriptor)) {
+	  if (LADSPA_IS_PORT_INPUT(iPortDescriptor))
+	    ppsPluginDescriptors[lPluginIndex]->connect_port
+	      (psInstance,
+	       lPortIndex,
+	       ppfPluginControlValues[lPluginIndex] + (lControlIndex++));
+	  if (LADSPA_IS_PORT_OUTPUT(iPortDescriptor))
+	    ppsPluginDescriptors[lPluginIndex]->connect_port
+	      (psInstance,
+	       lPortIndex,
+	       pfControlOutputs + (lControlOutputIndex++));
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
+void
+createPluginChain(PluginChain              * psChain,
+		  const unsigned long        lPluginCount,
+		  const LADSPA_Descriptor ** ppsPluginDescriptors,
+		  LADSPA_Data             ** ppfPluginControlValues,
+		  const unsigned long        lChannelCount,
+		  const unsigned long        lSampleRate) {
+
+  char pcError[CHAIN_ERROR_SIZE];
+
+  if (tryCreatePluginChain(psChain,
+			   lPluginCount,
+			   ppsPluginDescriptors,
+			   ppfPluginControlValues,
+			   lChannelCount,
+			   lSampleRate,
+			   pcError,
+			   sizeof(pcError)) != 0) {
+    fprintf(stderr, "%s\n", pcError);
+    exit(1);
+  }
+}
+
+/*****************************************************************************/
+
+static void
+connectPlugin(PluginChain * psChain,
+	      const unsigned long lPluginIndex,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lOffset) {
+
+  const LADSPA_Descriptor * psDescriptor;
+  unsigned long * plPortBuffers;
+  unsigned long lInstanceIndex;
+  unsigned long lPortIndex;
+
+  psDescriptor = psChain->ppsDescriptors[lPluginIndex];
+  for (lInstanceIndex = 0;
+       lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+       lInstanceIndex++) {
+    plPortBuffers = (psChain->pplPortBuffers[lPluginIndex]
+		     + lInstanceIndex * psDescriptor->PortCount);
+    for (lPortIndex = 0; lPortIndex < psDescriptor->PortCount; lPortIndex++)
+      if (LADSPA_IS_PORT_AUDIO(psDescriptor->PortDescriptors[lPortIndex]))
+	psDescriptor->connect_port
+	  (psChain->pppsInstances[lPluginIndex][lInstanceIndex],
+	   lPortIndex,
+	   ppfBuffers[plPortBuffers[lPortIndex]] + lOffset);
+  }
+}
+
+void
+connectPluginChain(PluginChain * psChain,
+		   LADSPA_Data ** ppfBuffers,
+		   const unsigned long lOffset) {
+
+  unsigned long lPluginIndex;
+
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    connectPlugin(psChain, lPluginIndex, ppfBuffers, lOffset);
+}
+
+/*****************************************************************************/
+
+void
+getPluginChainSegment(const PluginChain * psChain,
+		      const unsigned long lFirst,
+		      const unsigned long lCount,
+		      PluginChain * psSegment) {
+
+  *psSegment = *psChain;
+  psSegment->lPluginCount = lCount;
+  psSegment->ppsDescriptors = psChain->ppsDescriptors + lFirst;
+  psSegment->plInstanceCounts = psChain->plInstanceCounts + lFirst;
+  psSegment->pppsInstances = psChain->pppsInstances + lFirst;
+  psSegment->ppfControlValues = psChain->ppfControlValues + lFirst;
+  psSegment->pplPortBuffers = psChain->pplPortBuffers + lFirst;
+  psSegment->ppfControlOutputs = psChain->ppfControlOutputs + lFirst;
+  if (psChain->psAutomation != NULL)
+    psSegment->psAutomation = psChain->psAutomation + lFirst;
+  if (psChain->psProfile != NULL)
+    psSegment->psProfile = psChain->psProfile + lFirst;
+  psSegment->bEndOfChain = (psChain->bEndOfChain
+			    && lFirst + lCount == psChain->lPluginCount);
+}
+
+/*****************************************************************************/
+
+/* Threads running the channels of a chain in groups, each group on a
+   chain and buffers of its own. The caller runs the first group
+   itself, and all meet at sBarrier before and after each block. */
+typedef struct ChainThreads ChainThreads;
+
+typedef struct {
+  ChainThreads * psThreads;
+  unsigned long lGroup;
+} ChainWorker;
+
+struct ChainThreads {
+
+  unsigned long lGroupCount;
+  PluginChain * psChains;
+  LADSPA_Data *** pppfBuffers;
+  BufferArena * psArenas;
+  unsigned long * plFirstChannels;
+
+  pthread_t * psThreads;
+  ChainWorker * psWorkers;
+  pthread_barrier_t sBarrier;
+  int bQuit;
+
+  /* The block being run. */
+  LADSPA_Data ** ppfBuffers;
+  unsigned long lFrameCount;
+  unsigned long lSubBlockSize;
+
+};
+
+/* Run one group's channels of the current block. The group's chain
+   is handed the caller's buffers for its channels, and whichever
+   buffers it leaves its outputs in are handed back, so nothing is
+   copied. */
+static void
+runChainGroup(ChainThreads * psThreads, const unsigned long lGroup) {
+
+  LADSPA_Data ** ppfGroupBuffers;
+  PluginChain * psGroupChain;
+  unsigned long lChannelIndex;
+  unsigned long lFirstChannel;
+
+  psGroupChain = psThreads->psChains + lGroup;
+  ppfGroupBuffers = psThreads->pppfBuffers[lGroup];
+  lFirstChannel = psThreads->plFirstChannels[lGroup];
+
+  for (lChannelIndex = 0;
+       lChannelIndex < psGroupChain->lInputCount;
+       lChannelIndex++)
+    ppfGroupBuffers[lChannelIndex]
+      = psThreads->ppfBuffers[lFirstChannel + lChannelIndex];
+  processPluginChain(psGroupChain,
+		     ppfGroupBuffers,
+		     psThreads->lFrameCount,
+		     psThreads->lSubBlockSize);
+  for (lChannelIndex = 0;
+       lChannelIndex < psGroupChain->lOutputCount;
+       lChannelIndex++)
+    psThreads->ppfBuffers[lFirstChannel + lChannelIndex]
+      = ppfGroupBuffers[lChannelIndex];
+}
+
+static void *
+chainWorker(void * pvWorker) {
+
+  ChainWorker * psWorker;
+  ChainThreads * psThreads;
+
+  psWorker = (ChainWorker *)pvWorker;
+  psThreads = psWorker->psThreads;
+  for (;;) {
+    pthread_barrier_wait(&psThreads->sBarrier);
+    if (psThreads->bQuit)
+      break;
+    runChainGroup(psThreads, psWorker->lGroup);
+    pthread_barrier_wait(&psThreads->sBarrier);
+  }
+
+  return NULL;
+}
+
+unsigned long
+startPluginChainThreads(PluginChain * psChain,
+			unsigned long lThreadCount,
+			const unsigned long lBlockSize,
+			const int bHugePages) {
+
+  ChainThreads * psThreads;
+  unsigned long lBufferIndex;
+  unsigned long lChannelCount;
+  unsigned long lGroup;
+  unsigned long lInstanceIndex;
+  unsigned long lPluginIndex;
+
+  if (lThreadCount > psChain->lInputCount)
+    lThreadCount = psChain->lInputCount;
+  if (lThreadCount < 2
+      || psChain->pvThreads != NULL
+      || psChain->psAutomation != NULL
+      || psChain->psControlLog != NULL
+      || psChain->psProfile != NULL)
+    return 1;
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    if (psChain->plInstanceCounts[lPluginIndex] != psChain->lInputCount)
+      return 1;
+
+  psThreads = (ChainThreads *)calloc(1, sizeof(ChainThreads));
+  psThreads->lGroupCount = lThreadCount;
+  psThreads->psChains
+    = (PluginChain *)calloc(lThreadCount, sizeof(PluginChain));
+  psThreads->pppfBuffers
+    = (LADSPA_Data ***)calloc(lThreadCount, sizeof(LADSPA_Data **));
+  psThreads->psArenas
+    = (BufferArena *)calloc(lThreadCount, sizeof(BufferArena));
+  psThreads->plFirstChannels
+    = (unsigned long *)calloc(lThreadCount, sizeof(unsigned long));
+
+  /* Groups of contiguous channels, as even as they can be. */
+  for (lGroup = 0; lGroup < lThreadCount; lGroup++) {
+    psThreads->plFirstChannels[lGroup]
+      = psChain->lInputCount * lGroup / lThreadCount;
+    lChannelCount
+      = (psChain->lInputCount * (lGroup + 1) / lThreadCount
+	 - psThreads->plFirstChannels[lGroup]);
+    createPluginChain(psThreads->psChains + lGroup,
+		      psChain->lPluginCount,
+		      psChain->ppsDescriptors,
+		      psChain->ppfControlValues,
+		      lChannelCount,
+		      psChain->lSampleRate);
+    createBufferArena(psThreads->psArenas + lGroup,
+		      (getArenaSpace(psThreads->psChains[lGroup].lBufferCount
+				     * sizeof(LADSPA_Data *))
+		       + (psThreads->psChains[lGroup].lBufferCount
+			  * getArenaSpace(lBlockSize * sizeof(LADSPA_Data)))),
+		      bHugePages);
+    psThreads->pppfBuffers[lGroup]
+      = (LADSPA_Data **)allocateFromArena
+      (psThreads->psArenas + lGroup,
+       psThreads->psChains[lGroup].lBufferCount * sizeof(LADSPA_Data *));
+    for (lBufferIndex = 0;
+	 lBufferIndex < psThreads->psChains[lGroup].lBufferCount;
+	 lBufferIndex++)
+      psThreads->pppfBuffers[lGroup][lBufferIndex]
+	= (LADSPA_Data *)allocateFromArena(psThreads->psArenas + lGroup,
+					   lBlockSize * sizeof(LADSPA_Data));
+  }
+
+  /* The chain's own instances are not run any more. */
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    for (lInstanceIndex = 0;
+	 lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+	 lInstanceIndex++) {
+      psChain->ppsDescriptors[lPluginIndex]
+	->cleanup(psChain->pppsInstances[lPluginIndex][lInstanceIndex]);
+      psChain->pppsInstances[lPluginIndex][lInstanceIndex] = NULL;
+    }
+
+  pthread_barrier_init(&psThreads->sBarrier, NULL, lThreadCount);
+  psThreads->psThreads
+    = (pthread_t *)calloc(lThreadCount, sizeof(pthread_t));
+  psThreads->psWorkers
+    = (ChainWorker *)calloc(lThreadCount, sizeof(ChainWorker));
+  for (lGroup = 1; lGroup < lThreadCount; lGroup++) {
+    psThreads->psWorkers[lGroup].psThreads = psThreads;
+    psThreads->psWorkers[lGroup].lGroup = lGroup;
+    if (pthread_create(psThreads->psThreads + lGroup,
+		       NULL,
+		       chainWorker,
+		       psThreads->psWorkers + lGroup) != 0) {
+      fprintf(stderr, "Failed to start channel threads.\n");
+      exit(1);
+    }
+  }
+
+  psChain->pvThreads = psThreads;
+  return lThreadCount;
+}
+
+static void
+stopPluginChainThreads(PluginChain * psChain) {
+
+  ChainThreads * psThreads;
+  unsigned long lGroup;
+
+  psThreads = (ChainThreads *)psChain->pvThreads;
+  psThreads->bQuit = 1;
+  pthread_barrier_wait(&psThreads->sBarrier);
+  for (lGroup = 1; lGroup < psThreads->lGroupCount; lGroup++)
+    pthread_join(psThreads->psThreads[lGroup], NULL);
+  pthread_barrier_destroy(&psThreads->sBarrier);
+
+  for (lGroup = 0; lGroup < psThreads->lGroupCount; lGroup++) {
+    destroyPluginChain(psThreads->psChains + lGroup);
+    destroyBufferArena(psThreads->psArenas + lGroup);
+  }
+  free(psThreads->psChains);
+  free(psThreads->pppfBuffers);
+  free(psThreads->psArenas);
+  free(psThreads->plFirstChannels);
+  free(psThreads->psThreads);
+  free(psThreads->psWorkers);
+  free(psThreads);
+  psChain->pvThreads = NULL;
+}
+
+/*****************************************************************************/
+
+void
+activatePluginChain(PluginChain * psChain) {
+
+  ChainThreads * psThreads;
+  unsigned long lGroup;
+  unsigned long lInstanceIndex;
+  unsigned long lPluginIndex;
+
+  psChain->lFramePosition = 0;
+  if (psChain->pvThreads != NULL) {
+    psThreads = (ChainThreads *)psChain->pvThreads;
+    for (lGroup = 0; lGroup < psThreads->lGroupCount; lGroup++)
+      activatePluginChain(psThreads->psChains + lGroup);
+    return;
+  }
+
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    if (psChain->ppsDescriptors[lPluginIndex]->activate != NULL)
+      for (lInstanceIndex = 0;
+	   lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+	   lInstanceIndex++)
+	psChain->ppsDescriptors[lPluginIndex]
+	  ->activate(psChain->pppsInstances[lPluginIndex][lInstanceIndex]);
+
+  if (psChain->psAutomation != NULL)
+    for (lPluginIndex = 0;
+	 lPluginIndex < psChain->lPluginCount;
+	 lPluginIndex++)
+      resetAutomation(psChain->psAutomation + lPluginIndex);
+}
+
+/* Run every instance of one plugin for lFrameCount frames. */
+static void
+runPlugin(PluginChain * psChain,
+	  const unsigned long lPluginIndex,
+	  const unsigned long lFrameCount) {
+
+  unsigned long lInstanceIndex;
+
+  for (lInstanceIndex = 0;
+       lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+       lInstanceIndex++)
+    psChain->ppsDescriptors[lPluginIndex]
+      ->run(psChain->pppsInstances[lPluginIndex][lInstanceIndex],
+	    lFrameCount);
+}
+
+void
+runPluginChain(PluginChain * psChain, const unsigned long lFrameCount) {
+
+  unsigned long lPluginIndex;
+
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    runPlugin(psChain, lPluginIndex, lFrameCount);
+}
+
+/* Run one plugin over lFrameCount frames from lOffset, splitting the
+   run wherever its automation changes a control. */
+static void
+runAutomatedPlugin(PluginChain * psChain,
+		   const unsigned long lPluginIndex,
+		   LADSPA_Data ** ppfBuffers,
+		   const unsigned long lOffset,
+		   const unsigned long lFrameCount) {
+
+  PluginAutomation * psAutomation;
+  unsigned long lDone;
+  unsigned long lPiece;
+
+  psAutomation = psChain->psAutomation + lPluginIndex;
+  for (lDone = 0; lDone < lFrameCount; lDone += lPiece) {
+    lPiece = applyAutomation(psAutomation, psChain->lFramePosition + lDone);
+    if (lPiece > lFrameCount - lDone)
+      lPiece = lFrameCount - lDone;
+    if (lDone > 0) {
+      connectPlugin(psChain, lPluginIndex, ppfBuffers, lOffset + lDone);
+      psAutomation->lExtraRuns++;
+    }
+    runPlugin(psChain, lPluginIndex, lPiece);
+  }
+}
+
+void
+processPluginChain(PluginChain * psChain,
+		   LADSPA_Data ** ppfBuffers,
+		   const unsigned long lFrameCount,
+		   const unsigned long lSubBlockSize) {
+
+  ChainThreads * psThreads;
+  ProfileClock sStart;
+  unsigned long lFrameSize;
+  unsigned long lOffset;
+  unsigned long lPluginIndex;
+
+  /* Each group of channels leaves its outputs where it found its
+     inputs, so there is nothing to reorder afterwards. */
+  if (psChain->pvThreads != NULL) {
+    psThreads = (ChainThreads *)psChain->pvThreads;
+    psThreads->ppfBuffers = ppfBuffers;
+    psThreads->lFrameCount = lFrameCount;
+    psThreads->lSubBlockSize = lSubBlockSize;
+    pthread_barrier_wait(&psThreads->sBarrier);
+    runChainGroup(psThreads, 0);
+    pthread_barrier_wait(&psThreads->sBarrier);
+    psChain->lFramePosition += lFrameCount;
+    return;
+  }
+
+  for (lOffset = 0; lOffset < lFrameCount; lOffset += lFrameSize) {
+    lFrameSize = lFrameCount - lOffset;
+    if (lFrameSize > lSubBlockSize)
+      lFrameSize = lSubBlockSize;
+    connectPluginChain(psChain, ppfBuffers, lOffset);
+    if (psChain->psAutomation == NULL && psChain->psProfile == NULL)
+      runPluginChain(psChain, lFrameSize);
+    else
+      for (lPluginIndex = 0;
+	   lPluginIndex < psChain->lPluginCount;
+	   lPluginIndex++) {
+	if (psChain->psProfile != NULL)
+	  readProfileClock(&sStart);
+	if (psChain->psAutomation == NULL
+	    || psChain->psAutomation[lPluginIndex].lPointCount == 0)
+	  runPlugin(psChain, lPluginIndex, lFrameSize);
+	else
+	  runAutomatedPlugin(psChain,
+			     lPluginIndex,
+			     ppfBuffers,
+			     lOffset,
+			     lFrameSize);
+	if (psChain->psProfile != NULL)
+	  addProfileTime(psChain->psProfile + lPluginIndex, &sStart);
+      }
+    if (psChain->psControlLog != NULL)
+      writeControlLogRow(psChain->psControlLog,
+			 psChain->lFramePosition,
+			 lFrameSize);
+    psChain->lFramePosition += lFrameSize;
+  }
+
+  if (psChain->psProfile != NULL)
+    for (lPluginIndex = 0;
+	 lPluginIndex < psChain->lPluginCount;
+	 lPluginIndex++)
+      endProfileBlock(psChain->psProfile + lPluginIndex);
+
+  /* Swap buffers round so the outputs are first, ready to be written
+     out, and the inputs of the next block go where the plan expects
+     them. */
+  if (psChain->bEndOfChain && psChain->bReorderBuffers) {
+    for (lOffset = 0; lOffset < psChain->lBufferCount; lOffset++)
+      psChain->ppfReorder[lOffset]
+	= ppfBuffers[psChain->plOutputOrder[lOffset]];
+    memcpy(ppfBuffers,
+	   psChain->ppfReorder,
+	   psChain->lBufferCount * sizeof(LADSPA_Data *));
+  }
+}
+
+void
+deactivatePluginChain(PluginChain * psChain) {
+
+  ChainThreads * psThreads;
+  unsigned long lGroup;
+  unsigned long lInstanceIndex;
+  unsigned long lPluginIndex;
+
+  if (psChain->pvThreads != NULL) {
+    psThreads = (ChainThreads *)psChain->pvThreads;
+    for (lGroup = 0; lGroup < psThreads->lGroupCount; lGroup++)
+      deactivatePluginChain(psThreads->psChains + lGroup);
+    return;
+  }
+
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    if (psChain->ppsDescriptors[lPluginIndex]->deactivate != NULL)
+      for (lInstanceIndex = 0;
+	   lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+	   lInstanceIndex++)
+	psChain->ppsDescriptors[lPluginIndex]
+	  ->deactivate(psChain->pppsInstances[lPluginIndex][lInstanceIndex]);
+}
+
+void
+destroyPluginChain(PluginChain * psChain) {
+
+  unsigned long lInstanceIndex;
+  unsigned long lPluginIndex;
+
+  if (psChain->pvThreads != NULL)
+    stopPluginChainThreads(psChain);
+
+  /* A chain that failed to be created may be missing instances. */
+  for (lPluginIndex = 0;
+       psChain->pppsInstances && lPluginIndex < psChain->lPluginCount;
+       lPluginIndex++) {
+    if (psChain->pppsInstances[lPluginIndex] == NULL)
+      continue;
+    for (lInstanceIndex = 0;
+	 lInstanceIndex < psChain->plInstanceCounts[lPluginIndex];
+	 lInstanceIndex++)
+      if (psChain->pppsInstances[lPluginIndex][lInstanceIndex] != NULL)
+	psChain->ppsDescriptors[lPluginIndex]
+	  ->cleanup(psChain->pppsInstances[lPluginIndex][lInstanceIndex]);
+    free(psChain->pppsInstances[lPluginIndex]);
+  }
+  free(psChain->pppsInstances);
+  free(psChain->plInstanceCounts);
+  psChain->pppsInstances = NULL;
+  psChain->plInstanceCounts = NULL;
+
+  destroyBufferArena(&psChain->sControlArena);
+  free(psChain->ppfControlOutputs);
+  psChain->ppfControlOutputs = NULL;
+
+  for (lPluginIndex = 0; lPluginIndex < psChain->lPluginCount; lPluginIndex++)
+    free(psChain->pplPortBuffers[lPluginIndex]);
+  free(psChain->pplPortBuffers);
+  free(psChain->plOutputOrder);
+  free(psChain->ppfReorder);
+  psChain->pplPortBuffers = NULL;
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,290 @@
+/* compare.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The comparison is a subtraction, a maximum and two sums of squares
+   per sample. SSE is always there on x86-64. */
+#if defined(__SSE__)
+#define COMPARE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Compare lSampleCount samples of one channel. Returns the largest
+   absolute difference and adds the squared differences and squared
+   reference samples to *pdErrorEnergy and *pdReferenceEnergy. A NaN
+   or infinity in the output is an infinite error. */
+static LADSPA_Data
+compareSamples(const LADSPA_Data * pfOutput,
+	       const LADSPA_Data * pfReference,
+	       const unsigned long lSampleCount,
+	       double * pdErrorEnergy,
+	       double * pdReferenceEnergy) {
+
+  LADSPA_Data fDifference;
+  LADSPA_Data fErrorEnergy;
+  LADSPA_Data fMaxError;
+  LADSPA_Data fReferenceEnergy;
+  unsigned long lIndex;
+
+  fMaxError = 0;
+  fErrorEnergy = 0;
+  fReferenceEnergy = 0;
+  lIndex = 0;
+
+#ifdef COMPARE_USE_SSE
+  {
+    __m128 fAbsMask;
+    __m128 fDifference4;
+    __m128 fErrorEnergy4;
+    __m128 fMax4;
+    __m128 fReference4;
+    __m128 fReferenceEnergy4;
+    LADSPA_Data pfLanes[4];
+
+    fAbsMask = _mm_set1_ps(-0.0f);
+    fMax4 = _mm_setzero_ps();
+    fErrorEnergy4 = _mm_setzero_ps();
+    fReferenceEnergy4 = _mm_setzero_ps();
+    for (; lIndex + 4 <= lSampleCount; lIndex += 4) {
+      fReference4 = _mm_loadu_ps(pfReference + lIndex);
+      fDifference4 = _mm_sub_ps(_mm_loadu_ps(pfOutput + lIndex),
+				fReference4);
+      fMax4 = _mm_max_ps(fMax4, _mm_andnot_ps(fAbsMask, fDifference4));
+      fErrorEnergy4 = _mm_add_ps(fErrorEnergy4,
+				 _mm_mul_ps(fDifference4, fDifference4));
+      fReferenceEnergy4 = _mm_add_ps(fReferenceEnergy4,
+				     _mm_mul_ps(fReference4, fReference4));
+    }
+    _mm_storeu_ps(pfLanes, fMax4);
+    fMaxError = pfLanes[0];
+    if (pfLanes[1] > fMaxError)
+      fMaxError = pfLanes[1];
+    if (pfLanes[2] > fMaxError)
+      fMaxError = pfLanes[2];
+    if (pfLanes[3] > fMaxError)
+      fMaxError = pfLanes[3];
+    _mm_storeu_ps(pfLanes, fErrorEnergy4);
+    fErrorEnergy = pfLanes[0] + pfLanes[1] + pfLanes[2] + pfLanes[3];
+    _mm_storeu_ps(pfLanes, fReferenceEnergy4);
+    fReferenceEnergy = pfLanes[0] + pfLanes[1] + pfLanes[2] + pfLanes[3];
+  }
+#endif
+
+  for (; lIndex < lSampleCount; lIndex++) {
+    fDifference = pfOutput[lIndex] - pfReference[lIndex];
+    if (fabsf(fDifference) > fMaxError)
+      fMaxError = fabsf(fDifference);
+    fErrorEnergy += fDifference * fDifference;
+    fReferenceEnergy += pfReference[lIndex] * pfReference[lIndex];
+  }
+
+  /* The maximum passes NaNs over, but the sum does not. */
+  if (!isfinite(fErrorEnergy))
+    fMaxError = INFINITY;
+
+  *pdErrorEnergy += fErrorEnergy;
+  *pdReferenceEnergy += fReferenceEnergy;
+  return fMaxError;
+}
+
+static double
+getLevel(const double dValue) {
+  return dValue > 0 ? 20 * log10(dValue) : -INFINITY;
+}
+
+/*****************************************************************************/
+
+void
+openReferenceComparison(ReferenceComparison * psComparison,
+			const char * pcFilename,
+			const unsigned long lChannelCount,
+			const unsigned long lSampleRate,
+			const unsigned long lBlockSize,
+			const LADSPA_Data fTolerance) {
+
+  unsigned long lChannelIndex;
+
+  memset(psComparison, 0, sizeof(*psComparison));
+  openWaveFile(&psComparison->sReference, pcFilename, lBlockSize);
+  if (psComparison->sReference.lChannelCount != lChannelCount
+      || psComparison->sReference.lSampleRate != lSampleRate) {
+    fprintf(stderr,
+	    "Reference file \"%s\" has %lu channels at %lu Hz but the "
+	    "output has %lu at %lu Hz.\n",
+	    pcFilename,
+	    psComparison->sReference.lChannelCount,
+	    psComparison->sReference.lSampleRate,
+	    lChannelCount,
+	    lSampleRate);
+    exit(1);
+  }
+
+  psComparison->pcFilename = pcFilename;
+  psComparison->fTolerance = fTolerance;
+  psComparison->lFirstDivergence = COMPARE_NO_DIVERGENCE;
+  psComparison->ppfReference
+    = (LADSPA_Data **)calloc(lChannelCount, sizeof(LADSPA_Data *));
+  psComparison->ppfOutput
+    = (LADSPA_Data **)calloc(lChannelCount, sizeof(LADSPA_Data *));
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    psComparison->ppfReference[lChannelIndex]
+      = (LADSPA_Data *)calloc(lBlockSize, sizeof(LADSPA_Data));
+    psComparison->ppfOutput[lChannelIndex]
+      = (LADSPA_Data *)calloc(lBlockSize, sizeof(LADSPA_Data));
+  }
+}
+
+void
+compareWithReference(ReferenceComparison * psComparison,
+		     LADSPA_Data ** ppfOutputs,
+		     const unsigned long lFrameCount) {
+
+  LADSPA_Data fMaxError;
+  unsigned long lChannelCount;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lReadCount;
+
+  lChannelCount = psComparison->sReference.lChannelCount;
+  lReadCount = readWaveFileUpTo(&psComparison->sReference,
+				psComparison->ppfReference,
+				lFrameCount);
+  psComparison->lExtraFrames += lFrameCount - lReadCount;
+  if (lReadCount == 0)
+    return;
+
+  /* Compare what would have been written. */
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++)
+    memcpy(psComparison->ppfOutput[lChannelIndex],
+	   ppfOutputs[lChannelIndex],
+	   lReadCount * sizeof(LADSPA_Data));
+  quantizeWaveSamples(psComparison->sReference.iSampleFormat,
+		      psComparison->ppfOutput,
+		      lChannelCount,
+		      lReadCount);
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+
+    fMaxError = compareSamples(psComparison->ppfOutput[lChannelIndex],
+			       psComparison->ppfReference[lChannelIndex],
+			       lReadCount,
+			       &psComparison->dErrorEnergy,
+			       &psComparison->dReferenceEnergy);
+    if (fMaxError > psComparison->fMaxError)
+      psComparison->fMaxError = fMaxError;
+
+    /* Only a block that diverges is searched for where, and only up
+       to any divergence already found in an earlier channel. */
+    if (fMaxError > psComparison->fTolerance)
+      for (lFrameIndex = 0;
+	   (lFrameIndex < lReadCount
+	    && (psComparison->lFrameCount + lFrameIndex
+		< psComparison->lFirstDivergence));
+	   lFrameIndex++)
+	if (!(fabsf(psComparison->ppfOutput[lChannelIndex][lFrameIndex]
+		    - psComparison->ppfReference[lChannelIndex][lFrameIndex])
+	      <= psComparison->fTolerance)) {
+	  psComparison->lFirstDivergence
+	    = psComparison->lFrameCount + lFrameIndex;
+	  psComparison->lFirstDivergenceChannel = lChannelIndex;
+	  break;
+	}
+  }
+
+  psComparison->lFrameCount += lReadCount;
+}
+
+int
+closeReferenceComparison(ReferenceComparison * psComparison) {
+
+  WaveFile * psReference;
+  double dErrorRMS;
+  double dSampleCount;
+  int bFailed;
+  unsigned long lChannelIndex;
+  unsigned long lMissingFrames;
+
+  psReference = &psComparison->sReference;
+  lMissingFrames = 0;
+  if (psReference->lLength != WAVE_LENGTH_UNKNOWN
+      && psReference->lLength > psComparison->lFrameCount)
+    lMissingFrames = psReference->lLength - psComparison->lFrameCount;
+
+  dSampleCount = (double)psComparison->lFrameCount
+    * psReference->lChannelCount;
+  dErrorRMS = (dSampleCount > 0
+	       ? sqrt(psComparison->dErrorEnergy / dSampleCount)
+	       : 0);
+
+  printf("Compared %lu frames of %lu channels with \"%s\" (%s).\n",
+	 psComparison->lFrameCount,
+	 psReference->lChannelCount,
+	 psComparison->pcFilename,
+	 getWaveSampleFormatName(psReference->iSampleFormat));
+  if (psComparison->fMaxError == 0)
+    printf("Every frame compared matches the reference exactly.\n");
+  else {
+    printf("Max error: %g (%.1f dBFS).\n",
+	   psComparison->fMaxError,
+	   getLevel(psComparison->fMaxError));
+    printf("RMS error: %g (%.1f dBFS).\n", dErrorRMS, getLevel(dErrorRMS));
+    printf("SNR: %.1f dB.\n",
+	   10 * log10(psComparison->dReferenceEnergy
+		      / psComparison->dErrorEnergy));
+    if (psComparison->lFirstDivergence == COMPARE_NO_DIVERGENCE)
+      printf("No sample differs by more than the tolerance of %g.\n",
+	     psComparison->fTolerance);
+    else
+      printf("First difference above the tolerance of %g: frame %lu, "
+	     "channel %lu.\n",
+	     psComparison->fTolerance,
+	     psComparison->lFirstDivergence,
+	     psComparison->lFirstDivergenceChannel + 1);
+  }
+  if (psComparison->lExtraFrames > 0)
+    printf("The output runs %lu frames past the end of the reference.\n",
+	   psComparison->lExtraFrames);
+  if (lMissingFrames > 0)
+    printf("The output stops %lu frames short of the end of the "
+	   "reference.\n",
+	   lMissingFrames);
+
+  bFailed = (psComparison->lFirstDivergence != COMPARE_NO_DIVERGENCE
+	     || psComparison->lExtraFrames > 0
+	     || lMissingFrames > 0);
+  if (bFailed)
+    printf("Output differs from the reference.\n");
+  else
+    printf("Output is within the tolerance of the reference.\n");
+
+  for (lChannelIndex = 0;
+       lChannelIndex < psReference->lChannelCount;
+       lChannelIndex++) {
+    free(psComparison->ppfReference[lChannelIndex]);
+    free(psComparison->ppfOutput[lChannelIndex]);
+  }
+  free(psComparison->ppfReference);
+  free(psComparison->ppfOutput);
+  closeWaveFile(psReference);
+
+  return bFailed;
+}
+
+/*****************************************************************************/
+
+/* EOF */
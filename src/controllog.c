@@ -0,0 +1,456 @@
+/* controllog.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Rows gathered before a group is written. */
+#define CONTROL_LOG_GROUP_ROWS 4096
+
+#define CONTROL_LOG_MAGIC "LADSPACL"
+#define CONTROL_LOG_VERSION 1
+
+/*****************************************************************************/
+
+static void
+writeLE16(unsigned char * pucData, const unsigned long lValue) {
+  pucData[0] = (unsigned char)(lValue & 0xFF);
+  pucData[1] = (unsigned char)((lValue >> 8) & 0xFF);
+}
+
+static void
+writeLE32(unsigned char * pucData, const unsigned long lValue) {
+  pucData[0] = (unsigned char)(lValue & 0xFF);
+  pucData[1] = (unsigned char)((lValue >> 8) & 0xFF);
+  pucData[2] = (unsigned char)((lValue >> 16) & 0xFF);
+  pucData[3] = (unsigned char)((lValue >> 24) & 0xFF);
+}
+
+static unsigned long
+readLE16(const unsigned char * pucData) {
+  return (unsigned long)pucData[0] | ((unsigned long)pucData[1] << 8);
+}
+
+static unsigned long
+readLE32(const unsigned char * pucData) {
+  return ((unsigned long)pucData[0]
+	  | ((unsigned long)pucData[1] << 8)
+	  | ((unsigned long)pucData[2] << 16)
+	  | ((unsigned long)pucData[3] << 24));
+}
+
+static void
+writeLEFloat(unsigned char * pucData, const LADSPA_Data fValue) {
+  uint32_t iBits;
+  memcpy(&iBits, &fValue, sizeof(iBits));
+  writeLE32(pucData, iBits);
+}
+
+static LADSPA_Data
+readLEFloat(const unsigned char * pucData) {
+  LADSPA_Data fValue;
+  uint32_t iBits;
+  iBits = (uint32_t)readLE32(pucData);
+  memcpy(&fValue, &iBits, sizeof(fValue));
+  return fValue;
+}
+
+/* A failed write is remembered and reported by closeControlLog(), so
+   rows can be logged from inside a chain without stopping it. */
+static void
+writeControlLogBytes(ControlLog * psLog,
+		     const unsigned char * pucData,
+		     const size_t lSize) {
+  if (!psLog->bFailed
+      && fwrite(pucData, 1, lSize, psLog->poFile) != lSize)
+    psLog->bFailed = 1;
+}
+
+/* Write out the rows gathered so far as one group: the row count,
+   then the first frame and length of each row, then each column in
+   turn. */
+static void
+flushControlLog(ControlLog * psLog) {
+
+  unsigned char * pucGroup;
+  unsigned char * pucPosition;
+  unsigned long lColumnIndex;
+  unsigned long lRowIndex;
+  size_t lGroupSize;
+
+  if (psLog->lRowCount == 0)
+    return;
+
+  lGroupSize = 4 + psLog->lRowCount * (12 + 4 * psLog->lColumnCount);
+  pucGroup = (unsigned char *)malloc(lGroupSize);
+
+  pucPosition = pucGroup;
+  writeLE32(pucPosition, psLog->lRowCount);
+  pucPosition += 4;
+  for (lRowIndex = 0; lRowIndex < psLog->lRowCount; lRowIndex++) {
+    writeLE32(pucPosition, psLog->pllFrames[lRowIndex] & 0xFFFFFFFFUL);
+    writeLE32(pucPosition + 4, psLog->pllFrames[lRowIndex] >> 32);
+    pucPosition += 8;
+  }
+  for (lRowIndex = 0; lRowIndex < psLog->lRowCount; lRowIndex++) {
+    writeLE32(pucPosition, psLog->plFrameCounts[lRowIndex]);
+    pucPosition += 4;
+  }
+  for (lColumnIndex = 0; lColumnIndex < psLog->lColumnCount; lColumnIndex++)
+    for (lRowIndex = 0; lRowIndex < psLog->lRowCount; lRowIndex++) {
+      writeLEFloat(pucPosition,
+		   psLog->pfValues[lColumnIndex * CONTROL_LOG_GROUP_ROWS
+				   + lRowIndex]);
+      pucPosition += 4;
+    }
+
+  writeControlLogBytes(psLog, pucGroup, lGroupSize);
+  free(pucGroup);
+
+  psLog->lRowsWritten += psLog->lRowCount;
+  psLog->lRowCount = 0;
+}
+
+/*****************************************************************************/
+
+ControlLog *
+createControlLog(const char               * pcFilename,
+		 const unsigned long        lPluginCount,
+		 const LADSPA_Descriptor ** ppsPluginDescriptors,
+		 const unsigned long      * plInstanceCounts,
+		 LADSPA_Data             ** ppfControlOutputs,
+		 const unsigned long        lSampleRate) {
+
+  ControlLog * psLog;
+  LADSPA_PortDescriptor iPortDescriptor;
+  const LADSPA_Descriptor * psDescriptor;
+  char * pcName;
+  unsigned char pucField[12];
+  unsigned long lColumnIndex;
+  unsigned long lControlIndex;
+  unsigned long lInstanceIndex;
+  unsigned long lPluginIndex;
+  unsigned long lPortIndex;
+  size_t lNameLength;
+
+  psLog = (ControlLog *)calloc(1, sizeof(ControlLog));
+  psLog->pcFilename = strdup(pcFilename);
+  psLog->poFile = fopen(pcFilename, "wb");
+  if (!psLog->poFile) {
+    fprintf(stderr, "Failed to create control log \"%s\".\n", pcFilename);
+    exit(1);
+  }
+
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+    psLog->lColumnCount
+      += (plInstanceCounts[lPluginIndex]
+	  * getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			       LADSPA_PORT_CONTROL | LADSPA_PORT_OUTPUT));
+  psLog->ppfSources
+    = (LADSPA_Data **)calloc(psLog->lColumnCount + 1, sizeof(LADSPA_Data *));
+  psLog->pllFrames
+    = (unsigned long long *)calloc(CONTROL_LOG_GROUP_ROWS,
+				   sizeof(unsigned long long));
+  psLog->plFrameCounts
+    = (unsigned long *)calloc(CONTROL_LOG_GROUP_ROWS, sizeof(unsigned long));
+  psLog->pfValues
+    = (LADSPA_Data *)calloc((psLog->lColumnCount + 1)
+			    * CONTROL_LOG_GROUP_ROWS,
+			    sizeof(LADSPA_Data));
+
+  /* Header:
+     ------- */
+
+  writeControlLogBytes(psLog,
+		       (const unsigned char *)CONTROL_LOG_MAGIC,
+		       strlen(CONTROL_LOG_MAGIC));
+  writeLE32(pucField, CONTROL_LOG_VERSION);
+  writeLE32(pucField + 4, psLog->lColumnCount);
+  writeLE32(pucField + 8, lSampleRate);
+  writeControlLogBytes(psLog, pucField, 12);
+
+  /* Each column is named "<plugin>:<label>:<port name>", with
+     " (channel <n>)" after it for a plugin run once per channel. The
+     outputs of each instance follow those of the one before. */
+  lColumnIndex = 0;
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+    psDescriptor = ppsPluginDescriptors[lPluginIndex];
+    lControlIndex = 0;
+    for (lInstanceIndex = 0;
+	 lInstanceIndex < plInstanceCounts[lPluginIndex];
+	 lInstanceIndex++)
+      for (lPortIndex = 0;
+	   lPortIndex < psDescriptor->PortCount;
+	   lPortIndex++) {
+	iPortDescriptor = psDescriptor->PortDescriptors[lPortIndex];
+	if (!LADSPA_IS_PORT_CONTROL(iPortDescriptor)
+	    || !LADSPA_IS_PORT_OUTPUT(iPortDescriptor))
+	  continue;
+	psLog->ppfSources[lColumnIndex++]
+	  = ppfControlOutputs[lPluginIndex] + lControlIndex++;
+	lNameLength = (strlen(psDescriptor->Label)
+		       + strlen(psDescriptor->PortNames[lPortIndex])
+		       + 48);
+	pcName = (char *)malloc(lNameLength);
+	if (plInstanceCounts[lPluginIndex] > 1)
+	  snprintf(pcName,
+		   lNameLength,
+		   "%lu:%s:%s (channel %lu)",
+		   lPluginIndex + 1,
+		   psDescriptor->Label,
+		   psDescriptor->PortNames[lPortIndex],
+		   lInstanceIndex + 1);
+	else
+	  snprintf(pcName,
+		   lNameLength,
+		   "%lu:%s:%s",
+		   lPluginIndex + 1,
+		   psDescriptor->Label,
+		   psDescriptor->PortNames[lPortIndex]);
+	lNameLength = strlen(pcName);
+	writeLE16(pucField, lNameLength);
+	writeControlLogBytes(psLog, pucField, 2);
+	writeControlLogBytes(psLog,
+			     (const unsigned char *)pcName,
+			     lNameLength);
+	free(pcName);
+      }
+  }
+
+  return psLog;
+}
+
+void
+writeControlLogRow(ControlLog * psLog,
+		   const unsigned long lFrame,
+		   const unsigned long lFrameCount) {
+
+  unsigned long lColumnIndex;
+
+  if (lFrame + lFrameCount <= psLog->lFirstFrame)
+    return;
+  if (lFrame < psLog->lFirstFrame) {
+    psLog->pllFrames[psLog->lRowCount] = psLog->lFirstFrame;
+    psLog->plFrameCounts[psLog->lRowCount]
+      = lFrame + lFrameCount - psLog->lFirstFrame;
+  }
+  else {
+    psLog->pllFrames[psLog->lRowCount] = lFrame;
+    psLog->plFrameCounts[psLog->lRowCount] = lFrameCount;
+  }
+  for (lColumnIndex = 0; lColumnIndex < psLog->lColumnCount; lColumnIndex++)
+    psLog->pfValues[lColumnIndex * CONTROL_LOG_GROUP_ROWS + psLog->lRowCount]
+      = *(psLog->ppfSources[lColumnIndex]);
+
+  if (++psLog->lRowCount == CONTROL_LOG_GROUP_ROWS)
+    flushControlLog(psLog);
+}
+
+unsigned long
+closeControlLog(ControlLog * psLog) {
+
+  unsigned long lRowCount;
+
+  flushControlLog(psLog);
+  if (fclose(psLog->poFile) != 0 || psLog->bFailed) {
+    fprintf(stderr,
+	    "Failed to write to control log \"%s\".\n",
+	    psLog->pcFilename);
+    exit(1);
+  }
+  lRowCount = psLog->lRowsWritten;
+
+  free(psLog->pcFilename);
+  free(psLog->ppfSources);
+  free(psLog->pllFrames);
+  free(psLog->plFrameCounts);
+  free(psLog->pfValues);
+  free(psLog);
+
+  return lRowCount;
+}
+
+/*****************************************************************************/
+
+static void
+readControlLogBytes(FILE * poFile,
+		    const char * pcFilename,
+		    unsigned char * pucData,
+		    const size_t lSize) {
+  if (fread(pucData, 1, lSize, poFile) != lSize) {
+    fprintf(stderr, "Control log \"%s\" is truncated.\n", pcFilename);
+    exit(1);
+  }
+}
+
+/* Bytes left to read in the log, so sizes read from it can be checked
+   before anything is allocated for them. */
+static unsigned long long
+getControlLogBytesLeft(FILE * poFile, const char * pcFilename) {
+
+  struct stat sStat;
+  long lPosition;
+
+  lPosition = ftell(poFile);
+  if (lPosition < 0 || fstat(fileno(poFile), &sStat) != 0) {
+    fprintf(stderr, "Failed to read control log \"%s\".\n", pcFilename);
+    exit(1);
+  }
+  if ((unsigned long long)sStat.st_size < (unsigned long long)lPosition)
+    return 0;
+  return (unsigned long long)sStat.st_size - lPosition;
+}
+
+static void
+writeCSVField(FILE * poFile, const char * pcField) {
+  fputc('"', poFile);
+  for (; *pcField != '\0'; pcField++) {
+    if (*pcField == '"')
+      fputc('"', poFile);
+    fputc(*pcField, poFile);
+  }
+  fputc('"', poFile);
+}
+
+unsigned long
+exportControlLog(const char * pcLogFilename, const char * pcCSVFilename) {
+
+  FILE * poCSV;
+  FILE * poLog;
+  char * pcName;
+  unsigned char pucField[12];
+  unsigned char * pucGroup;
+  unsigned long long llFrame;
+  unsigned long lColumnCount;
+  unsigned long lColumnIndex;
+  unsigned long lNameLength;
+  unsigned long lRowCount;
+  unsigned long lRowIndex;
+  unsigned long lRowsWritten;
+  unsigned long lSampleRate;
+  size_t lGroupSize;
+
+  poLog = fopen(pcLogFilename, "rb");
+  if (!poLog) {
+    fprintf(stderr, "Failed to open control log \"%s\".\n", pcLogFilename);
+    exit(1);
+  }
+
+  readControlLogBytes(poLog, pcLogFilename, pucField, 8);
+  if (memcmp(pucField, CONTROL_LOG_MAGIC, 8) != 0) {
+    fprintf(stderr, "\"%s\" is not a control log.\n", pcLogFilename);
+    exit(1);
+  }
+  readControlLogBytes(poLog, pcLogFilename, pucField, 12);
+  if (readLE32(pucField) != CONTROL_LOG_VERSION) {
+    fprintf(stderr,
+	    "Control log \"%s\" has unknown version %lu.\n",
+	    pcLogFilename,
+	    readLE32(pucField));
+    exit(1);
+  }
+  lColumnCount = readLE32(pucField + 4);
+  lSampleRate = readLE32(pucField + 8);
+  if (2ULL * lColumnCount > getControlLogBytesLeft(poLog, pcLogFilename)) {
+    fprintf(stderr, "Control log \"%s\" is truncated.\n", pcLogFilename);
+    exit(1);
+  }
+  if (lSampleRate == 0)
+    lSampleRate = 1;
+
+  if (strcmp(pcCSVFilename, "-") == 0)
+    poCSV = stdout;
+  else
+    poCSV = fopen(pcCSVFilename, "w");
+  if (!poCSV) {
+    fprintf(stderr, "Failed to create CSV file \"%s\".\n", pcCSVFilename);
+    exit(1);
+  }
+
+  fputs("frame,seconds,frames", poCSV);
+  for (lColumnIndex = 0; lColumnIndex < lColumnCount; lColumnIndex++) {
+    readControlLogBytes(poLog, pcLogFilename, pucField, 2);
+    lNameLength = readLE16(pucField);
+    pcName = (char *)calloc(lNameLength + 1, 1);
+    readControlLogBytes(poLog,
+			pcLogFilename,
+			(unsigned char *)pcName,
+			lNameLength);
+    fputc(',', poCSV);
+    writeCSVField(poCSV, pcName);
+    free(pcName);
+  }
+  fputc('\n', poCSV);
+
+  lRowsWritten = 0;
+  while (fread(pucField, 1, 4, poLog) == 4) {
+    lRowCount = readLE32(pucField);
+    if (lRowCount == 0 || lRowCount > CONTROL_LOG_GROUP_ROWS) {
+      fprintf(stderr,
+	      "Control log \"%s\" has a group of %lu rows, which is "
+	      "damaged.\n",
+	      pcLogFilename,
+	      lRowCount);
+      exit(1);
+    }
+    lGroupSize = lRowCount * (12 + 4 * (size_t)lColumnCount);
+    if (lGroupSize > getControlLogBytesLeft(poLog, pcLogFilename)) {
+      fprintf(stderr, "Control log \"%s\" is truncated.\n", pcLogFilename);
+      exit(1);
+    }
+    pucGroup = (unsigned char *)malloc(lGroupSize + 1);
+    if (!pucGroup) {
+      fprintf(stderr,
+	      "Failed to allocate %lu bytes to read control log \"%s\".\n",
+	      (unsigned long)lGroupSize,
+	      pcLogFilename);
+      exit(1);
+    }
+    readControlLogBytes(poLog, pcLogFilename, pucGroup, lGroupSize);
+    for (lRowIndex = 0; lRowIndex < lRowCount; lRowIndex++) {
+      llFrame = (readLE32(pucGroup + 8 * lRowIndex)
+		 | ((unsigned long long)readLE32(pucGroup + 8 * lRowIndex + 4)
+		    << 32));
+      fprintf(poCSV,
+	      "%llu,%.6f,%lu",
+	      llFrame,
+	      (double)llFrame / lSampleRate,
+	      readLE32(pucGroup + 8 * lRowCount + 4 * lRowIndex));
+      for (lColumnIndex = 0; lColumnIndex < lColumnCount; lColumnIndex++)
+	fprintf(poCSV,
+		",%.9g",
+		readLEFloat(pucGroup
+			    + 12 * lRowCount
+			    + 4 * (lColumnIndex * lRowCount + lRowIndex)));
+      fputc('\n', poCSV);
+    }
+    free(pucGroup);
+    lRowsWritten += lRowCount;
+  }
+
+  fclose(poLog);
+  if (poCSV != stdout && fclose(poCSV) != 0) {
+    fprintf(stderr, "Failed to write CSV file \"%s\".\n", pcCSVFilename);
+    exit(1);
+  }
+
+  return lRowsWritten;
+}
+
+/*****************************************************************************/
+
+/* EOF */
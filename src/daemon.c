@@ -0,0 +1,531 @@
+/* daemon.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* The longest request accepted, in bytes. */
+#define DAEMON_MAX_REQUEST 65536
+
+/* Connections that may wait for a worker. */
+#define DAEMON_BACKLOG 128
+
+/* How long a client may take to send its request before the worker
+   gives up on it and takes the next connection. */
+#define DAEMON_REQUEST_SECONDS 10
+
+/*****************************************************************************/
+
+/* One worker process, as seen by the others. */
+typedef struct {
+  pid_t iPid;
+  int bBusy;
+} DaemonWorker;
+
+/* Counters shared by the supervisor and its workers, in memory
+   mapped before the workers are forked and updated atomically. */
+typedef struct {
+
+  double dStartSeconds;
+
+  unsigned long lJobs;
+  unsigned long lFailedJobs;
+  unsigned long lWarmJobs;
+  unsigned long lFrames;
+  unsigned long lRenderMicroseconds;
+  unsigned long lWorkerStarts;
+
+  unsigned long lWorkerCount;
+  DaemonWorker psWorkers[1];
+
+} DaemonShared;
+
+/* Set by signal handlers. */
+static volatile sig_atomic_t g_bStop = 0;
+
+/*****************************************************************************/
+
+static double
+getDaemonSeconds(void) {
+
+  struct timespec sTime;
+
+  clock_gettime(CLOCK_MONOTONIC, &sTime);
+  return sTime.tv_sec + sTime.tv_nsec * 1e-9;
+}
+
+static void
+handleStopSignal(int iSignal) {
+  (void)iSignal;
+  g_bStop = 1;
+}
+
+/* Install the stop handler without SA_RESTART, so a blocked accept()
+   or waitpid() returns to look at the flag. */
+static void
+catchStopSignals(void) {
+
+  struct sigaction sAction;
+
+  memset(&sAction, 0, sizeof(sAction));
+  sAction.sa_handler = handleStopSignal;
+  sigemptyset(&sAction.sa_mask);
+  sigaction(SIGINT, &sAction, NULL);
+  sigaction(SIGTERM, &sAction, NULL);
+  signal(SIGPIPE, SIG_IGN);
+}
+
+static void
+fillSocketAddress(struct sockaddr_un * psAddress, const char * pcSocketPath) {
+
+  if (strlen(pcSocketPath) >= sizeof(psAddress->sun_path)) {
+    fprintf(stderr, "Socket path \"%s\" is too long.\n", pcSocketPath);
+    exit(1);
+  }
+  memset(psAddress, 0, sizeof(*psAddress));
+  psAddress->sun_family = AF_UNIX;
+  strcpy(psAddress->sun_path, pcSocketPath);
+}
+
+static void
+writeAll(const int iFile, const char * pcData, unsigned long lLength) {
+
+  ssize_t lWritten;
+
+  while (lLength > 0) {
+    lWritten = write(iFile, pcData, lLength);
+    if (lWritten < 0 && errno == EINTR)
+      continue;
+    if (lWritten <= 0)
+      return;
+    pcData += lWritten;
+    lLength -= lWritten;
+  }
+}
+
+/*****************************************************************************/
+
+/* Read a request: lines up to an empty one. Returns the lines, split
+   in place in the returned buffer, with their count in *plLineCount,
+   or NULL if the request is cut short, too long or too slow. */
+static char **
+readDaemonRequest(const int iClient,
+		  char ** ppcBuffer,
+		  unsigned long * plLineCount) {
+
+  char ** ppcLines;
+  char * pcBuffer;
+  char * pcLine;
+  ssize_t lRead;
+  struct timeval sTimeout;
+  unsigned long lLength;
+  unsigned long lLineCount;
+
+  /* A client that connects and sends nothing would otherwise hold the
+     worker for good. */
+  memset(&sTimeout, 0, sizeof(sTimeout));
+  sTimeout.tv_sec = DAEMON_REQUEST_SECONDS;
+  setsockopt(iClient, SOL_SOCKET, SO_RCVTIMEO, &sTimeout, sizeof(sTimeout));
+
+  pcBuffer = (char *)malloc(DAEMON_MAX_REQUEST + 1);
+  *ppcBuffer = pcBuffer;
+  lLength = 0;
+  for (;;) {
+    if (lLength >= 2
+	&& pcBuffer[lLength - 1] == '\n'
+	&& pcBuffer[lLength - 2] == '\n')
+      break;
+    if (lLength == DAEMON_MAX_REQUEST)
+      return NULL;
+    lRead = read(iClient, pcBuffer + lLength, DAEMON_MAX_REQUEST - lLength);
+    if (lRead < 0 && errno == EINTR)
+      continue;
+    if (lRead <= 0)
+      return NULL;
+    lLength += lRead;
+  }
+  pcBuffer[lLength - 1] = '\0';
+
+  lLineCount = 0;
+  for (pcLine = pcBuffer; *pcLine; pcLine = strchr(pcLine, '\n') + 1)
+    lLineCount++;
+  ppcLines = (char **)calloc(lLineCount + 1, sizeof(char *));
+  lLineCount = 0;
+  for (pcLine = pcBuffer; *pcLine; ) {
+    ppcLines[lLineCount++] = pcLine;
+    pcLine = strchr(pcLine, '\n');
+    *pcLine++ = '\0';
+  }
+
+  *plLineCount = lLineCount;
+  return ppcLines;
+}
+
+static void
+writeDaemonStatus(const int iClient, DaemonShared * psShared) {
+
+  char pcStatus[1024];
+  double dRenderSeconds;
+  unsigned long lBusy;
+  unsigned long lWorkerIndex;
+
+  lBusy = 0;
+  for (lWorkerIndex = 0; lWorkerIndex < psShared->lWorkerCount; lWorkerIndex++)
+    if (__atomic_load_n(&psShared->psWorkers[lWorkerIndex].bBusy,
+			__ATOMIC_RELAXED))
+      lBusy++;
+  dRenderSeconds
+    = __atomic_load_n(&psShared->lRenderMicroseconds, __ATOMIC_RELAXED)
+    * 1e-6;
+
+  snprintf(pcStatus,
+	   sizeof(pcStatus),
+	   "Up %.0f seconds with %lu workers, %lu busy; %lu started.\n"
+	   "Jobs: %lu taken, %lu failed, %lu on warm chains.\n"
+	   "Rendered %lu frames in %.3f seconds, %.3f ms a job.\n"
+	   "ok status\n",
+	   getDaemonSeconds() - psShared->dStartSeconds,
+	   psShared->lWorkerCount,
+	   lBusy,
+	   __atomic_load_n(&psShared->lWorkerStarts, __ATOMIC_RELAXED),
+	   __atomic_load_n(&psShared->lJobs, __ATOMIC_RELAXED),
+	   __atomic_load_n(&psShared->lFailedJobs, __ATOMIC_RELAXED),
+	   __atomic_load_n(&psShared->lWarmJobs, __ATOMIC_RELAXED),
+	   __atomic_load_n(&psShared->lFrames, __ATOMIC_RELAXED),
+	   dRenderSeconds,
+	   (psShared->lJobs
+	    ? dRenderSeconds * 1000 / psShared->lJobs
+	    : 0.0));
+  writeAll(iClient, pcStatus, strlen(pcStatus));
+}
+
+/* Take connections until told to stop. A job runs with standard
+   output and error on the client's connection, so whatever it prints,
+   including the message before any exit(1), goes to the client. */
+static void
+runDaemonWorker(const int iListener,
+		DaemonShared * psShared,
+		DaemonWorker * psWorker,
+		DaemonJobFunction fJob,
+		void * pvContext) {
+
+  char ** ppcLines;
+  char * pcBuffer;
+  double dStart;
+  int bWarm;
+  int iClient;
+  int iStderr;
+  int iStdout;
+  unsigned long lFrames;
+  unsigned long lJobNumber;
+  unsigned long lLineCount;
+  unsigned long lMicroseconds;
+
+  catchStopSignals();
+  iStdout = dup(STDOUT_FILENO);
+  iStderr = dup(STDERR_FILENO);
+
+  while (!g_bStop) {
+
+    iClient = accept(iListener, NULL, NULL);
+    if (iClient < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+	continue;
+      fprintf(stderr, "Daemon worker failed to accept a connection.\n");
+      exit(1);
+    }
+
+    ppcLines = readDaemonRequest(iClient, &pcBuffer, &lLineCount);
+    if (ppcLines == NULL || lLineCount < 2)
+      writeAll(iClient, "Bad request.\n", 13);
+    else if (lLineCount == 2 && strcmp(ppcLines[1], "status") == 0)
+      writeDaemonStatus(iClient, psShared);
+    else if (lLineCount == 2 && strcmp(ppcLines[1], "shutdown") == 0) {
+      kill(getppid(), SIGTERM);
+      writeAll(iClient, "ok shutting down\n", 17);
+    }
+    else {
+
+      __atomic_store_n(&psWorker->bBusy, 1, __ATOMIC_RELAXED);
+      lJobNumber = __atomic_add_fetch(&psShared->lJobs, 1, __ATOMIC_RELAXED);
+      dStart = getDaemonSeconds();
+
+      fflush(stdout);
+      fflush(stderr);
+      dup2(iClient, STDOUT_FILENO);
+      dup2(iClient, STDERR_FILENO);
+
+      if (chdir(ppcLines[0]) != 0) {
+	fprintf(stderr, "Daemon cannot change to \"%s\".\n", ppcLines[0]);
+	exit(1);
+      }
+      bWarm = 0;
+      lFrames = fJob(pvContext, ppcLines + 1, lLineCount - 1, &bWarm);
+
+      lMicroseconds = (unsigned long)((getDaemonSeconds() - dStart) * 1e6);
+      __atomic_add_fetch(&psShared->lFrames, lFrames, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&psShared->lRenderMicroseconds,
+			 lMicroseconds,
+			 __ATOMIC_RELAXED);
+      if (bWarm)
+	__atomic_add_fetch(&psShared->lWarmJobs, 1, __ATOMIC_RELAXED);
+      printf("ok job %lu: %lu frames in %.3f ms on worker %ld, %s chain\n",
+	     lJobNumber,
+	     lFrames,
+	     lMicroseconds * 1e-3,
+	     (long)getpid(),
+	     bWarm ? "warm" : "new");
+
+      fflush(stdout);
+      fflush(stderr);
+      dup2(iStdout, STDOUT_FILENO);
+      dup2(iStderr, STDERR_FILENO);
+      __atomic_store_n(&psWorker->bBusy, 0, __ATOMIC_RELAXED);
+    }
+
+    free(ppcLines);
+    free(pcBuffer);
+    close(iClient);
+  }
+
+  exit(0);
+}
+
+static void
+startDaemonWorker(const int iListener,
+		  DaemonShared * psShared,
+		  const unsigned long lWorkerIndex,
+		  DaemonJobFunction fJob,
+		  void * pvContext) {
+
+  DaemonWorker * psWorker;
+  pid_t iPid;
+
+  psWorker = psShared->psWorkers + lWorkerIndex;
+  psWorker->bBusy = 0;
+  fflush(stdout);
+  fflush(stderr);
+  iPid = fork();
+  if (iPid < 0) {
+    fprintf(stderr, "Failed to start a daemon worker.\n");
+    exit(1);
+  }
+  if (iPid == 0)
+    runDaemonWorker(iListener, psShared, psWorker, fJob, pvContext);
+  psWorker->iPid = iPid;
+  __atomic_add_fetch(&psShared->lWorkerStarts, 1, __ATOMIC_RELAXED);
+}
+
+/*****************************************************************************/
+
+void
+runDaemon(const char * pcSocketPath,
+	  const unsigned long lWorkerCount,
+	  DaemonJobFunction fJob,
+	  void * pvContext) {
+
+  DaemonShared * psShared;
+  int bBound;
+  int iListener;
+  int iProbe;
+  int iStatus;
+  mode_t iMask;
+  pid_t iPid;
+  struct sockaddr_un sAddress;
+  unsigned long lMappingSize;
+  unsigned long lWorkerIndex;
+
+  fillSocketAddress(&sAddress, pcSocketPath);
+
+  /* A socket file nobody answers on is left over from a daemon that
+     did not shut down cleanly. */
+  iProbe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connect(iProbe, (struct sockaddr *)&sAddress, sizeof(sAddress)) == 0) {
+    fprintf(stderr,
+	    "A daemon is already listening on \"%s\".\n",
+	    pcSocketPath);
+    exit(1);
+  }
+  close(iProbe);
+  unlink(pcSocketPath);
+
+  /* Jobs read and write files as the daemon's user, so only that
+     user may connect. The socket is created with no access for
+     anyone else rather than changed afterwards, which would leave a
+     moment in which others could connect. */
+  iListener = socket(AF_UNIX, SOCK_STREAM, 0);
+  iMask = umask(0177);
+  bBound = (iListener >= 0
+	    && bind(iListener,
+		    (struct sockaddr *)&sAddress,
+		    sizeof(sAddress)) == 0);
+  umask(iMask);
+  if (!bBound || listen(iListener, DAEMON_BACKLOG) != 0) {
+    fprintf(stderr, "Failed to listen on \"%s\".\n", pcSocketPath);
+    exit(1);
+  }
+
+  lMappingSize = sizeof(DaemonShared) + lWorkerCount * sizeof(DaemonWorker);
+  psShared = (DaemonShared *)mmap(NULL,
+				  lMappingSize,
+				  PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_ANONYMOUS,
+				  -1,
+				  0);
+  if (psShared == MAP_FAILED) {
+    fprintf(stderr, "Failed to map daemon counters.\n");
+    exit(1);
+  }
+  psShared->dStartSeconds = getDaemonSeconds();
+  psShared->lWorkerCount = lWorkerCount;
+
+  catchStopSignals();
+  for (lWorkerIndex = 0; lWorkerIndex < lWorkerCount; lWorkerIndex++)
+    startDaemonWorker(iListener, psShared, lWorkerIndex, fJob, pvContext);
+  printf("Listening on \"%s\" with %lu workers.\n",
+	 pcSocketPath,
+	 lWorkerCount);
+  fflush(stdout);
+
+  /* Replace workers as they die. A worker that dies during a job has
+     failed it; the client has whatever it printed on the way out. */
+  while (!g_bStop) {
+    iPid = waitpid(-1, &iStatus, 0);
+    if (iPid < 0)
+      continue;
+    for (lWorkerIndex = 0; lWorkerIndex < lWorkerCount; lWorkerIndex++)
+      if (psShared->psWorkers[lWorkerIndex].iPid == iPid)
+	break;
+    if (lWorkerIndex == lWorkerCount)
+      continue;
+    if (psShared->psWorkers[lWorkerIndex].bBusy)
+      __atomic_add_fetch(&psShared->lFailedJobs, 1, __ATOMIC_RELAXED);
+    if (!g_bStop)
+      startDaemonWorker(iListener, psShared, lWorkerIndex, fJob, pvContext);
+  }
+
+  /* Workers finish the job they are on before stopping. */
+  for (lWorkerIndex = 0; lWorkerIndex < lWorkerCount; lWorkerIndex++)
+    kill(psShared->psWorkers[lWorkerIndex].iPid, SIGTERM);
+  while (waitpid(-1, &iStatus, 0) > 0 || errno == EINTR)
+    ;
+  close(iListener);
+  unlink(pcSocketPath);
+
+  printf("Stopped after %lu jobs (%lu failed, %lu on warm chains), "
+	 "%lu frames.\n",
+	 psShared->lJobs,
+	 psShared->lFailedJobs,
+	 psShared->lWarmJobs,
+	 psShared->lFrames);
+  munmap(psShared, lMappingSize);
+}
+
+/*****************************************************************************/
+
+int
+submitDaemonJob(const char * pcSocketPath,
+		char * const * ppcWords,
+		const unsigned long lWordCount) {
+
+  char pcReply[4096];
+  char pcLastLine[8];
+  char * pcDirectory;
+  int bOk;
+  int iSocket;
+  ssize_t lRead;
+  ssize_t lIndex;
+  struct sockaddr_un sAddress;
+  unsigned long lLastLineLength;
+  unsigned long lWordIndex;
+
+  for (lWordIndex = 0; lWordIndex < lWordCount; lWordIndex++)
+    if (ppcWords[lWordIndex][0] == '\0'
+	|| strchr(ppcWords[lWordIndex], '\n') != NULL) {
+      fprintf(stderr,
+	      "Arguments sent to the daemon must not be empty or hold "
+	      "newlines.\n");
+      exit(1);
+    }
+  pcDirectory = getcwd(NULL, 0);
+  if (pcDirectory == NULL || strchr(pcDirectory, '\n') != NULL) {
+    fprintf(stderr, "Cannot send the working directory to the daemon.\n");
+    exit(1);
+  }
+
+  fillSocketAddress(&sAddress, pcSocketPath);
+  iSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (iSocket < 0
+      || connect(iSocket,
+		 (struct sockaddr *)&sAddress,
+		 sizeof(sAddress)) != 0) {
+    fprintf(stderr, "No daemon is listening on \"%s\".\n", pcSocketPath);
+    exit(1);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  writeAll(iSocket, pcDirectory, strlen(pcDirectory));
+  writeAll(iSocket, "\n", 1);
+  for (lWordIndex = 0; lWordIndex < lWordCount; lWordIndex++) {
+    writeAll(iSocket, ppcWords[lWordIndex], strlen(ppcWords[lWordIndex]));
+    writeAll(iSocket, "\n", 1);
+  }
+  writeAll(iSocket, "\n", 1);
+  shutdown(iSocket, SHUT_WR);
+  free(pcDirectory);
+
+  /* Copy the reply out, watching for the "ok" that ends a job which
+     succeeded. */
+  lLastLineLength = 0;
+  bOk = 0;
+  while ((lRead = read(iSocket, pcReply, sizeof(pcReply))) != 0) {
+    if (lRead < 0) {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    fwrite(pcReply, 1, lRead, stdout);
+    for (lIndex = 0; lIndex < lRead; lIndex++) {
+      if (pcReply[lIndex] == '\n') {
+	bOk = (lLastLineLength >= 3
+	       && strncmp(pcLastLine, "ok ", 3) == 0);
+	lLastLineLength = 0;
+      }
+      else {
+	if (lLastLineLength < sizeof(pcLastLine))
+	  pcLastLine[lLastLineLength] = pcReply[lIndex];
+	lLastLineLength++;
+	bOk = 0;
+      }
+    }
+  }
+  close(iSocket);
+
+  return bOk ? 0 : 1;
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,1002 @@
+/* graph.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+#include "utils.h"
+
+/*****************************************************************************/
+
+/* Most words allowed on one line of a graph file. */
+#define GRAPH_MAX_WORDS 256
+
+/*****************************************************************************/
+
+/* Work-stealing scheduler:
+   ------------------------
+
+   Each thread has a deque of ready tasks. It takes work from the
+   bottom of its own deque, so a branch tends to continue on the core
+   that ran its predecessor, and steals from the top of other deques
+   when its own is empty. A task finishing makes its dependents ready
+   on the same thread. A block is done when every task has run. */
+
+typedef struct {
+
+  pthread_mutex_t sLock;
+  unsigned long * plTasks;
+  unsigned long lTop;
+  unsigned long lBottom;
+
+} TaskDeque;
+
+typedef struct GraphScheduler GraphScheduler;
+
+typedef struct {
+  GraphScheduler * psScheduler;
+  unsigned long lIndex;
+} GraphWorker;
+
+struct GraphScheduler {
+
+  ProcessGraph * psGraph;
+
+  unsigned long lThreadCount;
+  pthread_t * psThreads;
+  GraphWorker * psWorkers;
+  TaskDeque * psDeques;
+
+  /* Block start signalling. */
+  pthread_mutex_t sLock;
+  pthread_cond_t sStart;
+  unsigned long lGeneration;
+  int bQuit;
+
+  /* Threads with nothing to take or steal sleep on sWork until a
+     task is made ready or the block is done. lReady counts tasks in
+     the deques, and is raised before a task is pushed so it never
+     drops below the number a thread could take. */
+  pthread_mutex_t sWorkLock;
+  pthread_cond_t sWork;
+  unsigned long lReady;
+
+  /* Per block: dependencies still outstanding for each task and
+     tasks not yet finished. */
+  unsigned long * plPending;
+  unsigned long lRemaining;
+  unsigned long lFrameCount;
+  unsigned long lSubBlockSize;
+
+};
+
+/*****************************************************************************/
+
+static void
+pushTask(TaskDeque * psDeque, const unsigned long lTask) {
+  pthread_mutex_lock(&psDeque->sLock);
+  psDeque->plTasks[psDeque->lBottom++] = lTask;
+  pthread_mutex_unlock(&psDeque->sLock);
+}
+
+/* Take a task from the bottom (bOwner) or top of a deque. Returns 0
+   if it is empty. */
+static int
+takeTask(TaskDeque * psDeque, const int bOwner, unsigned long * plTask) {
+
+  int bFound;
+
+  pthread_mutex_lock(&psDeque->sLock);
+  bFound = (psDeque->lBottom > psDeque->lTop);
+  if (bFound) {
+    if (bOwner)
+      *plTask = psDeque->plTasks[--psDeque->lBottom];
+    else
+      *plTask = psDeque->plTasks[psDeque->lTop++];
+  }
+  pthread_mutex_unlock(&psDeque->sLock);
+
+  return bFound;
+}
+
+/* Push a task that has become ready and wake a sleeping thread to
+   steal it. */
+static void
+readyTask(GraphScheduler * psScheduler,
+	  const unsigned long lThread,
+	  const unsigned long lTask) {
+  __atomic_add_fetch(&psScheduler->lReady, 1, __ATOMIC_RELEASE);
+  pushTask(psScheduler->psDeques + lThread, lTask);
+  pthread_mutex_lock(&psScheduler->sWorkLock);
+  pthread_cond_signal(&psScheduler->sWork);
+  pthread_mutex_unlock(&psScheduler->sWorkLock);
+}
+
+/*****************************************************************************/
+
+static void
+runGraphNode(ProcessGraph * psGraph,
+	     GraphNode * psNode,
+	     const unsigned long lFrameCount,
+	     const unsigned long lSubBlockSize) {
+
+  LADSPA_Data * pfOutput;
+  const LADSPA_Data * pfInput;
+  LADSPA_Data fGain;
+  unsigned long lFrameIndex;
+  unsigned long lFrameSize;
+  unsigned long lInputIndex;
+  unsigned long lOffset;
+  unsigned long lOutputIndex;
+  unsigned long lPortIndex;
+
+  if (psNode->psDescriptor == NULL) {
+
+    /* Mix point. */
+    pfOutput = psGraph->ppfEdgeBuffers[psNode->plOutputEdges[0]];
+    memset(pfOutput, 0, sizeof(LADSPA_Data) * lFrameCount);
+    for (lInputIndex = 0; lInputIndex < psNode->lInputCount; lInputIndex++) {
+      pfInput = psGraph->ppfEdgeBuffers[psNode->plInputEdges[lInputIndex]];
+      fGain = psNode->pfGains[lInputIndex];
+      for (lFrameIndex = 0; lFrameIndex < lFrameCount; lFrameIndex++)
+	pfOutput[lFrameIndex] += fGain * pfInput[lFrameIndex];
+    }
+    return;
+  }
+
+  for (lOffset = 0; lOffset < lFrameCount; lOffset += lFrameSize) {
+
+    lFrameSize = lFrameCount - lOffset;
+    if (lFrameSize > lSubBlockSize)
+      lFrameSize = lSubBlockSize;
+
+    lInputIndex = 0;
+    lOutputIndex = 0;
+    for (lPortIndex = 0;
+	 lPortIndex < psNode->psDescriptor->PortCount;
+	 lPortIndex++) {
+      if (!LADSPA_IS_PORT_AUDIO(psNode->psDescriptor
+				->PortDescriptors[lPortIndex]))
+	continue;
+      if (LADSPA_IS_PORT_INPUT(psNode->psDescriptor
+			       ->PortDescriptors[lPortIndex]))
+	psNode->psDescriptor->connect_port
+	  (psNode->hInstance,
+	   lPortIndex,
+	   (psGraph->ppfEdgeBuffers[psNode->plInputEdges[lInputIndex++]]
+	    + lOffset));
+      else
+	psNode->psDescriptor->connect_port
+	  (psNode->hInstance,
+	   lPortIndex,
+	   (psGraph->ppfEdgeBuffers[psNode->plOutputEdges[lOutputIndex++]]
+	    + lOffset));
+    }
+
+    psNode->psDescriptor->run(psNode->hInstance, lFrameSize);
+  }
+}
+
+/* Run tasks for the current block until none are left. */
+static void
+workOnBlock(GraphScheduler * psScheduler, const unsigned long lIndex) {
+
+  ProcessGraph * psGraph;
+  unsigned long lDependentIndex;
+  unsigned long lNodeIndex;
+  unsigned long lTask;
+  unsigned long lVictim;
+  int bFound;
+
+  psGraph = psScheduler->psGraph;
+
+  while (__atomic_load_n(&psScheduler->lRemaining, __ATOMIC_ACQUIRE) > 0) {
+
+    bFound = takeTask(psScheduler->psDeques + lIndex, 1, &lTask);
+    for (lVictim = 1;
+	 !bFound && lVictim < psScheduler->lThreadCount;
+	 lVictim++) {
+      bFound = takeTask(psScheduler->psDeques
+			+ (lIndex + lVictim) % psScheduler->lThreadCount,
+			0,
+			&lTask);
+      if (bFound)
+	__atomic_fetch_add(&psGraph->lSteals, 1, __ATOMIC_RELAXED);
+    }
+    if (!bFound) {
+      pthread_mutex_lock(&psScheduler->sWorkLock);
+      while (__atomic_load_n(&psScheduler->lReady, __ATOMIC_ACQUIRE) == 0
+	     && __atomic_load_n(&psScheduler->lRemaining,
+				__ATOMIC_ACQUIRE) > 0)
+	pthread_cond_wait(&psScheduler->sWork, &psScheduler->sWorkLock);
+      pthread_mutex_unlock(&psScheduler->sWorkLock);
+      continue;
+    }
+    __atomic_sub_fetch(&psScheduler->lReady, 1, __ATOMIC_ACQ_REL);
+
+    for (lNodeIndex = psGraph->plTaskStart[lTask];
+	 lNodeIndex < psGraph->plTaskStart[lTask + 1];
+	 lNodeIndex++)
+      runGraphNode(psGraph,
+		   psGraph->psNodes + psGraph->plTaskNodes[lNodeIndex],
+		   psScheduler->lFrameCount,
+		   psScheduler->lSubBlockSize);
+
+    for (lDependentIndex = psGraph->plDependentStart[lTask];
+	 lDependentIndex < psGraph->plDependentStart[lTask + 1];
+	 lDependentIndex++)
+      if (__atomic_sub_fetch(psScheduler->plPending
+			     + psGraph->plDependents[lDependentIndex],
+			     1,
+			     __ATOMIC_ACQ_REL) == 0)
+	readyTask(psScheduler,
+		  lIndex,
+		  psGraph->plDependents[lDependentIndex]);
+
+    /* The last task lets the sleepers go. */
+    if (__atomic_sub_fetch(&psScheduler->lRemaining, 1, __ATOMIC_ACQ_REL)
+	== 0) {
+      pthread_mutex_lock(&psScheduler->sWorkLock);
+      pthread_cond_broadcast(&psScheduler->sWork);
+      pthread_mutex_unlock(&psScheduler->sWorkLock);
+    }
+  }
+}
+
+static void *
+graphWorkerThread(void * pvWorker) {
+
+  GraphScheduler * psScheduler;
+  GraphWorker * psWorker;
+  unsigned long lSeen;
+
+  psWorker = (GraphWorker *)pvWorker;
+  psScheduler = psWorker->psScheduler;
+
+  lSeen = 0;
+  while (1) {
+    pthread_mutex_lock(&psScheduler->sLock);
+    while (psScheduler->lGeneration == lSeen && !psScheduler->bQuit)
+      pthread_cond_wait(&psScheduler->sStart, &psScheduler->sLock);
+    lSeen = psScheduler->lGeneration;
+    if (psScheduler->bQuit) {
+      pthread_mutex_unlock(&psScheduler->sLock);
+      break;
+    }
+    pthread_mutex_unlock(&psScheduler->sLock);
+
+    workOnBlock(psScheduler, psWorker->lIndex);
+  }
+
+  return NULL;
+}
+
+/*****************************************************************************/
+
+/* Graph file parsing:
+   ------------------- */
+
+static unsigned long
+findEdge(ProcessGraph * psGraph, const char * pcName, const int bCreate) {
+
+  unsigned long lEdgeIndex;
+
+  for (lEdgeIndex = 0; lEdgeIndex < psGraph->lEdgeCount; lEdgeIndex++)
+    if (strcmp(psGraph->ppcEdgeNames[lEdgeIndex], pcName) == 0)
+      return lEdgeIndex;
+
+  if (!bCreate)
+    return psGraph->lEdgeCount;
+
+  psGraph->ppcEdgeNames
+    = (char **)realloc(psGraph->ppcEdgeNames,
+		       (psGraph->lEdgeCount + 1) * sizeof(char *));
+  psGraph->ppcEdgeNames[psGraph->lEdgeCount] = strdup(pcName);
+  return psGraph->lEdgeCount++;
+}
+
+static GraphNode *
+addNode(ProcessGraph * psGraph, const char * pcName) {
+
+  GraphNode * psNode;
+
+  psGraph->psNodes
+    = (GraphNode *)realloc(psGraph->psNodes,
+			   (psGraph->lNodeCount + 1) * sizeof(GraphNode));
+  psNode = psGraph->psNodes + psGraph->lNodeCount++;
+  memset(psNode, 0, sizeof(GraphNode));
+  psNode->pcName = strdup(pcName);
+
+  return psNode;
+}
+
+static void
+failGraphLine(const char * pcFilename,
+	      const unsigned long lLine,
+	      const char * pcMessage,
+	      const char * pcDetail) {
+  fprintf(stderr,
+	  "%s:%lu: %s%s%s%s\n",
+	  pcFilename,
+	  lLine,
+	  pcMessage,
+	  pcDetail ? " \"" : "",
+	  pcDetail ? pcDetail : "",
+	  pcDetail ? "\"" : "");
+  exit(1);
+}
+
+/* Nodes and mixes share one namespace. */
+static void
+checkNodeName(const ProcessGraph * psGraph,
+	      const char * pcFilename,
+	      const unsigned long lLine,
+	      const char * pcName) {
+
+  unsigned long lNodeIndex;
+
+  for (lNodeIndex = 0; lNodeIndex < psGraph->lNodeCount; lNodeIndex++)
+    if (strcmp(psGraph->psNodes[lNodeIndex].pcName, pcName) == 0)
+      failGraphLine(pcFilename, lLine, "Duplicate node", pcName);
+}
+
+/* Mark each edge with the node that writes it, or ~0 for graph
+   inputs, checking that every edge has exactly one source. */
+static unsigned long *
+findEdgeWriters(ProcessGraph * psGraph, const char * pcFilename) {
+
+  GraphNode * psNode;
+  unsigned long * plWriters;
+  unsigned long lEdgeIndex;
+  unsigned long lIndex;
+  unsigned long lNodeIndex;
+
+  plWriters = (unsigned long *)malloc(psGraph->lEdgeCount
+				      * sizeof(unsigned long));
+  for (lEdgeIndex = 0; lEdgeIndex < psGraph->lEdgeCount; lEdgeIndex++)
+    plWriters[lEdgeIndex] = psGraph->lNodeCount;
+
+  for (lIndex = 0; lIndex < psGraph->lInputCount; lIndex++)
+    plWriters[psGraph->plInputEdges[lIndex]] = ~0UL;
+
+  for (lNodeIndex = 0; lNodeIndex < psGraph->lNodeCount; lNodeIndex++) {
+    psNode = psGraph->psNodes + lNodeIndex;
+    for (lIndex = 0; lIndex < psNode->lOutputCount; lIndex++) {
+      lEdgeIndex = psNode->plOutputEdges[lIndex];
+      if (plWriters[lEdgeIndex] != psGraph->lNodeCount) {
+	fprintf(stderr,
+		"%s: edge \"%s\" is written more than once.\n",
+		pcFilename,
+		psGraph->ppcEdgeNames[lEdgeIndex]);
+	exit(1);
+      }
+      plWriters[lEdgeIndex] = lNodeIndex;
+    }
+  }
+
+  for (lEdgeIndex = 0; lEdgeIndex < psGraph->lEdgeCount; lEdgeIndex++)
+    if (plWriters[lEdgeIndex] == psGraph->lNodeCount) {
+      fprintf(stderr,
+	      "%s: edge \"%s\" is never written.\n",
+	      pcFilename,
+	      psGraph->ppcEdgeNames[lEdgeIndex]);
+      exit(1);
+    }
+
+  return plWriters;
+}
+
+/* Compile the execution plan. Nodes are put in dependency order, then
+   runs of nodes where each feeds only the next, and the next is fed
+   only by it, are merged into a single task (a branch). Tasks record
+   the tasks waiting on them and how many tasks they wait on. */
+static void
+planProcessGraph(ProcessGraph * psGraph, const char * pcFilename) {
+
+  GraphNode * psNode;
+  unsigned long * plDependencyCount;
+  unsigned long * plDependentCount;
+  unsigned long ** pplDependents;
+  unsigned long * plNodeTask;
+  unsigned long * plOrder;
+  unsigned long * plWaiting;
+  unsigned long * plWriters;
+  unsigned long lCurrent;
+  unsigned long lDependency;
+  unsigned long lIndex;
+  unsigned long lNext;
+  unsigned long lNodeCount;
+  unsigned long lNodeIndex;
+  unsigned long lOrderCount;
+  unsigned long lOther;
+  unsigned long lTask;
+
+  lNodeCount = psGraph->lNodeCount;
+  plWriters = findEdgeWriters(psGraph, pcFilename);
+
+  /* Node dependencies, without duplicates. */
+  plDependencyCount = (unsigned long *)calloc(lNodeCount + 1,
+					      sizeof(unsigned long));
+  plDependentCount = (unsigned long *)calloc(lNodeCount + 1,
+					     sizeof(unsigned long));
+  pplDependents = (unsigned long **)calloc(lNodeCount + 1,
+					   sizeof(unsigned long *));
+  for (lNodeIndex = 0; lNodeIndex < lNodeCount; lNodeIndex++) {
+    psNode = psGraph->psNodes + lNodeIndex;
+    for (lIndex = 0; lIndex < psNode->lInputCount; lIndex++) {
+      lDependency = plWriters[psNode->plInputEdges[lIndex]];
+      if (lDependency == ~0UL)
+	continue;
+      for (lOther = 0; lOther < plDependentCount[lDependency]; lOther++)
+	if (pplDependents[lDependency][lOther] == lNodeIndex)
+	  break;
+      if (lOther < plDependentCount[lDependency])
+	continue;
+      pplDependents[lDependency]
+	= (unsigned long *)realloc(pplDependents[lDependency],
+				   (plDependentCount[lDependency] + 1)
+				   * sizeof(unsigned long));
+      pplDependents[lDependency][plDependentCount[lDependency]++]
+	= lNodeIndex;
+      plDependencyCount[lNodeIndex]++;
+    }
+  }
+
+  /* Dependency order (Kahn), which also finds cycles. */
+  plOrder = (unsigned long *)calloc(lNodeCount + 1, sizeof(unsigned long));
+  plWaiting = (unsigned long *)calloc(lNodeCount + 1, sizeof(unsigned long));
+  lOrderCount = 0;
+  for (lNodeIndex = 0; lNodeIndex < lNodeCount; lNodeIndex++) {
+    plWaiting[lNodeIndex] = plDependencyCount[lNodeIndex];
+    if (plWaiting[lNodeIndex] == 0)
+      plOrder[lOrderCount++] = lNodeIndex;
+  }
+  for (lIndex = 0; lIndex < lOrderCount; lIndex++) {
+    lCurrent = plOrder[lIndex];
+    for (lOther = 0; lOther < plDependentCount[lCurrent]; lOther++)
+      if (--plWaiting[pplDependents[lCurrent][lOther]] == 0)
+	plOrder[lOrderCount++] = pplDependents[lCurrent][lOther];
+  }
+  if (lOrderCount < lNodeCount) {
+    fprintf(stderr, "%s: the graph contains a cycle.\n", pcFilename);
+    exit(1);
+  }
+
+  /* Merge branches into tasks. */
+  plNodeTask = (unsigned long *)malloc((lNodeCount + 1)
+				       * sizeof(unsigned long));
+  for (lNodeIndex = 0; lNodeIndex < lNodeCount; lNodeIndex++)
+    plNodeTask[lNodeIndex] = ~0UL;
+  psGraph->plTaskStart = (unsigned long *)calloc(lNodeCount + 1,
+						 sizeof(unsigned long));
+  psGraph->plTaskNodes = (unsigned long *)calloc(lNodeCount + 1,
+						 sizeof(unsigned long));
+  psGraph->lTaskCount = 0;
+  lIndex = 0;
+  for (lOther = 0; lOther < lNodeCount; lOther++) {
+    lCurrent = plOrder[lOther];
+    if (plNodeTask[lCurrent] != ~0UL)
+      continue;
+    psGraph->plTaskStart[psGraph->lTaskCount] = lIndex;
+    while (1) {
+      plNodeTask[lCurrent] = psGraph->lTaskCount;
+      psGraph->plTaskNodes[lIndex++] = lCurrent;
+      if (plDependentCount[lCurrent] != 1)
+	break;
+      lNext = pplDependents[lCurrent][0];
+      if (plDependencyCount[lNext] != 1 || plNodeTask[lNext] != ~0UL)
+	break;
+      lCurrent = lNext;
+    }
+    psGraph->lTaskCount++;
+  }
+  psGraph->plTaskStart[psGraph->lTaskCount] = lIndex;
+
+  /* Task dependencies come from the first node of each task and
+     dependents from the last. */
+  psGraph->plTaskDependencyCount
+    = (unsigned long *)calloc(psGraph->lTaskCount + 1,
+			      sizeof(unsigned long));
+  psGraph->plDependentStart
+    = (unsigned long *)calloc(psGraph->lTaskCount + 1,
+			      sizeof(unsigned long));
+  lIndex = 0;
+  for (lNodeIndex = 0; lNodeIndex < lNodeCount; lNodeIndex++)
+    lIndex += plDependentCount[lNodeIndex];
+  psGraph->plDependents
+    = (unsigned long *)calloc(lIndex + 1, sizeof(unsigned long));
+  lIndex = 0;
+  for (lTask = 0; lTask < psGraph->lTaskCount; lTask++) {
+    psGraph->plTaskDependencyCount[lTask]
+      = plDependencyCount[psGraph->plTaskNodes[psGraph->plTaskStart[lTask]]];
+    lCurrent = psGraph->plTaskNodes[psGraph->plTaskStart[lTask + 1] - 1];
+    psGraph->plDependentStart[lTask] = lIndex;
+    for (lOther = 0; lOther < plDependentCount[lCurrent]; lOther++)
+      psGraph->plDependents[lIndex++]
+	= plNodeTask[pplDependents[lCurrent][lOther]];
+  }
+  psGraph->plDependentStart[psGraph->lTaskCount] = lIndex;
+
+  for (lNodeIndex = 0; lNodeIndex < lNodeCount; lNodeIndex++)
+    free(pplDependents[lNodeIndex]);
+  free(pplDependents);
+  free(plDependencyCount);
+  free(plDependentCount);
+  free(plNodeTask);
+  free(plOrder);
+  free(plWaiting);
+  free(plWriters);
+}
+
+/*****************************************************************************/
+
+void
+loadProcessGraph(ProcessGraph * psGraph, const char * pcFilename) {
+
+  FILE * poFile;
+  GraphNode * psNode;
+  char * pcEndPointer;
+  char * pcGain;
+  char * pcLine;
+  char * pcSave;
+  char * ppcWords[GRAPH_MAX_WORDS];
+  unsigned long lControlCount;
+  unsigned long lIndex;
+  unsigned long lInputCount;
+  unsigned long lLine;
+  unsigned long lOutputCount;
+  unsigned long lWordCount;
+  unsigned long lWordIndex;
+  size_t lLineSize;
+
+  memset(psGraph, 0, sizeof(ProcessGraph));
+
+  poFile = fopen(pcFilename, "r");
+  if (!poFile) {
+    fprintf(stderr, "Failed to open graph file \"%s\".\n", pcFilename);
+    exit(1);
+  }
+
+  pcLine = NULL;
+  lLineSize = 0;
+  lLine = 0;
+  while (getline(&pcLine, &lLineSize, poFile) >= 0) {
+
+    lLine++;
+    if (strchr(pcLine, '#'))
+      *strchr(pcLine, '#') = '\0';
+    lWordCount = 0;
+    for (ppcWords[0] = strtok_r(pcLine, " \t\r\n", &pcSave);
+	 ppcWords[lWordCount] != NULL;
+	 ppcWords[lWordCount] = strtok_r(NULL, " \t\r\n", &pcSave))
+      if (++lWordCount == GRAPH_MAX_WORDS)
+	failGraphLine(pcFilename, lLine, "Line too long.", NULL);
+    if (lWordCount == 0)
+      continue;
+
+    if (strcmp(ppcWords[0], "input") == 0
+	|| strcmp(ppcWords[0], "output") == 0) {
+
+      /* input <edge>...  or  output <edge>... */
+      if (lWordCount < 2)
+	failGraphLine(pcFilename, lLine, "No edges given.", NULL);
+      if (ppcWords[0][0] == 'i') {
+	if (psGraph->lInputCount > 0)
+	  failGraphLine(pcFilename, lLine, "Inputs given twice.", NULL);
+	psGraph->lInputCount = lWordCount - 1;
+	psGraph->plInputEdges
+	  = (unsigned long *)calloc(lWordCount, sizeof(unsigned long));
+	for (lIndex = 1; lIndex < lWordCount; lIndex++)
+	  psGraph->plInputEdges[lIndex - 1]
+	    = findEdge(psGraph, ppcWords[lIndex], 1);
+      }
+      else {
+	if (psGraph->lOutputCount > 0)
+	  failGraphLine(pcFilename, lLine, "Outputs given twice.", NULL);
+	psGraph->lOutputCount = lWordCount - 1;
+	psGraph->plOutputEdges
+	  = (unsigned long *)calloc(lWordCount, sizeof(unsigned long));
+	for (lIndex = 1; lIndex < lWordCount; lIndex++)
+	  psGraph->plOutputEdges[lIndex - 1]
+	    = findEdge(psGraph, ppcWords[lIndex], 1);
+      }
+    }
+
+    else if (strcmp(ppcWords[0], "mix") == 0) {
+
+      /* mix <output edge> <input edge>[*<gain>]... */
+      if (lWordCount < 3)
+	failGraphLine(pcFilename, lLine, "A mix needs inputs.", NULL);
+      checkNodeName(psGraph, pcFilename, lLine, ppcWords[1]);
+      psNode = addNode(psGraph, ppcWords[1]);
+      psNode->lOutputCount = 1;
+      psNode->plOutputEdges
+	= (unsigned long *)calloc(1, sizeof(unsigned long));
+      psNode->plOutputEdges[0] = findEdge(psGraph, ppcWords[1], 1);
+      psNode->lInputCount = lWordCount - 2;
+      psNode->plInputEdges
+	= (unsigned long *)calloc(lWordCount, sizeof(unsigned long));
+      psNode->pfGains
+	= (LADSPA_Data *)calloc(lWordCount, sizeof(LADSPA_Data));
+      for (lIndex = 2; lIndex < lWordCount; lIndex++) {
+	psNode->pfGains[lIndex - 2] = 1;
+	pcGain = strchr(ppcWords[lIndex], '*');
+	if (pcGain) {
+	  *(pcGain++) = '\0';
+	  psNode->pfGains[lIndex - 2]
+	    = (LADSPA_Data)strtod(pcGain, &pcEndPointer);
+	  if (*pcGain == '\0' || *pcEndPointer != '\0')
+	    failGraphLine(pcFilename, lLine, "Bad gain", pcGain);
+	}
+	if (ppcWords[lIndex][0] == '\0')
+	  failGraphLine(pcFilename, lLine, "A mix input has no edge.", NULL);
+	psNode->plInputEdges[lIndex - 2]
+	  = findEdge(psGraph, ppcWords[lIndex], 1);
+      }
+    }
+
+    else if (strcmp(ppcWords[0], "node") == 0) {
+
+      /* node <name> <plugin file> <label> <inputs> -> <outputs>
+	 <controls> */
+      if (lWordCount < 4)
+	failGraphLine(pcFilename, lLine,
+		      "Expected a name, plugin file and label.", NULL);
+      checkNodeName(psGraph, pcFilename, lLine, ppcWords[1]);
+
+      psNode = addNode(psGraph, ppcWords[1]);
+      psNode->pvLibrary = loadLADSPAPluginLibrary(ppcWords[2]);
+      psNode->psDescriptor
+	= findLADSPAPluginDescriptor(psNode->pvLibrary,
+				     ppcWords[2],
+				     ppcWords[3]);
+
+      lInputCount
+	= getPortCountByType(psNode->psDescriptor,
+			     LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT);
+      lOutputCount
+	= getPortCountByType(psNode->psDescriptor,
+			     LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT);
+      lControlCount
+	= getPortCountByType(psNode->psDescriptor,
+			     LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT);
+
+      if (lWordCount != 4 + lInputCount + 1 + lOutputCount + lControlCount
+	  || strcmp(ppcWords[4 + lInputCount], "->") != 0) {
+	fprintf(stderr,
+		"%s:%lu: plugin \"%s\" needs %lu input edges, \"->\", "
+		"%lu output edges and %lu control values.\n",
+		pcFilename,
+		lLine,
+		psNode->psDescriptor->Name,
+		lInputCount,
+		lOutputCount,
+		lControlCount);
+	exit(1);
+      }
+
+      lWordIndex = 4;
+      psNode->lInputCount = lInputCount;
+      psNode->plInputEdges
+	= (unsigned long *)calloc(lInputCount + 1, sizeof(unsigned long));
+      for (lIndex = 0; lIndex < lInputCount; lIndex++)
+	psNode->plInputEdges[lIndex]
+	  = findEdge(psGraph, ppcWords[lWordIndex++], 1);
+      lWordIndex++;
+      psNode->lOutputCount = lOutputCount;
+      psNode->plOutputEdges
+	= (unsigned long *)calloc(lOutputCount + 1, sizeof(unsigned long));
+      for (lIndex = 0; lIndex < lOutputCount; lIndex++)
+	psNode->plOutputEdges[lIndex]
+	  = findEdge(psGraph, ppcWords[lWordIndex++], 1);
+      psNode->pfControlValues
+	= (LADSPA_Data *)calloc(lControlCount + 1, sizeof(LADSPA_Data));
+      for (lIndex = 0; lIndex < lControlCount; lIndex++) {
+	psNode->pfControlValues[lIndex]
+	  = (LADSPA_Data)strtod(ppcWords[lWordIndex], &pcEndPointer);
+	if (*pcEndPointer != '\0')
+	  failGraphLine(pcFilename, lLine,
+			"Bad control value", ppcWords[lWordIndex]);
+	lWordIndex++;
+      }
+    }
+
+    else
+      failGraphLine(pcFilename, lLine, "Unknown statement", ppcWords[0]);
+  }
+  free(pcLine);
+  fclose(poFile);
+
+  if (psGraph->lOutputCount == 0) {
+    fprintf(stderr, "%s: no output edges given.\n", pcFilename);
+    exit(1);
+  }
+
+  planProcessGraph(psGraph, pcFilename);
+}
+
+/*****************************************************************************/
+
+void
+instantiateProcessGraph(ProcessGraph * psGraph,
+			const unsigned long lSampleRate,
+			const unsigned long lBlockSize,
+			unsigned long lThreadCount,
+			const int bHugePages) {
+
+  GraphNode * psNode;
+  GraphScheduler * psScheduler;
+  LADSPA_PortDescriptor iPortDescriptor;
+  unsigned long lControlIndex;
+  unsigned long lControlOutputIndex;
+  unsigned long lEdgeIndex;
+  unsigned long lIndex;
+  unsigned long lNodeIndex;
+  unsigned long lPortIndex;
+
+  psGraph->lSampleRate = lSampleRate;
+
+  /* Every edge has its own buffer, so branches never share one, but
+     they are all allocated together. */
+  createBufferArena(&psGraph->sEdgeArena,
+		    (psGraph->lEdgeCount
+		     * getArenaSpace(lBlockSize * sizeof(LADSPA_Data))),
+		    bHugePages);
+  psGraph->ppfEdgeBuffers
+    = (LADSPA_Data **)calloc(psGraph->lEdgeCount, sizeof(LADSPA_Data *));
+  for (lEdgeIndex = 0; lEdgeIndex < psGraph->lEdgeCount; lEdgeIndex++)
+    psGraph->ppfEdgeBuffers[lEdgeIndex]
+      = (LADSPA_Data *)allocateFromArena(&psGraph->sEdgeArena,
+					 lBlockSize * sizeof(LADSPA_Data));
+  psGraph->ppfInputBuffers
+    = (LADSPA_Data **)calloc(psGraph->lInputCount + 1,
+			     sizeof(LADSPA_Data *));
+  for (lIndex = 0; lIndex < psGraph->lInputCount; lIndex++)
+    psGraph->ppfInputBuffers[lIndex]
+      = psGraph->ppfEdgeBuffers[psGraph->plInputEdges[lIndex]];
+  psGraph->ppfOutputBuffers
+    = (LADSPA_Data **)calloc(psGraph->lOutputCount + 1,
+			     sizeof(LADSPA_Data *));
+  for (lIndex = 0; lIndex < psGraph->lOutputCount; lIndex++)
+    psGraph->ppfOutputBuffers[lIndex]
+      = psGraph->ppfEdgeBuffers[psGraph->plOutputEdges[lIndex]];
+
+  for (lNodeIndex = 0; lNodeIndex < psGraph->lNodeCount; lNodeIndex++) {
+
+    psNode = psGraph->psNodes + lNodeIndex;
+    if (!psNode->psDescriptor)
+      continue;
+
+    psNode->hInstance
+      = psNode->psDescriptor->instantiate(psNode->psDescriptor, lSampleRate);
+    if (!psNode->hInstance) {
+      fprintf(stderr,
+	      "Failed to instantiate plugin of type \"%s\".\n",
+	      psNode->psDescriptor->Name);
+      exit(1);
+    }
+
+    /* Each node has its own control outputs, as nodes run on
+       different worker threads. */
+    psNode->pfControlOutputs
+      = (LADSPA_Data *)calloc
+      (getPortCountByType(psNode->psDescriptor,
+			  LADSPA_PORT_CONTROL | LADSPA_PORT_OUTPUT) + 1,
+       sizeof(LADSPA_Data));
+
+    lControlIndex = 0;
+    lControlOutputIndex = 0;
+    for (lPortIndex = 0;
+	 lPortIndex < psNode->psDescriptor->PortCount;
+	 lPortIndex++) {
+      iPortDescriptor = psNode->psDescriptor->PortDescriptors[lPortIndex];
+      if (LADSPA_IS_PORT_CONTROL(iPortDescriptor)) {
+	if (LADSPA_IS_PORT_INPUT(iPortDescriptor))
+	  psNode->psDescriptor->connect_port
+	    (psNode->hInstance,
+	     lPortIndex,
+	     psNode->pfControlValues + (lControlIndex++));
+	else
+	  psNode->psDescriptor->connect_port
+	    (psNode->hInstance,
+	     lPortIndex,
+	     psNode->pfControlOutputs + (lControlOutputIndex++));
+      }
+    }
+  }
+
+  /* Start the thread pool. The calling thread is worker 0. */
+  if (lThreadCount > psGraph->lTaskCount)
+    lThreadCount = psGraph->lTaskCount;
+  if (lThreadCount < 1)
+    lThreadCount = 1;
+
+  psScheduler = (GraphScheduler *)calloc(1, sizeof(GraphScheduler));
+  psScheduler->psGraph = psGraph;
+  psScheduler->lThreadCount = lThreadCount;
+  psScheduler->plPending
+    = (unsigned long *)calloc(psGraph->lTaskCount + 1, sizeof(unsigned long));
+  psScheduler->psDeques
+    = (TaskDeque *)calloc(lThreadCount, sizeof(TaskDeque));
+  psScheduler->psWorkers
+    = (GraphWorker *)calloc(lThreadCount, sizeof(GraphWorker));
+  psScheduler->psThreads
+    = (pthread_t *)calloc(lThreadCount, sizeof(pthread_t));
+  pthread_mutex_init(&psScheduler->sLock, NULL);
+  pthread_cond_init(&psScheduler->sStart, NULL);
+  pthread_mutex_init(&psScheduler->sWorkLock, NULL);
+  pthread_cond_init(&psScheduler->sWork, NULL);
+  for (lIndex = 0; lIndex < lThreadCount; lIndex++) {
+    pthread_mutex_init(&psScheduler->psDeques[lIndex].sLock, NULL);
+    psScheduler->psDeques[lIndex].plTasks
+      = (unsigned long *)calloc(psGraph->lTaskCount + 1,
+				sizeof(unsigned long));
+    psScheduler->psWorkers[lIndex].psScheduler = psScheduler;
+    psScheduler->psWorkers[lIndex].lIndex = lIndex;
+  }
+  for (lIndex = 1; lIndex < lThreadCount; lIndex++)
+    if (pthread_create(psScheduler->psThreads + lIndex,
+		       NULL,
+		       graphWorkerThread,
+		       psScheduler->psWorkers + lIndex) != 0) {
+      fprintf(stderr, "Failed to start graph threads.\n");
+      exit(1);
+    }
+
+  psGraph->lThreadCount = lThreadCount;
+  psGraph->pvScheduler = psScheduler;
+}
+
+/*****************************************************************************/
+
+void
+activateProcessGraph(ProcessGraph * psGraph) {
+
+  unsigned long lNodeIndex;
+
+  for (lNodeIndex = 0; lNodeIndex < psGraph->lNodeCount; lNodeIndex++)
+    if (psGraph->psNodes[lNodeIndex].psDescriptor
+	&& psGraph->psNodes[lNodeIndex].psDescriptor->activate)
+      psGraph->psNodes[lNodeIndex].psDescriptor
+	->activate(psGraph->psNodes[lNodeIndex].hInstance);
+}
+
+void
+runProcessGraph(ProcessGraph * psGraph,
+		const unsigned long lFrameCount,
+		const unsigned long lSubBlockSize) {
+
+  GraphScheduler * psScheduler;
+  unsigned long lTask;
+  unsigned long lThread;
+
+  psScheduler = (GraphScheduler *)psGraph->pvScheduler;
+
+  /* Every task from the last block has finished, so the deques are
+     empty and nobody is touching the counters. */
+  psScheduler->lFrameCount = lFrameCount;
+  psScheduler->lSubBlockSize = lSubBlockSize;
+  for (lThread = 0; lThread < psScheduler->lThreadCount; lThread++) {
+    pthread_mutex_lock(&psScheduler->psDeques[lThread].sLock);
+    psScheduler->psDeques[lThread].lTop = 0;
+    psScheduler->psDeques[lThread].lBottom = 0;
+    pthread_mutex_unlock(&psScheduler->psDeques[lThread].sLock);
+  }
+  for (lTask = 0; lTask < psGraph->lTaskCount; lTask++)
+    psScheduler->plPending[lTask] = psGraph->plTaskDependencyCount[lTask];
+  __atomic_store_n(&psScheduler->lRemaining,
+		   psGraph->lTaskCount,
+		   __ATOMIC_RELEASE);
+
+  /* Deal the tasks that can start straight away round the threads,
+     so independent branches start on different cores. */
+  lThread = 0;
+  for (lTask = 0; lTask < psGraph->lTaskCount; lTask++)
+    if (psGraph->plTaskDependencyCount[lTask] == 0) {
+      readyTask(psScheduler, lThread, lTask);
+      lThread = (lThread + 1) % psScheduler->lThreadCount;
+    }
+
+  if (psScheduler->lThreadCount > 1) {
+    pthread_mutex_lock(&psScheduler->sLock);
+    psScheduler->lGeneration++;
+    pthread_cond_broadcast(&psScheduler->sStart);
+    pthread_mutex_unlock(&psScheduler->sLock);
+  }
+
+  workOnBlock(psScheduler, 0);
+  psGraph->lBlocksRun++;
+}
+
+void
+deactivateProcessGraph(ProcessGraph * psGraph) {
+
+  unsigned long lNodeIndex;
+
+  for (lNodeIndex = 0; lNodeIndex < psGraph->lNodeCount; lNodeIndex++)
+    if (psGraph->psNodes[lNodeIndex].psDescriptor
+	&& psGraph->psNodes[lNodeIndex].psDescriptor->deactivate)
+      psGraph->psNodes[lNodeIndex].psDescriptor
+	->deactivate(psGraph->psNodes[lNodeIndex].hInstance);
+}
+
+/*****************************************************************************/
+
+void
+destroyProcessGraph(ProcessGraph * psGraph) {
+
+  GraphNode * psNode;
+  GraphScheduler * psScheduler;
+  unsigned long lIndex;
+  unsigned long lNodeIndex;
+
+  psScheduler = (GraphScheduler *)psGraph->pvScheduler;
+  if (psScheduler) {
+    pthread_mutex_lock(&psScheduler->sLock);
+    psScheduler->bQuit = 1;
+    pthread_cond_broadcast(&psScheduler->sStart);
+    pthread_mutex_unlock(&psScheduler->sLock);
+    for (lIndex = 1; lIndex < psScheduler->lThreadCount; lIndex++)
+      pthread_join(psScheduler->psThreads[lIndex], NULL);
+    for (lIndex = 0; lIndex < psScheduler->lThreadCount; lIndex++) {
+      pthread_mutex_destroy(&psScheduler->psDeques[lIndex].sLock);
+      free(psScheduler->psDeques[lIndex].plTasks);
+    }
+    pthread_mutex_destroy(&psScheduler->sLock);
+    pthread_cond_destroy(&psScheduler->sStart);
+    pthread_mutex_destroy(&psScheduler->sWorkLock);
+    pthread_cond_destroy(&psScheduler->sWork);
+    free(psScheduler->psDeques);
+    free(psScheduler->psWorkers);
+    free(psScheduler->psThreads);
+    free(psScheduler->plPending);
+    free(psScheduler);
+  }
+
+  for (lNodeIndex = 0; lNodeIndex < psGraph->lNodeCount; lNodeIndex++) {
+    psNode = psGraph->psNodes + lNodeIndex;
+    if (psNode->psDescriptor) {
+      if (psNode->hInstance)
+	psNode->psDescriptor->cleanup(psNode->hInstance);
+      unloadLADSPAPluginLibrary(psNode->pvLibrary);
+    }
+    free(psNode->pcName);
+    free(psNode->plInputEdges);
+    free(psNode->plOutputEdges);
+    free(psNode->pfControlValues);
+    free(psNode->pfControlOutputs);
+    free(psNode->pfGains);
+  }
+  free(psGraph->psNodes);
+
+  for (lIndex = 0; lIndex < psGraph->lEdgeCount; lIndex++)
+    free(psGraph->ppcEdgeNames[lIndex]);
+  if (psGraph->ppfEdgeBuffers)
+    destroyBufferArena(&psGraph->sEdgeArena);
+  free(psGraph->ppcEdgeNames);
+  free(psGraph->ppfEdgeBuffers);
+  free(psGraph->ppfInputBuffers);
+  free(psGraph->ppfOutputBuffers);
+  free(psGraph->plInputEdges);
+  free(psGraph->plOutputEdges);
+  free(psGraph->plTaskStart);
+  free(psGraph->plTaskNodes);
+  free(psGraph->plTaskDependencyCount);
+  free(psGraph->plDependentStart);
+  free(psGraph->plDependents);
+  memset(psGraph, 0, sizeof(ProcessGraph));
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,1136 @@
+/* host.h
+
+   Free software. Do with as you will. No warranty. */
+
+#ifndef LADSPA_SDK_HOST
+#define LADSPA_SDK_HOST
+
+/*****************************************************************************/
+
+#include <stdio.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+/*****************************************************************************/
+
+/* Functions in profile.c: */
+
+/* A point in time, with the time stamp counter where there is one
+   (otherwise llCycles stays 0). */
+typedef struct {
+  double dSeconds;
+  unsigned long long llCycles;
+} ProfileClock;
+
+/* Time spent in one stage of a render, such as a plugin's run() or
+   decoding the input, in total and block by block. Each stage is
+   only updated by one thread. Stages without a name are left out of
+   reports. */
+typedef struct {
+
+  const char * pcName;
+
+  double dSeconds;
+  unsigned long long llCycles;
+
+  /* Time so far in the current block, then each finished block. */
+  double dBlockSeconds;
+  double * pdBlockSeconds;
+  unsigned long lBlockCount;
+  unsigned long lBlockCapacity;
+
+} ProfileStage;
+
+void readProfileClock(ProfileClock * psClock);
+
+/* Add the time since psStart to a stage. */
+void addProfileTime(ProfileStage * psStage, const ProfileClock * psStart);
+
+/* Close the stage's current block. */
+void endProfileBlock(ProfileStage * psStage);
+
+/* Free the block times of lStageCount stages and the array. */
+void freeProfileStages(ProfileStage * psStages,
+		       const unsigned long lStageCount);
+
+/* Report each stage's time, share of dWallSeconds, time and cycles
+   per frame and percentiles of its block times, with the realtime
+   factor for lFrameCount frames at lSampleRate. */
+void printProfile(FILE * poFile,
+		  const ProfileStage * psStages,
+		  const unsigned long lStageCount,
+		  const unsigned long lFrameCount,
+		  const unsigned long lSampleRate,
+		  const double dWallSeconds);
+
+/* The same report as a JSON object. */
+void writeProfileJSON(FILE * poFile,
+		      const ProfileStage * psStages,
+		      const unsigned long lStageCount,
+		      const unsigned long lFrameCount,
+		      const unsigned long lSampleRate,
+		      const double dWallSeconds);
+
+/*****************************************************************************/
+
+/* Sample encodings understood by wave.c. Integer encodings are
+   little-endian two's complement, float encodings are IEEE. */
+
+#define WAVE_SAMPLE_NONE	0
+#define WAVE_SAMPLE_INT16	1
+#define WAVE_SAMPLE_INT24	2
+#define WAVE_SAMPLE_INT32	3
+#define WAVE_SAMPLE_FLOAT32	4
+#define WAVE_SAMPLE_FLOAT64	5
+
+/* Length of a stream whose end is not known until it is reached. */
+#define WAVE_LENGTH_UNKNOWN	((unsigned long)-1)
+
+/* Containers. RF64 is RIFF with 64bit sizes in a "ds64" chunk, Sony
+   Wave64 uses GUIDs and 64bit sizes throughout. */
+#define WAVE_CONTAINER_RIFF	0
+#define WAVE_CONTAINER_RF64	1
+#define WAVE_CONTAINER_W64	2
+
+/* Room for the message a failed try...() call leaves in a WaveFile. */
+#define WAVE_ERROR_SIZE		512
+
+/* An open Wave file. Several may be open at once. The structure is
+   filled in by openWaveFile() or createWaveFile(); callers should
+   treat the fields as read-only. */
+typedef struct {
+
+  FILE * poFile;
+  int iFileDescriptor;
+  const char * pcFilename;
+  int bWritable;
+
+  /* Headerless PCM rather than a Wave file, otherwise one of the
+     WAVE_CONTAINER_* values. */
+  int bRaw;
+  int iContainer;
+
+  /* The whole file when it could be memory-mapped (output only once
+     its space is reserved), otherwise NULL and stdio is used. */
+  unsigned char * pucMap;
+  size_t lMapSize;
+  size_t lAdvisedTo;
+  size_t lDroppedTo;
+
+  int iSampleFormat;
+  unsigned long lChannelCount;
+  unsigned long lSampleRate;
+
+  /* Length in frames, or WAVE_LENGTH_UNKNOWN for a stream read from
+     or written to a pipe. Frame counts and positions are unsigned
+     long, which is 64bit on the LP64 systems long renders need. */
+  unsigned long lLength;
+
+  unsigned long lBytesPerFrame;
+  unsigned long lDataOffset;
+
+  /* Frames read or written so far. */
+  unsigned long lFramePosition;
+
+  /* Interleaved stdio buffer large enough for lBufferFrames. */
+  unsigned long lBufferFrames;
+  unsigned char * pucBuffer;
+
+  /* Largest absolute sample value written, 1.0 being full scale. */
+  LADSPA_Data fPeak;
+
+  /* If set by the caller, reading or writing is timed here, split
+     into file access and sample conversion. When the file is mapped,
+     access happens through page faults during conversion. */
+  ProfileStage * psAccessProfile;
+  ProfileStage * psConvertProfile;
+
+  /* If set by the caller to an OutputMeter (see meter.c), every
+     block written is measured there on the way out. */
+  void * pvMeter;
+
+  /* Why the last try...() call on the file failed. */
+  char pcError[WAVE_ERROR_SIZE];
+
+} WaveFile;
+
+/*****************************************************************************/
+
+/* Functions in wave.c: */
+
+/* Open a Wave file for reading. The chunks of a RIFF, RF64 or Wave64
+   file are walked to find the "fmt " and "data" chunks, so files
+   with extra chunks are fine. Plain and WAVE_FORMAT_EXTENSIBLE files
+   holding 16, 24 or 32bit integer or 32 or 64bit float samples are
+   supported. Errors are handled by writing a message to stderr and
+   calling exit(1). At most lBufferFrames frames may be read by a
+   single readWaveFile() call. A filename of "-" reads standard input;
+   a data chunk length of 0xFFFFFFFF there, or of 0 in a file whose
+   own length is unknown too, gives a length of
+   WAVE_LENGTH_UNKNOWN. */
+void openWaveFile(WaveFile * psWave,
+		  const char * pcFilename,
+		  const unsigned long lBufferFrames);
+
+/* The try...() functions below do the same as the functions without
+   "try" in their names, but return -1 on failure, with a message in
+   psWave->pcError, and 0 on success. A file that fails to open or be
+   created is left closed. */
+int tryOpenWaveFile(WaveFile * psWave,
+		    const char * pcFilename,
+		    const unsigned long lBufferFrames);
+
+/* Open a headerless file of interleaved samples for reading, "-"
+   meaning standard input. The length is worked out from the size of
+   a regular file and is otherwise WAVE_LENGTH_UNKNOWN. */
+void openRawFile(WaveFile * psWave,
+		 const char * pcFilename,
+		 const int iSampleFormat,
+		 const unsigned long lChannelCount,
+		 const unsigned long lSampleRate,
+		 const unsigned long lBufferFrames);
+
+int tryOpenRawFile(WaveFile * psWave,
+		   const char * pcFilename,
+		   const int iSampleFormat,
+		   const unsigned long lChannelCount,
+		   const unsigned long lSampleRate,
+		   const unsigned long lBufferFrames);
+
+/* Create a Wave file of known length for writing. Errors are handled
+   by writing a message to stderr and calling exit(1). At most
+   lBufferFrames frames may be written by a single writeWaveFile()
+   call. The header is finalised by closeWaveFile(), so writing fewer
+   frames than lLength gives a shorter, valid file. Names ending in
+   ".w64" are written as Wave64, and files with more than 4GB of audio
+   as RF64. A filename of "-" writes standard output. If lLength is
+   WAVE_LENGTH_UNKNOWN the file is streamed through stdio and, if it
+   cannot be rewound to correct the header, keeps 0xFFFFFFFF
+   lengths. */
+void createWaveFile(WaveFile * psWave,
+		    const char * pcFilename,
+		    const unsigned long lChannelCount,
+		    const unsigned long lSampleRate,
+		    const unsigned long lLength,
+		    const int iSampleFormat,
+		    const unsigned long lBufferFrames);
+
+int tryCreateWaveFile(WaveFile * psWave,
+		      const char * pcFilename,
+		      const unsigned long lChannelCount,
+		      const unsigned long lSampleRate,
+		      const unsigned long lLength,
+		      const int iSampleFormat,
+		      const unsigned long lBufferFrames);
+
+/* As createWaveFile(), but with no header. */
+void createRawFile(WaveFile * psWave,
+		   const char * pcFilename,
+		   const unsigned long lChannelCount,
+		   const unsigned long lSampleRate,
+		   const unsigned long lLength,
+		   const int iSampleFormat,
+		   const unsigned long lBufferFrames);
+
+int tryCreateRawFile(WaveFile * psWave,
+		     const char * pcFilename,
+		     const unsigned long lChannelCount,
+		     const unsigned long lSampleRate,
+		     const unsigned long lLength,
+		     const int iSampleFormat,
+		     const unsigned long lBufferFrames);
+
+/* Read lFrameCount frames and deinterleave them into one buffer per
+   channel, scaled so full scale is +/-1. */
+void readWaveFile(WaveFile * psWave,
+		  LADSPA_Data ** ppfBuffers,
+		  const unsigned long lFrameCount);
+
+int tryReadWaveFile(WaveFile * psWave,
+		    LADSPA_Data ** ppfBuffers,
+		    const unsigned long lFrameCount);
+
+/* As readWaveFile(), but stopping at the end of the file or stream.
+   Returns the number of frames read, 0 once the end is reached. */
+unsigned long readWaveFileUpTo(WaveFile * psWave,
+			       LADSPA_Data ** ppfBuffers,
+			       const unsigned long lFrameCount);
+
+/* Interleave lFrameCount frames from one buffer per channel and write
+   them. Integer encodings are hard clipped. */
+void writeWaveFile(WaveFile * psWave,
+		   LADSPA_Data ** ppfBuffers,
+		   const unsigned long lFrameCount);
+
+int tryWriteWaveFile(WaveFile * psWave,
+		     LADSPA_Data ** ppfBuffers,
+		     const unsigned long lFrameCount);
+
+/* Move the read position of a file opened with openWaveFile() to
+   frame lFrame. On a memory-mapped file from createWaveFile() this
+   instead sets the number of frames closeWaveFile() keeps, for use
+   after writeWaveFileAt(). An input read from a pipe can only move
+   forward, which it does by reading and discarding frames. */
+void seekWaveFile(WaveFile * psWave, const unsigned long lFrame);
+
+int trySeekWaveFile(WaveFile * psWave, const unsigned long lFrame);
+
+/* Stop using a memory map for a file, reading or writing through
+   stdio from the current position on, so mlockall() does not pin the
+   whole file. An output file must not have been written yet. */
+void unmapWaveFile(WaveFile * psWave);
+
+/* Whether seekWaveFile() can move an input file backwards, which it
+   cannot when the input is a pipe. */
+int canRewindWaveFile(const WaveFile * psWave);
+
+/* Write lFrameCount frames at frame lFrame of a memory-mapped file
+   from createWaveFile(), raising *pfPeak to the largest absolute
+   sample written. Neither the file position nor fPeak is touched, so
+   several threads may write disjoint ranges of the same file at once.
+   Files that could not be mapped are an error. */
+void writeWaveFileAt(WaveFile * psWave,
+		     LADSPA_Data ** ppfBuffers,
+		     const unsigned long lFrameCount,
+		     const unsigned long lFrame,
+		     LADSPA_Data * pfPeak);
+
+/* Replace samples with what they would read back as after being
+   written in iSampleFormat. */
+void quantizeWaveSamples(const int iSampleFormat,
+			 LADSPA_Data ** ppfBuffers,
+			 const unsigned long lChannelCount,
+			 const unsigned long lFrameCount);
+
+/* Close a Wave file and free its buffer. An output's header is
+   finalised first, and a failure to get its audio to disk is an
+   error. */
+void closeWaveFile(WaveFile * psWave);
+int tryCloseWaveFile(WaveFile * psWave);
+
+/* Map a sample format name ("16", "24", "32", "float" or "double")
+   to a WAVE_SAMPLE_* value. Returns WAVE_SAMPLE_NONE if the name is
+   not recognised. */
+int getWaveSampleFormat(const char * pcName);
+
+/* Return a printable name for a WAVE_SAMPLE_* value. */
+const char * getWaveSampleFormatName(const int iSampleFormat);
+
+/* Functions in arena.c: */
+
+/* Alignment of everything handed out by an arena: a cache line,
+   which is also enough for any SIMD load or store. */
+#define ARENA_ALIGNMENT 64
+
+/* Name of the environment variable applyplugin sets, before loading
+   any plugin, to the alignment in bytes that every audio port will
+   have when connected. Plugins that read it in instantiate() may use
+   aligned loads and stores when it is at least their vector size. */
+#define ARENA_ALIGNMENT_VARIABLE "LADSPA_HOST_BUFFER_ALIGNMENT"
+
+/* Where an arena's memory came from. */
+#define ARENA_HEAP		0
+#define ARENA_HUGETLB		1
+#define ARENA_TRANSPARENT	2
+
+/* One contiguous, zeroed block that buffers are carved from in turn,
+   so buffers used together share pages. */
+typedef struct {
+
+  unsigned char * pucBase;
+  unsigned long lSize;
+  unsigned long lUsed;
+
+  /* The allocation itself, which may start before pucBase. */
+  void * pvMapping;
+  unsigned long lMappingSize;
+  int iBacking;
+
+} BufferArena;
+
+/* The space an allocation of lBytes takes up in an arena. Sum these
+   to size an arena. */
+unsigned long getArenaSpace(const unsigned long lBytes);
+
+/* Create an arena of at least lSize bytes. If bHugePages is set, it
+   is backed by reserved huge pages if there are enough, and otherwise
+   by memory the kernel is asked to back with transparent huge
+   pages. Errors are handled by writing a message to stderr and
+   calling exit(1). */
+void createBufferArena(BufferArena * psArena,
+		       const unsigned long lSize,
+		       const int bHugePages);
+
+/* As createBufferArena(), but returns -1 if the memory cannot be had
+   and 0 otherwise. */
+int tryCreateBufferArena(BufferArena * psArena,
+			 const unsigned long lSize,
+			 const int bHugePages);
+
+/* Take the next lBytes of the arena, aligned to ARENA_ALIGNMENT.
+   Running out is an error in the caller's sizing, and exits. */
+void * allocateFromArena(BufferArena * psArena, const unsigned long lBytes);
+
+/* Release the arena and everything taken from it. */
+void destroyBufferArena(BufferArena * psArena);
+
+const char * getArenaBackingName(const int iBacking);
+
+/* Functions in resample.c: */
+
+/* A streaming sample rate converter. The ratio between the rates is
+   reduced to lUp/lDown and each output is a windowed sinc filter over
+   lTapCount inputs, with the taps for every one of the lUp phases
+   worked out in advance. Input is kept in a per-channel history
+   between calls. The first output lines up with the first input, so
+   the resampler adds no delay, but the last outputs only appear once
+   enough input (silence, at the end of a stream) follows them. */
+typedef struct {
+
+  unsigned long lInputRate;
+  unsigned long lOutputRate;
+  unsigned long lUp;
+  unsigned long lDown;
+
+  /* lUp rows of lTapCount coefficients, aligned for the vector
+     kernels. */
+  unsigned long lTapCount;
+  LADSPA_Data * pfCoefficients;
+
+  unsigned long lChannelCount;
+  unsigned long lMaxInputFrames;
+
+  /* Unused input, lHistoryLength frames of lHistoryCapacity. */
+  LADSPA_Data ** ppfHistory;
+  unsigned long lHistoryCapacity;
+  unsigned long lHistoryLength;
+
+  /* History frame and phase of the next output. */
+  unsigned long lPosition;
+  unsigned long lPhase;
+
+} Resampler;
+
+/* Create a resampler for lChannelCount channels, taking at most
+   lMaxInputFrames frames a call. Errors are handled by writing a
+   message to stderr and calling exit(1). */
+Resampler * createResampler(const unsigned long lChannelCount,
+			    const unsigned long lInputRate,
+			    const unsigned long lOutputRate,
+			    const unsigned long lMaxInputFrames);
+
+/* Forget all input, as at creation. */
+void resetResampler(Resampler * psResampler);
+
+/* The most frames runResampler() can produce from lInputFrames
+   frames, for sizing output buffers. */
+unsigned long getResamplerMaxOutput(const Resampler * psResampler,
+				    const unsigned long lInputFrames);
+
+/* Feed lInputFrames frames from one buffer per channel and write the
+   frames that are now ready to ppfOutput. Returns the number
+   written. */
+unsigned long runResampler(Resampler * psResampler,
+			   LADSPA_Data ** ppfInput,
+			   const unsigned long lInputFrames,
+			   LADSPA_Data ** ppfOutput);
+
+void destroyResampler(Resampler * psResampler);
+
+/* Functions in meter.c: */
+
+/* Levels of the output measured as it is written: per channel the
+   sample peak, the true peak of the output upsampled four times, the
+   RMS level and the number of samples at or beyond full scale, and
+   the integrated loudness of ITU-R BS.1770 / EBU R128. */
+typedef struct {
+
+  unsigned long lChannelCount;
+  unsigned long lSampleRate;
+  unsigned long lFrameCount;
+
+  LADSPA_Data * pfPeaks;
+  LADSPA_Data * pfTruePeaks;
+  double * pdSumSquares;
+  unsigned long * plClipCounts;
+
+  /* The upsampler takes at most lMaxFrames at a time, so blocks are
+     passed through in pieces, pointed to by ppfPiece. */
+  Resampler * psUpsampler;
+  unsigned long lMaxFrames;
+  LADSPA_Data ** ppfPiece;
+  LADSPA_Data ** ppfUpsampled;
+
+  /* K-weighting biquads (b0 b1 b2 a1 a2), and two direct form II
+     states per channel. */
+  double pdShelf[5];
+  double pdHighPass[5];
+  double * pdFilterState;
+  double * pdChannelWeights;
+
+  /* Weighted energy of the 100ms step being filled, the mean square
+     of the last four steps and of every 400ms block so far. */
+  unsigned long lStepLength;
+  unsigned long lStepFrames;
+  double dStepEnergy;
+  unsigned long lStepCount;
+  double pdSteps[4];
+  double * pdBlocks;
+  unsigned long lBlockCount;
+  unsigned long lBlockCapacity;
+
+  /* Set by finishOutputMeter(), in LUFS, or -INFINITY if no block
+     passed the gates. */
+  double dIntegratedLoudness;
+
+} OutputMeter;
+
+/* Create a meter for lChannelCount channels at lSampleRate, measuring
+   blocks of any length but working on at most lMaxFrames at a
+   time. */
+OutputMeter * createOutputMeter(const unsigned long lChannelCount,
+				const unsigned long lSampleRate,
+				const unsigned long lMaxFrames);
+
+/* Measure lFrameCount frames, one buffer per channel. */
+void runOutputMeter(OutputMeter * psMeter,
+		    LADSPA_Data ** ppfBuffers,
+		    const unsigned long lFrameCount);
+
+/* Measure the end of the true peak filter and work out the
+   integrated loudness. Call once, after the last block. */
+void finishOutputMeter(OutputMeter * psMeter);
+
+/* Report the levels of each channel and the loudness. */
+void printOutputMeter(FILE * poFile, const OutputMeter * psMeter);
+
+/* The same report as a JSON object, levels that are minus infinity
+   being null. */
+void writeOutputMeterJSON(FILE * poFile, const OutputMeter * psMeter);
+
+void destroyOutputMeter(OutputMeter * psMeter);
+
+/* Functions in automation.c: */
+
+/* A control change read from an automation file, at frame lFrame
+   of the render. The value is reached lRampFrames later, moving in a
+   straight line from wherever the control was. */
+typedef struct {
+  unsigned long lFrame;
+  unsigned long lControl;
+  LADSPA_Data fValue;
+  unsigned long lRampFrames;
+  unsigned long lSequence;
+} AutomationPoint;
+
+typedef struct {
+  int bActive;
+  unsigned long lStart;
+  unsigned long lEnd;
+  LADSPA_Data fFrom;
+  LADSPA_Data fTo;
+} AutomationRamp;
+
+/* The automation of one plugin: its points in time order, the
+   control values they change and where playback has got to. Only
+   the thread running the plugin touches this. */
+typedef struct {
+
+  AutomationPoint * psPoints;
+  unsigned long lPointCount;
+  unsigned long lNextPoint;
+
+  /* The plugin's live control values and what they started as. */
+  LADSPA_Data * pfControls;
+  LADSPA_Data * pfInitial;
+  unsigned long lControlCount;
+
+  /* One ramp slot per control and how many are moving. */
+  AutomationRamp * psRamps;
+  unsigned long lRampCount;
+
+  /* The shortest run() worth making and how often ramps move. */
+  unsigned long lStep;
+
+  /* run() calls made beyond one per sub-block. */
+  unsigned long lExtraRuns;
+
+} PluginAutomation;
+
+/* Read an automation file for a chain of lPluginCount plugins. Each
+   line reads "<seconds> <plugin> <control> <value> [<ramp seconds>]",
+   where plugins count from 1 along the chain and the control is
+   either the name of a control input, in double quotes if it holds
+   spaces, or its position among the plugin's control values,
+   counting from 1. '#' starts a comment. Points less than lStep
+   frames after an earlier point on the same plugin are moved back to
+   it. Returns one PluginAutomation per plugin, driving the values in
+   ppfPluginControlValues. Errors are handled by writing a message to
+   stderr and calling exit(1). */
+PluginAutomation *
+loadAutomation(const char               * pcFilename,
+	       const unsigned long        lPluginCount,
+	       const LADSPA_Descriptor ** ppsPluginDescriptors,
+	       LADSPA_Data             ** ppfPluginControlValues,
+	       const unsigned long        lSampleRate,
+	       const unsigned long        lStep);
+
+/* Rewind to the start and restore the initial control values. */
+void resetAutomation(PluginAutomation * psAutomation);
+
+/* Bring the control values up to date for a run() starting at frame
+   lPosition and return how many frames may run before they change
+   again, or ~0 if they never do. */
+unsigned long applyAutomation(PluginAutomation * psAutomation,
+			      const unsigned long lPosition);
+
+void freeAutomation(PluginAutomation * psAutomation,
+		    const unsigned long lPluginCount);
+
+/* Find control input lControl (counting from 1) or the control
+   input named pcName. Returns the index into the plugin's control
+   values, or ~0 if there is none. */
+unsigned long findControl(const LADSPA_Descriptor * psDescriptor,
+			  const char * pcName);
+
+/*****************************************************************************/
+
+/* Functions in compare.c: */
+
+/* lFirstDivergence until a sample differs by more than the
+   tolerance. */
+#define COMPARE_NO_DIVERGENCE (~0UL)
+
+/* Rendered output checked block by block against a reference file
+   instead of being written. Each block is first quantised to the
+   reference's sample format, so a render that would have written the
+   reference file exactly compares exactly. */
+typedef struct {
+
+  WaveFile sReference;
+  const char * pcFilename;
+
+  /* The largest absolute error, full scale being 1, allowed in any
+     sample. */
+  LADSPA_Data fTolerance;
+
+  /* A block of the reference and of quantised output per channel. */
+  LADSPA_Data ** ppfReference;
+  LADSPA_Data ** ppfOutput;
+
+  /* Frames compared, and frames of output past the end of the
+     reference. */
+  unsigned long lFrameCount;
+  unsigned long lExtraFrames;
+
+  LADSPA_Data fMaxError;
+  double dErrorEnergy;
+  double dReferenceEnergy;
+
+  /* The first frame and channel (from 0) with an error above the
+     tolerance. */
+  unsigned long lFirstDivergence;
+  unsigned long lFirstDivergenceChannel;
+
+} ReferenceComparison;
+
+/* Open pcFilename to compare output of lChannelCount channels at
+   lSampleRate against, at most lBlockSize frames at a time. Errors,
+   including a reference of another shape, are handled by writing a
+   message to stderr and calling exit(1). */
+void openReferenceComparison(ReferenceComparison * psComparison,
+			     const char * pcFilename,
+			     const unsigned long lChannelCount,
+			     const unsigned long lSampleRate,
+			     const unsigned long lBlockSize,
+			     const LADSPA_Data fTolerance);
+
+/* Compare the next lFrameCount frames of output, one buffer per
+   channel, with the reference. The buffers are not changed. */
+void compareWithReference(ReferenceComparison * psComparison,
+			  LADSPA_Data ** ppfOutputs,
+			  const unsigned long lFrameCount);
+
+/* Report the maximum and RMS errors, the signal to noise ratio and
+   the first divergence on stdout and close the reference. Returns 1
+   if a sample was out by more than the tolerance or the lengths
+   differ, 0 otherwise. */
+int closeReferenceComparison(ReferenceComparison * psComparison);
+
+/*****************************************************************************/
+
+/* Functions in daemon.c: */
+
+/* A render daemon is a supervisor and worker processes that take
+   connections in turn from one Unix domain socket, so a job that
+   fails with exit(1), as the host does on any error, takes down one
+   worker, which is replaced. A request is the client's working
+   directory followed by the words of a command line, each on a line
+   of its own, ended by an empty line. While a job runs the worker's
+   standard output and error are the connection, so the client sees
+   what a local render would print, and a job that succeeds ends with
+   a line starting "ok". The words "status" and "shutdown" on their
+   own are requests to the daemon itself. */
+
+/* Run a job in a daemon worker, given the words of the request and
+   the context passed to runDaemon(). Returns the number of frames
+   rendered, setting *pbWarm if no plugins had to be instantiated.
+   Errors are handled by writing a message to stderr and calling
+   exit(1). */
+typedef unsigned long (*DaemonJobFunction)(void * pvContext,
+					   char ** ppcWords,
+					   const unsigned long lWordCount,
+					   int * pbWarm);
+
+/* Serve jobs on pcSocketPath with lWorkerCount workers until a client
+   asks for "shutdown" or the daemon gets SIGINT or SIGTERM. Errors
+   are handled by writing a message to stderr and calling exit(1). */
+void runDaemon(const char * pcSocketPath,
+	       const unsigned long lWorkerCount,
+	       DaemonJobFunction fJob,
+	       void * pvContext);
+
+/* Send lWordCount words and the working directory to the daemon on
+   pcSocketPath, copying its reply to stdout. Returns 0 if the reply
+   ends with "ok", 1 otherwise. */
+int submitDaemonJob(const char * pcSocketPath,
+		    char * const * ppcWords,
+		    const unsigned long lWordCount);
+
+/*****************************************************************************/
+
+/* Functions in sweep.c: */
+
+/* A parameter sweep read from a file: the control values of every
+   point to render. Each line of the file is either
+
+     <plugin> <control> <value>...
+     point <plugin>:<control>=<value>...
+
+   counting plugins and controls from 1 or naming the control. Lines
+   of the first kind are the axes of a grid, and every combination of
+   their values is a point, the first line changing slowest. A value
+   may be written <first>:<last>:<count> for evenly spaced values.
+   Lines of the second kind are a point each. A file holds one kind or
+   the other. Controls a point does not set keep the values given on
+   the command line. */
+typedef struct {
+
+  unsigned long lPointCount;
+
+  /* For each point, one array of control values per plugin, laid
+     out like those from the command line. */
+  LADSPA_Data *** pppfControlValues;
+
+  /* For each point, what it sets, as "<plugin>:<control>=<value>"
+     with numbers counting from 1. */
+  char ** ppcDescriptions;
+
+} ParameterSweep;
+
+/* Errors are handled by writing a message to stderr and calling
+   exit(1). */
+void loadParameterSweep(ParameterSweep           * psSweep,
+			const char               * pcFilename,
+			const unsigned long        lPluginCount,
+			const LADSPA_Descriptor ** ppsPluginDescriptors,
+			LADSPA_Data             ** ppfPluginControlValues);
+
+void freeParameterSweep(ParameterSweep * psSweep,
+			const unsigned long lPluginCount);
+
+/*****************************************************************************/
+
+/* Functions in controllog.c: */
+
+/* A control log records the control outputs of a chain after each
+   run. The file starts with "LADSPACL", then little-endian 32bit
+   version, column count and sample rate, then each column name as a
+   16bit length and its bytes. Groups of rows follow, each a 32bit row
+   count, the 64bit first frame of each row, the 32bit frame count of
+   each row and then each column as 32bit floats. */
+typedef struct {
+
+  FILE * poFile;
+  char * pcFilename;
+
+  /* Where each column is read from. */
+  unsigned long lColumnCount;
+  LADSPA_Data ** ppfSources;
+
+  /* The group being gathered, values held column by column. */
+  unsigned long lRowCount;
+  unsigned long long * pllFrames;
+  unsigned long * plFrameCounts;
+  LADSPA_Data * pfValues;
+
+  unsigned long lRowsWritten;
+  int bFailed;
+
+  /* Rows are only kept from this frame on, so a caller running a
+     pre-roll can leave it out. 0 unless the caller sets it. */
+  unsigned long lFirstFrame;
+
+} ControlLog;
+
+/* Create a control log with a column for each control output of each
+   instance of lPluginCount plugins, read from ppfControlOutputs with
+   the instance counts in plInstanceCounts (see PluginChain). Errors
+   are handled by writing a message to stderr and calling exit(1). */
+ControlLog * createControlLog(const char               * pcFilename,
+			      const unsigned long        lPluginCount,
+			      const LADSPA_Descriptor ** ppsPluginDescriptors,
+			      const unsigned long      * plInstanceCounts,
+			      LADSPA_Data             ** ppfControlOutputs,
+			      const unsigned long        lSampleRate);
+
+/* Record the current control outputs for lFrameCount frames starting
+   at lFrame, less any frames before lFirstFrame. Rows are buffered
+   and written a group at a time. */
+void writeControlLogRow(ControlLog * psLog,
+			const unsigned long lFrame,
+			const unsigned long lFrameCount);
+
+/* Write any rows left, close the file and free the log. Returns the
+   number of rows written. A write that failed on the way, here or
+   earlier, is handled by writing a message to stderr and calling
+   exit(1). */
+unsigned long closeControlLog(ControlLog * psLog);
+
+/* Convert a control log to CSV with a row per log row, "-" meaning
+   stdout. Returns the number of rows. */
+unsigned long exportControlLog(const char * pcLogFilename,
+			       const char * pcCSVFilename);
+
+/* Functions in chain.c: */
+
+/* Count the ports on a plugin that have all the bits in iType set. */
+unsigned long getPortCountByType(const LADSPA_Descriptor     * psDescriptor,
+				 const LADSPA_PortDescriptor   iType);
+
+/* The number of audio channels a chain of plugins produces when fed
+   lChannelCount channels (see createPluginChain()). Errors are
+   handled by writing a message to stderr and calling exit(1). */
+unsigned long
+getPluginChainOutputCount(const unsigned long        lPluginCount,
+			  const LADSPA_Descriptor ** ppsPluginDescriptors,
+			  const unsigned long        lChannelCount);
+
+/* As getPluginChainOutputCount(), but returns -1, with a message in
+   pcError, if the channels do not match up and 0 otherwise, setting
+   *plOutputCount. */
+int
+tryGetPluginChainOutputCount(const unsigned long        lPluginCount,
+			     const LADSPA_Descriptor ** ppsPluginDescriptors,
+			     const unsigned long        lChannelCount,
+			     unsigned long            * plOutputCount,
+			     char                     * pcError,
+			     const size_t               lErrorSize);
+
+/* A linear chain of plugin instances, each feeding its audio outputs
+   to the audio inputs of the next. */
+typedef struct {
+
+  unsigned long lPluginCount;
+  const LADSPA_Descriptor ** ppsDescriptors;
+
+  /* The instances of each plugin: one, or one per channel for a mono
+     plugin given more than one channel. */
+  unsigned long * plInstanceCounts;
+  LADSPA_Handle ** pppsInstances;
+
+  /* Control input values, one array per plugin, owned by the
+     caller. */
+  LADSPA_Data ** ppfControlValues;
+
+  /* Control output values, one array per plugin, in port order,
+     all taken from sControlArena. Of a plugin run per channel, each
+     instance's follow those of the one before. */
+  LADSPA_Data ** ppfControlOutputs;
+  BufferArena sControlArena;
+
+  unsigned long lSampleRate;
+
+  /* Audio inputs on the first plugin, audio outputs on the last and
+     the number of buffers needed to run the chain. */
+  unsigned long lInputCount;
+  unsigned long lOutputCount;
+  unsigned long lBufferCount;
+
+  /* The buffer plan: the buffer used by each audio port of each
+     plugin, indexed by port number, with the ports of later
+     instances following those of the first. */
+  unsigned long ** pplPortBuffers;
+
+  /* Where the chain outputs end up, followed by the remaining
+     buffers, and whether that differs from the identity. */
+  unsigned long * plOutputOrder;
+  int bReorderBuffers;
+  LADSPA_Data ** ppfReorder;
+
+  /* Set unless this is a segment that stops short of the end. */
+  int bEndOfChain;
+
+  /* Optional automation, one per plugin, set by the caller after
+     createPluginChain(), and the frame of the input it is timed
+     against. This counts from 0 on activation, so a caller starting
+     partway through the input moves it on to match. */
+  PluginAutomation * psAutomation;
+  unsigned long lFramePosition;
+
+  /* Optional log the control outputs are written to after each
+     sub-block, set by the caller. */
+  ControlLog * psControlLog;
+
+  /* Optional timing of each plugin's run() calls, one stage per
+     plugin, set by the caller. A block is one processPluginChain()
+     call. */
+  ProfileStage * psProfile;
+
+  /* Set by startPluginChainThreads(). */
+  void * pvThreads;
+
+} PluginChain;
+
+/* Check that the audio ports of neighbouring plugins match up, given
+   lChannelCount channels into the first, plan which buffer each audio
+   port uses, then instantiate every plugin and connect its control
+   ports. A plugin with one audio input and one audio output that
+   meets more than one channel is instantiated once per channel, all
+   instances sharing its control values. Plugins flagged
+   INPLACE_BROKEN get output buffers separate from their inputs; all
+   others run in place. Errors are handled by writing a message to
+   stderr and calling exit(1). */
+void createPluginChain(PluginChain              * psChain,
+		       const unsigned long        lPluginCount,
+		       const LADSPA_Descriptor ** ppsPluginDescriptors,
+		       LADSPA_Data             ** ppfPluginControlValues,
+		       const unsigned long        lChannelCount,
+		       const unsigned long        lSampleRate);
+
+/* As createPluginChain(), but returns -1, with a message in pcError
+   and nothing left to destroy, on failure and 0 on success. */
+int tryCreatePluginChain(PluginChain              * psChain,
+			 const unsigned long        lPluginCount,
+			 const LADSPA_Descriptor ** ppsPluginDescriptors,
+			 LADSPA_Data             ** ppfPluginControlValues,
+			 const unsigned long        lChannelCount,
+			 const unsigned long        lSampleRate,
+			 char                     * pcError,
+			 const size_t               lErrorSize);
+
+/* If every plugin in the chain is run once per channel, split the
+   channels into up to lThreadCount groups, each run on a thread with
+   a chain and buffers of lBlockSize frames of its own, the caller
+   running the first. Call before activation, and not on a chain with
+   automation, a control log or a profile. The buffers given to
+   processPluginChain() come back with some exchanged for the threads'
+   own, so they must not be used once the chain is destroyed. Returns
+   the number of threads, 1 if the chain is left to run serially. */
+unsigned long startPluginChainThreads(PluginChain * psChain,
+				      unsigned long lThreadCount,
+				      const unsigned long lBlockSize,
+				      const int bHugePages);
+
+/* Connect the audio ports of every plugin to lBufferCount buffers
+   according to the buffer plan, starting lOffset samples in. This may
+   be done before every run. The chain inputs are read from the first
+   buffers; see processPluginChain() for where the outputs end up. */
+void connectPluginChain(PluginChain * psChain,
+			LADSPA_Data ** ppfBuffers,
+			const unsigned long lOffset);
+
+/* Fill in psSegment as a view of lCount plugins of psChain starting
+   at lFirst. The view shares the instances of the full chain, so it
+   is connected and run like any chain but must not be destroyed. */
+void getPluginChainSegment(const PluginChain * psChain,
+			   const unsigned long lFirst,
+			   const unsigned long lCount,
+			   PluginChain * psSegment);
+
+/* Activate every plugin and rewind any automation. */
+void activatePluginChain(PluginChain * psChain);
+
+/* Run every plugin in order for lFrameCount frames. */
+void runPluginChain(PluginChain * psChain, const unsigned long lFrameCount);
+
+/* Process lFrameCount frames held in ppfBuffers, connecting and
+   running the chain on at most lSubBlockSize frames at a time so the
+   working set of the whole chain can stay in cache. The chain inputs
+   are read from the first buffers and, by reordering the pointers in
+   ppfBuffers afterwards, the chain outputs are left in the first
+   buffers too. Plugins with automation are run in shorter pieces so
+   their control changes land on the right frame. */
+void processPluginChain(PluginChain * psChain,
+			LADSPA_Data ** ppfBuffers,
+			const unsigned long lFrameCount,
+			const unsigned long lSubBlockSize);
+
+void deactivatePluginChain(PluginChain * psChain);
+
+/* Clean up every instance, stopping any threads. */
+void destroyPluginChain(PluginChain * psChain);
+
+/*****************************************************************************/
+
+/* Functions in graph.c: */
+
+/* A processing graph read from a text file. Each line is one of:
+
+     input <edge>...
+     output <edge>...
+     node <name> <plugin file> <label> <input edges> -> <output edges>
+          <control values>
+     mix <edge> <edge>[*<gain>]...
+
+   "input" names the edges carrying the channels of the input file
+   and "output" those written to the output file. A node runs a plugin
+   with as many input edges, output edges and control values as it
+   has ports of each kind. A mix sums edges, optionally scaled, into
+   a new edge. Edges are named by use, may be read by any number of
+   nodes (fan-out) and must be written exactly once. Text after '#'
+   is ignored. */
+
+typedef struct {
+
+  char * pcName;
+
+  /* NULL for a mix. */
+  void * pvLibrary;
+  const LADSPA_Descriptor * psDescriptor;
+  LADSPA_Handle hInstance;
+  LADSPA_Data * pfControlValues;
+  /* Control outputs are connected here and ignored. */
+  LADSPA_Data * pfControlOutputs;
+
+  unsigned long lInputCount;
+  unsigned long * plInputEdges;
+  LADSPA_Data * pfGains;
+  unsigned long lOutputCount;
+  unsigned long * plOutputEdges;
+
+} GraphNode;
+
+typedef struct {
+
+  unsigned long lNodeCount;
+  GraphNode * psNodes;
+
+  /* Every edge has a buffer of its own, all from one arena. */
+  unsigned long lEdgeCount;
+  char ** ppcEdgeNames;
+  LADSPA_Data ** ppfEdgeBuffers;
+  BufferArena sEdgeArena;
+
+  /* The graph inputs and outputs, and their buffers for reading and
+     writing files. */
+  unsigned long lInputCount;
+  unsigned long * plInputEdges;
+  LADSPA_Data ** ppfInputBuffers;
+  unsigned long lOutputCount;
+  unsigned long * plOutputEdges;
+  LADSPA_Data ** ppfOutputBuffers;
+
+  /* The execution plan: nodes grouped into tasks, each a branch of
+     nodes that must run one after the other, with the tasks each
+     waits on and the tasks waiting on it. */
+  unsigned long lTaskCount;
+  unsigned long * plTaskStart;
+  unsigned long * plTaskNodes;
+  unsigned long * plTaskDependencyCount;
+  unsigned long * plDependentStart;
+  unsigned long * plDependents;
+
+  unsigned long lSampleRate;
+  unsigned long lThreadCount;
+  void * pvScheduler;
+
+  /* Blocks run and tasks taken from another thread's queue. */
+  unsigned long lBlocksRun;
+  unsigned long lSteals;
+
+} ProcessGraph;
+
+/* Read a graph file, load its plugins and compile an execution
+   plan. Errors are handled by writing a message to stderr and
+   calling exit(1). */
+void loadProcessGraph(ProcessGraph * psGraph, const char * pcFilename);
+
+/* Allocate a buffer of lBlockSize frames per edge, on huge pages if
+   bHugePages is set (see createBufferArena()), instantiate every
+   plugin and start a pool of lThreadCount threads (including the
+   caller) to run it. */
+void instantiateProcessGraph(ProcessGraph * psGraph,
+			     const unsigned long lSampleRate,
+			     const unsigned long lBlockSize,
+			     unsigned long lThreadCount,
+			     const int bHugePages);
+
+void activateProcessGraph(ProcessGraph * psGraph);
+
+/* Run the graph for lFrameCount frames from ppfInputBuffers into
+   ppfOutputBuffers, independent branches in parallel. Plugins are
+   run on at most lSubBlockSize frames at a time. */
+void runProcessGraph(ProcessGraph * psGraph,
+		     const unsigned long lFrameCount,
+		     const unsigned long lSubBlockSize);
+
+void deactivateProcessGraph(ProcessGraph * psGraph);
+
+/* Stop the threads, clean up every instance and unload the plugin
+   libraries. */
+void destroyProcessGraph(ProcessGraph * psGraph);
+
+/*****************************************************************************/
+
+/* Functions in ring.c: */
+
+/* A bounded lock-free queue of pointers between exactly one producer
+   thread and exactly one consumer thread. The indices live on their
+   own cache lines so the two sides do not fight over them. Waiting
+   counts and queue depth are kept for reporting. */
+
+#define RING_CACHE_LINE 64
+
+typedef struct {
+
+  void ** ppvSlots;
+  unsigned long lMask;
+
+  char pcPad0[RING_CACHE_LINE];
+
+  /* Written by the producer only. */
+  unsigned long lHead;
+  unsigned long lPushWaits;
+
+  char pcPad1[RING_CACHE_LINE];
+
+  /* Written by the consumer only. */
+  unsigned long lTail;
+  unsigned long lPopWaits;
+  unsigned long lPopCount;
+  unsigned long lDepthTotal;
+
+  char pcPad2[RING_CACHE_LINE];
+
+} BlockRing;
+
+/* Create a ring that can hold at least lCapacity entries. */
+void createBlockRing(BlockRing * psRing, const unsigned long lCapacity);
+
+void destroyBlockRing(BlockRing * psRing);
+
+/* Add an entry, waiting while the ring is full. Producer only. */
+void pushBlockRing(BlockRing * psRing, void * pvBlock);
+
+/* Remove the oldest entry, waiting while the ring is empty. Consumer
+   only. */
+void * popBlockRing(BlockRing * psRing);
+
+/*****************************************************************************/
+
+#endif
+
+/* EOF */
@@ -0,0 +1,402 @@
+/* ladspahost.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+#include "utils.h"
+
+#include "host.h"
+#include "ladspahost.h"
+
+/*****************************************************************************/
+
+#define LADSPA_HOST_DEFAULT_BLOCK_SIZE 2048
+
+#define LADSPA_HOST_ERROR_SIZE 512
+
+/*****************************************************************************/
+
+struct LADSPAHost {
+
+  unsigned long lBlockSize;
+
+  /* The plugins in chain order, with their libraries and our copies
+     of their control values. */
+  unsigned long lPluginCount;
+  void ** ppvLibraries;
+  const LADSPA_Descriptor ** ppsDescriptors;
+  LADSPA_Data ** ppfControlValues;
+
+  /* The chain from the last render, if it is still any use. */
+  PluginChain sChain;
+  int bChainReady;
+
+  LADSPA_Data fPeak;
+  char pcError[LADSPA_HOST_ERROR_SIZE];
+
+};
+
+/*****************************************************************************/
+
+/* Record a failure. Returns iCode. */
+static int
+setHostError(LADSPAHost * psHost,
+	     const int iCode,
+	     const char * pcFormat,
+	     ...) {
+
+  va_list sArguments;
+
+  va_start(sArguments, pcFormat);
+  vsnprintf(psHost->pcError, sizeof(psHost->pcError), pcFormat, sArguments);
+  va_end(sArguments);
+
+  return iCode;
+}
+
+static void
+dropChain(LADSPAHost * psHost) {
+  if (psHost->bChainReady) {
+    destroyPluginChain(&psHost->sChain);
+    psHost->bChainReady = 0;
+  }
+}
+
+/* Make sure there is a chain for lChannelCount channels at
+   lSampleRate. */
+static int
+prepareChain(LADSPAHost * psHost,
+	     const unsigned long lChannelCount,
+	     const unsigned long lSampleRate) {
+
+  if (psHost->bChainReady
+      && psHost->sChain.lInputCount == lChannelCount
+      && psHost->sChain.lSampleRate == lSampleRate)
+    return LADSPA_HOST_OK;
+
+  dropChain(psHost);
+  if (tryCreatePluginChain(&psHost->sChain,
+			   psHost->lPluginCount,
+			   psHost->ppsDescriptors,
+			   psHost->ppfControlValues,
+			   lChannelCount,
+			   lSampleRate,
+			   psHost->pcError,
+			   sizeof(psHost->pcError)) != 0)
+    return LADSPA_HOST_ERROR_CHAIN;
+  psHost->bChainReady = 1;
+
+  return LADSPA_HOST_OK;
+}
+
+/*****************************************************************************/
+
+LADSPAHost *
+createLADSPAHost(const unsigned long lBlockSize) {
+
+  LADSPAHost * psHost;
+
+  psHost = (LADSPAHost *)calloc(1, sizeof(LADSPAHost));
+  if (psHost)
+    psHost->lBlockSize = (lBlockSize
+			  ? lBlockSize
+			  : LADSPA_HOST_DEFAULT_BLOCK_SIZE);
+
+  return psHost;
+}
+
+/*****************************************************************************/
+
+int
+addLADSPAHostPlugin(LADSPAHost * psHost,
+		    const char * pcLibraryFilename,
+		    const char * pcLabel,
+		    const LADSPA_Data * pfControlValues,
+		    const unsigned long lControlValueCount) {
+
+  const LADSPA_Descriptor * psDescriptor;
+  LADSPA_Data * pfControls;
+  unsigned long lControlCount;
+  unsigned long lPluginCount;
+  void * pvLibrary;
+  void * pvGrown;
+
+  pvLibrary = tryLoadLADSPAPluginLibrary(pcLibraryFilename,
+					 psHost->pcError,
+					 sizeof(psHost->pcError));
+  if (!pvLibrary)
+    return LADSPA_HOST_ERROR_LIBRARY;
+
+  psDescriptor = tryFindLADSPAPluginDescriptor(pvLibrary,
+					       pcLibraryFilename,
+					       pcLabel,
+					       psHost->pcError,
+					       sizeof(psHost->pcError));
+  if (!psDescriptor) {
+    unloadLADSPAPluginLibrary(pvLibrary);
+    return LADSPA_HOST_ERROR_PLUGIN;
+  }
+
+  lControlCount = getPortCountByType(psDescriptor,
+				     LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT);
+  if (lControlValueCount != lControlCount) {
+    setHostError(psHost,
+		 LADSPA_HOST_ERROR_CONTROLS,
+		 "Plugin \"%s\" has %lu control inputs but %lu values were "
+		 "given.",
+		 psDescriptor->Name,
+		 lControlCount,
+		 lControlValueCount);
+    unloadLADSPAPluginLibrary(pvLibrary);
+    return LADSPA_HOST_ERROR_CONTROLS;
+  }
+
+  /* Grow the plugin arrays by one. */
+  lPluginCount = psHost->lPluginCount + 1;
+  pfControls = (LADSPA_Data *)calloc(lControlCount + 1, sizeof(LADSPA_Data));
+  if (pfControls == NULL) {
+    unloadLADSPAPluginLibrary(pvLibrary);
+    return setHostError(psHost, LADSPA_HOST_ERROR_MEMORY, "Out of memory.");
+  }
+  if (lControlCount > 0)
+    memcpy(pfControls, pfControlValues, lControlCount * sizeof(LADSPA_Data));
+  if ((pvGrown = realloc(psHost->ppvLibraries,
+			 lPluginCount * sizeof(void *))) != NULL)
+    psHost->ppvLibraries = (void **)pvGrown;
+  if (pvGrown
+      && (pvGrown = realloc(psHost->ppsDescriptors,
+			    lPluginCount * sizeof(LADSPA_Descriptor *)))
+      != NULL)
+    psHost->ppsDescriptors = (const LADSPA_Descriptor **)pvGrown;
+  if (pvGrown
+      && (pvGrown = realloc(psHost->ppfControlValues,
+			    lPluginCount * sizeof(LADSPA_Data *))) != NULL)
+    psHost->ppfControlValues = (LADSPA_Data **)pvGrown;
+  if (!pvGrown) {
+    free(pfControls);
+    unloadLADSPAPluginLibrary(pvLibrary);
+    return setHostError(psHost, LADSPA_HOST_ERROR_MEMORY, "Out of memory.");
+  }
+
+  /* The chain no longer matches. */
+  dropChain(psHost);
+
+  psHost->ppvLibraries[psHost->lPluginCount] = pvLibrary;
+  psHost->ppsDescriptors[psHost->lPluginCount] = psDescriptor;
+  psHost->ppfControlValues[psHost->lPluginCount] = pfControls;
+  psHost->lPluginCount = lPluginCount;
+
+  return LADSPA_HOST_OK;
+}
+
+/*****************************************************************************/
+
+/* Run the open input through the chain to the open output, a block
+   at a time. */
+static int
+renderBlocks(LADSPAHost * psHost,
+	     WaveFile * psInputFile,
+	     WaveFile * psOutputFile,
+	     LADSPA_Data ** ppfBuffers,
+	     const unsigned long lTailFrames) {
+
+  unsigned long lBufferIndex;
+  unsigned long lFrameSize;
+  unsigned long lInputLength;
+  unsigned long lOutputLength;
+  unsigned long lReadSize;
+  unsigned long lTimeAt;
+
+  lInputLength = psInputFile->lLength;
+  lOutputLength = (lInputLength == WAVE_LENGTH_UNKNOWN
+		   ? WAVE_LENGTH_UNKNOWN
+		   : lInputLength + lTailFrames);
+
+  for (lTimeAt = 0; lTimeAt < lOutputLength; lTimeAt += lFrameSize) {
+
+    lFrameSize = psHost->lBlockSize;
+    if (lOutputLength != WAVE_LENGTH_UNKNOWN
+	&& lFrameSize > lOutputLength - lTimeAt)
+      lFrameSize = lOutputLength - lTimeAt;
+
+    lReadSize = readWaveFileUpTo(psInputFile, ppfBuffers, lFrameSize);
+    if (lInputLength == WAVE_LENGTH_UNKNOWN) {
+      /* A stream's length is known once it runs out. */
+      if (lReadSize < lFrameSize) {
+	lInputLength = lTimeAt + lReadSize;
+	lOutputLength = lInputLength + lTailFrames;
+	if (lFrameSize > lOutputLength - lTimeAt)
+	  lFrameSize = lOutputLength - lTimeAt;
+      }
+    }
+    else if (lTimeAt + lReadSize < lInputLength && lReadSize < lFrameSize)
+      return setHostError(psHost,
+			  LADSPA_HOST_ERROR_INPUT,
+			  "Failed to read audio from input file \"%s\". Is "
+			  "the file damaged?",
+			  psInputFile->pcFilename);
+    if (lFrameSize == 0)
+      break;
+
+    /* Silence after the end of the input. */
+    if (lReadSize < lFrameSize)
+      for (lBufferIndex = 0;
+	   lBufferIndex < psHost->sChain.lInputCount;
+	   lBufferIndex++)
+	memset(ppfBuffers[lBufferIndex] + lReadSize,
+	       0,
+	       sizeof(LADSPA_Data) * (lFrameSize - lReadSize));
+
+    processPluginChain(&psHost->sChain,
+		       ppfBuffers,
+		       lFrameSize,
+		       psHost->lBlockSize);
+
+    if (tryWriteWaveFile(psOutputFile, ppfBuffers, lFrameSize) != 0)
+      return setHostError(psHost,
+			  LADSPA_HOST_ERROR_OUTPUT,
+			  "%s",
+			  psOutputFile->pcError);
+  }
+
+  return LADSPA_HOST_OK;
+}
+
+int
+renderLADSPAHostFile(LADSPAHost * psHost,
+		     const char * pcInputFilename,
+		     const char * pcOutputFilename,
+		     const double dTailSeconds) {
+
+  BufferArena sArena;
+  LADSPA_Data ** ppfBuffers;
+  WaveFile sInputFile;
+  WaveFile sOutputFile;
+  int iResult;
+  unsigned long lBufferBytes;
+  unsigned long lBufferIndex;
+  unsigned long lOutputLength;
+  unsigned long lTailFrames;
+
+  if (psHost->lPluginCount == 0)
+    return setHostError(psHost,
+			LADSPA_HOST_ERROR_USAGE,
+			"There are no plugins to render with.");
+  if (!(dTailSeconds >= 0))
+    return setHostError(psHost,
+			LADSPA_HOST_ERROR_USAGE,
+			"The tail cannot be negative.");
+
+  if (tryOpenWaveFile(&sInputFile, pcInputFilename, psHost->lBlockSize) != 0)
+    return setHostError(psHost,
+			LADSPA_HOST_ERROR_INPUT,
+			"%s",
+			sInputFile.pcError);
+
+  iResult = prepareChain(psHost,
+			 sInputFile.lChannelCount,
+			 sInputFile.lSampleRate);
+  if (iResult != LADSPA_HOST_OK) {
+    tryCloseWaveFile(&sInputFile);
+    return iResult;
+  }
+
+  lTailFrames = (unsigned long)(dTailSeconds * sInputFile.lSampleRate);
+  lOutputLength = (sInputFile.lLength == WAVE_LENGTH_UNKNOWN
+		   ? WAVE_LENGTH_UNKNOWN
+		   : sInputFile.lLength + lTailFrames);
+  if (tryCreateWaveFile(&sOutputFile,
+			pcOutputFilename,
+			psHost->sChain.lOutputCount,
+			sInputFile.lSampleRate,
+			lOutputLength,
+			sInputFile.iSampleFormat,
+			psHost->lBlockSize) != 0) {
+    tryCloseWaveFile(&sInputFile);
+    return setHostError(psHost,
+			LADSPA_HOST_ERROR_OUTPUT,
+			"%s",
+			sOutputFile.pcError);
+  }
+
+  lBufferBytes = getArenaSpace(psHost->lBlockSize * sizeof(LADSPA_Data));
+  ppfBuffers = (LADSPA_Data **)calloc(psHost->sChain.lBufferCount + 1,
+				      sizeof(LADSPA_Data *));
+  if (ppfBuffers == NULL
+      || tryCreateBufferArena(&sArena,
+			      psHost->sChain.lBufferCount * lBufferBytes,
+			      0) != 0) {
+    free(ppfBuffers);
+    tryCloseWaveFile(&sInputFile);
+    tryCloseWaveFile(&sOutputFile);
+    return setHostError(psHost, LADSPA_HOST_ERROR_MEMORY, "Out of memory.");
+  }
+  for (lBufferIndex = 0;
+       lBufferIndex < psHost->sChain.lBufferCount;
+       lBufferIndex++)
+    ppfBuffers[lBufferIndex]
+      = (LADSPA_Data *)allocateFromArena(&sArena, lBufferBytes);
+
+  activatePluginChain(&psHost->sChain);
+  iResult = renderBlocks(psHost,
+			 &sInputFile,
+			 &sOutputFile,
+			 ppfBuffers,
+			 lTailFrames);
+  deactivatePluginChain(&psHost->sChain);
+
+  psHost->fPeak = sOutputFile.fPeak;
+  tryCloseWaveFile(&sInputFile);
+  if (tryCloseWaveFile(&sOutputFile) != 0 && iResult == LADSPA_HOST_OK)
+    iResult = setHostError(psHost,
+			   LADSPA_HOST_ERROR_OUTPUT,
+			   "%s",
+			   sOutputFile.pcError);
+  destroyBufferArena(&sArena);
+  free(ppfBuffers);
+
+  return iResult;
+}
+
+/*****************************************************************************/
+
+LADSPA_Data
+getLADSPAHostPeak(const LADSPAHost * psHost) {
+  return psHost->fPeak;
+}
+
+const char *
+getLADSPAHostError(const LADSPAHost * psHost) {
+  return psHost->pcError;
+}
+
+/*****************************************************************************/
+
+void
+destroyLADSPAHost(LADSPAHost * psHost) {
+
+  unsigned long lPluginIndex;
+
+  dropChain(psHost);
+  for (lPluginIndex = 0; lPluginIndex < psHost->lPluginCount; lPluginIndex++) {
+    free(psHost->ppfControlValues[lPluginIndex]);
+    unloadLADSPAPluginLibrary(psHost->ppvLibraries[lPluginIndex]);
+  }
+  free(psHost->ppfControlValues);
+  free(psHost->ppsDescriptors);
+  free(psHost->ppvLibraries);
+  free(psHost);
+}
+
+/*****************************************************************************/
+
+/* EOF */
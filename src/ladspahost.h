@@ -0,0 +1,98 @@
+/* ladspahost.h
+
+   Free software. Do with as you will. No warranty. */
+
+#ifndef LADSPA_SDK_LADSPAHOST
+#define LADSPA_SDK_LADSPAHOST
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+/*****************************************************************************/
+
+/* libladspahost renders Wave files through chains of LADSPA plugins
+   from inside another program. It is built from the same code as
+   applyplugin, as libladspahost.a and libladspahost.so.
+
+   Everything a render needs is kept in a LADSPAHost, and the library
+   keeps no state of its own, so any number of hosts may render at
+   once on different threads provided each host is used by one thread
+   at a time (and the plugins themselves are reentrant). Nothing here
+   writes to stderr or calls exit(). Calls that can fail return one of
+   the LADSPA_HOST_* codes below, and getLADSPAHostError() describes
+   the last failure. */
+
+#define LADSPA_HOST_OK			0
+
+/* A plugin library could not be loaded. */
+#define LADSPA_HOST_ERROR_LIBRARY	1
+
+/* The library is not a LADSPA library or has no such label. */
+#define LADSPA_HOST_ERROR_PLUGIN	2
+
+/* The wrong number of control values was given for a plugin. */
+#define LADSPA_HOST_ERROR_CONTROLS	3
+
+/* The plugins do not fit the channels of the input or each other, or
+   one failed to instantiate. */
+#define LADSPA_HOST_ERROR_CHAIN		4
+
+/* The input file could not be opened or read. */
+#define LADSPA_HOST_ERROR_INPUT		5
+
+/* The output file could not be created or written. */
+#define LADSPA_HOST_ERROR_OUTPUT	6
+
+/* Memory ran out. */
+#define LADSPA_HOST_ERROR_MEMORY	7
+
+/* The host was used wrongly, for instance rendering with no
+   plugins. */
+#define LADSPA_HOST_ERROR_USAGE		8
+
+/*****************************************************************************/
+
+typedef struct LADSPAHost LADSPAHost;
+
+/* Create a host that processes lBlockSize frames at a time, 0 meaning
+   2048. Returns NULL if memory runs out. */
+LADSPAHost * createLADSPAHost(const unsigned long lBlockSize);
+
+/* Add a plugin to the end of the host's chain. The library is found
+   on the LADSPA_PATH as applyplugin finds it. pfControlValues holds
+   one value for each control input of the plugin, in port order, and
+   is copied. */
+int addLADSPAHostPlugin(LADSPAHost * psHost,
+			const char * pcLibraryFilename,
+			const char * pcLabel,
+			const LADSPA_Data * pfControlValues,
+			const unsigned long lControlValueCount);
+
+/* Run the whole of a Wave file through the chain, freshly activated,
+   and write the result to another in the same sample format, with
+   dTailSeconds of silence run through after the input so reverbs and
+   delays can ring out. Either name may be "-" for standard input or
+   output. The chain is instantiated at the input's sample rate and
+   kept for the next render if that has the same rate and channel
+   count. */
+int renderLADSPAHostFile(LADSPAHost * psHost,
+			 const char * pcInputFilename,
+			 const char * pcOutputFilename,
+			 const double dTailSeconds);
+
+/* The largest absolute sample written by the last render, 1 being
+   full scale. */
+LADSPA_Data getLADSPAHostPeak(const LADSPAHost * psHost);
+
+/* A description of the last failure, or "" if there has been none. */
+const char * getLADSPAHostError(const LADSPAHost * psHost);
+
+/* Clean up the plugins and unload their libraries. */
+void destroyLADSPAHost(LADSPAHost * psHost);
+
+/*****************************************************************************/
+
+#endif
+
+/* EOF */
@@ -116,16 +116,34 @@ dlopenLADSPA(const char * pcFilename, int iFlag) {
 /*****************************************************************************/
 
 void *
-loadLADSPAPluginLibrary(const char * pcPluginFilename) {
+tryLoadLADSPAPluginLibrary(const char * pcPluginFilename,
+			   char * pcError,
+			   const size_t lErrorSize) {
 
   void * pvPluginHandle;
 
   pvPluginHandle = dlopenLADSPA(pcPluginFilename, RTLD_NOW);
+  if (!pvPluginHandle)
+    snprintf(pcError,
+	     lErrorSize,
+	     "Failed to load plugin \"%s\": %s",
+	     pcPluginFilename,
+	     dlerror());
+
+  return pvPluginHandle;
+}
+
+void *
+loadLADSPAPluginLibrary(const char * pcPluginFilename) {
+
+  char pcError[LADSPA_ERROR_SIZE];
+  void * pvPluginHandle;
+
+  pvPluginHandle = tryLoadLADSPAPluginLibrary(pcPluginFilename,
+					      pcError,
+					      sizeof(pcError));
   if (!pvPluginHandle) {
-    fprintf(stderr, 
-	    "Failed to load plugin \"%s\": %s\n", 
-	    pcPluginFilename,
-	    dlerror());
+    fprintf(stderr, "%s\n", pcError);
     exit(1);
   }
 
@@ -142,11 +160,14 @@ unloadLADSPAPluginLibrary(void * pvLADSPAPluginLibrary) {
 /*****************************************************************************/
 
 const LADSPA_Descriptor *
-findLADSPAPluginDescriptor(void * pvLADSPAPluginLibrary,
-			   const char * pcPluginLibraryFilename,
-			   const char * pcPluginLabel) {
+tryFindLADSPAPluginDescriptor(void * pvLADSPAPluginLibrary,
+			      const char * pcPluginLibraryFilename,
+			      const char * pcPluginLabel,
+			      char * pcError,
+			      const size_t lErrorSize) {
 
   const LADSPA_Descriptor * psDescriptor;
+  const char * pcDlError;
   LADSPA_Descriptor_Function pfDescriptorFunction;
   unsigned long lPluginIndex;
 
@@ -155,32 +176,53 @@ findLADSPAPluginDescriptor(void * pvLADSPAPluginLibrary,
     = (LADSPA_Descriptor_Function)dlsym(pvLADSPAPluginLibrary,
 					"ladspa_descriptor");
   if (!pfDescriptorFunction) {
-    const char * pcError = dlerror();
-    if (pcError) {
-      fprintf(stderr,
-	      "Unable to find ladspa_descriptor() function in plugin "
-	      "library file \"%s\": %s.\n"
-	      "Are you sure this is a LADSPA plugin file?\n", 
-	      pcPluginLibraryFilename,
-	      pcError);
-      exit(1);
-    }
+    pcDlError = dlerror();
+    snprintf(pcError,
+	     lErrorSize,
+	     "Unable to find ladspa_descriptor() function in plugin "
+	     "library file \"%s\": %s.\n"
+	     "Are you sure this is a LADSPA plugin file?", 
+	     pcPluginLibraryFilename,
+	     pcDlError ? pcDlError : "the symbol is NULL");
+    return NULL;
   }
 
   for (lPluginIndex = 0;; lPluginIndex++) {
     psDescriptor = pfDescriptorFunction(lPluginIndex);
     if (psDescriptor == NULL) {
-      fprintf(stderr,
-	      "Unable to find label \"%s\" in plugin library file \"%s\".\n",
-	      pcPluginLabel,
-	      pcPluginLibraryFilename);
-      exit(1);      
+      snprintf(pcError,
+	       lErrorSize,
+	       "Unable to find label \"%s\" in plugin library file \"%s\".",
+	       pcPluginLabel,
+	       pcPluginLibraryFilename);
+      return NULL;
     }
     if (strcmp(psDescriptor->Label, pcPluginLabel) == 0)
       return psDescriptor;
   }
 }
 
+const LADSPA_Descriptor *
+findLADSPAPluginDescriptor(void * pvLADSPAPluginLibrary,
+			   const char * pcPluginLibraryFilename,
+			   const char * pcPluginLabel) {
+
+  char pcError[LADSPA_ERROR_SIZE];
+  const LADSPA_Descriptor * psDescriptor;
+
+  psDescriptor = tryFindLADSPAPluginDescriptor(pvLADSPAPluginLibrary,
+					       pcPluginLibraryFilename,
+					       pcPluginLabel,
+					       pcError,
+					       sizeof(pcError));
+  if (!psDescriptor) {
+    fprintf(stderr, "%s\n", pcError);
+    exit(1);
+  }
+
+  return psDescriptor;
+}
+
 /*****************************************************************************/
 
 /* EOF */
@@ -0,0 +1,522 @@
+/* meter.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The level of every sample is a maximum, a sum of squares and a
+   comparison. SSE is always there on x86-64. */
+#if defined(__SSE__)
+#define METER_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* True peak is measured on the output upsampled this many times, as
+   ITU-R BS.1770 asks. */
+#define METER_OVERSAMPLING 4
+
+/* Loudness is gated on blocks of 400ms starting every 100ms. */
+#define METER_STEPS_PER_SECOND 10
+#define METER_STEPS_PER_BLOCK 4
+
+/* Gates, in LUFS and in LU below the absolutely gated loudness. */
+#define METER_ABSOLUTE_GATE -70.0
+#define METER_RELATIVE_GATE -10.0
+
+/*****************************************************************************/
+
+/* Find the largest absolute value of lSampleCount samples, adding
+   their squares to *pdSumSquares and the number at or beyond full
+   scale to *plClipCount. */
+static LADSPA_Data
+measureSamples(const LADSPA_Data * pfSamples,
+	       const unsigned long lSampleCount,
+	       double * pdSumSquares,
+	       unsigned long * plClipCount) {
+
+  LADSPA_Data fAbs;
+  LADSPA_Data fPeak;
+  LADSPA_Data fSumSquares;
+  unsigned long lClipCount;
+  unsigned long lIndex;
+
+  fPeak = 0;
+  fSumSquares = 0;
+  lClipCount = 0;
+  lIndex = 0;
+
+#ifdef METER_USE_SSE
+  {
+    __m128 fAbs4;
+    __m128 fAbsMask;
+    __m128 fFullScale;
+    __m128 fPeak4;
+    __m128 fSample4;
+    __m128 fSumSquares4;
+    LADSPA_Data pfLanes[4];
+
+    fAbsMask = _mm_set1_ps(-0.0f);
+    fFullScale = _mm_set1_ps(1.0f);
+    fPeak4 = _mm_setzero_ps();
+    fSumSquares4 = _mm_setzero_ps();
+    for (; lIndex + 4 <= lSampleCount; lIndex += 4) {
+      fSample4 = _mm_loadu_ps(pfSamples + lIndex);
+      fAbs4 = _mm_andnot_ps(fAbsMask, fSample4);
+      fPeak4 = _mm_max_ps(fPeak4, fAbs4);
+      fSumSquares4 = _mm_add_ps(fSumSquares4,
+				_mm_mul_ps(fSample4, fSample4));
+      lClipCount
+	+= __builtin_popcount(_mm_movemask_ps(_mm_cmpge_ps(fAbs4,
+							   fFullScale)));
+    }
+    _mm_storeu_ps(pfLanes, fPeak4);
+    fPeak = pfLanes[0];
+    if (pfLanes[1] > fPeak)
+      fPeak = pfLanes[1];
+    if (pfLanes[2] > fPeak)
+      fPeak = pfLanes[2];
+    if (pfLanes[3] > fPeak)
+      fPeak = pfLanes[3];
+    _mm_storeu_ps(pfLanes, fSumSquares4);
+    fSumSquares = pfLanes[0] + pfLanes[1] + pfLanes[2] + pfLanes[3];
+  }
+#endif
+
+  for (; lIndex < lSampleCount; lIndex++) {
+    fAbs = fabsf(pfSamples[lIndex]);
+    if (fAbs > fPeak)
+      fPeak = fAbs;
+    fSumSquares += pfSamples[lIndex] * pfSamples[lIndex];
+    if (fAbs >= 1.0f)
+      lClipCount++;
+  }
+
+  *pdSumSquares += fSumSquares;
+  *plClipCount += lClipCount;
+  return fPeak;
+}
+
+/* The two biquads of the K-weighting filter of ITU-R BS.1770, a high
+   shelf modelling the head and a high pass, worked out for
+   lSampleRate by the bilinear transform. */
+static void
+buildKWeighting(OutputMeter * psMeter, const unsigned long lSampleRate) {
+
+  double dA0;
+  double dK;
+  double dQ;
+  double dVb;
+  double dVh;
+
+  dK = tan(M_PI * 1681.974450955533 / lSampleRate);
+  dQ = 0.7071752369554196;
+  dVh = pow(10.0, 3.999843853973347 / 20);
+  dVb = pow(dVh, 0.4996667741545416);
+  dA0 = 1 + dK / dQ + dK * dK;
+  psMeter->pdShelf[0] = (dVh + dVb * dK / dQ + dK * dK) / dA0;
+  psMeter->pdShelf[1] = 2 * (dK * dK - dVh) / dA0;
+  psMeter->pdShelf[2] = (dVh - dVb * dK / dQ + dK * dK) / dA0;
+  psMeter->pdShelf[3] = 2 * (dK * dK - 1) / dA0;
+  psMeter->pdShelf[4] = (1 - dK / dQ + dK * dK) / dA0;
+
+  dK = tan(M_PI * 38.13547087602444 / lSampleRate);
+  dQ = 0.5003270373238773;
+  dA0 = 1 + dK / dQ + dK * dK;
+  psMeter->pdHighPass[0] = 1;
+  psMeter->pdHighPass[1] = -2;
+  psMeter->pdHighPass[2] = 1;
+  psMeter->pdHighPass[3] = 2 * (dK * dK - 1) / dA0;
+  psMeter->pdHighPass[4] = (1 - dK / dQ + dK * dK) / dA0;
+}
+
+/* Run one biquad, b0 b1 b2 a1 a2, over a sample with direct form II
+   state pdState. */
+static double
+runBiquad(const double * pdCoefficients, double * pdState, double dInput) {
+
+  double dOutput;
+  double dW;
+
+  dW = (dInput
+	- pdCoefficients[3] * pdState[0]
+	- pdCoefficients[4] * pdState[1]);
+  dOutput = (pdCoefficients[0] * dW
+	     + pdCoefficients[1] * pdState[0]
+	     + pdCoefficients[2] * pdState[1]);
+  pdState[1] = pdState[0];
+  pdState[0] = dW;
+  return dOutput;
+}
+
+/* K-weight lFrameCount frames of each channel, adding their weighted
+   energy to the current 100ms step and closing steps, and with them
+   400ms blocks, as they fill. */
+static void
+weighLoudness(OutputMeter * psMeter,
+	      LADSPA_Data ** ppfBuffers,
+	      unsigned long lOffset,
+	      unsigned long lFrameCount) {
+
+  const LADSPA_Data * pfSamples;
+  double dBlock;
+  double dEnergy;
+  double dSample;
+  double * pdState;
+  unsigned long lChannelIndex;
+  unsigned long lFrame;
+  unsigned long lRun;
+  unsigned long lStepIndex;
+
+  while (lFrameCount > 0) {
+
+    lRun = psMeter->lStepLength - psMeter->lStepFrames;
+    if (lRun > lFrameCount)
+      lRun = lFrameCount;
+
+    for (lChannelIndex = 0;
+	 lChannelIndex < psMeter->lChannelCount;
+	 lChannelIndex++) {
+      if (psMeter->pdChannelWeights[lChannelIndex] == 0)
+	continue;
+      pfSamples = ppfBuffers[lChannelIndex] + lOffset;
+      pdState = psMeter->pdFilterState + 4 * lChannelIndex;
+      dEnergy = 0;
+      for (lFrame = 0; lFrame < lRun; lFrame++) {
+	dSample = runBiquad(psMeter->pdShelf, pdState, pfSamples[lFrame]);
+	dSample = runBiquad(psMeter->pdHighPass, pdState + 2, dSample);
+	dEnergy += dSample * dSample;
+      }
+      psMeter->dStepEnergy
+	+= psMeter->pdChannelWeights[lChannelIndex] * dEnergy;
+    }
+
+    psMeter->lStepFrames += lRun;
+    lOffset += lRun;
+    lFrameCount -= lRun;
+    if (psMeter->lStepFrames < psMeter->lStepLength)
+      break;
+
+    /* A step is complete. Every step from the fourth on ends a
+       block. */
+    psMeter->pdSteps[psMeter->lStepCount % METER_STEPS_PER_BLOCK]
+      = psMeter->dStepEnergy / psMeter->lStepLength;
+    psMeter->lStepCount++;
+    psMeter->dStepEnergy = 0;
+    psMeter->lStepFrames = 0;
+    if (psMeter->lStepCount < METER_STEPS_PER_BLOCK)
+      continue;
+    dBlock = 0;
+    for (lStepIndex = 0; lStepIndex < METER_STEPS_PER_BLOCK; lStepIndex++)
+      dBlock += psMeter->pdSteps[lStepIndex];
+    if (psMeter->lBlockCount == psMeter->lBlockCapacity) {
+      psMeter->lBlockCapacity = (psMeter->lBlockCapacity
+				 ? 2 * psMeter->lBlockCapacity
+				 : 1024);
+      psMeter->pdBlocks
+	= (double *)realloc(psMeter->pdBlocks,
+			    psMeter->lBlockCapacity * sizeof(double));
+    }
+    psMeter->pdBlocks[psMeter->lBlockCount++]
+      = dBlock / METER_STEPS_PER_BLOCK;
+  }
+}
+
+/* Upsample lFrameCount frames and raise each channel's true peak to
+   the largest absolute value among them. */
+static void
+findTruePeaks(OutputMeter * psMeter,
+	      LADSPA_Data ** ppfInput,
+	      const unsigned long lFrameCount) {
+
+  LADSPA_Data fPeak;
+  double dUnused;
+  unsigned long lChannelIndex;
+  unsigned long lOutputCount;
+  unsigned long lUnused;
+
+  lOutputCount = runResampler(psMeter->psUpsampler,
+			      ppfInput,
+			      lFrameCount,
+			      psMeter->ppfUpsampled);
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++) {
+    dUnused = 0;
+    lUnused = 0;
+    fPeak = measureSamples(psMeter->ppfUpsampled[lChannelIndex],
+			   lOutputCount,
+			   &dUnused,
+			   &lUnused);
+    if (fPeak > psMeter->pfTruePeaks[lChannelIndex])
+      psMeter->pfTruePeaks[lChannelIndex] = fPeak;
+  }
+}
+
+static double
+getDecibels(const double dValue) {
+  return dValue > 0 ? 20 * log10(dValue) : -INFINITY;
+}
+
+/* Loudness in LUFS of a K-weighted mean square. */
+static double
+getLoudness(const double dMeanSquare) {
+  return dMeanSquare > 0 ? -0.691 + 10 * log10(dMeanSquare) : -INFINITY;
+}
+
+/* Print a level for JSON, which has no infinities. */
+static void
+writeJSONLevel(FILE * poFile, const double dLevel) {
+  if (isfinite(dLevel))
+    fprintf(poFile, "%.2f", dLevel);
+  else
+    fprintf(poFile, "null");
+}
+
+/*****************************************************************************/
+
+OutputMeter *
+createOutputMeter(const unsigned long lChannelCount,
+		  const unsigned long lSampleRate,
+		  const unsigned long lMaxFrames) {
+
+  OutputMeter * psMeter;
+  unsigned long lChannelIndex;
+  unsigned long lUpsampledFrames;
+
+  psMeter = (OutputMeter *)calloc(1, sizeof(OutputMeter));
+  psMeter->lChannelCount = lChannelCount;
+  psMeter->lSampleRate = lSampleRate;
+  psMeter->lMaxFrames = lMaxFrames;
+
+  psMeter->pfPeaks = (LADSPA_Data *)calloc(lChannelCount,
+					   sizeof(LADSPA_Data));
+  psMeter->pfTruePeaks = (LADSPA_Data *)calloc(lChannelCount,
+					       sizeof(LADSPA_Data));
+  psMeter->pdSumSquares = (double *)calloc(lChannelCount, sizeof(double));
+  psMeter->plClipCounts = (unsigned long *)calloc(lChannelCount,
+						  sizeof(unsigned long));
+
+  psMeter->psUpsampler = createResampler(lChannelCount,
+					 lSampleRate,
+					 METER_OVERSAMPLING * lSampleRate,
+					 lMaxFrames);
+  lUpsampledFrames = getResamplerMaxOutput(psMeter->psUpsampler, lMaxFrames);
+  psMeter->ppfPiece
+    = (LADSPA_Data **)calloc(lChannelCount, sizeof(LADSPA_Data *));
+  psMeter->ppfUpsampled
+    = (LADSPA_Data **)calloc(lChannelCount, sizeof(LADSPA_Data *));
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++)
+    psMeter->ppfUpsampled[lChannelIndex]
+      = (LADSPA_Data *)calloc(lUpsampledFrames, sizeof(LADSPA_Data));
+
+  /* BS.1770 weights the surround channels of 5.1 up and leaves out
+     the LFE. Anything else is weighted evenly. */
+  psMeter->pdChannelWeights = (double *)calloc(lChannelCount,
+					       sizeof(double));
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++)
+    psMeter->pdChannelWeights[lChannelIndex] = 1;
+  if (lChannelCount == 6) {
+    psMeter->pdChannelWeights[3] = 0;
+    psMeter->pdChannelWeights[4] = 1.41;
+    psMeter->pdChannelWeights[5] = 1.41;
+  }
+  psMeter->pdFilterState = (double *)calloc(4 * lChannelCount,
+					    sizeof(double));
+  buildKWeighting(psMeter, lSampleRate);
+  psMeter->lStepLength = lSampleRate / METER_STEPS_PER_SECOND;
+  if (psMeter->lStepLength == 0)
+    psMeter->lStepLength = 1;
+
+  return psMeter;
+}
+
+void
+runOutputMeter(OutputMeter * psMeter,
+	       LADSPA_Data ** ppfBuffers,
+	       const unsigned long lFrameCount) {
+
+  LADSPA_Data fPeak;
+  unsigned long lChannelIndex;
+  unsigned long lDone;
+  unsigned long lPiece;
+
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++) {
+    fPeak = measureSamples(ppfBuffers[lChannelIndex],
+			   lFrameCount,
+			   psMeter->pdSumSquares + lChannelIndex,
+			   psMeter->plClipCounts + lChannelIndex);
+    if (fPeak > psMeter->pfPeaks[lChannelIndex])
+      psMeter->pfPeaks[lChannelIndex] = fPeak;
+  }
+
+  weighLoudness(psMeter, ppfBuffers, 0, lFrameCount);
+
+  /* The upsampler takes at most lMaxFrames at a time. */
+  for (lDone = 0; lDone < lFrameCount; lDone += lPiece) {
+    lPiece = lFrameCount - lDone;
+    if (lPiece > psMeter->lMaxFrames)
+      lPiece = psMeter->lMaxFrames;
+    for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+	 lChannelIndex++)
+      psMeter->ppfPiece[lChannelIndex] = ppfBuffers[lChannelIndex] + lDone;
+    findTruePeaks(psMeter, psMeter->ppfPiece, lPiece);
+  }
+
+  psMeter->lFrameCount += lFrameCount;
+}
+
+void
+finishOutputMeter(OutputMeter * psMeter) {
+
+  LADSPA_Data ** ppfSilence;
+  double dAbsoluteGated;
+  double dGate;
+  double dSum;
+  unsigned long lBlockIndex;
+  unsigned long lChannelIndex;
+  unsigned long lCount;
+  unsigned long lFlushFrames;
+
+  /* The upsampler holds back its last outputs until the input after
+     them arrives, so follow the output with silence. */
+  lFlushFrames = psMeter->psUpsampler->lTapCount;
+  if (lFlushFrames > psMeter->lMaxFrames)
+    lFlushFrames = psMeter->lMaxFrames;
+  ppfSilence = (LADSPA_Data **)calloc(psMeter->lChannelCount,
+				      sizeof(LADSPA_Data *));
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++)
+    ppfSilence[lChannelIndex]
+      = (LADSPA_Data *)calloc(lFlushFrames, sizeof(LADSPA_Data));
+  findTruePeaks(psMeter, ppfSilence, lFlushFrames);
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++)
+    free(ppfSilence[lChannelIndex]);
+  free(ppfSilence);
+
+  /* Integrated loudness: the mean of the blocks above the absolute
+     gate, then of those above the relative gate it sets. */
+  dSum = 0;
+  lCount = 0;
+  for (lBlockIndex = 0; lBlockIndex < psMeter->lBlockCount; lBlockIndex++)
+    if (getLoudness(psMeter->pdBlocks[lBlockIndex]) > METER_ABSOLUTE_GATE) {
+      dSum += psMeter->pdBlocks[lBlockIndex];
+      lCount++;
+    }
+  psMeter->dIntegratedLoudness = -INFINITY;
+  if (lCount > 0) {
+    dAbsoluteGated = getLoudness(dSum / lCount);
+    dGate = dAbsoluteGated + METER_RELATIVE_GATE;
+    dSum = 0;
+    lCount = 0;
+    for (lBlockIndex = 0; lBlockIndex < psMeter->lBlockCount; lBlockIndex++)
+      if (getLoudness(psMeter->pdBlocks[lBlockIndex]) > METER_ABSOLUTE_GATE
+	  && getLoudness(psMeter->pdBlocks[lBlockIndex]) > dGate) {
+	dSum += psMeter->pdBlocks[lBlockIndex];
+	lCount++;
+      }
+    if (lCount > 0)
+      psMeter->dIntegratedLoudness = getLoudness(dSum / lCount);
+  }
+}
+
+void
+printOutputMeter(FILE * poFile, const OutputMeter * psMeter) {
+
+  double dFrames;
+  unsigned long lChannelIndex;
+
+  dFrames = (psMeter->lFrameCount ? (double)psMeter->lFrameCount : 1.0);
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++)
+    fprintf(poFile,
+	    "Channel %lu: peak %.2f dBFS, true peak %.2f dBTP, "
+	    "RMS %.2f dBFS, %lu samples clipped.\n",
+	    lChannelIndex + 1,
+	    getDecibels(psMeter->pfPeaks[lChannelIndex]),
+	    getDecibels(psMeter->pfTruePeaks[lChannelIndex]),
+	    getDecibels(sqrt(psMeter->pdSumSquares[lChannelIndex]
+			     / dFrames)),
+	    psMeter->plClipCounts[lChannelIndex]);
+  if (isfinite(psMeter->dIntegratedLoudness))
+    fprintf(poFile,
+	    "Integrated loudness: %.1f LUFS.\n",
+	    psMeter->dIntegratedLoudness);
+  else
+    fprintf(poFile,
+	    "Integrated loudness: none (under 400ms, or silent).\n");
+}
+
+void
+writeOutputMeterJSON(FILE * poFile, const OutputMeter * psMeter) {
+
+  double dFrames;
+  unsigned long lChannelIndex;
+
+  dFrames = (psMeter->lFrameCount ? (double)psMeter->lFrameCount : 1.0);
+  fprintf(poFile,
+	  "{\n"
+	  "  \"frames\": %lu,\n"
+	  "  \"sample_rate\": %lu,\n"
+	  "  \"integrated_lufs\": ",
+	  psMeter->lFrameCount,
+	  psMeter->lSampleRate);
+  writeJSONLevel(poFile, psMeter->dIntegratedLoudness);
+  fprintf(poFile, ",\n  \"channels\": [");
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++) {
+    fprintf(poFile,
+	    "%s\n    {\"peak_dbfs\": ",
+	    lChannelIndex ? "," : "");
+    writeJSONLevel(poFile, getDecibels(psMeter->pfPeaks[lChannelIndex]));
+    fprintf(poFile, ", \"true_peak_dbtp\": ");
+    writeJSONLevel(poFile,
+		   getDecibels(psMeter->pfTruePeaks[lChannelIndex]));
+    fprintf(poFile, ", \"rms_dbfs\": ");
+    writeJSONLevel(poFile,
+		   getDecibels(sqrt(psMeter->pdSumSquares[lChannelIndex]
+				    / dFrames)));
+    fprintf(poFile,
+	    ", \"clipped\": %lu}",
+	    psMeter->plClipCounts[lChannelIndex]);
+  }
+  fprintf(poFile, "\n  ]\n}\n");
+}
+
+void
+destroyOutputMeter(OutputMeter * psMeter) {
+
+  unsigned long lChannelIndex;
+
+  for (lChannelIndex = 0; lChannelIndex < psMeter->lChannelCount;
+       lChannelIndex++)
+    free(psMeter->ppfUpsampled[lChannelIndex]);
+  free(psMeter->ppfUpsampled);
+  free(psMeter->ppfPiece);
+  destroyResampler(psMeter->psUpsampler);
+  free(psMeter->pfPeaks);
+  free(psMeter->pfTruePeaks);
+  free(psMeter->pdSumSquares);
+  free(psMeter->plClipCounts);
+  free(psMeter->pdChannelWeights);
+  free(psMeter->pdFilterState);
+  free(psMeter->pdBlocks);
+  free(psMeter);
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,259 @@
+/* profile.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* The time stamp counter gives cycle counts alongside the clock on
+   x86. Elsewhere only the clock is used. */
+#if defined(__x86_64__) || defined(__i386__)
+#define PROFILE_USE_TSC
+#include <x86intrin.h>
+#endif
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+void
+readProfileClock(ProfileClock * psClock) {
+
+  struct timespec sNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &sNow);
+  psClock->dSeconds = sNow.tv_sec + sNow.tv_nsec * 1e-9;
+#ifdef PROFILE_USE_TSC
+  psClock->llCycles = __rdtsc();
+#else
+  psClock->llCycles = 0;
+#endif
+}
+
+void
+addProfileTime(ProfileStage * psStage, const ProfileClock * psStart) {
+
+  ProfileClock sNow;
+
+  readProfileClock(&sNow);
+  psStage->dSeconds += sNow.dSeconds - psStart->dSeconds;
+  psStage->dBlockSeconds += sNow.dSeconds - psStart->dSeconds;
+  psStage->llCycles += sNow.llCycles - psStart->llCycles;
+}
+
+void
+endProfileBlock(ProfileStage * psStage) {
+
+  if (psStage->lBlockCount == psStage->lBlockCapacity) {
+    psStage->lBlockCapacity = (psStage->lBlockCapacity
+			       ? 2 * psStage->lBlockCapacity
+			       : 1024);
+    psStage->pdBlockSeconds
+      = (double *)realloc(psStage->pdBlockSeconds,
+			  psStage->lBlockCapacity * sizeof(double));
+  }
+  psStage->pdBlockSeconds[psStage->lBlockCount++] = psStage->dBlockSeconds;
+  psStage->dBlockSeconds = 0;
+}
+
+void
+freeProfileStages(ProfileStage * psStages, const unsigned long lStageCount) {
+
+  unsigned long lStageIndex;
+
+  for (lStageIndex = 0; lStageIndex < lStageCount; lStageIndex++)
+    free(psStages[lStageIndex].pdBlockSeconds);
+  free(psStages);
+}
+
+/*****************************************************************************/
+
+static int
+compareDoubles(const void * pvA, const void * pvB) {
+  double dA = *(const double *)pvA;
+  double dB = *(const double *)pvB;
+  return (dA < dB ? -1 : dA > dB);
+}
+
+/* Percentiles of block time in microseconds. */
+#define PROFILE_PERCENTILE_COUNT 4
+static const double g_pdPercentiles[PROFILE_PERCENTILE_COUNT]
+  = { 50, 90, 99, 100 };
+static const char * g_ppcPercentileNames[PROFILE_PERCENTILE_COUNT]
+  = { "p50", "p90", "p99", "max" };
+
+static void
+getBlockPercentiles(const ProfileStage * psStage, double * pdResults) {
+
+  double * pdSorted;
+  unsigned long lIndex;
+  unsigned long lRank;
+
+  if (psStage->lBlockCount == 0) {
+    for (lIndex = 0; lIndex < PROFILE_PERCENTILE_COUNT; lIndex++)
+      pdResults[lIndex] = 0;
+    return;
+  }
+
+  pdSorted = (double *)malloc(psStage->lBlockCount * sizeof(double));
+  memcpy(pdSorted,
+	 psStage->pdBlockSeconds,
+	 psStage->lBlockCount * sizeof(double));
+  qsort(pdSorted, psStage->lBlockCount, sizeof(double), compareDoubles);
+
+  /* Nearest rank. */
+  for (lIndex = 0; lIndex < PROFILE_PERCENTILE_COUNT; lIndex++) {
+    lRank = (unsigned long)(g_pdPercentiles[lIndex] / 100.0
+			    * psStage->lBlockCount + 0.999999);
+    if (lRank < 1)
+      lRank = 1;
+    if (lRank > psStage->lBlockCount)
+      lRank = psStage->lBlockCount;
+    pdResults[lIndex] = pdSorted[lRank - 1] * 1e6;
+  }
+
+  free(pdSorted);
+}
+
+static void
+writeJSONString(FILE * poFile, const char * pcString) {
+  fputc('"', poFile);
+  for (; *pcString != '\0'; pcString++) {
+    if (*pcString == '"' || *pcString == '\\')
+      fprintf(poFile, "\\%c", *pcString);
+    else if ((unsigned char)*pcString < 0x20)
+      fprintf(poFile, "\\u%04x", *pcString);
+    else
+      fputc(*pcString, poFile);
+  }
+  fputc('"', poFile);
+}
+
+/*****************************************************************************/
+
+void
+printProfile(FILE * poFile,
+	     const ProfileStage * psStages,
+	     const unsigned long lStageCount,
+	     const unsigned long lFrameCount,
+	     const unsigned long lSampleRate,
+	     const double dWallSeconds) {
+
+  const ProfileStage * psStage;
+  double pdPercentiles[PROFILE_PERCENTILE_COUNT];
+  double dAudioSeconds;
+  double dFrames;
+  unsigned long lIndex;
+  unsigned long lStageIndex;
+
+  dAudioSeconds = (double)lFrameCount / lSampleRate;
+  dFrames = (lFrameCount ? (double)lFrameCount : 1.0);
+
+  fprintf(poFile,
+	  "Profile: %.3f seconds for %.3f seconds of audio, "
+	  "%.1f times realtime.\n",
+	  dWallSeconds,
+	  dAudioSeconds,
+	  dWallSeconds > 0 ? dAudioSeconds / dWallSeconds : 0.0);
+  fprintf(poFile,
+	  "%-28s %9s %6s %9s %9s",
+	  "Stage",
+	  "Seconds",
+	  "Wall%",
+	  "ns/frame",
+	  "cyc/frame");
+  for (lIndex = 0; lIndex < PROFILE_PERCENTILE_COUNT; lIndex++)
+    fprintf(poFile, " %7s", g_ppcPercentileNames[lIndex]);
+  fprintf(poFile, "  (block times in us)\n");
+
+  for (lStageIndex = 0; lStageIndex < lStageCount; lStageIndex++) {
+    psStage = psStages + lStageIndex;
+    if (psStage->pcName == NULL)
+      continue;
+    getBlockPercentiles(psStage, pdPercentiles);
+    fprintf(poFile,
+	    "%-28.28s %9.4f %6.1f %9.2f %9.2f",
+	    psStage->pcName,
+	    psStage->dSeconds,
+	    dWallSeconds > 0 ? 100 * psStage->dSeconds / dWallSeconds : 0.0,
+	    psStage->dSeconds * 1e9 / dFrames,
+	    (double)psStage->llCycles / dFrames);
+    for (lIndex = 0; lIndex < PROFILE_PERCENTILE_COUNT; lIndex++)
+      fprintf(poFile, " %7.1f", pdPercentiles[lIndex]);
+    fprintf(poFile, "\n");
+  }
+}
+
+void
+writeProfileJSON(FILE * poFile,
+		 const ProfileStage * psStages,
+		 const unsigned long lStageCount,
+		 const unsigned long lFrameCount,
+		 const unsigned long lSampleRate,
+		 const double dWallSeconds) {
+
+  const ProfileStage * psStage;
+  double pdPercentiles[PROFILE_PERCENTILE_COUNT];
+  double dAudioSeconds;
+  double dFrames;
+  int bFirst;
+  unsigned long lIndex;
+  unsigned long lStageIndex;
+
+  dAudioSeconds = (double)lFrameCount / lSampleRate;
+  dFrames = (lFrameCount ? (double)lFrameCount : 1.0);
+
+  fprintf(poFile,
+	  "{\n"
+	  "  \"frames\": %lu,\n"
+	  "  \"sample_rate\": %lu,\n"
+	  "  \"audio_seconds\": %.6f,\n"
+	  "  \"wall_seconds\": %.6f,\n"
+	  "  \"realtime_factor\": %.3f,\n"
+	  "  \"stages\": [",
+	  lFrameCount,
+	  lSampleRate,
+	  dAudioSeconds,
+	  dWallSeconds,
+	  dWallSeconds > 0 ? dAudioSeconds / dWallSeconds : 0.0);
+
+  bFirst = 1;
+  for (lStageIndex = 0; lStageIndex < lStageCount; lStageIndex++) {
+    psStage = psStages + lStageIndex;
+    if (psStage->pcName == NULL)
+      continue;
+    getBlockPercentiles(psStage, pdPercentiles);
+    fprintf(poFile, "%s\n    {\"name\": ", bFirst ? "" : ",");
+    writeJSONString(poFile, psStage->pcName);
+    fprintf(poFile,
+	    ", \"seconds\": %.6f, \"wall_share\": %.4f, "
+	    "\"ns_per_frame\": %.3f, \"cycles_per_frame\": %.3f, "
+	    "\"blocks\": %lu, \"block_us\": {",
+	    psStage->dSeconds,
+	    dWallSeconds > 0 ? psStage->dSeconds / dWallSeconds : 0.0,
+	    psStage->dSeconds * 1e9 / dFrames,
+	    (double)psStage->llCycles / dFrames,
+	    psStage->lBlockCount);
+    for (lIndex = 0; lIndex < PROFILE_PERCENTILE_COUNT; lIndex++)
+      fprintf(poFile,
+	      "%s\"%s\": %.3f",
+	      lIndex ? ", " : "",
+	      g_ppcPercentileNames[lIndex],
+	      pdPercentiles[lIndex]);
+    fprintf(poFile, "}}");
+    bFirst = 0;
+  }
+  fprintf(poFile, "\n  ]\n}\n");
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -0,0 +1,392 @@
+/* resample.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The filter is a dot product per output sample. SSE is always there
+   on x86-64; AVX is used when the compiler is told it may (e.g. by
+   adding -mavx or -march=native to CFLAGS). */
+#if defined(__SSE__)
+#define RESAMPLE_USE_SSE
+#include <xmmintrin.h>
+#if defined(__AVX__)
+#define RESAMPLE_USE_AVX
+#include <immintrin.h>
+#endif
+#endif
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Zero crossings of the sinc either side of the centre, at whichever
+   of the two rates is lower. */
+#define RESAMPLE_ZERO_CROSSINGS 16
+
+/* Cutoff as a fraction of the lower Nyquist frequency. */
+#define RESAMPLE_PASSBAND 0.92
+
+/* Kaiser window shape, giving about 80dB of stopband rejection. */
+#define RESAMPLE_KAISER_BETA 8.0
+
+/* Taps are a multiple of this so the kernels need no tail loop, and
+   coefficient rows are aligned to it. */
+#define RESAMPLE_TAP_GRANULE 8
+
+/* Most phases in a coefficient table. Rates whose ratio needs more
+   than this are refused. */
+#define RESAMPLE_MAX_PHASES 65536
+
+/*****************************************************************************/
+
+static unsigned long
+getGreatestCommonDivisor(unsigned long lA, unsigned long lB) {
+  unsigned long lRemainder;
+  while (lB != 0) {
+    lRemainder = lA % lB;
+    lA = lB;
+    lB = lRemainder;
+  }
+  return lA;
+}
+
+/* Zeroth order modified Bessel function of the first kind, for the
+   Kaiser window. */
+static double
+getBesselI0(const double dX) {
+
+  double dSum;
+  double dTerm;
+  unsigned long lIndex;
+
+  dSum = 1;
+  dTerm = 1;
+  for (lIndex = 1; lIndex < 64; lIndex++) {
+    dTerm *= (dX / (2.0 * lIndex)) * (dX / (2.0 * lIndex));
+    dSum += dTerm;
+    if (dTerm < dSum * 1e-12)
+      break;
+  }
+  return dSum;
+}
+
+/* Fill in one row of taps per phase. Phase p of lUp places the
+   output p/lUp of an input sample after the centre tap. Each row is
+   normalised to unity gain at DC. */
+static void
+buildCoefficients(Resampler * psResampler) {
+
+  LADSPA_Data * pfRow;
+  double dCutoff;
+  double dDistance;
+  double dHalfWidth;
+  double dSum;
+  double dValue;
+  double dWindow;
+  double * pdRow;
+  unsigned long lPhase;
+  unsigned long lTap;
+
+  dCutoff = RESAMPLE_PASSBAND;
+  if (psResampler->lUp < psResampler->lDown)
+    dCutoff *= (double)psResampler->lUp / psResampler->lDown;
+  dHalfWidth = psResampler->lTapCount / 2;
+
+  pdRow = (double *)malloc(psResampler->lTapCount * sizeof(double));
+  for (lPhase = 0; lPhase < psResampler->lUp; lPhase++) {
+
+    dSum = 0;
+    for (lTap = 0; lTap < psResampler->lTapCount; lTap++) {
+      dDistance = ((double)lTap - (dHalfWidth - 1)
+		   - (double)lPhase / psResampler->lUp);
+      if (fabs(dDistance) >= dHalfWidth) {
+	pdRow[lTap] = 0;
+	continue;
+      }
+      dValue = dCutoff * dDistance * M_PI;
+      dValue = (dValue == 0 ? dCutoff : dCutoff * sin(dValue) / dValue);
+      dWindow = dDistance / dHalfWidth;
+      dWindow = (getBesselI0(RESAMPLE_KAISER_BETA
+			     * sqrt(1 - dWindow * dWindow))
+		 / getBesselI0(RESAMPLE_KAISER_BETA));
+      pdRow[lTap] = dValue * dWindow;
+      dSum += pdRow[lTap];
+    }
+
+    pfRow = psResampler->pfCoefficients + lPhase * psResampler->lTapCount;
+    for (lTap = 0; lTap < psResampler->lTapCount; lTap++)
+      pfRow[lTap] = (LADSPA_Data)(pdRow[lTap] / dSum);
+  }
+  free(pdRow);
+}
+
+/*****************************************************************************/
+
+/* Dot product of lCount samples with a row of coefficients.
+   pfCoefficients is aligned and lCount is a multiple of
+   RESAMPLE_TAP_GRANULE; pfSamples may be anywhere. */
+static LADSPA_Data
+applyFilter(const LADSPA_Data * pfSamples,
+	    const LADSPA_Data * pfCoefficients,
+	    const unsigned long lCount) {
+
+  unsigned long lIndex;
+
+#if defined(RESAMPLE_USE_AVX)
+
+  __m256 fSumA;
+  __m256 fSumB;
+  __m128 fSum;
+
+  fSumA = _mm256_setzero_ps();
+  fSumB = _mm256_setzero_ps();
+  for (lIndex = 0; lIndex + 16 <= lCount; lIndex += 16) {
+    fSumA = _mm256_add_ps(fSumA,
+			  _mm256_mul_ps(_mm256_loadu_ps(pfSamples + lIndex),
+					_mm256_load_ps(pfCoefficients
+						       + lIndex)));
+    fSumB = _mm256_add_ps(fSumB,
+			  _mm256_mul_ps(_mm256_loadu_ps(pfSamples + lIndex
+							+ 8),
+					_mm256_load_ps(pfCoefficients
+						       + lIndex + 8)));
+  }
+  if (lIndex < lCount)
+    fSumA = _mm256_add_ps(fSumA,
+			  _mm256_mul_ps(_mm256_loadu_ps(pfSamples + lIndex),
+					_mm256_load_ps(pfCoefficients
+						       + lIndex)));
+  fSumA = _mm256_add_ps(fSumA, fSumB);
+  fSum = _mm_add_ps(_mm256_castps256_ps128(fSumA),
+		    _mm256_extractf128_ps(fSumA, 1));
+  fSum = _mm_add_ps(fSum, _mm_movehl_ps(fSum, fSum));
+  fSum = _mm_add_ss(fSum, _mm_shuffle_ps(fSum, fSum, 1));
+  return _mm_cvtss_f32(fSum);
+
+#elif defined(RESAMPLE_USE_SSE)
+
+  __m128 fSumA;
+  __m128 fSumB;
+
+  fSumA = _mm_setzero_ps();
+  fSumB = _mm_setzero_ps();
+  for (lIndex = 0; lIndex < lCount; lIndex += 8) {
+    fSumA = _mm_add_ps(fSumA,
+		       _mm_mul_ps(_mm_loadu_ps(pfSamples + lIndex),
+				  _mm_load_ps(pfCoefficients + lIndex)));
+    fSumB = _mm_add_ps(fSumB,
+		       _mm_mul_ps(_mm_loadu_ps(pfSamples + lIndex + 4),
+				  _mm_load_ps(pfCoefficients + lIndex + 4)));
+  }
+  fSumA = _mm_add_ps(fSumA, fSumB);
+  fSumA = _mm_add_ps(fSumA, _mm_movehl_ps(fSumA, fSumA));
+  fSumA = _mm_add_ss(fSumA, _mm_shuffle_ps(fSumA, fSumA, 1));
+  return _mm_cvtss_f32(fSumA);
+
+#else
+
+  LADSPA_Data fSum;
+
+  fSum = 0;
+  for (lIndex = 0; lIndex < lCount; lIndex++)
+    fSum += pfSamples[lIndex] * pfCoefficients[lIndex];
+  return fSum;
+
+#endif
+}
+
+/*****************************************************************************/
+
+Resampler *
+createResampler(const unsigned long lChannelCount,
+		const unsigned long lInputRate,
+		const unsigned long lOutputRate,
+		const unsigned long lMaxInputFrames) {
+
+  Resampler * psResampler;
+  unsigned long lChannelIndex;
+  unsigned long lDivisor;
+  unsigned long lHalfWidth;
+
+  lDivisor = getGreatestCommonDivisor(lInputRate, lOutputRate);
+  if (lOutputRate / lDivisor > RESAMPLE_MAX_PHASES) {
+    fprintf(stderr,
+	    "Cannot resample from %lu Hz to %lu Hz: the ratio between "
+	    "them is too complex.\n",
+	    lInputRate,
+	    lOutputRate);
+    exit(1);
+  }
+
+  psResampler = (Resampler *)calloc(1, sizeof(Resampler));
+  psResampler->lInputRate = lInputRate;
+  psResampler->lOutputRate = lOutputRate;
+  psResampler->lUp = lOutputRate / lDivisor;
+  psResampler->lDown = lInputRate / lDivisor;
+  psResampler->lChannelCount = lChannelCount;
+  psResampler->lMaxInputFrames = lMaxInputFrames;
+
+  /* The filter is widened in proportion when decimating, as its
+     cutoff is then lower. */
+  lHalfWidth = RESAMPLE_ZERO_CROSSINGS;
+  if (psResampler->lDown > psResampler->lUp)
+    lHalfWidth = ((RESAMPLE_ZERO_CROSSINGS * psResampler->lDown
+		   + psResampler->lUp - 1)
+		  / psResampler->lUp);
+  lHalfWidth = (unsigned long)ceil(lHalfWidth / RESAMPLE_PASSBAND);
+  psResampler->lTapCount
+    = ((2 * lHalfWidth + RESAMPLE_TAP_GRANULE - 1)
+       / RESAMPLE_TAP_GRANULE * RESAMPLE_TAP_GRANULE);
+
+  if (posix_memalign((void **)&psResampler->pfCoefficients,
+		     RESAMPLE_TAP_GRANULE * sizeof(LADSPA_Data),
+		     (psResampler->lUp * psResampler->lTapCount
+		      * sizeof(LADSPA_Data))) != 0) {
+    fprintf(stderr, "Failed to allocate resampler coefficients.\n");
+    exit(1);
+  }
+  buildCoefficients(psResampler);
+
+  psResampler->lHistoryCapacity = psResampler->lTapCount + lMaxInputFrames;
+  psResampler->ppfHistory
+    = (LADSPA_Data **)calloc(lChannelCount, sizeof(LADSPA_Data *));
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++)
+    psResampler->ppfHistory[lChannelIndex]
+      = (LADSPA_Data *)calloc(psResampler->lHistoryCapacity,
+			      sizeof(LADSPA_Data));
+
+  resetResampler(psResampler);
+  return psResampler;
+}
+
+void
+resetResampler(Resampler * psResampler) {
+
+  unsigned long lChannelIndex;
+
+  /* Start with silence before the centre tap, so the first output
+     lines up with the first input and there is no delay. */
+  for (lChannelIndex = 0;
+       lChannelIndex < psResampler->lChannelCount;
+       lChannelIndex++)
+    memset(psResampler->ppfHistory[lChannelIndex],
+	   0,
+	   psResampler->lHistoryCapacity * sizeof(LADSPA_Data));
+  psResampler->lHistoryLength = psResampler->lTapCount / 2 - 1;
+  psResampler->lPosition = 0;
+  psResampler->lPhase = 0;
+}
+
+unsigned long
+getResamplerMaxOutput(const Resampler * psResampler,
+		      const unsigned long lInputFrames) {
+  return ((unsigned long)((unsigned long long)lInputFrames
+			  * psResampler->lUp
+			  / psResampler->lDown)
+	  + 2);
+}
+
+unsigned long
+runResampler(Resampler * psResampler,
+	     LADSPA_Data ** ppfInput,
+	     const unsigned long lInputFrames,
+	     LADSPA_Data ** ppfOutput) {
+
+  const LADSPA_Data * pfHistory;
+  LADSPA_Data * pfOutput;
+  unsigned long lChannelIndex;
+  unsigned long lLast;
+  unsigned long lOutputCount;
+  unsigned long lPhase;
+  unsigned long lPosition;
+
+  if (lInputFrames > psResampler->lMaxInputFrames) {
+    fprintf(stderr, "Too much input given to resampler.\n");
+    exit(1);
+  }
+
+  for (lChannelIndex = 0;
+       lChannelIndex < psResampler->lChannelCount;
+       lChannelIndex++)
+    memcpy(psResampler->ppfHistory[lChannelIndex]
+	   + psResampler->lHistoryLength,
+	   ppfInput[lChannelIndex],
+	   lInputFrames * sizeof(LADSPA_Data));
+  psResampler->lHistoryLength += lInputFrames;
+
+  /* Produce every output whose taps are all in the history. Each
+     channel walks the same positions and phases. */
+  lOutputCount = 0;
+  lPosition = psResampler->lPosition;
+  lPhase = psResampler->lPhase;
+  if (psResampler->lHistoryLength >= psResampler->lTapCount) {
+    lLast = psResampler->lHistoryLength - psResampler->lTapCount;
+    for (lChannelIndex = 0;
+	 lChannelIndex < psResampler->lChannelCount;
+	 lChannelIndex++) {
+      pfHistory = psResampler->ppfHistory[lChannelIndex];
+      pfOutput = ppfOutput[lChannelIndex];
+      lPosition = psResampler->lPosition;
+      lPhase = psResampler->lPhase;
+      lOutputCount = 0;
+      while (lPosition <= lLast) {
+	pfOutput[lOutputCount++]
+	  = applyFilter(pfHistory + lPosition,
+			(psResampler->pfCoefficients
+			 + lPhase * psResampler->lTapCount),
+			psResampler->lTapCount);
+	lPhase += psResampler->lDown;
+	lPosition += lPhase / psResampler->lUp;
+	lPhase %= psResampler->lUp;
+      }
+    }
+    psResampler->lPosition = lPosition;
+    psResampler->lPhase = lPhase;
+  }
+
+  /* Keep only what later outputs still need. */
+  if (psResampler->lPosition > 0) {
+    lPosition = psResampler->lPosition;
+    if (lPosition > psResampler->lHistoryLength)
+      lPosition = psResampler->lHistoryLength;
+    for (lChannelIndex = 0;
+	 lChannelIndex < psResampler->lChannelCount;
+	 lChannelIndex++)
+      memmove(psResampler->ppfHistory[lChannelIndex],
+	      psResampler->ppfHistory[lChannelIndex] + lPosition,
+	      ((psResampler->lHistoryLength - lPosition)
+	       * sizeof(LADSPA_Data)));
+    psResampler->lHistoryLength -= lPosition;
+    psResampler->lPosition -= lPosition;
+  }
+
+  return lOutputCount;
+}
+
+void
+destroyResampler(Resampler * psResampler) {
+
+  unsigned long lChannelIndex;
+
+  for (lChannelIndex = 0;
+       lChannelIndex < psResampler->lChannelCount;
+       lChannelIndex++)
+    free(psResampler->ppfHistory[lChannelIndex]);
+  free(psResampler->ppfHistory);
+  free(psResampler->pfCoefficients);
+  free(psResampler);
+}
+
+/*****************************************************************************/
+
+/* EOF */
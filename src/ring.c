@@ -0,0 +1,112 @@
+/* ring.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*****************************************************************************/
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Waiting: spin briefly (the other side is usually just about to
+   deliver), then yield, then sleep so an idle thread does not burn a
+   core. */
+static void
+backOff(const unsigned long lAttempt) {
+
+  struct timespec sDelay;
+
+  if (lAttempt < 64) {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+  }
+  else if (lAttempt < 128)
+    sched_yield();
+  else {
+    sDelay.tv_sec = 0;
+    sDelay.tv_nsec = 50000;
+    nanosleep(&sDelay, NULL);
+  }
+}
+
+/*****************************************************************************/
+
+void
+createBlockRing(BlockRing * psRing, const unsigned long lCapacity) {
+
+  unsigned long lSize;
+
+  /* One slot is always left empty to tell full from empty. */
+  for (lSize = 2; lSize < lCapacity + 1; lSize <<= 1)
+    ;
+
+  memset(psRing, 0, sizeof(BlockRing));
+  psRing->ppvSlots = (void **)calloc(lSize, sizeof(void *));
+  psRing->lMask = lSize - 1;
+}
+
+void
+destroyBlockRing(BlockRing * psRing) {
+  free(psRing->ppvSlots);
+  psRing->ppvSlots = NULL;
+}
+
+/*****************************************************************************/
+
+void
+pushBlockRing(BlockRing * psRing, void * pvBlock) {
+
+  unsigned long lHead;
+  unsigned long lAttempt;
+
+  lHead = __atomic_load_n(&psRing->lHead, __ATOMIC_RELAXED);
+  for (lAttempt = 0;
+       lHead - __atomic_load_n(&psRing->lTail, __ATOMIC_ACQUIRE)
+	 > psRing->lMask - 1;
+       lAttempt++) {
+    if (lAttempt == 0)
+      psRing->lPushWaits++;
+    backOff(lAttempt);
+  }
+
+  psRing->ppvSlots[lHead & psRing->lMask] = pvBlock;
+  __atomic_store_n(&psRing->lHead, lHead + 1, __ATOMIC_RELEASE);
+}
+
+void *
+popBlockRing(BlockRing * psRing) {
+
+  unsigned long lTail;
+  unsigned long lHead;
+  unsigned long lAttempt;
+  void * pvBlock;
+
+  lTail = __atomic_load_n(&psRing->lTail, __ATOMIC_RELAXED);
+  for (lAttempt = 0;
+       (lHead = __atomic_load_n(&psRing->lHead, __ATOMIC_ACQUIRE)) == lTail;
+       lAttempt++) {
+    if (lAttempt == 0)
+      psRing->lPopWaits++;
+    backOff(lAttempt);
+  }
+
+  psRing->lPopCount++;
+  psRing->lDepthTotal += lHead - lTail;
+
+  pvBlock = psRing->ppvSlots[lTail & psRing->lMask];
+  __atomic_store_n(&psRing->lTail, lTail + 1, __ATOMIC_RELEASE);
+
+  return pvBlock;
+}
+
+/*****************************************************************************/
+
+/* EOF */
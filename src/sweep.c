@@ -0,0 +1,374 @@
+/* sweep.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+/* Most points a sweep may have, to catch grids that multiply out to
+   more renders than anyone meant. */
+#define SWEEP_MAX_POINTS 4096
+
+/* Room for describing one control setting of a point. */
+#define SWEEP_SETTING_SIZE 48
+
+/*****************************************************************************/
+
+/* One control and the values it takes. */
+typedef struct {
+  unsigned long lPlugin;
+  unsigned long lControl;
+  unsigned long lValueCount;
+  LADSPA_Data * pfValues;
+} SweepAxis;
+
+static void
+failSweepLine(const char * pcFilename,
+	      const unsigned long lLine,
+	      const char * pcMessage,
+	      const char * pcDetail) {
+  fprintf(stderr,
+	  "%s:%lu: %s \"%s\".\n",
+	  pcFilename,
+	  lLine,
+	  pcMessage,
+	  pcDetail);
+  exit(1);
+}
+
+/* Read a plugin number and a control number or name, filling in the
+   plugin and control indices of psAxis. */
+static void
+parseSweepControl(const char * pcFilename,
+		  const unsigned long lLine,
+		  const char * pcPlugin,
+		  const char * pcControl,
+		  const unsigned long lPluginCount,
+		  const LADSPA_Descriptor ** ppsPluginDescriptors,
+		  SweepAxis * psAxis) {
+
+  char * pcEndPointer;
+
+  psAxis->lPlugin = strtoul(pcPlugin, &pcEndPointer, 10);
+  if (*pcEndPointer != '\0'
+      || psAxis->lPlugin < 1
+      || psAxis->lPlugin > lPluginCount)
+    failSweepLine(pcFilename, lLine, "No such plugin", pcPlugin);
+  psAxis->lPlugin--;
+
+  psAxis->lControl = findControl(ppsPluginDescriptors[psAxis->lPlugin],
+				 pcControl);
+  if (psAxis->lControl == ~0UL)
+    failSweepLine(pcFilename, lLine, "No such control", pcControl);
+}
+
+/* Add the values given by pcWord to psAxis: a number, or
+   <first>:<last>:<count> for count evenly spaced values. */
+static void
+parseSweepValues(const char * pcFilename,
+		 const unsigned long lLine,
+		 const char * pcWord,
+		 SweepAxis * psAxis) {
+
+  char * pcEndPointer;
+  double dFirst;
+  double dLast;
+  unsigned long lCount;
+  unsigned long lIndex;
+
+  dFirst = strtod(pcWord, &pcEndPointer);
+  if (pcEndPointer == pcWord)
+    failSweepLine(pcFilename, lLine, "Bad value", pcWord);
+  if (*pcEndPointer == '\0') {
+    dLast = dFirst;
+    lCount = 1;
+  }
+  else {
+    if (*pcEndPointer != ':')
+      failSweepLine(pcFilename, lLine, "Bad value", pcWord);
+    dLast = strtod(pcEndPointer + 1, &pcEndPointer);
+    if (*pcEndPointer != ':')
+      failSweepLine(pcFilename, lLine, "Bad range", pcWord);
+    lCount = strtoul(pcEndPointer + 1, &pcEndPointer, 10);
+    if (*pcEndPointer != '\0' || lCount == 0 || lCount > SWEEP_MAX_POINTS)
+      failSweepLine(pcFilename, lLine, "Bad range", pcWord);
+  }
+
+  psAxis->pfValues
+    = (LADSPA_Data *)realloc(psAxis->pfValues,
+			     ((psAxis->lValueCount + lCount)
+			      * sizeof(LADSPA_Data)));
+  for (lIndex = 0; lIndex < lCount; lIndex++)
+    psAxis->pfValues[psAxis->lValueCount++]
+      = (LADSPA_Data)(lCount == 1
+		      ? dFirst
+		      : dFirst + (dLast - dFirst) * lIndex / (lCount - 1));
+}
+
+/* Add a point to the sweep with the command line's control values,
+   for setSweepControl() to change. */
+static void
+addSweepPoint(ParameterSweep * psSweep,
+	      const unsigned long lPluginCount,
+	      const LADSPA_Descriptor ** ppsPluginDescriptors,
+	      LADSPA_Data ** ppfPluginControlValues) {
+
+  LADSPA_Data ** ppfValues;
+  unsigned long lControlCount;
+  unsigned long lPluginIndex;
+
+  psSweep->pppfControlValues
+    = (LADSPA_Data ***)realloc(psSweep->pppfControlValues,
+			       ((psSweep->lPointCount + 1)
+				* sizeof(LADSPA_Data **)));
+  psSweep->ppcDescriptions
+    = (char **)realloc(psSweep->ppcDescriptions,
+		       (psSweep->lPointCount + 1) * sizeof(char *));
+
+  ppfValues = (LADSPA_Data **)calloc(lPluginCount, sizeof(LADSPA_Data *));
+  for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++) {
+    lControlCount
+      = getPortCountByType(ppsPluginDescriptors[lPluginIndex],
+			   LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT);
+    ppfValues[lPluginIndex]
+      = (LADSPA_Data *)calloc(lControlCount + 1, sizeof(LADSPA_Data));
+    if (lControlCount > 0)
+      memcpy(ppfValues[lPluginIndex],
+	     ppfPluginControlValues[lPluginIndex],
+	     lControlCount * sizeof(LADSPA_Data));
+  }
+
+  psSweep->pppfControlValues[psSweep->lPointCount] = ppfValues;
+  psSweep->ppcDescriptions[psSweep->lPointCount]
+    = (char *)calloc(1, 1);
+  psSweep->lPointCount++;
+}
+
+/* Set a control of the newest point and describe the setting. */
+static void
+setSweepControl(ParameterSweep * psSweep,
+		const SweepAxis * psAxis,
+		const LADSPA_Data fValue) {
+
+  char ** ppcDescription;
+  size_t lLength;
+
+  psSweep->pppfControlValues[psSweep->lPointCount - 1]
+    [psAxis->lPlugin][psAxis->lControl] = fValue;
+
+  ppcDescription = psSweep->ppcDescriptions + psSweep->lPointCount - 1;
+  lLength = strlen(*ppcDescription);
+  *ppcDescription = (char *)realloc(*ppcDescription,
+				    lLength + SWEEP_SETTING_SIZE);
+  snprintf(*ppcDescription + lLength,
+	   SWEEP_SETTING_SIZE,
+	   "%s%lu:%lu=%g",
+	   lLength ? " " : "",
+	   psAxis->lPlugin + 1,
+	   psAxis->lControl + 1,
+	   fValue);
+}
+
+/*****************************************************************************/
+
+void
+loadParameterSweep(ParameterSweep           * psSweep,
+		   const char               * pcFilename,
+		   const unsigned long        lPluginCount,
+		   const LADSPA_Descriptor ** ppsPluginDescriptors,
+		   LADSPA_Data             ** ppfPluginControlValues) {
+
+  FILE * poFile;
+  SweepAxis * psAxes;
+  SweepAxis sSetting;
+  char * pcColon;
+  char * pcControl;
+  char * pcEquals;
+  char * pcLine;
+  char * pcSave;
+  char * pcWord;
+  size_t lLineSize;
+  unsigned long lAxisCount;
+  unsigned long lAxisIndex;
+  unsigned long lGridSize;
+  unsigned long lLine;
+  unsigned long lPlace;
+  unsigned long lPointIndex;
+  unsigned long lWordCount;
+
+  memset(psSweep, 0, sizeof(ParameterSweep));
+  psAxes = NULL;
+  lAxisCount = 0;
+
+  poFile = fopen(pcFilename, "r");
+  if (!poFile) {
+    fprintf(stderr, "Failed to open sweep file \"%s\".\n", pcFilename);
+    exit(1);
+  }
+
+  pcLine = NULL;
+  lLineSize = 0;
+  lLine = 0;
+  while (getline(&pcLine, &lLineSize, poFile) >= 0) {
+
+    lLine++;
+    if (strchr(pcLine, '#'))
+      *strchr(pcLine, '#') = '\0';
+    pcWord = strtok_r(pcLine, " \t\r\n", &pcSave);
+    if (pcWord == NULL)
+      continue;
+
+    if (strcmp(pcWord, "point") == 0) {
+
+      /* One point, given control by control: */
+      if (lAxisCount > 0)
+	failSweepLine(pcFilename,
+		      lLine,
+		      "Points cannot follow grid lines",
+		      pcWord);
+      addSweepPoint(psSweep,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues);
+      while ((pcWord = strtok_r(NULL, " \t\r\n", &pcSave)) != NULL) {
+	pcColon = strchr(pcWord, ':');
+	pcEquals = strchr(pcWord, '=');
+	if (!pcColon || !pcEquals || pcEquals < pcColon)
+	  failSweepLine(pcFilename,
+			lLine,
+			"Expected <plugin>:<control>=<value>, not",
+			pcWord);
+	*pcColon = '\0';
+	*pcEquals = '\0';
+	memset(&sSetting, 0, sizeof(sSetting));
+	parseSweepControl(pcFilename,
+			  lLine,
+			  pcWord,
+			  pcColon + 1,
+			  lPluginCount,
+			  ppsPluginDescriptors,
+			  &sSetting);
+	parseSweepValues(pcFilename, lLine, pcEquals + 1, &sSetting);
+	if (sSetting.lValueCount != 1)
+	  failSweepLine(pcFilename,
+			lLine,
+			"A point takes one value, not",
+			pcEquals + 1);
+	setSweepControl(psSweep, &sSetting, sSetting.pfValues[0]);
+	free(sSetting.pfValues);
+      }
+      continue;
+    }
+
+    /* An axis of the grid: */
+    if (psSweep->lPointCount > 0)
+      failSweepLine(pcFilename,
+		    lLine,
+		    "Grid lines cannot follow points",
+		    pcWord);
+    psAxes = (SweepAxis *)realloc(psAxes,
+				  (lAxisCount + 1) * sizeof(SweepAxis));
+    memset(psAxes + lAxisCount, 0, sizeof(SweepAxis));
+    lWordCount = 0;
+    pcControl = strtok_r(NULL, " \t\r\n", &pcSave);
+    if (pcControl == NULL)
+      failSweepLine(pcFilename,
+		    lLine,
+		    "Expected <plugin> <control> <value>..., not",
+		    pcWord);
+    parseSweepControl(pcFilename,
+		      lLine,
+		      pcWord,
+		      pcControl,
+		      lPluginCount,
+		      ppsPluginDescriptors,
+		      psAxes + lAxisCount);
+    while ((pcWord = strtok_r(NULL, " \t\r\n", &pcSave)) != NULL) {
+      parseSweepValues(pcFilename, lLine, pcWord, psAxes + lAxisCount);
+      lWordCount++;
+    }
+    if (lWordCount == 0)
+      failSweepLine(pcFilename, lLine, "No values for control", pcControl);
+    lAxisCount++;
+  }
+  free(pcLine);
+  fclose(poFile);
+
+  /* Multiply the grid out, the first line changing slowest: */
+  if (lAxisCount > 0) {
+    lGridSize = 1;
+    for (lAxisIndex = 0; lAxisIndex < lAxisCount; lAxisIndex++) {
+      lGridSize *= psAxes[lAxisIndex].lValueCount;
+      if (lGridSize > SWEEP_MAX_POINTS) {
+	fprintf(stderr,
+		"Sweep \"%s\" has more than %d points.\n",
+		pcFilename,
+		SWEEP_MAX_POINTS);
+	exit(1);
+      }
+    }
+    for (lPointIndex = 0; lPointIndex < lGridSize; lPointIndex++) {
+      addSweepPoint(psSweep,
+		    lPluginCount,
+		    ppsPluginDescriptors,
+		    ppfPluginControlValues);
+      lPlace = lGridSize;
+      for (lAxisIndex = 0; lAxisIndex < lAxisCount; lAxisIndex++) {
+	lPlace /= psAxes[lAxisIndex].lValueCount;
+	setSweepControl(psSweep,
+			psAxes + lAxisIndex,
+			psAxes[lAxisIndex].pfValues
+			[(lPointIndex / lPlace)
+			 % psAxes[lAxisIndex].lValueCount]);
+      }
+    }
+    for (lAxisIndex = 0; lAxisIndex < lAxisCount; lAxisIndex++)
+      free(psAxes[lAxisIndex].pfValues);
+    free(psAxes);
+  }
+
+  if (psSweep->lPointCount == 0) {
+    fprintf(stderr, "Sweep \"%s\" has no points.\n", pcFilename);
+    exit(1);
+  }
+  if (psSweep->lPointCount > SWEEP_MAX_POINTS) {
+    fprintf(stderr,
+	    "Sweep \"%s\" has more than %d points.\n",
+	    pcFilename,
+	    SWEEP_MAX_POINTS);
+    exit(1);
+  }
+}
+
+void
+freeParameterSweep(ParameterSweep * psSweep,
+		   const unsigned long lPluginCount) {
+
+  unsigned long lPluginIndex;
+  unsigned long lPointIndex;
+
+  for (lPointIndex = 0; lPointIndex < psSweep->lPointCount; lPointIndex++) {
+    for (lPluginIndex = 0; lPluginIndex < lPluginCount; lPluginIndex++)
+      free(psSweep->pppfControlValues[lPointIndex][lPluginIndex]);
+    free(psSweep->pppfControlValues[lPointIndex]);
+    free(psSweep->ppcDescriptions[lPointIndex]);
+  }
+  free(psSweep->pppfControlValues);
+  free(psSweep->ppcDescriptions);
+  memset(psSweep, 0, sizeof(ParameterSweep));
+}
+
+/*****************************************************************************/
+
+/* EOF */
@@ -8,12 +8,17 @@
 
 /*****************************************************************************/
 
+#include <stddef.h>
+
 #include "ladspa.h"
 
 /*****************************************************************************/
 
 /* Functions in load.c: */
 
+/* Room for the messages the try...() functions below write. */
+#define LADSPA_ERROR_SIZE 512
+
 /* This function call takes a plugin library filename, searches for
    the library along the LADSPA_PATH, loads it with dlopen() and
    returns a plugin handle for use with findPluginDescriptor() or
@@ -22,6 +27,13 @@
    inefficient) to call this more than once for the same file. */
 void * loadLADSPAPluginLibrary(const char * pcPluginFilename);
 
+/* As loadLADSPAPluginLibrary(), but on failure a message is written
+   to pcError (lErrorSize bytes) and NULL is returned. This is what
+   programs that must not exit, and the host library, use. */
+void * tryLoadLADSPAPluginLibrary(const char * pcPluginFilename,
+				  char * pcError,
+				  const size_t lErrorSize);
+
 /* This function unloads a LADSPA plugin library. */
 void unloadLADSPAPluginLibrary(void * pvLADSPAPluginLibrary);
 
@@ -35,6 +47,16 @@ findLADSPAPluginDescriptor(void * pvLADSPAPluginLibrary,
 			   const char * pcPluginLibraryFilename,
 			   const char * pcPluginLabel);
 
+/* As findLADSPAPluginDescriptor(), but on failure a message is
+   written to pcError (lErrorSize bytes) and NULL is returned. A
+   library without a ladspa_descriptor() function is a failure too. */
+const LADSPA_Descriptor *
+tryFindLADSPAPluginDescriptor(void * pvLADSPAPluginLibrary,
+			      const char * pcPluginLibraryFilename,
+			      const char * pcPluginLabel,
+			      char * pcError,
+			      const size_t lErrorSize);
+
 /*****************************************************************************/
 
 /* Functions in search.c: */
@@ -0,0 +1,2259 @@
+/* wave.c
+
+   Free software. Do with as you will. No warranty. */
+
+/*****************************************************************************/
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+#include "ladspa.h"
+
+#include "host.h"
+
+/*****************************************************************************/
+
+#ifndef BYTE_ORDER
+#error "Could not determine byte order."
+#endif
+
+/* The vectorised conversion kernels assume the file's little-endian
+   layout matches memory. SSE2 is always there on x86-64; the SSSE3
+   and AVX2 kernels are only built when the compiler is told it may
+   use them (e.g. by adding -mavx2 or -march=native to CFLAGS). */
+
+#if defined(__SSE2__) && (BYTE_ORDER == LITTLE_ENDIAN)
+#define WAVE_USE_SSE2
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#define WAVE_USE_SSSE3
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define WAVE_USE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/*****************************************************************************/
+
+#define WAVE_FORMAT_PCM		0x0001
+#define WAVE_FORMAT_IEEE_FLOAT	0x0003
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE
+
+/* WAVE_FORMAT_EXTENSIBLE sub-format GUIDs are the format tag followed
+   by these 14 bytes. */
+static const unsigned char g_pucSubFormatGUIDTail[14] = {
+  0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+  0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+/* Sony Wave64 names chunks with GUIDs. The "riff" GUID is its own;
+   the others are the old four character code followed by these 12
+   bytes. */
+static const unsigned char g_pucW64RiffGUID[16] = {
+  'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11,
+  0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00
+};
+static const unsigned char g_pucW64GUIDTail[12] = {
+  0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0,
+  0x4F, 0x8E, 0xDB, 0x8A
+};
+
+/* Largest header we write: Wave64 with an extensible format. */
+#define WAVE_MAX_HEADER_SIZE 128
+
+/* RIFF sizes are 32bit. Data larger than this is written as RF64. */
+#define WAVE_RIFF_MAX_DATA_SIZE (0xFFFFFFFFULL - WAVE_MAX_HEADER_SIZE)
+
+/* Scale factors between full scale floats and integer samples. The
+   16bit factor is historical and kept so old renders reproduce. */
+#define INT16_SCALE 32767.5f
+#define INT24_SCALE 8388608.0f
+#define INT32_SCALE 2147483648.0f
+
+/*****************************************************************************/
+
+/* Little-endian field access for headers and the portable
+   conversion paths. */
+
+static unsigned long
+readLE16(const unsigned char * pucData) {
+  return (unsigned long)pucData[0] | ((unsigned long)pucData[1] << 8);
+}
+
+static unsigned long
+readLE32(const unsigned char * pucData) {
+  return ((unsigned long)pucData[0]
+	  | ((unsigned long)pucData[1] << 8)
+	  | ((unsigned long)pucData[2] << 16)
+	  | ((unsigned long)pucData[3] << 24));
+}
+
+static unsigned long long
+readLE64(const unsigned char * pucData) {
+  return ((unsigned long long)readLE32(pucData)
+	  | ((unsigned long long)readLE32(pucData + 4) << 32));
+}
+
+static void
+writeLE16(unsigned char * pucData, const unsigned long lValue) {
+  pucData[0] = (unsigned char)(lValue & 0xFF);
+  pucData[1] = (unsigned char)((lValue >> 8) & 0xFF);
+}
+
+static void
+writeLE32(unsigned char * pucData, const unsigned long lValue) {
+  pucData[0] = (unsigned char)(lValue & 0xFF);
+  pucData[1] = (unsigned char)((lValue >> 8) & 0xFF);
+  pucData[2] = (unsigned char)((lValue >> 16) & 0xFF);
+  pucData[3] = (unsigned char)((lValue >> 24) & 0xFF);
+}
+
+static void
+writeLE64(unsigned char * pucData, const unsigned long long llValue) {
+  writeLE32(pucData, (unsigned long)(llValue & 0xFFFFFFFFUL));
+  writeLE32(pucData + 4, (unsigned long)(llValue >> 32));
+}
+
+/* Copy a little-endian value of lSize bytes into or out of a native
+   variable. */
+static void
+copyLE(void * pvDestination, const void * pvSource, const size_t lSize) {
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  memcpy(pvDestination, pvSource, lSize);
+#else
+  size_t lIndex;
+  for (lIndex = 0; lIndex < lSize; lIndex++)
+    ((unsigned char *)pvDestination)[lIndex]
+      = ((const unsigned char *)pvSource)[lSize - 1 - lIndex];
+#endif
+}
+
+/*****************************************************************************/
+
+static unsigned long
+getSampleSize(const int iSampleFormat) {
+  switch (iSampleFormat) {
+  case WAVE_SAMPLE_INT16:
+    return 2;
+  case WAVE_SAMPLE_INT24:
+    return 3;
+  case WAVE_SAMPLE_INT32:
+  case WAVE_SAMPLE_FLOAT32:
+    return 4;
+  case WAVE_SAMPLE_FLOAT64:
+    return 8;
+  }
+  return 0;
+}
+
+int
+getWaveSampleFormat(const char * pcName) {
+  if (strcmp(pcName, "16") == 0)
+    return WAVE_SAMPLE_INT16;
+  if (strcmp(pcName, "24") == 0)
+    return WAVE_SAMPLE_INT24;
+  if (strcmp(pcName, "32") == 0)
+    return WAVE_SAMPLE_INT32;
+  if (strcmp(pcName, "float") == 0)
+    return WAVE_SAMPLE_FLOAT32;
+  if (strcmp(pcName, "double") == 0)
+    return WAVE_SAMPLE_FLOAT64;
+  return WAVE_SAMPLE_NONE;
+}
+
+const char *
+getWaveSampleFormatName(const int iSampleFormat) {
+  switch (iSampleFormat) {
+  case WAVE_SAMPLE_INT16:
+    return "16bit integer";
+  case WAVE_SAMPLE_INT24:
+    return "24bit integer";
+  case WAVE_SAMPLE_INT32:
+    return "32bit integer";
+  case WAVE_SAMPLE_FLOAT32:
+    return "32bit float";
+  case WAVE_SAMPLE_FLOAT64:
+    return "64bit float";
+  }
+  return "unknown";
+}
+
+/*****************************************************************************/
+
+/* Vector helpers: */
+
+#ifdef WAVE_USE_SSE2
+
+/* Split two vectors of interleaved stereo pairs (L0 R0 L1 R1, L2 R2
+   L3 R3) into L0 L1 L2 L3 and R0 R1 R2 R3. Works on 32bit lanes of
+   any type. */
+static void
+deinterleave4(const __m128 fA,
+	      const __m128 fB,
+	      __m128 * pfLeft,
+	      __m128 * pfRight) {
+  *pfLeft = _mm_shuffle_ps(fA, fB, _MM_SHUFFLE(2, 0, 2, 0));
+  *pfRight = _mm_shuffle_ps(fA, fB, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static LADSPA_Data
+reducePeak(const __m128 fPeak) {
+  __m128 fTmp;
+  fTmp = _mm_max_ps(fPeak, _mm_movehl_ps(fPeak, fPeak));
+  fTmp = _mm_max_ss(fTmp, _mm_shuffle_ps(fTmp, fTmp, 1));
+  return _mm_cvtss_f32(fTmp);
+}
+
+/* Convert clamped, scaled floats to int32 with truncation, saturating
+   values of 2^31 and above (which _mm_cvttps_epi32() would turn into
+   0x80000000). */
+static __m128i
+truncateToInt32(const __m128 fValue) {
+  __m128i iOverflow;
+  iOverflow = _mm_castps_si128(_mm_cmpge_ps(fValue,
+					    _mm_set1_ps(INT32_SCALE)));
+  return _mm_or_si128(_mm_andnot_si128(iOverflow, _mm_cvttps_epi32(fValue)),
+		      _mm_and_si128(iOverflow, _mm_set1_epi32(0x7FFFFFFF)));
+}
+
+#endif
+
+#ifdef WAVE_USE_SSSE3
+
+/* Sign-extend four packed 24bit samples from the first 12 bytes of
+   a 16 byte load. */
+static __m128i
+unpackInt24x4(const unsigned char * pucSource) {
+  const __m128i iShuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					 -1, 6, 7, 8, -1, 9, 10, 11);
+  __m128i iData;
+  iData = _mm_loadu_si128((const __m128i *)pucSource);
+  return _mm_srai_epi32(_mm_shuffle_epi8(iData, iShuffle), 8);
+}
+
+/* Store the low 24 bits of four int32 lanes as 12 packed bytes. */
+static void
+packInt24x4(unsigned char * pucDestination, const __m128i iValue) {
+  const __m128i iShuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+					 10, 12, 13, 14, -1, -1, -1, -1);
+  __m128i iData;
+  int iTail;
+  iData = _mm_shuffle_epi8(iValue, iShuffle);
+  _mm_storel_epi64((__m128i *)pucDestination, iData);
+  iTail = _mm_cvtsi128_si32(_mm_srli_si128(iData, 8));
+  memcpy(pucDestination + 8, &iTail, 4);
+}
+
+#endif
+
+/*****************************************************************************/
+
+/* Decoding kernels: interleaved file data to one float buffer per
+   channel. Each handles mono and stereo with vector code where it
+   can and finishes (or handles wider files) with portable code. */
+
+static void
+decodeInt16(const unsigned char * pucSource,
+	    LADSPA_Data ** ppfBuffers,
+	    const unsigned long lChannelCount,
+	    const unsigned long lFrameCount) {
+
+  const unsigned char * pucRead;
+  LADSPA_Data * pfWrite;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  short sValue;
+
+  lVectorFrames = 0;
+
+#ifdef WAVE_USE_SSE2
+  {
+    const short * psSource = (const short *)pucSource;
+    const __m128 fScale = _mm_set1_ps(1.0f / INT16_SCALE);
+    __m128i iData;
+    if (lChannelCount == 1) {
+#ifdef WAVE_USE_AVX2
+      const __m256 fScale8 = _mm256_set1_ps(1.0f / INT16_SCALE);
+      for (; lVectorFrames + 8 <= lFrameCount; lVectorFrames += 8) {
+	iData = _mm_loadu_si128((const __m128i *)(psSource + lVectorFrames));
+	_mm256_storeu_ps(ppfBuffers[0] + lVectorFrames,
+			 _mm256_mul_ps(_mm256_cvtepi32_ps
+				       (_mm256_cvtepi16_epi32(iData)),
+				       fScale8));
+      }
+#endif
+      for (; lVectorFrames + 8 <= lFrameCount; lVectorFrames += 8) {
+	iData = _mm_loadu_si128((const __m128i *)(psSource + lVectorFrames));
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_mul_ps(_mm_cvtepi32_ps
+				 (_mm_srai_epi32(_mm_unpacklo_epi16(iData,
+								    iData),
+						 16)),
+				 fScale));
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames + 4,
+		      _mm_mul_ps(_mm_cvtepi32_ps
+				 (_mm_srai_epi32(_mm_unpackhi_epi16(iData,
+								    iData),
+						 16)),
+				 fScale));
+      }
+    }
+    else if (lChannelCount == 2) {
+#ifdef WAVE_USE_AVX2
+      const __m256 fScale8 = _mm256_set1_ps(1.0f / INT16_SCALE);
+      __m256i iData8;
+      for (; lVectorFrames + 8 <= lFrameCount; lVectorFrames += 8) {
+	iData8 = _mm256_loadu_si256((const __m256i *)
+				    (psSource + 2 * lVectorFrames));
+	_mm256_storeu_ps(ppfBuffers[0] + lVectorFrames,
+			 _mm256_mul_ps(_mm256_cvtepi32_ps
+				       (_mm256_srai_epi32
+					(_mm256_slli_epi32(iData8, 16), 16)),
+				       fScale8));
+	_mm256_storeu_ps(ppfBuffers[1] + lVectorFrames,
+			 _mm256_mul_ps(_mm256_cvtepi32_ps
+				       (_mm256_srai_epi32(iData8, 16)),
+				       fScale8));
+      }
+#endif
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	iData = _mm_loadu_si128((const __m128i *)
+				(psSource + 2 * lVectorFrames));
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_mul_ps(_mm_cvtepi32_ps
+				 (_mm_srai_epi32(_mm_slli_epi32(iData, 16),
+						 16)),
+				 fScale));
+	_mm_storeu_ps(ppfBuffers[1] + lVectorFrames,
+		      _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(iData, 16)),
+				 fScale));
+      }
+    }
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucRead = pucSource + 2 * (lVectorFrames * lChannelCount + lChannelIndex);
+    pfWrite = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucRead += 2 * lChannelCount) {
+      copyLE(&sValue, pucRead, 2);
+      pfWrite[lFrameIndex] = ((LADSPA_Data)sValue) * (1.0f / INT16_SCALE);
+    }
+  }
+}
+
+static void
+decodeInt24(const unsigned char * pucSource,
+	    LADSPA_Data ** ppfBuffers,
+	    const unsigned long lChannelCount,
+	    const unsigned long lFrameCount) {
+
+  const unsigned char * pucRead;
+  LADSPA_Data * pfWrite;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  long lValue;
+
+  lVectorFrames = 0;
+
+#ifdef WAVE_USE_SSSE3
+  {
+    const __m128 fScale = _mm_set1_ps(1.0f / INT24_SCALE);
+    __m128 fLeft, fRight;
+    /* Each 16 byte load only uses 12 bytes, so stop early enough not
+       to read past the end of the data. */
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 6 <= lFrameCount; lVectorFrames += 4)
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_mul_ps(_mm_cvtepi32_ps
+				 (unpackInt24x4(pucSource
+						+ 3 * lVectorFrames)),
+				 fScale));
+    }
+    else if (lChannelCount == 2) {
+      for (; lVectorFrames + 5 <= lFrameCount; lVectorFrames += 4) {
+	deinterleave4(_mm_cvtepi32_ps(unpackInt24x4(pucSource
+						    + 6 * lVectorFrames)),
+		      _mm_cvtepi32_ps(unpackInt24x4(pucSource
+						    + 6 * lVectorFrames + 12)),
+		      &fLeft,
+		      &fRight);
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_mul_ps(fLeft, fScale));
+	_mm_storeu_ps(ppfBuffers[1] + lVectorFrames,
+		      _mm_mul_ps(fRight, fScale));
+      }
+    }
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucRead = pucSource + 3 * (lVectorFrames * lChannelCount + lChannelIndex);
+    pfWrite = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucRead += 3 * lChannelCount) {
+      lValue = (((long)(signed char)pucRead[2]) * 65536
+		+ ((long)pucRead[1] << 8)
+		+ (long)pucRead[0]);
+      pfWrite[lFrameIndex] = ((LADSPA_Data)lValue) * (1.0f / INT24_SCALE);
+    }
+  }
+}
+
+static void
+decodeInt32(const unsigned char * pucSource,
+	    LADSPA_Data ** ppfBuffers,
+	    const unsigned long lChannelCount,
+	    const unsigned long lFrameCount) {
+
+  const unsigned char * pucRead;
+  LADSPA_Data * pfWrite;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  int iValue;
+
+  lVectorFrames = 0;
+
+#ifdef WAVE_USE_SSE2
+  {
+    const __m128i * piSource = (const __m128i *)pucSource;
+    const __m128 fScale = _mm_set1_ps(1.0f / INT32_SCALE);
+    __m128 fLeft, fRight;
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4)
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_mul_ps(_mm_cvtepi32_ps
+				 (_mm_loadu_si128(piSource
+						  + lVectorFrames / 4)),
+				 fScale));
+    }
+    else if (lChannelCount == 2) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	deinterleave4(_mm_cvtepi32_ps(_mm_loadu_si128(piSource
+						      + lVectorFrames / 2)),
+		      _mm_cvtepi32_ps(_mm_loadu_si128(piSource
+						      + lVectorFrames / 2
+						      + 1)),
+		      &fLeft,
+		      &fRight);
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_mul_ps(fLeft, fScale));
+	_mm_storeu_ps(ppfBuffers[1] + lVectorFrames,
+		      _mm_mul_ps(fRight, fScale));
+      }
+    }
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucRead = pucSource + 4 * (lVectorFrames * lChannelCount + lChannelIndex);
+    pfWrite = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucRead += 4 * lChannelCount) {
+      copyLE(&iValue, pucRead, 4);
+      pfWrite[lFrameIndex] = ((LADSPA_Data)iValue) * (1.0f / INT32_SCALE);
+    }
+  }
+}
+
+static void
+decodeFloat32(const unsigned char * pucSource,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lChannelCount,
+	      const unsigned long lFrameCount) {
+
+  const unsigned char * pucRead;
+  LADSPA_Data * pfWrite;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  float fValue;
+
+  lVectorFrames = 0;
+
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  if (lChannelCount == 1) {
+    /* Already in the right format: nothing to convert. */
+    memcpy(ppfBuffers[0], pucSource, lFrameCount * sizeof(float));
+    return;
+  }
+#endif
+
+#ifdef WAVE_USE_SSE2
+  if (lChannelCount == 2) {
+    const float * pfSource = (const float *)pucSource;
+    __m128 fLeft, fRight;
+#ifdef WAVE_USE_AVX2
+    __m256 fA, fB;
+    for (; lVectorFrames + 8 <= lFrameCount; lVectorFrames += 8) {
+      fA = _mm256_loadu_ps(pfSource + 2 * lVectorFrames);
+      fB = _mm256_loadu_ps(pfSource + 2 * lVectorFrames + 8);
+      _mm256_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		       _mm256_castpd_ps
+		       (_mm256_permute4x64_pd
+			(_mm256_castps_pd
+			 (_mm256_shuffle_ps(fA, fB, _MM_SHUFFLE(2, 0, 2, 0))),
+			 _MM_SHUFFLE(3, 1, 2, 0))));
+      _mm256_storeu_ps(ppfBuffers[1] + lVectorFrames,
+		       _mm256_castpd_ps
+		       (_mm256_permute4x64_pd
+			(_mm256_castps_pd
+			 (_mm256_shuffle_ps(fA, fB, _MM_SHUFFLE(3, 1, 3, 1))),
+			 _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+#endif
+    for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+      deinterleave4(_mm_loadu_ps(pfSource + 2 * lVectorFrames),
+		    _mm_loadu_ps(pfSource + 2 * lVectorFrames + 4),
+		    &fLeft,
+		    &fRight);
+      _mm_storeu_ps(ppfBuffers[0] + lVectorFrames, fLeft);
+      _mm_storeu_ps(ppfBuffers[1] + lVectorFrames, fRight);
+    }
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucRead = pucSource + 4 * (lVectorFrames * lChannelCount + lChannelIndex);
+    pfWrite = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucRead += 4 * lChannelCount) {
+      copyLE(&fValue, pucRead, 4);
+      pfWrite[lFrameIndex] = fValue;
+    }
+  }
+}
+
+static void
+decodeFloat64(const unsigned char * pucSource,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lChannelCount,
+	      const unsigned long lFrameCount) {
+
+  const unsigned char * pucRead;
+  LADSPA_Data * pfWrite;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  double dValue;
+
+  lVectorFrames = 0;
+
+#ifdef WAVE_USE_SSE2
+  {
+    const double * pdSource = (const double *)pucSource;
+    __m128d dA, dB;
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4)
+	_mm_storeu_ps(ppfBuffers[0] + lVectorFrames,
+		      _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd
+						 (pdSource + lVectorFrames)),
+				    _mm_cvtpd_ps(_mm_loadu_pd
+						 (pdSource + lVectorFrames
+						  + 2))));
+    }
+    else if (lChannelCount == 2) {
+      for (; lVectorFrames + 2 <= lFrameCount; lVectorFrames += 2) {
+	dA = _mm_loadu_pd(pdSource + 2 * lVectorFrames);
+	dB = _mm_loadu_pd(pdSource + 2 * lVectorFrames + 2);
+	_mm_storel_pi((__m64 *)(ppfBuffers[0] + lVectorFrames),
+		      _mm_cvtpd_ps(_mm_unpacklo_pd(dA, dB)));
+	_mm_storel_pi((__m64 *)(ppfBuffers[1] + lVectorFrames),
+		      _mm_cvtpd_ps(_mm_unpackhi_pd(dA, dB)));
+      }
+    }
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucRead = pucSource + 8 * (lVectorFrames * lChannelCount + lChannelIndex);
+    pfWrite = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucRead += 8 * lChannelCount) {
+      copyLE(&dValue, pucRead, 8);
+      pfWrite[lFrameIndex] = (LADSPA_Data)dValue;
+    }
+  }
+}
+
+static void
+decodeSamples(const int iSampleFormat,
+	      const unsigned char * pucSource,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lChannelCount,
+	      const unsigned long lFrameCount) {
+  switch (iSampleFormat) {
+  case WAVE_SAMPLE_INT16:
+    decodeInt16(pucSource, ppfBuffers, lChannelCount, lFrameCount);
+    break;
+  case WAVE_SAMPLE_INT24:
+    decodeInt24(pucSource, ppfBuffers, lChannelCount, lFrameCount);
+    break;
+  case WAVE_SAMPLE_INT32:
+    decodeInt32(pucSource, ppfBuffers, lChannelCount, lFrameCount);
+    break;
+  case WAVE_SAMPLE_FLOAT32:
+    decodeFloat32(pucSource, ppfBuffers, lChannelCount, lFrameCount);
+    break;
+  case WAVE_SAMPLE_FLOAT64:
+    decodeFloat64(pucSource, ppfBuffers, lChannelCount, lFrameCount);
+    break;
+  }
+}
+
+/*****************************************************************************/
+
+/* Encoding kernels: one float buffer per channel to interleaved file
+   data. Each returns the largest absolute value seen. Integer
+   encodings use hard clipping as it sounds better than
+   wraparound. */
+
+static LADSPA_Data
+encodeInt16(unsigned char * pucDestination,
+	    LADSPA_Data ** ppfBuffers,
+	    const unsigned long lChannelCount,
+	    const unsigned long lFrameCount) {
+
+  unsigned char * pucWrite;
+  const LADSPA_Data * pfRead;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  LADSPA_Data fValue, fAbsValue, fPeak;
+  short sValue;
+
+  lVectorFrames = 0;
+  fPeak = 0;
+
+#ifdef WAVE_USE_SSE2
+  if (lChannelCount <= 2) {
+    short * psDestination = (short *)pucDestination;
+    const __m128 fAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 fScale = _mm_set1_ps(INT16_SCALE);
+    const __m128 fMax = _mm_set1_ps(32767.0f);
+    const __m128 fMin = _mm_set1_ps(-32768.0f);
+    __m128 fA, fB, fPeak4;
+    __m128i iA, iB;
+    fPeak4 = _mm_setzero_ps();
+    if (lChannelCount == 1) {
+#ifdef WAVE_USE_AVX2
+      const __m256 fAbsMask8 = _mm256_castsi256_ps
+	(_mm256_set1_epi32(0x7FFFFFFF));
+      const __m256 fScale8 = _mm256_set1_ps(INT16_SCALE);
+      const __m256 fMax8 = _mm256_set1_ps(32767.0f);
+      const __m256 fMin8 = _mm256_set1_ps(-32768.0f);
+      __m256 fA8, fB8, fPeak8;
+      fPeak8 = _mm256_setzero_ps();
+      for (; lVectorFrames + 16 <= lFrameCount; lVectorFrames += 16) {
+	fA8 = _mm256_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB8 = _mm256_loadu_ps(ppfBuffers[0] + lVectorFrames + 8);
+	fPeak8 = _mm256_max_ps(fPeak8, _mm256_and_ps(fA8, fAbsMask8));
+	fPeak8 = _mm256_max_ps(fPeak8, _mm256_and_ps(fB8, fAbsMask8));
+	fA8 = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(fA8, fScale8), fMax8),
+			    fMin8);
+	fB8 = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(fB8, fScale8), fMax8),
+			    fMin8);
+	_mm256_storeu_si256((__m256i *)(psDestination + lVectorFrames),
+			    _mm256_permute4x64_epi64
+			    (_mm256_packs_epi32(_mm256_cvttps_epi32(fA8),
+						_mm256_cvttps_epi32(fB8)),
+			     _MM_SHUFFLE(3, 1, 2, 0)));
+      }
+      fPeak4 = _mm_max_ps(_mm256_castps256_ps128(fPeak8),
+			  _mm256_extractf128_ps(fPeak8, 1));
+#endif
+      for (; lVectorFrames + 8 <= lFrameCount; lVectorFrames += 8) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames + 4);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fB, fAbsMask));
+	fA = _mm_max_ps(_mm_min_ps(_mm_mul_ps(fA, fScale), fMax), fMin);
+	fB = _mm_max_ps(_mm_min_ps(_mm_mul_ps(fB, fScale), fMax), fMin);
+	_mm_storeu_si128((__m128i *)(psDestination + lVectorFrames),
+			 _mm_packs_epi32(_mm_cvttps_epi32(fA),
+					 _mm_cvttps_epi32(fB)));
+      }
+    }
+    else {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB = _mm_loadu_ps(ppfBuffers[1] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fB, fAbsMask));
+	iA = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(fA, fScale),
+						    fMax),
+					 fMin));
+	iB = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(fB, fScale),
+						    fMax),
+					 fMin));
+	_mm_storeu_si128((__m128i *)(psDestination + 2 * lVectorFrames),
+			 _mm_packs_epi32(_mm_unpacklo_epi32(iA, iB),
+					 _mm_unpackhi_epi32(iA, iB)));
+      }
+    }
+    fPeak = reducePeak(fPeak4);
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucWrite = (pucDestination
+		+ 2 * (lVectorFrames * lChannelCount + lChannelIndex));
+    pfRead = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucWrite += 2 * lChannelCount) {
+      fAbsValue = fabsf(pfRead[lFrameIndex]);
+      if (fAbsValue > fPeak)
+	fPeak = fAbsValue;
+      fValue = pfRead[lFrameIndex] * INT16_SCALE;
+      if (fValue > 32767)
+	sValue = 32767;
+      else if (fValue <= -32768)
+	sValue = -32768;
+      else
+	sValue = (short)fValue;
+      copyLE(pucWrite, &sValue, 2);
+    }
+  }
+
+  return fPeak;
+}
+
+static LADSPA_Data
+encodeInt24(unsigned char * pucDestination,
+	    LADSPA_Data ** ppfBuffers,
+	    const unsigned long lChannelCount,
+	    const unsigned long lFrameCount) {
+
+  unsigned char * pucWrite;
+  const LADSPA_Data * pfRead;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  LADSPA_Data fValue, fAbsValue, fPeak;
+  long lValue;
+
+  lVectorFrames = 0;
+  fPeak = 0;
+
+#ifdef WAVE_USE_SSSE3
+  if (lChannelCount <= 2) {
+    const __m128 fAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 fScale = _mm_set1_ps(INT24_SCALE);
+    const __m128 fMax = _mm_set1_ps(8388607.0f);
+    const __m128 fMin = _mm_set1_ps(-8388608.0f);
+    __m128 fA, fB, fPeak4;
+    __m128i iA, iB;
+    fPeak4 = _mm_setzero_ps();
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	packInt24x4(pucDestination + 3 * lVectorFrames,
+		    _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(fA,
+								      fScale),
+							   fMax),
+						fMin)));
+      }
+    }
+    else {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB = _mm_loadu_ps(ppfBuffers[1] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fB, fAbsMask));
+	iA = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(fA, fScale),
+						    fMax),
+					 fMin));
+	iB = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(fB, fScale),
+						    fMax),
+					 fMin));
+	packInt24x4(pucDestination + 6 * lVectorFrames,
+		    _mm_unpacklo_epi32(iA, iB));
+	packInt24x4(pucDestination + 6 * lVectorFrames + 12,
+		    _mm_unpackhi_epi32(iA, iB));
+      }
+    }
+    fPeak = reducePeak(fPeak4);
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucWrite = (pucDestination
+		+ 3 * (lVectorFrames * lChannelCount + lChannelIndex));
+    pfRead = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucWrite += 3 * lChannelCount) {
+      fAbsValue = fabsf(pfRead[lFrameIndex]);
+      if (fAbsValue > fPeak)
+	fPeak = fAbsValue;
+      fValue = pfRead[lFrameIndex] * INT24_SCALE;
+      if (fValue > 8388607)
+	lValue = 8388607;
+      else if (fValue <= -8388608)
+	lValue = -8388608;
+      else
+	lValue = (long)fValue;
+      pucWrite[0] = (unsigned char)(lValue & 0xFF);
+      pucWrite[1] = (unsigned char)((lValue >> 8) & 0xFF);
+      pucWrite[2] = (unsigned char)((lValue >> 16) & 0xFF);
+    }
+  }
+
+  return fPeak;
+}
+
+static LADSPA_Data
+encodeInt32(unsigned char * pucDestination,
+	    LADSPA_Data ** ppfBuffers,
+	    const unsigned long lChannelCount,
+	    const unsigned long lFrameCount) {
+
+  unsigned char * pucWrite;
+  const LADSPA_Data * pfRead;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  LADSPA_Data fValue, fAbsValue, fPeak;
+  int iValue;
+
+  lVectorFrames = 0;
+  fPeak = 0;
+
+#ifdef WAVE_USE_SSE2
+  if (lChannelCount <= 2) {
+    __m128i * piDestination = (__m128i *)pucDestination;
+    const __m128 fAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 fScale = _mm_set1_ps(INT32_SCALE);
+    const __m128 fMin = _mm_set1_ps(-INT32_SCALE);
+    __m128 fA, fB, fPeak4;
+    __m128i iA, iB;
+    fPeak4 = _mm_setzero_ps();
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	_mm_storeu_si128(piDestination + lVectorFrames / 4,
+			 truncateToInt32(_mm_max_ps(_mm_mul_ps(fA, fScale),
+						    fMin)));
+      }
+    }
+    else {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB = _mm_loadu_ps(ppfBuffers[1] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fB, fAbsMask));
+	iA = truncateToInt32(_mm_max_ps(_mm_mul_ps(fA, fScale), fMin));
+	iB = truncateToInt32(_mm_max_ps(_mm_mul_ps(fB, fScale), fMin));
+	_mm_storeu_si128(piDestination + lVectorFrames / 2,
+			 _mm_unpacklo_epi32(iA, iB));
+	_mm_storeu_si128(piDestination + lVectorFrames / 2 + 1,
+			 _mm_unpackhi_epi32(iA, iB));
+      }
+    }
+    fPeak = reducePeak(fPeak4);
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucWrite = (pucDestination
+		+ 4 * (lVectorFrames * lChannelCount + lChannelIndex));
+    pfRead = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucWrite += 4 * lChannelCount) {
+      fAbsValue = fabsf(pfRead[lFrameIndex]);
+      if (fAbsValue > fPeak)
+	fPeak = fAbsValue;
+      fValue = pfRead[lFrameIndex] * INT32_SCALE;
+      if (fValue >= INT32_SCALE)
+	iValue = 2147483647;
+      else if (fValue <= -INT32_SCALE)
+	iValue = -2147483647 - 1;
+      else
+	iValue = (int)fValue;
+      copyLE(pucWrite, &iValue, 4);
+    }
+  }
+
+  return fPeak;
+}
+
+static LADSPA_Data
+encodeFloat32(unsigned char * pucDestination,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lChannelCount,
+	      const unsigned long lFrameCount) {
+
+  unsigned char * pucWrite;
+  const LADSPA_Data * pfRead;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  LADSPA_Data fAbsValue, fPeak;
+  float fValue;
+
+  lVectorFrames = 0;
+  fPeak = 0;
+
+#ifdef WAVE_USE_SSE2
+  if (lChannelCount <= 2) {
+    float * pfDestination = (float *)pucDestination;
+    const __m128 fAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 fA, fB, fPeak4;
+    fPeak4 = _mm_setzero_ps();
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	_mm_storeu_ps(pfDestination + lVectorFrames, fA);
+      }
+    }
+    else {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB = _mm_loadu_ps(ppfBuffers[1] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fB, fAbsMask));
+	_mm_storeu_ps(pfDestination + 2 * lVectorFrames,
+		      _mm_unpacklo_ps(fA, fB));
+	_mm_storeu_ps(pfDestination + 2 * lVectorFrames + 4,
+		      _mm_unpackhi_ps(fA, fB));
+      }
+    }
+    fPeak = reducePeak(fPeak4);
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucWrite = (pucDestination
+		+ 4 * (lVectorFrames * lChannelCount + lChannelIndex));
+    pfRead = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucWrite += 4 * lChannelCount) {
+      fValue = pfRead[lFrameIndex];
+      fAbsValue = fabsf(fValue);
+      if (fAbsValue > fPeak)
+	fPeak = fAbsValue;
+      copyLE(pucWrite, &fValue, 4);
+    }
+  }
+
+  return fPeak;
+}
+
+static LADSPA_Data
+encodeFloat64(unsigned char * pucDestination,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lChannelCount,
+	      const unsigned long lFrameCount) {
+
+  unsigned char * pucWrite;
+  const LADSPA_Data * pfRead;
+  unsigned long lChannelIndex;
+  unsigned long lFrameIndex;
+  unsigned long lVectorFrames;
+  LADSPA_Data fAbsValue, fPeak;
+  double dValue;
+
+  lVectorFrames = 0;
+  fPeak = 0;
+
+#ifdef WAVE_USE_SSE2
+  if (lChannelCount <= 2) {
+    double * pdDestination = (double *)pucDestination;
+    const __m128 fAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 fA, fB, fLow, fHigh, fPeak4;
+    fPeak4 = _mm_setzero_ps();
+    if (lChannelCount == 1) {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	_mm_storeu_pd(pdDestination + lVectorFrames, _mm_cvtps_pd(fA));
+	_mm_storeu_pd(pdDestination + lVectorFrames + 2,
+		      _mm_cvtps_pd(_mm_movehl_ps(fA, fA)));
+      }
+    }
+    else {
+      for (; lVectorFrames + 4 <= lFrameCount; lVectorFrames += 4) {
+	fA = _mm_loadu_ps(ppfBuffers[0] + lVectorFrames);
+	fB = _mm_loadu_ps(ppfBuffers[1] + lVectorFrames);
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fA, fAbsMask));
+	fPeak4 = _mm_max_ps(fPeak4, _mm_and_ps(fB, fAbsMask));
+	/* Interleave to L0 R0 L1 R1 / L2 R2 L3 R3 then widen pairs. */
+	fLow = _mm_unpacklo_ps(fA, fB);
+	fHigh = _mm_unpackhi_ps(fA, fB);
+	_mm_storeu_pd(pdDestination + 2 * lVectorFrames, _mm_cvtps_pd(fLow));
+	_mm_storeu_pd(pdDestination + 2 * lVectorFrames + 2,
+		      _mm_cvtps_pd(_mm_movehl_ps(fLow, fLow)));
+	_mm_storeu_pd(pdDestination + 2 * lVectorFrames + 4,
+		      _mm_cvtps_pd(fHigh));
+	_mm_storeu_pd(pdDestination + 2 * lVectorFrames + 6,
+		      _mm_cvtps_pd(_mm_movehl_ps(fHigh, fHigh)));
+      }
+    }
+    fPeak = reducePeak(fPeak4);
+  }
+#endif
+
+  for (lChannelIndex = 0; lChannelIndex < lChannelCount; lChannelIndex++) {
+    pucWrite = (pucDestination
+		+ 8 * (lVectorFrames * lChannelCount + lChannelIndex));
+    pfRead = ppfBuffers[lChannelIndex];
+    for (lFrameIndex = lVectorFrames;
+	 lFrameIndex < lFrameCount;
+	 lFrameIndex++, pucWrite += 8 * lChannelCount) {
+      fAbsValue = fabsf(pfRead[lFrameIndex]);
+      if (fAbsValue > fPeak)
+	fPeak = fAbsValue;
+      dValue = pfRead[lFrameIndex];
+      copyLE(pucWrite, &dValue, 8);
+    }
+  }
+
+  return fPeak;
+}
+
+static LADSPA_Data
+encodeSamples(const int iSampleFormat,
+	      unsigned char * pucDestination,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lChannelCount,
+	      const unsigned long lFrameCount) {
+  switch (iSampleFormat) {
+  case WAVE_SAMPLE_INT16:
+    return encodeInt16(pucDestination, ppfBuffers, lChannelCount, lFrameCount);
+  case WAVE_SAMPLE_INT24:
+    return encodeInt24(pucDestination, ppfBuffers, lChannelCount, lFrameCount);
+  case WAVE_SAMPLE_INT32:
+    return encodeInt32(pucDestination, ppfBuffers, lChannelCount, lFrameCount);
+  case WAVE_SAMPLE_FLOAT32:
+    return encodeFloat32(pucDestination,
+			 ppfBuffers,
+			 lChannelCount,
+			 lFrameCount);
+  case WAVE_SAMPLE_FLOAT64:
+    return encodeFloat64(pucDestination,
+			 ppfBuffers,
+			 lChannelCount,
+			 lFrameCount);
+  }
+  return 0;
+}
+
+/*****************************************************************************/
+/* File access:
+   ------------ */
+
+/* Regular files are memory-mapped so the conversion kernels read and
+   write the page cache directly. Anything that cannot be mapped
+   (pipes, devices, huge files on 32bit machines) goes through stdio
+   instead. When reading a mapping, the kernel is asked to fetch
+   WAVE_READ_AHEAD bytes ahead of the read position and pages well
+   behind it are dropped from our address space. */
+
+#define WAVE_READ_AHEAD (4 * 1024 * 1024)
+
+/* Record why a call on psWave failed, for the try...() functions to
+   return. Always returns -1. */
+static int
+setWaveError(WaveFile * psWave, const char * pcFormat, ...) {
+
+  va_list sArguments;
+
+  va_start(sArguments, pcFormat);
+  vsnprintf(psWave->pcError, sizeof(psWave->pcError), pcFormat, sArguments);
+  va_end(sArguments);
+
+  return -1;
+}
+
+static int
+setUnsupportedFileError(WaveFile * psWave) {
+  return setWaveError(psWave,
+		      "The file \"%s\" is not a Wave file holding 16, 24 or "
+		      "32bit integer or 32 or 64bit float samples.",
+		      psWave->pcFilename);
+}
+
+/* The functions without "try" in their names handle errors by
+   writing a message to stderr and calling exit(1). */
+static void
+failOnWaveError(const WaveFile * psWave) {
+  fprintf(stderr, "%s\n", psWave->pcError);
+  exit(1);
+}
+
+/* Bytes of padding after llDataSize bytes of audio. RIFF chunks are
+   padded to an even length, Wave64 chunks to a multiple of 8. */
+static unsigned long
+getWavePadSize(const WaveFile * psWave, const unsigned long long llDataSize) {
+  if (psWave->bRaw)
+    return 0;
+  if (psWave->iContainer == WAVE_CONTAINER_W64)
+    return (unsigned long)((8 - (llDataSize & 7)) & 7);
+  return (unsigned long)(llDataSize & 1);
+}
+
+static void
+writeW64GUID(unsigned char * pucData, const char * pcName) {
+  memcpy(pucData, pcName, 4);
+  memcpy(pucData + 4, g_pucW64GUIDTail, 12);
+}
+
+/* Build the header for an output file holding lFrameCount frames.
+   Returns the header size, which does not depend on lFrameCount.
+   Plain 16bit mono and stereo files get the classic 44 byte header
+   that everything can read. Anything else is written as
+   WAVE_FORMAT_EXTENSIBLE. RIFF streams of unknown length reserve room
+   for a "ds64" chunk in a "JUNK" chunk, so closeWaveFile() can turn
+   them into RF64 should they pass 4GB. */
+static unsigned long
+buildWaveHeader(const WaveFile * psWave,
+		const unsigned long lFrameCount,
+		unsigned char * pucHeader) {
+
+  unsigned char * pucFormat;
+  unsigned long long llDataSize;
+  unsigned long long llFileSize;
+  unsigned long lBitsPerSample;
+  unsigned long lFormatOffset;
+  unsigned long lFormatSize;
+  unsigned long lHeaderSize;
+  int bFloat;
+  int bUnknown;
+
+  lBitsPerSample = getSampleSize(psWave->iSampleFormat) * 8;
+  bFloat = (psWave->iSampleFormat == WAVE_SAMPLE_FLOAT32
+	    || psWave->iSampleFormat == WAVE_SAMPLE_FLOAT64);
+  if (psWave->iSampleFormat == WAVE_SAMPLE_INT16
+      && psWave->lChannelCount <= 2)
+    lFormatSize = 16;
+  else
+    lFormatSize = 40;
+
+  if (psWave->iContainer == WAVE_CONTAINER_W64) {
+    lFormatOffset = 40 + 24;
+    lHeaderSize = lFormatOffset + lFormatSize + 24;
+  }
+  else {
+    lFormatOffset = 12 + 8;
+    if (psWave->iContainer == WAVE_CONTAINER_RF64
+	|| psWave->lLength == WAVE_LENGTH_UNKNOWN)
+      lFormatOffset += 8 + 28;
+    lHeaderSize = lFormatOffset + lFormatSize + 8;
+  }
+
+  /* Streams of unknown length use the largest sizes, which readers
+     take to mean "until the end of the stream". */
+  bUnknown = (lFrameCount == WAVE_LENGTH_UNKNOWN);
+  llDataSize = (unsigned long long)lFrameCount * psWave->lBytesPerFrame;
+  llFileSize = lHeaderSize + llDataSize + getWavePadSize(psWave, llDataSize);
+
+  memset(pucHeader, 0, lHeaderSize);
+
+  /* The format chunk body is the same in every container. */
+  pucFormat = pucHeader + lFormatOffset;
+  if (lFormatSize == 16)
+    writeLE16(pucFormat, WAVE_FORMAT_PCM);
+  else
+    writeLE16(pucFormat, WAVE_FORMAT_EXTENSIBLE);
+  writeLE16(pucFormat + 2, psWave->lChannelCount);
+  writeLE32(pucFormat + 4, psWave->lSampleRate);
+  writeLE32(pucFormat + 8, psWave->lSampleRate * psWave->lBytesPerFrame);
+  writeLE16(pucFormat + 12, psWave->lBytesPerFrame);
+  writeLE16(pucFormat + 14, lBitsPerSample);
+  if (lFormatSize == 40) {
+    /* Extension size, valid bits, channel mask (unassigned) and the
+       sub-format GUID. */
+    writeLE16(pucFormat + 16, 22);
+    writeLE16(pucFormat + 18, lBitsPerSample);
+    writeLE32(pucFormat + 20, 0);
+    writeLE16(pucFormat + 24,
+	      bFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    memcpy(pucFormat + 26, g_pucSubFormatGUIDTail, 14);
+  }
+
+  if (psWave->iContainer == WAVE_CONTAINER_W64) {
+    /* Wave64 sizes include the 24 byte chunk header. */
+    memcpy(pucHeader, g_pucW64RiffGUID, 16);
+    writeLE64(pucHeader + 16, bUnknown ? ~0ULL : llFileSize);
+    writeW64GUID(pucHeader + 24, "wave");
+    writeW64GUID(pucHeader + 40, "fmt ");
+    writeLE64(pucHeader + 56, 24 + lFormatSize);
+    writeW64GUID(pucHeader + lHeaderSize - 24, "data");
+    writeLE64(pucHeader + lHeaderSize - 8,
+	      bUnknown ? ~0ULL : 24 + llDataSize);
+    return lHeaderSize;
+  }
+
+  if (psWave->iContainer == WAVE_CONTAINER_RF64) {
+    /* The real sizes live in the "ds64" chunk. */
+    memcpy(pucHeader, "RF64", 4);
+    writeLE32(pucHeader + 4, 0xFFFFFFFFUL);
+    memcpy(pucHeader + 12, "ds64", 4);
+    writeLE32(pucHeader + 16, 28);
+    writeLE64(pucHeader + 20, bUnknown ? ~0ULL : llFileSize - 8);
+    writeLE64(pucHeader + 28, bUnknown ? ~0ULL : llDataSize);
+    writeLE64(pucHeader + 36, bUnknown ? ~0ULL : lFrameCount);
+    writeLE32(pucHeader + 44, 0);
+  }
+  else {
+    memcpy(pucHeader, "RIFF", 4);
+    writeLE32(pucHeader + 4, bUnknown ? 0xFFFFFFFFUL : llFileSize - 8);
+    if (lFormatOffset > 20) {
+      memcpy(pucHeader + 12, "JUNK", 4);
+      writeLE32(pucHeader + 16, 28);
+    }
+  }
+  memcpy(pucHeader + 8, "WAVE", 4);
+  memcpy(pucFormat - 8, "fmt ", 4);
+  writeLE32(pucFormat - 4, lFormatSize);
+  memcpy(pucHeader + lHeaderSize - 8, "data", 4);
+  writeLE32(pucHeader + lHeaderSize - 4,
+	    (bUnknown || psWave->iContainer == WAVE_CONTAINER_RF64
+	     ? 0xFFFFFFFFUL
+	     : (unsigned long)llDataSize));
+
+  return lHeaderSize;
+}
+
+/* Ask the kernel to start reading the mapping ahead of lPosition (a
+   byte offset) and forget pages well behind it. */
+static void
+adviseReadAhead(WaveFile * psWave, const size_t lPosition) {
+
+  size_t lPageMask;
+  size_t lStart;
+  size_t lEnd;
+
+  if (lPosition + WAVE_READ_AHEAD / 2 < psWave->lAdvisedTo)
+    return;
+
+  lPageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+
+  lStart = psWave->lAdvisedTo & ~lPageMask;
+  lEnd = lPosition + WAVE_READ_AHEAD;
+  if (lEnd > psWave->lMapSize)
+    lEnd = psWave->lMapSize;
+  if (lEnd > lStart)
+    madvise(psWave->pucMap + lStart, lEnd - lStart, MADV_WILLNEED);
+  psWave->lAdvisedTo = lEnd;
+
+  if (lPosition > 2 * WAVE_READ_AHEAD) {
+    lEnd = (lPosition - 2 * WAVE_READ_AHEAD) & ~lPageMask;
+    if (lEnd > psWave->lDroppedTo) {
+      madvise(psWave->pucMap + psWave->lDroppedTo,
+	      lEnd - psWave->lDroppedTo,
+	      MADV_DONTNEED);
+      psWave->lDroppedTo = lEnd;
+    }
+  }
+}
+
+/*****************************************************************************/
+
+/* Open psWave->pcFilename for reading, "-" meaning standard
+   input. */
+static int
+openInputStream(WaveFile * psWave) {
+
+  int iDescriptor;
+
+  if (strcmp(psWave->pcFilename, "-") == 0) {
+    iDescriptor = dup(STDIN_FILENO);
+    psWave->poFile = (iDescriptor >= 0 ? fdopen(iDescriptor, "rb") : NULL);
+  }
+  else
+    psWave->poFile = fopen(psWave->pcFilename, "rb");
+  if (!psWave->poFile)
+    return setWaveError(psWave,
+			"Failed to open input file \"%s\": %s",
+			psWave->pcFilename,
+			strerror(errno));
+
+  return 0;
+}
+
+/* Skip llSize bytes of input, reading them if the input is a pipe. */
+static int
+skipInput(FILE * poFile, unsigned long long llSize) {
+
+  unsigned char pucScratch[256];
+  size_t lChunk;
+
+  if (llSize == 0 || fseek(poFile, (long)llSize, SEEK_CUR) == 0)
+    return 1;
+  while (llSize > 0) {
+    lChunk = (llSize < sizeof(pucScratch)
+	      ? (size_t)llSize
+	      : sizeof(pucScratch));
+    if (fread(pucScratch, 1, lChunk, poFile) < lChunk)
+      return 0;
+    llSize -= lChunk;
+  }
+  return 1;
+}
+
+/* Map the whole of an input file opened with stdio if we can, and
+   work out its length from its size if that is not known. Otherwise
+   set up the stdio buffer. */
+static void
+prepareInputFile(WaveFile * psWave, const unsigned long lBufferFrames) {
+
+  struct stat sStat;
+  void * pvMap;
+
+  if (fstat(fileno(psWave->poFile), &sStat) == 0
+      && S_ISREG(sStat.st_mode)) {
+    if (psWave->lLength == WAVE_LENGTH_UNKNOWN)
+      psWave->lLength
+	= ((unsigned long long)sStat.st_size > psWave->lDataOffset
+	   ? (unsigned long)(((unsigned long long)sStat.st_size
+			      - psWave->lDataOffset)
+			     / psWave->lBytesPerFrame)
+	   : 0);
+    if (sStat.st_size > 0
+	&& (unsigned long long)sStat.st_size <= (size_t)-1) {
+      pvMap = mmap(NULL,
+		   (size_t)sStat.st_size,
+		   PROT_READ,
+		   MAP_SHARED,
+		   fileno(psWave->poFile),
+		   0);
+      if (pvMap != MAP_FAILED) {
+	psWave->pucMap = (unsigned char *)pvMap;
+	psWave->lMapSize = (size_t)sStat.st_size;
+	madvise(pvMap, psWave->lMapSize, MADV_SEQUENTIAL);
+	adviseReadAhead(psWave, psWave->lDataOffset);
+      }
+    }
+  }
+
+  psWave->lBufferFrames = lBufferFrames;
+  if (!psWave->pucMap)
+    psWave->pucBuffer
+      = (unsigned char *)calloc(lBufferFrames, psWave->lBytesPerFrame);
+}
+
+/* Walk the header of the open input file up to the start of the
+   audio, filling in the format, length and data offset. */
+static int
+readWaveHeader(WaveFile * psWave) {
+
+  unsigned char pucHeader[40];
+  unsigned char pucChunkID[4];
+  unsigned long long llChunkSize;
+  unsigned long long llDataSize;
+  unsigned long long llPadSize;
+  unsigned long long llRiffSize;
+  unsigned long lAlignment;
+  unsigned long lBitsPerSample;
+  unsigned long lBlockAlign;
+  unsigned long lChunkHeaderSize;
+  unsigned long lFormatTag;
+  unsigned long lOffset;
+  unsigned long lReadSize;
+  int bFoundFormat;
+  int bUnknownSize;
+
+  if (fread(pucHeader, 1, 12, psWave->poFile) < 12)
+    return setWaveError(psWave,
+			"Failed to read header from input file \"%s\": %s",
+			psWave->pcFilename,
+			strerror(errno));
+
+  /* RIFF and RF64 have four character chunk names and 32bit sizes
+     padded to even lengths; RF64 keeps the real sizes in a "ds64"
+     chunk. Wave64 has GUIDs and 64bit sizes padded to multiples of
+     8. */
+  if ((memcmp(pucHeader, "RIFF", 4) == 0
+       || memcmp(pucHeader, "RF64", 4) == 0)
+      && memcmp(pucHeader + 8, "WAVE", 4) == 0) {
+    psWave->iContainer = (pucHeader[1] == 'I'
+			  ? WAVE_CONTAINER_RIFF
+			  : WAVE_CONTAINER_RF64);
+    llRiffSize = readLE32(pucHeader + 4);
+    lChunkHeaderSize = 8;
+    lAlignment = 2;
+    lOffset = 12;
+  }
+  else if (memcmp(pucHeader, g_pucW64RiffGUID, 12) == 0) {
+    if (fread(pucHeader + 12, 1, 28, psWave->poFile) < 28
+	|| memcmp(pucHeader, g_pucW64RiffGUID, 16) != 0
+	|| memcmp(pucHeader + 24, "wave", 4) != 0
+	|| memcmp(pucHeader + 28, g_pucW64GUIDTail, 12) != 0)
+      return setUnsupportedFileError(psWave);
+    psWave->iContainer = WAVE_CONTAINER_W64;
+    llRiffSize = readLE64(pucHeader + 16);
+    lChunkHeaderSize = 24;
+    lAlignment = 8;
+    lOffset = 40;
+  }
+  else
+    return setUnsupportedFileError(psWave);
+
+  /* Walk the chunks until we reach the audio data. The format chunk
+     must come first. Anything else is skipped. Offsets are counted
+     rather than asked for, as pipes cannot tell us. */
+  bFoundFormat = 0;
+  lBlockAlign = 0;
+  llDataSize = ~0ULL;
+  while (1) {
+
+    if (fread(pucHeader, 1, lChunkHeaderSize, psWave->poFile)
+	< lChunkHeaderSize)
+      return setWaveError(psWave,
+			  "Input file \"%s\" has no audio data.",
+			  psWave->pcFilename);
+    lOffset += lChunkHeaderSize;
+    if (psWave->iContainer == WAVE_CONTAINER_W64) {
+      /* GUIDs we do not know are given a name that matches
+	 nothing. */
+      if (memcmp(pucHeader + 4, g_pucW64GUIDTail, 12) == 0)
+	memcpy(pucChunkID, pucHeader, 4);
+      else
+	memset(pucChunkID, 0, 4);
+      llChunkSize = readLE64(pucHeader + 16);
+      bUnknownSize = (llChunkSize == ~0ULL || llChunkSize == 0);
+      if (llChunkSize < 24 && !bUnknownSize)
+	return setUnsupportedFileError(psWave);
+      llChunkSize -= 24;
+    }
+    else {
+      memcpy(pucChunkID, pucHeader, 4);
+      llChunkSize = readLE32(pucHeader + 4);
+      bUnknownSize = (llChunkSize == 0xFFFFFFFFUL);
+    }
+
+    if (memcmp(pucChunkID, "data", 4) == 0) {
+      if (!bFoundFormat)
+	return setUnsupportedFileError(psWave);
+      /* Streaming writers that cannot go back to fill in the length
+	 leave it at all ones, or at 0. An empty data chunk is also 0,
+	 but then the file's own size was filled in. */
+      if (psWave->iContainer == WAVE_CONTAINER_RF64
+	  && llChunkSize == 0xFFFFFFFFUL) {
+	llChunkSize = llDataSize;
+	bUnknownSize = (llDataSize == ~0ULL);
+      }
+      if (llChunkSize == 0
+	  && (llRiffSize == 0
+	      || llRiffSize == 0xFFFFFFFFUL
+	      || llRiffSize == ~0ULL))
+	bUnknownSize = 1;
+      if (bUnknownSize)
+	psWave->lLength = WAVE_LENGTH_UNKNOWN;
+      else
+	psWave->lLength = (unsigned long)(llChunkSize / lBlockAlign);
+      break;
+    }
+
+    lReadSize = 0;
+
+    if (memcmp(pucChunkID, "ds64", 4) == 0
+	&& psWave->iContainer == WAVE_CONTAINER_RF64) {
+      /* RIFF size, data size and sample count, then a table we do
+	 not need. */
+      if (llChunkSize < 24)
+	return setUnsupportedFileError(psWave);
+      lReadSize = 24;
+      if (fread(pucHeader, 1, lReadSize, psWave->poFile) < lReadSize)
+	return setUnsupportedFileError(psWave);
+      llRiffSize = readLE64(pucHeader);
+      llDataSize = readLE64(pucHeader + 8);
+    }
+
+    if (memcmp(pucChunkID, "fmt ", 4) == 0) {
+
+      if (llChunkSize < 16)
+	return setUnsupportedFileError(psWave);
+      lReadSize = (llChunkSize < 40 ? (unsigned long)llChunkSize : 40);
+      if (fread(pucHeader, 1, lReadSize, psWave->poFile) < lReadSize)
+	return setUnsupportedFileError(psWave);
+
+      lFormatTag = readLE16(pucHeader);
+      psWave->lChannelCount = readLE16(pucHeader + 2);
+      psWave->lSampleRate = readLE32(pucHeader + 4);
+      lBlockAlign = readLE16(pucHeader + 12);
+      lBitsPerSample = readLE16(pucHeader + 14);
+
+      if (lFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+	if (lReadSize < 40
+	    || memcmp(pucHeader + 26, g_pucSubFormatGUIDTail, 14) != 0)
+	  return setUnsupportedFileError(psWave);
+	lFormatTag = readLE16(pucHeader + 24);
+      }
+
+      if (lFormatTag == WAVE_FORMAT_PCM && lBitsPerSample == 16)
+	psWave->iSampleFormat = WAVE_SAMPLE_INT16;
+      else if (lFormatTag == WAVE_FORMAT_PCM && lBitsPerSample == 24)
+	psWave->iSampleFormat = WAVE_SAMPLE_INT24;
+      else if (lFormatTag == WAVE_FORMAT_PCM && lBitsPerSample == 32)
+	psWave->iSampleFormat = WAVE_SAMPLE_INT32;
+      else if (lFormatTag == WAVE_FORMAT_IEEE_FLOAT && lBitsPerSample == 32)
+	psWave->iSampleFormat = WAVE_SAMPLE_FLOAT32;
+      else if (lFormatTag == WAVE_FORMAT_IEEE_FLOAT && lBitsPerSample == 64)
+	psWave->iSampleFormat = WAVE_SAMPLE_FLOAT64;
+      else
+	return setUnsupportedFileError(psWave);
+
+      psWave->lBytesPerFrame
+	= psWave->lChannelCount * getSampleSize(psWave->iSampleFormat);
+      if (psWave->lChannelCount == 0 || lBlockAlign != psWave->lBytesPerFrame)
+	return setUnsupportedFileError(psWave);
+
+      bFoundFormat = 1;
+    }
+
+    /* Skip the rest of the chunk and its padding. */
+    lOffset += lReadSize;
+    llChunkSize -= lReadSize;
+    llPadSize = (lAlignment - (lOffset + llChunkSize) % lAlignment)
+		% lAlignment;
+    if (!skipInput(psWave->poFile, llChunkSize + llPadSize))
+      return setWaveError(psWave,
+			  "Failed to read header from input file \"%s\": %s",
+			  psWave->pcFilename,
+			  strerror(errno));
+    lOffset += (unsigned long)(llChunkSize + llPadSize);
+  }
+
+  psWave->lDataOffset = lOffset;
+  return 0;
+}
+
+int
+tryOpenWaveFile(WaveFile * psWave,
+		const char * pcFilename,
+		const unsigned long lBufferFrames) {
+
+  memset(psWave, 0, sizeof(WaveFile));
+  psWave->pcFilename = pcFilename;
+  psWave->iFileDescriptor = -1;
+
+  if (openInputStream(psWave) != 0)
+    return -1;
+  if (readWaveHeader(psWave) != 0) {
+    fclose(psWave->poFile);
+    psWave->poFile = NULL;
+    return -1;
+  }
+
+  prepareInputFile(psWave, lBufferFrames);
+  return 0;
+}
+
+void
+openWaveFile(WaveFile * psWave,
+	     const char * pcFilename,
+	     const unsigned long lBufferFrames) {
+  if (tryOpenWaveFile(psWave, pcFilename, lBufferFrames) != 0)
+    failOnWaveError(psWave);
+}
+
+int
+tryOpenRawFile(WaveFile * psWave,
+	       const char * pcFilename,
+	       const int iSampleFormat,
+	       const unsigned long lChannelCount,
+	       const unsigned long lSampleRate,
+	       const unsigned long lBufferFrames) {
+
+  memset(psWave, 0, sizeof(WaveFile));
+  psWave->pcFilename = pcFilename;
+  psWave->iFileDescriptor = -1;
+  psWave->bRaw = 1;
+  psWave->iSampleFormat = iSampleFormat;
+  psWave->lChannelCount = lChannelCount;
+  psWave->lSampleRate = lSampleRate;
+  psWave->lBytesPerFrame = lChannelCount * getSampleSize(iSampleFormat);
+  psWave->lLength = WAVE_LENGTH_UNKNOWN;
+
+  if (openInputStream(psWave) != 0)
+    return -1;
+  prepareInputFile(psWave, lBufferFrames);
+  return 0;
+}
+
+void
+openRawFile(WaveFile * psWave,
+	    const char * pcFilename,
+	    const int iSampleFormat,
+	    const unsigned long lChannelCount,
+	    const unsigned long lSampleRate,
+	    const unsigned long lBufferFrames) {
+  if (tryOpenRawFile(psWave,
+		     pcFilename,
+		     iSampleFormat,
+		     lChannelCount,
+		     lSampleRate,
+		     lBufferFrames) != 0)
+    failOnWaveError(psWave);
+}
+
+/*****************************************************************************/
+
+/* Write to an output file through stdio from its start, beginning
+   with the header. The file is closed on failure. */
+static int
+openOutputStream(WaveFile * psWave,
+		 const unsigned char * pucHeader,
+		 const unsigned long lHeaderSize) {
+
+  psWave->poFile = fdopen(psWave->iFileDescriptor, "wb");
+  if (!psWave->poFile
+      || (lHeaderSize > 0
+	  && fwrite(pucHeader, 1, lHeaderSize, psWave->poFile) < lHeaderSize)) {
+    setWaveError(psWave,
+		 "Failed to write header to output file \"%s\": %s",
+		 psWave->pcFilename,
+		 strerror(errno));
+    if (psWave->poFile)
+      fclose(psWave->poFile);
+    else
+      close(psWave->iFileDescriptor);
+    psWave->poFile = NULL;
+    psWave->iFileDescriptor = -1;
+    return -1;
+  }
+
+  psWave->pucBuffer
+    = (unsigned char *)calloc(psWave->lBufferFrames, psWave->lBytesPerFrame);
+  return 0;
+}
+
+/* Shared by createWaveFile() and createRawFile(). Raw files are the
+   same with no header. */
+static int
+createOutputFile(WaveFile * psWave,
+		 const char * pcFilename,
+		 const unsigned long lChannelCount,
+		 const unsigned long lSampleRate,
+		 const unsigned long lLength,
+		 const int iSampleFormat,
+		 const unsigned long lBufferFrames,
+		 const int bRaw) {
+
+  struct stat sStat;
+  unsigned char pucHeader[WAVE_MAX_HEADER_SIZE];
+  unsigned long long llFileSize;
+  unsigned long lHeaderSize;
+  size_t lNameLength;
+  int iError;
+  void * pvMap;
+
+  memset(psWave, 0, sizeof(WaveFile));
+  psWave->pcFilename = pcFilename;
+  psWave->bWritable = 1;
+  psWave->bRaw = bRaw;
+  psWave->iSampleFormat = iSampleFormat;
+  psWave->lChannelCount = lChannelCount;
+  psWave->lSampleRate = lSampleRate;
+  psWave->lLength = lLength;
+  psWave->lBytesPerFrame = lChannelCount * getSampleSize(iSampleFormat);
+  psWave->lBufferFrames = lBufferFrames;
+
+  /* Wave64 if the name asks for it. Otherwise RIFF, or RF64 if the
+     audio would not fit in RIFF's 32bit sizes. */
+  lNameLength = strlen(pcFilename);
+  if (lNameLength > 4 && strcasecmp(pcFilename + lNameLength - 4, ".w64") == 0)
+    psWave->iContainer = WAVE_CONTAINER_W64;
+  else if (lLength != WAVE_LENGTH_UNKNOWN
+	   && ((unsigned long long)lLength * psWave->lBytesPerFrame
+	       > WAVE_RIFF_MAX_DATA_SIZE))
+    psWave->iContainer = WAVE_CONTAINER_RF64;
+
+  if (strcmp(pcFilename, "-") == 0)
+    psWave->iFileDescriptor = dup(STDOUT_FILENO);
+  else
+    psWave->iFileDescriptor
+      = open(pcFilename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (psWave->iFileDescriptor < 0)
+    return setWaveError(psWave,
+			"Failed to open output file \"%s\": %s",
+			pcFilename,
+			strerror(errno));
+
+  lHeaderSize = (bRaw ? 0 : buildWaveHeader(psWave, lLength, pucHeader));
+  psWave->lDataOffset = lHeaderSize;
+  llFileSize = (unsigned long long)lLength * psWave->lBytesPerFrame;
+  llFileSize += lHeaderSize + getWavePadSize(psWave, llFileSize);
+
+  /* Reserve the whole file up front and map it, so the encoders write
+     straight into the page cache. The header is written by
+     closeWaveFile() once we know how much audio there really is.
+     Streams of unknown length are written through stdio instead. */
+  if (lLength != WAVE_LENGTH_UNKNOWN
+      && fstat(psWave->iFileDescriptor, &sStat) == 0
+      && S_ISREG(sStat.st_mode)
+      && llFileSize <= (size_t)-1) {
+    iError = posix_fallocate(psWave->iFileDescriptor, 0, (off_t)llFileSize);
+    if (iError == ENOSPC) {
+      close(psWave->iFileDescriptor);
+      psWave->iFileDescriptor = -1;
+      return setWaveError(psWave,
+			  "Failed to reserve space for output file \"%s\": "
+			  "%s",
+			  pcFilename,
+			  strerror(iError));
+    }
+    /* Only a file whose blocks are really reserved is mapped. A
+       sparse mapping that meets a full disk raises SIGBUS, so where
+       the filesystem cannot preallocate stdio is used instead. */
+    if (iError == 0) {
+      pvMap = mmap(NULL,
+		   (size_t)llFileSize,
+		   PROT_READ | PROT_WRITE,
+		   MAP_SHARED,
+		   psWave->iFileDescriptor,
+		   0);
+      if (pvMap != MAP_FAILED) {
+	psWave->pucMap = (unsigned char *)pvMap;
+	psWave->lMapSize = (size_t)llFileSize;
+	madvise(pvMap, psWave->lMapSize, MADV_SEQUENTIAL);
+	return 0;
+      }
+      /* Give the reservation back, as stdio writes from the start. */
+      if (ftruncate(psWave->iFileDescriptor, 0) != 0) {
+	close(psWave->iFileDescriptor);
+	psWave->iFileDescriptor = -1;
+	return setWaveError(psWave,
+			    "Failed to truncate output file \"%s\": %s",
+			    pcFilename,
+			    strerror(errno));
+      }
+    }
+  }
+
+  return openOutputStream(psWave, pucHeader, lHeaderSize);
+}
+
+int
+tryCreateWaveFile(WaveFile * psWave,
+		  const char * pcFilename,
+		  const unsigned long lChannelCount,
+		  const unsigned long lSampleRate,
+		  const unsigned long lLength,
+		  const int iSampleFormat,
+		  const unsigned long lBufferFrames) {
+  return createOutputFile(psWave,
+			  pcFilename,
+			  lChannelCount,
+			  lSampleRate,
+			  lLength,
+			  iSampleFormat,
+			  lBufferFrames,
+			  0);
+}
+
+void
+createWaveFile(WaveFile * psWave,
+	       const char * pcFilename,
+	       const unsigned long lChannelCount,
+	       const unsigned long lSampleRate,
+	       const unsigned long lLength,
+	       const int iSampleFormat,
+	       const unsigned long lBufferFrames) {
+  if (tryCreateWaveFile(psWave,
+			pcFilename,
+			lChannelCount,
+			lSampleRate,
+			lLength,
+			iSampleFormat,
+			lBufferFrames) != 0)
+    failOnWaveError(psWave);
+}
+
+int
+tryCreateRawFile(WaveFile * psWave,
+		 const char * pcFilename,
+		 const unsigned long lChannelCount,
+		 const unsigned long lSampleRate,
+		 const unsigned long lLength,
+		 const int iSampleFormat,
+		 const unsigned long lBufferFrames) {
+  return createOutputFile(psWave,
+			  pcFilename,
+			  lChannelCount,
+			  lSampleRate,
+			  lLength,
+			  iSampleFormat,
+			  lBufferFrames,
+			  1);
+}
+
+void
+createRawFile(WaveFile * psWave,
+	      const char * pcFilename,
+	      const unsigned long lChannelCount,
+	      const unsigned long lSampleRate,
+	      const unsigned long lLength,
+	      const int iSampleFormat,
+	      const unsigned long lBufferFrames) {
+  if (tryCreateRawFile(psWave,
+		       pcFilename,
+		       lChannelCount,
+		       lSampleRate,
+		       lLength,
+		       iSampleFormat,
+		       lBufferFrames) != 0)
+    failOnWaveError(psWave);
+}
+
+/*****************************************************************************/
+
+/* Read up to lFrameCount frames from the current position, returning
+   the number actually available. */
+static unsigned long
+readFrames(WaveFile * psWave,
+	   LADSPA_Data ** ppfBuffers,
+	   unsigned long lFrameCount) {
+
+  ProfileClock sStart;
+  size_t lPosition;
+  size_t lReadLength;
+  unsigned char * pucSource;
+
+  if (psWave->psAccessProfile)
+    readProfileClock(&sStart);
+
+  lPosition = (psWave->lDataOffset
+	       + (size_t)psWave->lFramePosition * psWave->lBytesPerFrame);
+
+  if (psWave->pucMap) {
+
+    if (lPosition + lFrameCount * psWave->lBytesPerFrame > psWave->lMapSize)
+      lFrameCount = (lPosition < psWave->lMapSize
+		     ? (psWave->lMapSize - lPosition) / psWave->lBytesPerFrame
+		     : 0);
+    adviseReadAhead(psWave, lPosition);
+    pucSource = psWave->pucMap + lPosition;
+
+  }
+  else {
+
+    /* Mono float data can be read straight into the caller's
+       buffer. */
+    pucSource = psWave->pucBuffer;
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+    if (psWave->iSampleFormat == WAVE_SAMPLE_FLOAT32
+	&& psWave->lChannelCount == 1)
+      pucSource = (unsigned char *)ppfBuffers[0];
+#endif
+
+    /* On a pipe fread() waits for the whole block or the end of the
+       stream. A trailing partial frame is dropped. */
+    lReadLength = fread(pucSource,
+			psWave->lBytesPerFrame,
+			lFrameCount,
+			psWave->poFile);
+    lFrameCount = (unsigned long)lReadLength;
+  }
+
+  if (psWave->psAccessProfile) {
+    addProfileTime(psWave->psAccessProfile, &sStart);
+    endProfileBlock(psWave->psAccessProfile);
+  }
+  if (psWave->psConvertProfile)
+    readProfileClock(&sStart);
+
+  if (pucSource != (unsigned char *)ppfBuffers[0])
+    decodeSamples(psWave->iSampleFormat,
+		  pucSource,
+		  ppfBuffers,
+		  psWave->lChannelCount,
+		  lFrameCount);
+
+  if (psWave->psConvertProfile) {
+    addProfileTime(psWave->psConvertProfile, &sStart);
+    endProfileBlock(psWave->psConvertProfile);
+  }
+
+  psWave->lFramePosition += lFrameCount;
+  return lFrameCount;
+}
+
+int
+tryReadWaveFile(WaveFile * psWave,
+		LADSPA_Data ** ppfBuffers,
+		const unsigned long lFrameCount) {
+  if (readFrames(psWave, ppfBuffers, lFrameCount) < lFrameCount)
+    return setWaveError(psWave,
+			"Failed to read audio from input file. Is the file "
+			"damaged?");
+  return 0;
+}
+
+void
+readWaveFile(WaveFile * psWave,
+	     LADSPA_Data ** ppfBuffers,
+	     const unsigned long lFrameCount) {
+  if (tryReadWaveFile(psWave, ppfBuffers, lFrameCount) != 0)
+    failOnWaveError(psWave);
+}
+
+unsigned long
+readWaveFileUpTo(WaveFile * psWave,
+		 LADSPA_Data ** ppfBuffers,
+		 const unsigned long lFrameCount) {
+
+  unsigned long lAvailable;
+
+  lAvailable = lFrameCount;
+  if (psWave->lLength != WAVE_LENGTH_UNKNOWN) {
+    if (psWave->lFramePosition >= psWave->lLength)
+      return 0;
+    if (lAvailable > psWave->lLength - psWave->lFramePosition)
+      lAvailable = psWave->lLength - psWave->lFramePosition;
+  }
+  if (lAvailable == 0)
+    return 0;
+  return readFrames(psWave, ppfBuffers, lAvailable);
+}
+
+/*****************************************************************************/
+
+int
+trySeekWaveFile(WaveFile * psWave, const unsigned long lFrame) {
+
+  size_t lPosition;
+
+  lPosition = (psWave->lDataOffset
+	       + (size_t)lFrame * psWave->lBytesPerFrame);
+
+  if (psWave->pucMap) {
+    /* Start read-ahead afresh from the new position. Pages already
+       dropped behind it are simply faulted back in. */
+    psWave->lAdvisedTo = lPosition;
+    if (psWave->lDroppedTo > lPosition)
+      psWave->lDroppedTo = 0;
+  }
+  else if (!psWave->bWritable && !canRewindWaveFile(psWave)) {
+    /* A pipe can only be read through, so skip ahead by reading. */
+    if (lFrame < psWave->lFramePosition)
+      return setWaveError(psWave,
+			  "Cannot seek back in \"%s\", which is a pipe.",
+			  psWave->pcFilename);
+    if (!skipInput(psWave->poFile,
+		   (unsigned long long)(lFrame - psWave->lFramePosition)
+		   * psWave->lBytesPerFrame))
+      return setWaveError(psWave,
+			  "Input file \"%s\" ended before frame %lu.",
+			  psWave->pcFilename,
+			  lFrame);
+  }
+  else if (fseek(psWave->poFile, (long)lPosition, SEEK_SET) != 0)
+    return setWaveError(psWave,
+			"Failed to seek in file \"%s\".",
+			psWave->pcFilename);
+
+  psWave->lFramePosition = lFrame;
+  return 0;
+}
+
+void
+unmapWaveFile(WaveFile * psWave) {
+
+  unsigned char pucHeader[WAVE_MAX_HEADER_SIZE];
+  unsigned long lHeaderSize;
+
+  if (!psWave->pucMap)
+    return;
+  munmap(psWave->pucMap, psWave->lMapSize);
+  psWave->pucMap = NULL;
+  psWave->lMapSize = 0;
+
+  if (!psWave->bWritable) {
+    if (fseek(psWave->poFile,
+	      (long)(psWave->lDataOffset
+		     + (size_t)psWave->lFramePosition
+		     * psWave->lBytesPerFrame),
+	      SEEK_SET) != 0) {
+      setWaveError(psWave,
+		   "Failed to seek in file \"%s\".",
+		   psWave->pcFilename);
+      failOnWaveError(psWave);
+    }
+    psWave->pucBuffer
+      = (unsigned char *)calloc(psWave->lBufferFrames,
+				psWave->lBytesPerFrame);
+    return;
+  }
+
+  /* Nothing has been written yet, so start again through stdio. */
+  lHeaderSize = (psWave->bRaw
+		 ? 0
+		 : buildWaveHeader(psWave, psWave->lLength, pucHeader));
+  if (ftruncate(psWave->iFileDescriptor, 0) != 0) {
+    setWaveError(psWave,
+		 "Failed to truncate output file \"%s\": %s",
+		 psWave->pcFilename,
+		 strerror(errno));
+    failOnWaveError(psWave);
+  }
+  if (openOutputStream(psWave, pucHeader, lHeaderSize) != 0)
+    failOnWaveError(psWave);
+}
+
+int
+canRewindWaveFile(const WaveFile * psWave) {
+  /* lseek() rather than fseek() leaves the stdio buffer alone. */
+  return (psWave->pucMap != NULL
+	  || lseek(fileno(psWave->poFile), 0, SEEK_CUR) >= 0);
+}
+
+void
+seekWaveFile(WaveFile * psWave, const unsigned long lFrame) {
+  if (trySeekWaveFile(psWave, lFrame) != 0)
+    failOnWaveError(psWave);
+}
+
+/*****************************************************************************/
+
+int
+tryWriteWaveFile(WaveFile * psWave,
+		 LADSPA_Data ** ppfBuffers,
+		 const unsigned long lFrameCount) {
+
+  LADSPA_Data fPeak;
+  ProfileClock sStart;
+  size_t lPosition;
+  size_t lWriteLength;
+  unsigned char * pucDestination;
+
+  if (psWave->psConvertProfile)
+    readProfileClock(&sStart);
+
+  lPosition = (psWave->lDataOffset
+	       + (size_t)psWave->lFramePosition * psWave->lBytesPerFrame);
+
+  if (psWave->pucMap) {
+    if (lPosition + lFrameCount * psWave->lBytesPerFrame > psWave->lMapSize)
+      return setWaveError(psWave,
+			  "Attempt to write beyond the end of output file "
+			  "\"%s\".",
+			  psWave->pcFilename);
+    pucDestination = psWave->pucMap + lPosition;
+  }
+  else
+    pucDestination = psWave->pucBuffer;
+
+  if (psWave->pvMeter)
+    runOutputMeter((OutputMeter *)psWave->pvMeter, ppfBuffers, lFrameCount);
+  fPeak = encodeSamples(psWave->iSampleFormat,
+			pucDestination,
+			ppfBuffers,
+			psWave->lChannelCount,
+			lFrameCount);
+  if (fPeak > psWave->fPeak)
+    psWave->fPeak = fPeak;
+
+  if (psWave->psConvertProfile) {
+    addProfileTime(psWave->psConvertProfile, &sStart);
+    endProfileBlock(psWave->psConvertProfile);
+  }
+  if (psWave->psAccessProfile)
+    readProfileClock(&sStart);
+
+  if (!psWave->pucMap) {
+    lWriteLength = fwrite(pucDestination,
+			  psWave->lBytesPerFrame,
+			  lFrameCount,
+			  psWave->poFile);
+    if (lWriteLength < lFrameCount)
+      return setWaveError(psWave,
+			  "Failed to write audio to output file. Is the disk "
+			  "full?");
+  }
+
+  if (psWave->psAccessProfile) {
+    addProfileTime(psWave->psAccessProfile, &sStart);
+    endProfileBlock(psWave->psAccessProfile);
+  }
+
+  psWave->lFramePosition += lFrameCount;
+  return 0;
+}
+
+void
+writeWaveFile(WaveFile * psWave,
+	      LADSPA_Data ** ppfBuffers,
+	      const unsigned long lFrameCount) {
+  if (tryWriteWaveFile(psWave, ppfBuffers, lFrameCount) != 0)
+    failOnWaveError(psWave);
+}
+
+/*****************************************************************************/
+
+void
+writeWaveFileAt(WaveFile * psWave,
+		LADSPA_Data ** ppfBuffers,
+		const unsigned long lFrameCount,
+		const unsigned long lFrame,
+		LADSPA_Data * pfPeak) {
+
+  LADSPA_Data fPeak;
+  size_t lPosition;
+
+  lPosition = (psWave->lDataOffset
+	       + (size_t)lFrame * psWave->lBytesPerFrame);
+
+  if (!psWave->pucMap
+      || lPosition + lFrameCount * psWave->lBytesPerFrame > psWave->lMapSize) {
+    fprintf(stderr,
+	    "Attempt to write outside output file \"%s\".\n",
+	    psWave->pcFilename);
+    exit(1);
+  }
+
+  fPeak = encodeSamples(psWave->iSampleFormat,
+			psWave->pucMap + lPosition,
+			ppfBuffers,
+			psWave->lChannelCount,
+			lFrameCount);
+  if (fPeak > *pfPeak)
+    *pfPeak = fPeak;
+}
+
+/*****************************************************************************/
+
+void
+quantizeWaveSamples(const int iSampleFormat,
+		    LADSPA_Data ** ppfBuffers,
+		    const unsigned long lChannelCount,
+		    const unsigned long lFrameCount) {
+
+  unsigned char * pucEncoded;
+
+  pucEncoded
+    = (unsigned char *)malloc(lFrameCount * lChannelCount
+			      * getSampleSize(iSampleFormat));
+  encodeSamples(iSampleFormat,
+		pucEncoded,
+		ppfBuffers,
+		lChannelCount,
+		lFrameCount);
+  decodeSamples(iSampleFormat,
+		pucEncoded,
+		ppfBuffers,
+		lChannelCount,
+		lFrameCount);
+  free(pucEncoded);
+}
+
+/*****************************************************************************/
+
+int
+tryCloseWaveFile(WaveFile * psWave) {
+
+  unsigned char pucHeader[WAVE_MAX_HEADER_SIZE];
+  unsigned long long llDataSize;
+  unsigned long lHeaderSize;
+  unsigned long lPadSize;
+  int iResult;
+
+  iResult = 0;
+  if (psWave->bWritable) {
+
+    /* Finalise the header with the audio actually written, padding
+       the data chunk as the container needs. A stream that passed
+       4GB uses the room it reserved to become RF64. The file is
+       closed whatever goes wrong, with the first failure
+       reported. */
+    llDataSize
+      = (unsigned long long)psWave->lFramePosition * psWave->lBytesPerFrame;
+    lPadSize = getWavePadSize(psWave, llDataSize);
+    if (psWave->iContainer == WAVE_CONTAINER_RIFF
+	&& psWave->lLength == WAVE_LENGTH_UNKNOWN
+	&& llDataSize > WAVE_RIFF_MAX_DATA_SIZE)
+      psWave->iContainer = WAVE_CONTAINER_RF64;
+    lHeaderSize = buildWaveHeader(psWave, psWave->lFramePosition, pucHeader);
+    if (psWave->bRaw)
+      lHeaderSize = 0;
+
+    if (psWave->pucMap) {
+      memcpy(psWave->pucMap, pucHeader, lHeaderSize);
+      memset(psWave->pucMap + lHeaderSize + llDataSize, 0, lPadSize);
+      /* Write errors on a mapping only show up here. */
+      if (msync(psWave->pucMap, psWave->lMapSize, MS_SYNC) != 0)
+	iResult = setWaveError(psWave,
+			       "Failed to write audio to output file "
+			       "\"%s\": %s",
+			       psWave->pcFilename,
+			       strerror(errno));
+      munmap(psWave->pucMap, psWave->lMapSize);
+      if (lHeaderSize + llDataSize + lPadSize < psWave->lMapSize
+	  && ftruncate(psWave->iFileDescriptor,
+		       (off_t)(lHeaderSize + llDataSize + lPadSize)) != 0
+	  && iResult == 0)
+	iResult = setWaveError(psWave,
+			       "Failed to truncate output file \"%s\": %s",
+			       psWave->pcFilename,
+			       strerror(errno));
+      close(psWave->iFileDescriptor);
+    }
+    else {
+      for (; lPadSize > 0; lPadSize--)
+	fputc(0, psWave->poFile);
+      /* On a pipe the seek fails and a streamed header keeps its
+	 unknown length. */
+      if (lHeaderSize > 0 && psWave->lFramePosition != psWave->lLength)
+	if (fseek(psWave->poFile, 0, SEEK_SET) == 0)
+	  fwrite(pucHeader, 1, lHeaderSize, psWave->poFile);
+      if (fclose(psWave->poFile) != 0)
+	iResult = setWaveError(psWave,
+			       "Failed to write audio to output file "
+			       "\"%s\". Is the disk full?",
+			       psWave->pcFilename);
+    }
+  }
+  else {
+    if (psWave->pucMap)
+      munmap(psWave->pucMap, psWave->lMapSize);
+    fclose(psWave->poFile);
+  }
+
+  free(psWave->pucBuffer);
+  psWave->poFile = NULL;
+  psWave->pucBuffer = NULL;
+  psWave->pucMap = NULL;
+
+  return iResult;
+}
+
+void
+closeWaveFile(WaveFile * psWave) {
+  if (tryCloseWaveFile(psWave) != 0)
+    failOnWaveError(psWave);
+}
+
+/*****************************************************************************/
+
+/* EOF */